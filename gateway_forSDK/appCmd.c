@@ -4,18 +4,56 @@
  * INCLUDES
  */
 #include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "types.h"
 #include "appCmd.h"
 #include "server.h"
 #include "socCmd.h"
 #include "nodes.h"
+#include "nodeDb.h"
+#include "groups.h"
+#include "socTx.h"
+#include "attrCache.h"
+#include "trans.h"
+#include "config.h"
+#include "log.h"
 
 /**********************************************************************
  * LOCAL CONSTANTS
  */
 
-/* None */
+/*
+ * Length of each command an App may send, 0 for unknown IDs
+ */
+static const u8 app_cmdLenTbl[] = {
+    [CMD_HEART_BEAT] = sizeof(gw_hbCmd_t),
+    [CMD_QUERY_REQ]  = APP_CMD_HDR_LEN,
+    [CMD_LEAVE_NWK]  = APP_CMD_HDR_LEN,
+    [CMD_BIND]       = sizeof(gw_bindCmd_t),
+    [CMD_GROUP]      = sizeof(gw_groupCmd_t),
+    [CMD_LIGHT]      = sizeof(gw_lightCmd_t),
+    [CMD_LEVEL]      = sizeof(gw_levelCmd_t),
+    [CMD_CLOSE]      = APP_CMD_HDR_LEN,
+    [CMD_LIGHT_MULTI] = offsetof(gw_lightMultiCmd_t, addr),
+    [CMD_LEVEL_MULTI] = offsetof(gw_levelMultiCmd_t, addr),
+    [CMD_PKT_LEN_REQ] = sizeof(gw_pktLenCmd_t),
+    [CMD_LIGHT_BULK]  = offsetof(gw_lightBulkCmd_t, entry),
+    [CMD_LEVEL_BULK]  = offsetof(gw_levelBulkCmd_t, entry),
+    [CMD_ATTR_REQ]    = sizeof(gw_attrReqCmd_t),
+};
+
+/*
+ * Read of each cached attribute, sent on a cache miss
+ */
+static void (*const app_attrReadTbl[ATTR_CACHE_ATTR_NUM])(u16 dstAddr, u8 endpoint, u8 addrMode) = {
+    [ATTR_CACHE_ON_OFF] = zllSocGetState,
+    [ATTR_CACHE_LEVEL]  = zllSocGetLevel,
+    [ATTR_CACHE_HUE]    = zllSocGetHue,
+    [ATTR_CACHE_SAT]    = zllSocGetSat,
+};
 
 /**********************************************************************
  * LOCAL TYPES
@@ -37,18 +75,25 @@ void app_lightCmdHandler(gw_lightCmd_t* cmd);
 void app_levelCmdHandler(gw_levelCmd_t* cmd);
 void app_groupCmdHandler(gw_groupCmd_t* cmd);
 void app_queryCmdHandler(void);
+void app_lightMultiCmdHandler(gw_lightMultiCmd_t* cmd);
+void app_levelMultiCmdHandler(gw_levelMultiCmd_t* cmd);
+void app_pktLenCmdHandler(server_conn_t *conn, gw_pktLenCmd_t* cmd);
+void app_lightBulkCmdHandler(gw_lightBulkCmd_t* cmd);
+void app_levelBulkCmdHandler(gw_levelBulkCmd_t* cmd);
+void app_attrReqCmdHandler(server_conn_t *conn, gw_attrReqCmd_t* cmd);
 
 /*********************************************************************
  * @fn      app_cmdHandler
  *
  * @brief   handle the received commands from Apps
  *
+ * @param   conn - the App which sent it
  * @param   buf - the recevied command
  * @param   len - the length of received command
  *
  * @return  none
  */
-void app_cmdHandler(u8* buf, u8 len)
+void app_cmdHandler(server_conn_t *conn, u8* buf, u32 len)
 {
     u8 i;
     //printf("received App command:\n");
@@ -63,6 +108,9 @@ void app_cmdHandler(u8* buf, u8 len)
         return;
     }
 
+    /* Deliveries of the unicast commands sent now are reported to this App */
+    trans_setOrigin(conn->id);
+
     switch (buf[1]) {
     case CMD_HEART_BEAT:
         break;
@@ -90,7 +138,32 @@ void app_cmdHandler(u8* buf, u8 len)
         app_levelCmdHandler((gw_levelCmd_t*)buf);
         break;
 
+    case CMD_LIGHT_MULTI:
+        app_lightMultiCmdHandler((gw_lightMultiCmd_t*)buf);
+        break;
+
+    case CMD_LEVEL_MULTI:
+        app_levelMultiCmdHandler((gw_levelMultiCmd_t*)buf);
+        break;
+
+    case CMD_PKT_LEN_REQ:
+        app_pktLenCmdHandler(conn, (gw_pktLenCmd_t*)buf);
+        break;
+
+    case CMD_LIGHT_BULK:
+        app_lightBulkCmdHandler((gw_lightBulkCmd_t*)buf);
+        break;
+
+    case CMD_LEVEL_BULK:
+        app_levelBulkCmdHandler((gw_levelBulkCmd_t*)buf);
+        break;
+
+    case CMD_ATTR_REQ:
+        app_attrReqCmdHandler(conn, (gw_attrReqCmd_t*)buf);
+        break;
+
     case CMD_CLOSE:
+        nodeDb_close();
         exit(0);
         break;
 
@@ -100,11 +173,132 @@ void app_cmdHandler(u8* buf, u8 len)
 
     }
 
+    trans_setOrigin(TRANS_NO_ORIGIN);
+}
+
+
+/*********************************************************************
+ * @fn      app_cmdLen
+ *
+ * @brief   Get the length of the command at the start of a buffer. The
+ *          multi-target and bulk commands carry their number of targets,
+ *          until it has arrived only the fixed part is known.
+ *
+ * @param   buf - the command, SOF and command ID are present
+ * @param   avail - number of bytes received so far
+ *
+ * @return  the length of the command, or of the part needed to know it,
+ *          0 if it is not a valid command
+ */
+static u32 app_cmdLen(u8* buf, u32 avail)
+{
+    u32 hdrLen;
+    u16 num;
+
+    hdrLen = (buf[1] < sizeof(app_cmdLenTbl)) ? app_cmdLenTbl[buf[1]] : 0;
+    if (avail < hdrLen) {
+        return hdrLen;
+    }
+
+    switch (buf[1]) {
+    case CMD_LIGHT_MULTI:
+    case CMD_LEVEL_MULTI:
+        /* The number of addresses is the last byte of the fixed part */
+        num = buf[hdrLen - 1];
+        if (num == 0 || num > APP_MAX_TARGETS) {
+            return 0;
+        }
+        return hdrLen + num * sizeof(u16);
+
+    case CMD_LIGHT_BULK:
+    case CMD_LEVEL_BULK:
+        /* The number of entries is the last u16 of the fixed part */
+        memcpy((u8*)&num, &buf[hdrLen - 2], 2);
+        if (num == 0 || num > APP_MAX_BULK_ENTRIES) {
+            return 0;
+        }
+        return hdrLen + num * sizeof(gw_bulkEntry_t);
+
+    default:
+        return hdrLen;
+    }
+}
+
+/*********************************************************************
+ * @fn      app_frameCmds
+ *
+ * @brief   Split the byte stream received from an App into commands and
+ *          handle every complete one. Bytes which can not start a
+ *          command are skipped.
+ *
+ * @param   conn - the App which sent them
+ * @param   buf - the received bytes
+ * @param   len - number of received bytes
+ *
+ * @return  number of bytes consumed, the rest is an incomplete command
+ */
+u32 app_frameCmds(server_conn_t *conn, u8* buf, u32 len)
+{
+    u32 off = 0;
+    u32 cmdLen;
 
+    while (off < len) {
+        if (buf[off] != APP_CMD_SOF) {
+            off++;
+            continue;
+        }
 
+        if (len - off < APP_CMD_HDR_LEN) {
+            break;
+        }
+
+        cmdLen = app_cmdLen(&buf[off], len - off);
+        if (cmdLen == 0) {
+            /* Not a command, look for the next SOF */
+            off++;
+            continue;
+        }
+
+        if (cmdLen > conn->maxPktLen) {
+            LOG_WARN(LOG_MOD_APP, "App %u: command 0x%02x of %u bytes over the %u negotiated",
+                     conn->id, buf[off + 1], cmdLen, conn->maxPktLen);
+            off++;
+            continue;
+        }
+
+        if (len - off < cmdLen) {
+            break;
+        }
+
+        app_cmdHandler(conn, &buf[off], cmdLen);
+        off += cmdLen;
+    }
+
+    return off;
 }
 
 
+/*********************************************************************
+ * @fn      app_encodeReportCmd
+ *
+ * @brief   Fill in a report command
+ *
+ * @param   p - the command to fill
+ * @param   type - the device type
+ * @param   nwkAddr - the network address of the device
+ * @param   extAddr - the extended address of the device
+ *
+ * @return  none
+ */
+static void app_encodeReportCmd(gw_reportCmd_t* p, u8 type, u16 nwkAddr, u8*extAddr)
+{
+    p->sof = APP_CMD_SOF;
+    p->cmd = CMD_REPORT;
+    p->devType = type;
+    p->nwkAddr = nwkAddr;
+    memcpy(p->extAddr, extAddr, 8);
+}
+
  /*********************************************************************
  * @fn      app_sendDeviceReportCmd
  *
@@ -118,34 +312,28 @@ void app_cmdHandler(u8* buf, u8 len)
  */
 void app_sendDeviceReportCmd(u8 type, u16 nwkAddr, u8*extAddr)
 {
-    int i;
-    int clients_fd[MAX_SOCKET_NUM];
-    int clients_num;
-    u8 buf[20];
-    gw_reportCmd_t* p = (gw_reportCmd_t*)buf;
-
-    p->sof = APP_CMD_SOF;
-    p->cmd = CMD_REPORT;
-    p->devType = type;
-    p->nwkAddr = nwkAddr;
-    memcpy(p->extAddr, extAddr, 8);
+    server_msg_t *msg = server_msgAlloc(sizeof(gw_reportCmd_t));
 
-    /* Send the report command to all connected Apps */
-    socketPool_get(clients_fd, &clients_num);
-    for(i = 0; i < clients_num; i++) {
-        server_send(clients_fd[i], buf, sizeof(gw_reportCmd_t));
+    if (!msg) {
+        return;
     }
+    app_encodeReportCmd((gw_reportCmd_t*)msg->data, type, nwkAddr, extAddr);
 
+    /* Send the report command to all connected Apps */
+    server_broadcastMsg(msg);
+    server_msgUnref(msg);
 }
 
 
 void app_sendGroupRspCmd(u16 nwkAddr, u16 groupID, u8 opcode, u8 status)
 {
-    int i;
-    int clients_fd[MAX_SOCKET_NUM];
-    int clients_num;
-    u8 buf[20];
-    gw_groupRspCmd_t* p = (gw_groupRspCmd_t*)buf;
+    server_msg_t *msg = server_msgAlloc(sizeof(gw_groupRspCmd_t));
+    gw_groupRspCmd_t* p;
+
+    if (!msg) {
+        return;
+    }
+    p = (gw_groupRspCmd_t*)msg->data;
 
     p->sof = APP_CMD_SOF;
     p->cmd = CMD_GROUP_RSP;
@@ -155,9 +343,136 @@ void app_sendGroupRspCmd(u16 nwkAddr, u16 groupID, u8 opcode, u8 status)
     p->groupId = groupID;
 
     /* Send the report command to all connected Apps */
-    socketPool_get(clients_fd, &clients_num);
-    for(i = 0; i < clients_num; i++) {
-        server_send(clients_fd[i], buf, sizeof(gw_groupRspCmd_t));
+    server_broadcastMsg(msg);
+    server_msgUnref(msg);
+}
+
+
+/*********************************************************************
+ * @fn      app_encodeAttrRspCmd
+ *
+ * @brief   Fill in an attribute response command
+ *
+ * @param   p - the command to fill
+ * @param   nwkAddr - the device
+ * @param   endpoint - its endpoint
+ * @param   attr - the attribute
+ * @param   status - ZCL status
+ * @param   value - the value
+ * @param   ageMs - age of the value
+ *
+ * @return  none
+ */
+static void app_encodeAttrRspCmd(gw_attrRspCmd_t* p, u16 nwkAddr, u8 endpoint, u8 attr, u8 status, u8 value, u32 ageMs)
+{
+    p->sof = APP_CMD_SOF;
+    p->cmd = CMD_ATTR_RSP;
+    p->nwkAddr = nwkAddr;
+    p->endpoint = endpoint;
+    p->attr = attr;
+    p->status = status;
+    p->value = value;
+    p->ageMs = ageMs;
+}
+
+/*********************************************************************
+ * @fn      app_sendAttrRspCmd
+ *
+ * @brief   send an attribute the device just told to all Apps
+ *
+ * @param   nwkAddr - the device
+ * @param   endpoint - its endpoint
+ * @param   attr - the attribute
+ * @param   status - ZCL status of the read
+ * @param   value - the value
+ *
+ * @return  none
+ */
+void app_sendAttrRspCmd(u16 nwkAddr, u8 endpoint, u8 attr, u8 status, u8 value)
+{
+    server_msg_t *msg;
+
+    if (server_connNum() == 0) {
+        return;
+    }
+
+    msg = server_msgAlloc(sizeof(gw_attrRspCmd_t));
+    if (!msg) {
+        return;
+    }
+    app_encodeAttrRspCmd((gw_attrRspCmd_t*)msg->data, nwkAddr, endpoint, attr, status, value, 0);
+
+    server_broadcastMsg(msg);
+    server_msgUnref(msg);
+}
+
+/*********************************************************************
+ * @fn      app_sendDeliveryRspCmd
+ *
+ * @brief   tell an App whether a unicast command it sent was delivered
+ *
+ * @param   connId - ID of the App connection
+ * @param   nwkAddr - the device
+ * @param   endpoint - its endpoint
+ * @param   clusterID - ZCL cluster of the command
+ * @param   cmdID - ZCL command ID
+ * @param   status - ZCL status of the response or APP_DELIVERY_*
+ * @param   attempts - times the command was sent
+ *
+ * @return  none
+ */
+void app_sendDeliveryRspCmd(u32 connId, u16 nwkAddr, u8 endpoint, u16 clusterID, u8 cmdID, u8 status, u8 attempts)
+{
+    server_conn_t *conn = server_connById(connId);
+    gw_deliveryRspCmd_t rsp;
+
+    if (!conn) {
+        /* The App left meanwhile */
+        return;
+    }
+
+    rsp.sof = APP_CMD_SOF;
+    rsp.cmd = CMD_DELIVERY_RSP;
+    rsp.nwkAddr = nwkAddr;
+    rsp.endpoint = endpoint;
+    rsp.clusterID = clusterID;
+    rsp.cmdID = cmdID;
+    rsp.status = status;
+    rsp.attempts = attempts;
+    server_send(conn, (u8*)&rsp, sizeof(rsp));
+}
+
+/*********************************************************************
+ * @fn      app_attrReqCmdHandler
+ *
+ * @brief   answer an attribute request from the cache, or read the
+ *          device if the cached value is missing or too old
+ *
+ * @param   conn - the App
+ * @param   cmd - the recevied attribute request
+ *
+ * @return  none
+ */
+void app_attrReqCmdHandler(server_conn_t *conn, gw_attrReqCmd_t* cmd)
+{
+    gw_attrRspCmd_t rsp;
+    u32 maxAgeMs = cmd->maxAgeMs ? cmd->maxAgeMs : ATTR_CACHE_DEFAULT_MAX_AGE_MS;
+    u32 ageMs;
+    u8 value;
+
+    if (cmd->attr >= ATTR_CACHE_ATTR_NUM) {
+        return;
+    }
+
+    if (attrCache_get(cmd->nwkAddr, cmd->endpoint, cmd->attr, maxAgeMs, &value, &ageMs) == 0) {
+        app_encodeAttrRspCmd(&rsp, cmd->nwkAddr, cmd->endpoint, cmd->attr, 0, value, ageMs);
+        server_send(conn, (u8*)&rsp, sizeof(rsp));
+        return;
+    }
+
+    /* Misses of the same attribute share one read */
+    if (attrCache_startRead(cmd->nwkAddr, cmd->endpoint, cmd->attr)) {
+        app_attrReadTbl[cmd->attr](cmd->nwkAddr, cmd->endpoint, ADDR_MODE_SHORT_ADDR);
     }
 }
 
@@ -178,7 +493,7 @@ void app_lightCmdHandler(gw_lightCmd_t* cmd)
     u8 addrMode = cmd->addrMode;
     u8 opCode = cmd->opCode;
 
-    printf("0x%x,  0x%x,  0x%x\n", dstAddr, addrMode, opCode);
+    LOG_DEBUG(LOG_MOD_APP, "light 0x%x,  0x%x,  0x%x", dstAddr, addrMode, opCode);
 
     /* Get enpoint from node list */
     if (cmd->addrMode == ADDR_MODE_SHORT_ADDR) {
@@ -212,6 +527,206 @@ void app_levelCmdHandler(gw_levelCmd_t* cmd)
 }
 
 
+/*********************************************************************
+ * @fn      app_lightMultiCmdHandler
+ *
+ * @brief   send an on-off command to many lights. Lights which make up
+ *          whole groups are reached with one groupcast per group, the
+ *          rest one by one.
+ *
+ * @param   cmd - the recevied multi-target light command
+ *
+ * @return  none
+ */
+void app_lightMultiCmdHandler(gw_lightMultiCmd_t* cmd)
+{
+    u8 endpoint = 0xB;
+    u16 addrs[APP_MAX_TARGETS];
+    u16 groupIds[APP_MAX_TARGETS];
+    u32 num = cmd->num;
+    u32 groupNum;
+    u32 i;
+
+    memcpy(addrs, cmd->addr, num * sizeof(u16));
+    groupNum = groups_cover(addrs, &num, groupIds, APP_MAX_TARGETS);
+
+    LOG_DEBUG(LOG_MOD_APP, "light 0x%x to %u lights: %u groups, %u unicasts",
+              cmd->opCode, cmd->num, groupNum, num);
+
+    for (i = 0; i < groupNum; i++) {
+        zllSocSetState(cmd->opCode, groupIds[i], endpoint, ADDR_MODE_GROUP);
+    }
+    for (i = 0; i < num; i++) {
+        zllSocSetState(cmd->opCode, addrs[i], endpoint, ADDR_MODE_SHORT_ADDR);
+    }
+}
+
+/*********************************************************************
+ * @fn      app_levelMultiCmdHandler
+ *
+ * @brief   send a level command to many lights, grouped like
+ *          app_lightMultiCmdHandler()
+ *
+ * @param   cmd - the recevied multi-target level command
+ *
+ * @return  none
+ */
+void app_levelMultiCmdHandler(gw_levelMultiCmd_t* cmd)
+{
+    u8 endpoint = 0xB;
+    u16 addrs[APP_MAX_TARGETS];
+    u16 groupIds[APP_MAX_TARGETS];
+    u32 num = cmd->num;
+    u32 groupNum;
+    u32 i;
+
+    memcpy(addrs, cmd->addr, num * sizeof(u16));
+    groupNum = groups_cover(addrs, &num, groupIds, APP_MAX_TARGETS);
+
+    LOG_DEBUG(LOG_MOD_APP, "level 0x%x to %u lights: %u groups, %u unicasts",
+              cmd->level, cmd->num, groupNum, num);
+
+    for (i = 0; i < groupNum; i++) {
+        zllSocSetLevel(cmd->level, cmd->transTime, groupIds[i], endpoint, ADDR_MODE_GROUP);
+    }
+    for (i = 0; i < num; i++) {
+        zllSocSetLevel(cmd->level, cmd->transTime, addrs[i], endpoint, ADDR_MODE_SHORT_ADDR);
+    }
+}
+
+
+/*********************************************************************
+ * @fn      app_pktLenCmdHandler
+ *
+ * @brief   agree on the longest command an App may send. Commands up to
+ *          APP_DEFAULT_PACKET_LEN are always accepted.
+ *
+ * @param   conn - the App
+ * @param   cmd - the recevied packet length request
+ *
+ * @return  none
+ */
+void app_pktLenCmdHandler(server_conn_t *conn, gw_pktLenCmd_t* cmd)
+{
+    gw_pktLenCmd_t rsp;
+
+    conn->maxPktLen = cmd->maxLen;
+    if (conn->maxPktLen > MAX_APP_PACKET_LEN) {
+        conn->maxPktLen = MAX_APP_PACKET_LEN;
+    } else if (conn->maxPktLen < APP_DEFAULT_PACKET_LEN) {
+        conn->maxPktLen = APP_DEFAULT_PACKET_LEN;
+    }
+
+    rsp.sof = APP_CMD_SOF;
+    rsp.cmd = CMD_PKT_LEN_RSP;
+    rsp.maxLen = conn->maxPktLen;
+    server_send(conn, (u8*)&rsp, sizeof(rsp));
+}
+
+static int app_cmpBulkEntry(const void *a, const void *b)
+{
+    return (int)((const gw_bulkEntry_t*)a)->value - (int)((const gw_bulkEntry_t*)b)->value;
+}
+
+/*********************************************************************
+ * @fn      app_bulkCmdHandler
+ *
+ * @brief   send the entries of a bulk command as one batch of frames.
+ *          Lights set to the same value which make up whole groups are
+ *          reached with one groupcast per group.
+ *
+ * @param   entry - the entries
+ * @param   num - number of entries
+ * @param   isLevel - TRUE for level commands, FALSE for on-off
+ * @param   transTime - transition time of level commands
+ *
+ * @return  none
+ */
+static void app_bulkCmdHandler(const gw_bulkEntry_t* entry, u32 num, u8 isLevel, u16 transTime)
+{
+    u8 endpoint = 0xB;
+    gw_bulkEntry_t sorted[APP_MAX_BULK_ENTRIES];
+    u16 addrs[APP_MAX_BULK_ENTRIES];
+    u16 groupIds[APP_MAX_BULK_ENTRIES];
+    u32 addrNum, groupNum;
+    u32 frameNum = 0;
+    u32 i, j, k;
+
+    /* The frames never outnumber the entries, the batch is queued whole
+     * or not at all */
+    if (socTx_reserve(num) != 0) {
+        LOG_WARN(LOG_MOD_APP, "bulk of %u entries does not fit the UART queue, dropped", num);
+        return;
+    }
+
+    memcpy(sorted, entry, num * sizeof(gw_bulkEntry_t));
+    qsort(sorted, num, sizeof(gw_bulkEntry_t), app_cmpBulkEntry);
+
+    for (i = 0; i < num; i = j) {
+        addrNum = 0;
+        for (j = i; j < num && sorted[j].value == sorted[i].value; j++) {
+            if (sorted[j].addrMode == ADDR_MODE_SHORT_ADDR) {
+                addrs[addrNum++] = sorted[j].addr;
+                continue;
+            }
+            if (isLevel) {
+                zllSocSetLevel(sorted[j].value, transTime, sorted[j].addr, endpoint, sorted[j].addrMode);
+            } else {
+                zllSocSetState(sorted[j].value, sorted[j].addr, endpoint, sorted[j].addrMode);
+            }
+            frameNum++;
+        }
+
+        groupNum = groups_cover(addrs, &addrNum, groupIds, APP_MAX_BULK_ENTRIES);
+        for (k = 0; k < groupNum; k++) {
+            if (isLevel) {
+                zllSocSetLevel(sorted[i].value, transTime, groupIds[k], endpoint, ADDR_MODE_GROUP);
+            } else {
+                zllSocSetState(sorted[i].value, groupIds[k], endpoint, ADDR_MODE_GROUP);
+            }
+        }
+        for (k = 0; k < addrNum; k++) {
+            if (isLevel) {
+                zllSocSetLevel(sorted[i].value, transTime, addrs[k], endpoint, ADDR_MODE_SHORT_ADDR);
+            } else {
+                zllSocSetState(sorted[i].value, addrs[k], endpoint, ADDR_MODE_SHORT_ADDR);
+            }
+        }
+        frameNum += groupNum + addrNum;
+    }
+
+    LOG_DEBUG(LOG_MOD_APP, "bulk %s of %u entries: %u frames", isLevel ? "level" : "light", num, frameNum);
+}
+
+/*********************************************************************
+ * @fn      app_lightBulkCmdHandler
+ *
+ * @brief   parse the received bulk on-off command
+ *
+ * @param   cmd - the recevied bulk light command
+ *
+ * @return  none
+ */
+void app_lightBulkCmdHandler(gw_lightBulkCmd_t* cmd)
+{
+    app_bulkCmdHandler(cmd->entry, cmd->num, FALSE, 0);
+}
+
+/*********************************************************************
+ * @fn      app_levelBulkCmdHandler
+ *
+ * @brief   parse the received bulk level command
+ *
+ * @param   cmd - the recevied bulk level command
+ *
+ * @return  none
+ */
+void app_levelBulkCmdHandler(gw_levelBulkCmd_t* cmd)
+{
+    app_bulkCmdHandler(cmd->entry, cmd->num, TRUE, cmd->transTime);
+}
+
+
 /*********************************************************************
  * @fn      app_groupCmdHandler
  *
@@ -239,7 +754,8 @@ void app_groupCmdHandler(gw_groupCmd_t* cmd)
 /*********************************************************************
  * @fn      app_queryCmdHandler
  *
- * @brief   search the nodes in node list and send to App through report command
+ * @brief   search the nodes in node list and send to App through report command.
+ *          The reports of all nodes are sent as one message.
  *
  * @param   none
  *
@@ -247,15 +763,29 @@ void app_groupCmdHandler(gw_groupCmd_t* cmd)
  */
 void app_queryCmdHandler(void)
 {
-    int i;
+    u32 i;
+    u32 num = nodes_curNum();
     nodeInfo_t *entry;
+    server_msg_t *msg;
+    gw_reportCmd_t *p;
+
+    if (num == 0) {
+        return;
+    }
 
-    for(i = 0; i < MAX_NODE_NUM; i++) {
+    msg = server_msgAlloc(num * sizeof(gw_reportCmd_t));
+    if (!msg) {
+        return;
+    }
+
+    p = (gw_reportCmd_t*)msg->data;
+    for(i = 0; i < num; i++) {
         entry = nodes_get(i);
-        if (entry->nwkAddr != EMPTY_NODE_NWK_ADDR) {
-            app_sendDeviceReportCmd(entry->devType, entry->nwkAddr, entry->extAddr);
-        }
+        app_encodeReportCmd(&p[i], entry->devType, entry->nwkAddr, entry->extAddr);
     }
+
+    server_broadcastMsg(msg);
+    server_msgUnref(msg);
 }
 
 
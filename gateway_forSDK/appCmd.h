@@ -3,16 +3,32 @@
 
 #include "types.h"
 
-#pragma pack(1)
+#pragma pack(push, 1)
 
 /*********************************************************************
  * CONSTANTS
  */
 
-#define MAX_APP_PACKET_LEN          50
+/* Longest command an App may send after CMD_PKT_LEN_REQ, and before
+ * it. Every connection can buffer a command of MAX_APP_PACKET_LEN. */
+#define MAX_APP_PACKET_LEN          2048
+#define APP_DEFAULT_PACKET_LEN      512
+
+/* SOF and command ID, the whole of commands without payload */
+#define APP_CMD_HDR_LEN             2
 
 #define APP_CMD_SOF                 0xA3
 
+/* Most devices one multi-target command may address */
+#define APP_MAX_TARGETS             200
+
+/* Most entries of a bulk command, one scene of a whole floor */
+#define APP_MAX_BULK_ENTRIES        400
+
+/* Statuses of CMD_DELIVERY_RSP besides those of the ZCL default response */
+#define APP_DELIVERY_TIMEOUT        0x94      //!< ZCL TIMEOUT, no response to any send
+#define APP_DELIVERY_SUPERSEDED     0xFF      //!< A newer command took its place
+
 /*********************************************************************
  * ENUMS
  */
@@ -39,6 +55,25 @@ enum {
 	/* Close Gateway */
 	CMD_CLOSE,
 
+	/* Multi-target Device Command ID */
+	CMD_LIGHT_MULTI,
+	CMD_LEVEL_MULTI,
+
+	/* Packet length negotiation */
+	CMD_PKT_LEN_REQ,
+	CMD_PKT_LEN_RSP,
+
+	/* Bulk Device Command ID */
+	CMD_LIGHT_BULK,
+	CMD_LEVEL_BULK,
+
+	/* Cached attribute Command ID */
+	CMD_ATTR_REQ,
+	CMD_ATTR_RSP,
+
+	/* Delivery result Command ID */
+	CMD_DELIVERY_RSP,
+
 };
 
 
@@ -143,6 +178,123 @@ typedef struct gw_levelCmd_tag {
 
 
 
+/*
+ *  Definiton for on-off command to many lights, num short addresses
+ *  follow the header. Lights forming a whole group get one groupcast.
+ */
+typedef struct gw_lightMultiCmd_tag {
+    u8 sof;
+    u8 cmd;
+    u8 opCode;
+    u8 num;
+    u16 addr[];
+} gw_lightMultiCmd_t;
+
+/*
+ *  Definiton for level command to many lights, num short addresses
+ *  follow the header
+ */
+typedef struct gw_levelMultiCmd_tag {
+    u8 sof;
+    u8 cmd;
+    u8 opCode;
+    u8 level;
+    u16 transTime;
+    u8 num;
+    u16 addr[];
+} gw_levelMultiCmd_t;
+
+
+/*
+ *  Definition of packet length request and response. The App asks for
+ *  the longest command it wants to send, the gateway answers with the
+ *  length it accepts from that App from now on.
+ */
+typedef struct {
+    u8 sof;
+    u8 cmd;
+    u16 maxLen;
+} gw_pktLenCmd_t;
+
+/*
+ *  One target of a bulk command, value is the on-off opCode or the level
+ */
+typedef struct {
+    u8 addrMode;
+    u16 addr;
+    u8 value;
+} gw_bulkEntry_t;
+
+/*
+ *  Definiton for on-off command to many targets, each with its own state
+ */
+typedef struct gw_lightBulkCmd_tag {
+    u8 sof;
+    u8 cmd;
+    u16 num;
+    gw_bulkEntry_t entry[];
+} gw_lightBulkCmd_t;
+
+/*
+ *  Definiton for level command to many targets, each with its own level
+ *  and one transition time for all
+ */
+typedef struct gw_levelBulkCmd_tag {
+    u8 sof;
+    u8 cmd;
+    u16 transTime;
+    u16 num;
+    gw_bulkEntry_t entry[];
+} gw_levelBulkCmd_t;
+
+
+/*
+ *  Definition of attribute request, attr is one of ATTR_CACHE_* in
+ *  attrCache.h. A cached value no older than maxAgeMs is answered at
+ *  once to the App, 0 takes the gateway default. Otherwise the device is
+ *  read and the answer goes to all Apps.
+ */
+typedef struct {
+    u8 sof;
+    u8 cmd;
+    u16 nwkAddr;
+    u8 endpoint;
+    u8 attr;
+    u16 maxAgeMs;
+} gw_attrReqCmd_t;
+
+/*
+ *  Definition of attribute response, also sent when a device reports a
+ *  cached attribute. status is the ZCL status, value is valid on success.
+ */
+typedef struct {
+    u8 sof;
+    u8 cmd;
+    u16 nwkAddr;
+    u8 endpoint;
+    u8 attr;
+    u8 status;
+    u8 value;
+    u32 ageMs;
+} gw_attrRspCmd_t;
+
+/*
+ *  Definition of delivery response, sent to the App a unicast command
+ *  came from once the device answered it or the gateway gave up.
+ *  status is the ZCL status of the default response or APP_DELIVERY_*.
+ */
+typedef struct {
+    u8 sof;
+    u8 cmd;
+    u16 nwkAddr;
+    u8 endpoint;
+    u16 clusterID;
+    u8 cmdID;
+    u8 status;
+    u8 attempts;                      //!< Times the command was sent
+} gw_deliveryRspCmd_t;
+
+
 /*********************************************************************
  * TYPES
  */
@@ -153,9 +305,17 @@ typedef struct gw_levelCmd_tag {
  * Public Functions
  */
 
-void app_cmdHandler(u8* buf, u8 len);
+struct server_conn_tag;
+
+void app_cmdHandler(struct server_conn_tag *conn, u8* buf, u32 len);
+u32  app_frameCmds(struct server_conn_tag *conn, u8* buf, u32 len);
 
 void app_sendDeviceReportCmd(u8 type, u16 nwkAddr, u8*extAddr);
+void app_sendGroupRspCmd(u16 nwkAddr, u16 groupID, u8 opcode, u8 status);
+void app_sendAttrRspCmd(u16 nwkAddr, u8 endpoint, u8 attr, u8 status, u8 value);
+void app_sendDeliveryRspCmd(u32 connId, u16 nwkAddr, u8 endpoint, u16 clusterID, u8 cmdID, u8 status, u8 attempts);
+
 
+#pragma pack(pop)
 
 #endif  /* __APP_CMD_H__ */
@@ -0,0 +1,476 @@
+
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "attrCache.h"
+#include "socCmd.h"
+#include "nodes.h"
+#include "groups.h"
+#include "swTimer.h"
+#include "log.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* None */
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+/*
+ * Entries are kept sorted by network address and endpoint in a dense
+ * table. A value is written by read responses and attribute reports of
+ * the devices, and by the commands the gateway sends them.
+ */
+typedef struct {
+    attrCache_entry_t *tbl;
+    u32 num;
+    u32 size;
+    attrCache_stats_t stats;
+} attrCache_ctrl_t;
+
+/* ZCL attribute behind each cached attribute */
+typedef struct {
+    u16 clusterID;
+    u16 attrId;
+} attrCache_zclAttr_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+attrCache_ctrl_t attrCache_vs;
+attrCache_ctrl_t *attrCache_v = &attrCache_vs;
+
+static const attrCache_zclAttr_t attrCache_zclAttr[ATTR_CACHE_ATTR_NUM] = {
+    [ATTR_CACHE_ON_OFF] = { ZCL_CLUSTER_ID_GEN_ON_OFF,               0x0000 },
+    [ATTR_CACHE_LEVEL]  = { ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL,        0x0000 },
+    [ATTR_CACHE_HUE]    = { ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL,   0x0000 },
+    [ATTR_CACHE_SAT]    = { ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL,   0x0001 },
+};
+
+static const char *attrCache_attrName[ATTR_CACHE_ATTR_NUM] = {
+    "on", "level", "hue", "sat",
+};
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* None */
+
+
+/*********************************************************************
+ * @fn      attrCache_find
+ *
+ * @brief   Find the entry of an endpoint
+ *
+ * @param   nwkAddr - the node
+ * @param   endpoint - its endpoint
+ * @param   pos - returns its index, or where it would be inserted
+ *
+ * @return  the entry, NULL if there is none
+ */
+static attrCache_entry_t* attrCache_find(u16 nwkAddr, u8 endpoint, u32 *pos)
+{
+    u32 key = ((u32)nwkAddr << 8) | endpoint;
+    u32 lo = 0, hi = attrCache_v->num, mid;
+    attrCache_entry_t *entry;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        entry = &attrCache_v->tbl[mid];
+        if ((((u32)entry->nwkAddr << 8) | entry->endpoint) < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *pos = lo;
+
+    if (lo == attrCache_v->num) {
+        return NULL;
+    }
+    entry = &attrCache_v->tbl[lo];
+    return (entry->nwkAddr == nwkAddr && entry->endpoint == endpoint) ? entry : NULL;
+}
+
+/*********************************************************************
+ * @fn      attrCache_add
+ *
+ * @brief   Find the entry of an endpoint, creating it if needed
+ *
+ * @param   nwkAddr - the node
+ * @param   endpoint - its endpoint
+ *
+ * @return  the entry, NULL if out of memory. Valid until the next
+ *          entry is added or removed.
+ */
+static attrCache_entry_t* attrCache_add(u16 nwkAddr, u8 endpoint)
+{
+    attrCache_entry_t *entry;
+    attrCache_entry_t *tbl;
+    u32 pos;
+
+    entry = attrCache_find(nwkAddr, endpoint, &pos);
+    if (entry) {
+        return entry;
+    }
+
+    if (attrCache_v->num == attrCache_v->size) {
+        tbl = realloc(attrCache_v->tbl, (attrCache_v->size ? attrCache_v->size * 2 : ATTR_CACHE_INIT_SIZE) *
+                      sizeof(attrCache_entry_t));
+        if (!tbl) {
+            return NULL;
+        }
+        attrCache_v->tbl = tbl;
+        attrCache_v->size = attrCache_v->size ? attrCache_v->size * 2 : ATTR_CACHE_INIT_SIZE;
+    }
+
+    memmove(&attrCache_v->tbl[pos + 1], &attrCache_v->tbl[pos], (attrCache_v->num - pos) * sizeof(attrCache_entry_t));
+    attrCache_v->num++;
+    entry = &attrCache_v->tbl[pos];
+    memset(entry, 0, sizeof(attrCache_entry_t));
+    entry->nwkAddr = nwkAddr;
+    entry->endpoint = endpoint;
+    return entry;
+}
+
+/*********************************************************************
+ * @fn      attrCache_reset
+ *
+ * @brief   Forget every cached value and the counters
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void attrCache_reset(void)
+{
+    free(attrCache_v->tbl);
+    memset(attrCache_v, 0, sizeof(attrCache_ctrl_t));
+}
+
+/*********************************************************************
+ * @fn      attrCache_attrOf
+ *
+ * @brief   Map a ZCL attribute to a cached attribute
+ *
+ * @param   clusterID - ZCL cluster
+ * @param   attrId - ZCL attribute ID
+ *
+ * @return  the cached attribute, -1 if it is not cached
+ */
+int attrCache_attrOf(u16 clusterID, u16 attrId)
+{
+    int i;
+
+    for (i = 0; i < ATTR_CACHE_ATTR_NUM; i++) {
+        if (attrCache_zclAttr[i].clusterID == clusterID && attrCache_zclAttr[i].attrId == attrId) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*********************************************************************
+ * @fn      attrCache_set
+ *
+ * @brief   Store a value
+ *
+ * @param   nwkAddr - the node
+ * @param   endpoint - its endpoint
+ * @param   attr - the attribute
+ * @param   value - its value
+ *
+ * @return  none
+ */
+static void attrCache_set(u16 nwkAddr, u8 endpoint, u8 attr, u8 value)
+{
+    attrCache_entry_t *entry = attrCache_add(nwkAddr, endpoint);
+
+    if (!entry) {
+        return;
+    }
+    entry->value[attr] = value;
+    entry->updateUs[attr] = swTimer_nowUs();
+    entry->readUs[attr] = 0;
+    entry->valid |= (1 << attr);
+}
+
+/*********************************************************************
+ * @fn      attrCache_update
+ *
+ * @brief   Store a value reported by a device, in a read response or an
+ *          attribute report
+ *
+ * @param   nwkAddr - the node
+ * @param   endpoint - its endpoint
+ * @param   attr - the attribute
+ * @param   value - its value
+ *
+ * @return  none
+ */
+void attrCache_update(u16 nwkAddr, u8 endpoint, u8 attr, u8 value)
+{
+    if (attr >= ATTR_CACHE_ATTR_NUM) {
+        return;
+    }
+    attrCache_v->stats.updates++;
+    attrCache_set(nwkAddr, endpoint, attr, value);
+}
+
+/*********************************************************************
+ * @fn      attrCache_cmdSent
+ *
+ * @brief   Store the value a command sets. A groupcast sets it on every
+ *          known member, a broadcast is not tracked.
+ *
+ * @param   addrMode - address mode of the command
+ * @param   dstAddr - network address or group ID
+ * @param   endpoint - destination endpoint
+ * @param   attr - the attribute
+ * @param   value - its value
+ *
+ * @return  none
+ */
+void attrCache_cmdSent(u8 addrMode, u16 dstAddr, u8 endpoint, u8 attr, u8 value)
+{
+    const group_t *group;
+    u32 i;
+
+    if (attr >= ATTR_CACHE_ATTR_NUM) {
+        return;
+    }
+
+    if (addrMode == ADDR_MODE_GROUP) {
+        group = groups_get(dstAddr);
+        for (i = 0; group && i < group->memberNum; i++) {
+            attrCache_set(group->members[i], endpoint, attr, value);
+        }
+    } else if (addrMode == ADDR_MODE_SHORT_ADDR && dstAddr < 0xFFF8) {
+        attrCache_set(dstAddr, endpoint, attr, value);
+    }
+}
+
+/*********************************************************************
+ * @fn      attrCache_invalidate
+ *
+ * @brief   Forget the attributes of a cluster, called when a command
+ *          to it failed or got no response
+ *
+ * @param   nwkAddr - the node
+ * @param   endpoint - its endpoint
+ * @param   clusterID - ZCL cluster
+ *
+ * @return  none
+ */
+void attrCache_invalidate(u16 nwkAddr, u8 endpoint, u16 clusterID)
+{
+    attrCache_entry_t *entry;
+    u32 pos;
+    int i;
+
+    entry = attrCache_find(nwkAddr, endpoint, &pos);
+    if (!entry) {
+        return;
+    }
+
+    for (i = 0; i < ATTR_CACHE_ATTR_NUM; i++) {
+        if (attrCache_zclAttr[i].clusterID == clusterID) {
+            entry->valid &= ~(1 << i);
+            entry->readUs[i] = 0;
+        }
+    }
+    attrCache_v->stats.invalidations++;
+}
+
+/*********************************************************************
+ * @fn      attrCache_get
+ *
+ * @brief   Look up a value no older than a bound
+ *
+ * @param   nwkAddr - the node
+ * @param   endpoint - its endpoint
+ * @param   attr - the attribute
+ * @param   maxAgeMs - oldest acceptable value
+ * @param   value - returns the value
+ * @param   ageMs - returns its age
+ *
+ * @return  0 on a hit, -1 if the value is unknown or too old
+ */
+int attrCache_get(u16 nwkAddr, u8 endpoint, u8 attr, u32 maxAgeMs, u8 *value, u32 *ageMs)
+{
+    attrCache_entry_t *entry;
+    u64 age;
+    u32 pos;
+
+    entry = attrCache_find(nwkAddr, endpoint, &pos);
+    if (attr >= ATTR_CACHE_ATTR_NUM || !entry || !(entry->valid & (1 << attr))) {
+        attrCache_v->stats.misses++;
+        return -1;
+    }
+
+    age = (swTimer_nowUs() - entry->updateUs[attr]) / 1000;
+    if (age > maxAgeMs) {
+        attrCache_v->stats.misses++;
+        return -1;
+    }
+
+    *value = entry->value[attr];
+    *ageMs = (u32)age;
+    attrCache_v->stats.hits++;
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      attrCache_startRead
+ *
+ * @brief   Claim the read of a missed value, so concurrent misses of
+ *          the same attribute share one radio read
+ *
+ * @param   nwkAddr - the node
+ * @param   endpoint - its endpoint
+ * @param   attr - the attribute
+ *
+ * @return  TRUE if the caller should send the read, FALSE if one is
+ *          already on its way
+ */
+int attrCache_startRead(u16 nwkAddr, u8 endpoint, u8 attr)
+{
+    attrCache_entry_t *entry;
+    u64 now = swTimer_nowUs();
+
+    if (attr >= ATTR_CACHE_ATTR_NUM) {
+        return FALSE;
+    }
+
+    entry = attrCache_add(nwkAddr, endpoint);
+    if (!entry) {
+        return FALSE;
+    }
+
+    if (entry->readUs[attr] && now - entry->readUs[attr] < (u64)ATTR_CACHE_READ_TIMEOUT_MS * 1000) {
+        return FALSE;
+    }
+    entry->readUs[attr] = now;
+    attrCache_v->stats.reads++;
+    return TRUE;
+}
+
+/*********************************************************************
+ * @fn      attrCache_removeNode
+ *
+ * @brief   Forget every endpoint of a node
+ *
+ * @param   nwkAddr - the node
+ *
+ * @return  none
+ */
+void attrCache_removeNode(u16 nwkAddr)
+{
+    u32 first, last;
+
+    attrCache_find(nwkAddr, 0, &first);
+    for (last = first; last < attrCache_v->num && attrCache_v->tbl[last].nwkAddr == nwkAddr; last++);
+    if (last == first) {
+        return;
+    }
+
+    memmove(&attrCache_v->tbl[first], &attrCache_v->tbl[last], (attrCache_v->num - last) * sizeof(attrCache_entry_t));
+    attrCache_v->num -= last - first;
+}
+
+/*********************************************************************
+ * @fn      attrCache_renameNode
+ *
+ * @brief   Keep the values of a node which rejoined with a new network
+ *          address
+ *
+ * @param   oldAddr - its previous address
+ * @param   newAddr - its new address
+ *
+ * @return  none
+ */
+void attrCache_renameNode(u16 oldAddr, u16 newAddr)
+{
+    attrCache_entry_t saved;
+    attrCache_entry_t *entry;
+    u32 pos;
+
+    attrCache_removeNode(newAddr);
+
+    /* Remove and add back, the table stays sorted */
+    while (1) {
+        attrCache_find(oldAddr, 0, &pos);
+        if (pos == attrCache_v->num || attrCache_v->tbl[pos].nwkAddr != oldAddr) {
+            break;
+        }
+
+        saved = attrCache_v->tbl[pos];
+        attrCache_v->num--;
+        memmove(&attrCache_v->tbl[pos], &attrCache_v->tbl[pos + 1], (attrCache_v->num - pos) * sizeof(attrCache_entry_t));
+
+        entry = attrCache_add(newAddr, saved.endpoint);
+        if (entry) {
+            *entry = saved;
+            entry->nwkAddr = newAddr;
+        }
+    }
+}
+
+/*********************************************************************
+ * @fn      attrCache_getStats
+ *
+ * @brief   Get the cache counters
+ *
+ * @param   none
+ *
+ * @return  the counters
+ */
+attrCache_stats_t* attrCache_getStats(void)
+{
+    return &attrCache_v->stats;
+}
+
+/*********************************************************************
+ * @fn      attrCache_print
+ *
+ * @brief   Print the counters and every cached value with its age
+ *
+ * @param   fp - where to print
+ *
+ * @return  none
+ */
+void attrCache_print(FILE *fp)
+{
+    attrCache_stats_t *st = &attrCache_v->stats;
+    attrCache_entry_t *entry;
+    u64 now = swTimer_nowUs();
+    u32 i;
+    int j;
+
+    fprintf(fp, "Attribute cache: %u endpoints, %u hits, %u misses, %u reads, %u updates, %u invalidations\n",
+            attrCache_v->num, st->hits, st->misses, st->reads, st->updates, st->invalidations);
+    for (i = 0; i < attrCache_v->num; i++) {
+        entry = &attrCache_v->tbl[i];
+        fprintf(fp, "    0x%04x/0x%02x:", entry->nwkAddr, entry->endpoint);
+        for (j = 0; j < ATTR_CACHE_ATTR_NUM; j++) {
+            if (entry->valid & (1 << j)) {
+                fprintf(fp, " %s %u (%llu ms)", attrCache_attrName[j], entry->value[j],
+                        (unsigned long long)((now - entry->updateUs[j]) / 1000));
+            }
+        }
+        fprintf(fp, "\n");
+    }
+    fprintf(fp, "\n");
+}
@@ -0,0 +1,72 @@
+#ifndef  __ATTR_CACHE_H__
+#define  __ATTR_CACHE_H__
+
+#include <stdio.h>
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* Initial capacity of the cache, doubles when full */
+#define ATTR_CACHE_INIT_SIZE            64
+
+/* A read which got no response by then may be sent again */
+#define ATTR_CACHE_READ_TIMEOUT_MS      3000
+
+/*********************************************************************
+ * ENUMS
+ */
+
+/*
+ * Cached attributes, also the attribute IDs of CMD_ATTR_REQ
+ */
+enum {
+    ATTR_CACHE_ON_OFF,
+    ATTR_CACHE_LEVEL,
+    ATTR_CACHE_HUE,
+    ATTR_CACHE_SAT,
+    ATTR_CACHE_ATTR_NUM,
+};
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+/* Last known attributes of one endpoint of a node */
+typedef struct {
+    u16 nwkAddr;
+    u8 endpoint;
+    u8 valid;                                   //!< Bit per attribute
+    u8 value[ATTR_CACHE_ATTR_NUM];
+    u64 updateUs[ATTR_CACHE_ATTR_NUM];          //!< Monotonic time the value was learnt
+    u64 readUs[ATTR_CACHE_ATTR_NUM];            //!< Time a read was sent, 0 if none is pending
+} attrCache_entry_t;
+
+typedef struct {
+    u32 hits;
+    u32 misses;
+    u32 reads;                                  //!< Reads sent for misses
+    u32 updates;                                //!< Values learnt from the network
+    u32 invalidations;
+} attrCache_stats_t;
+
+
+/*********************************************************************
+ * Public Functions
+ */
+void attrCache_reset(void);
+int  attrCache_attrOf(u16 clusterID, u16 attrId);
+void attrCache_update(u16 nwkAddr, u8 endpoint, u8 attr, u8 value);
+void attrCache_cmdSent(u8 addrMode, u16 dstAddr, u8 endpoint, u8 attr, u8 value);
+void attrCache_invalidate(u16 nwkAddr, u8 endpoint, u16 clusterID);
+int  attrCache_get(u16 nwkAddr, u8 endpoint, u8 attr, u32 maxAgeMs, u8 *value, u32 *ageMs);
+int  attrCache_startRead(u16 nwkAddr, u8 endpoint, u8 attr);
+void attrCache_removeNode(u16 nwkAddr);
+void attrCache_renameNode(u16 oldAddr, u16 newAddr);
+attrCache_stats_t* attrCache_getStats(void);
+void attrCache_print(FILE *fp);
+
+#endif  /* __ATTR_CACHE_H__ */
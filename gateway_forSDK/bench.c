@@ -0,0 +1,935 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/socket.h>
+
+#include "types.h"
+#include "config.h"
+#include "appCmd.h"
+#include "socCmd.h"
+#include "nodes.h"
+#include "socSim.h"
+#include "swTimer.h"
+#include "trans.h"
+#include "tool.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+#define BENCH_DEF_APPS                  10
+#define BENCH_DEF_LIGHTS                100
+#define BENCH_DEF_CMDS                  10000
+#define BENCH_DEF_ITERATIONS            1000
+#define BENCH_MAX_APPS                  256
+
+/* A sample which takes longer is counted as lost */
+#define BENCH_SAMPLE_TIMEOUT_MS         1000
+
+/* Longest wait for the network to be announced and a phase to drain */
+#define BENCH_SETTLE_TIMEOUT_MS         10000
+
+/* Longest time between two sends of a transaction: its response timeout
+ * and the last retry backoff. A UART quiet this long has no retries left
+ * to come. */
+#define BENCH_QUIET_MS                  (TRANS_TIMEOUT_MS + (TRANS_RETRY_BASE_MS << TRANS_RETRIES_INTERACTIVE))
+
+/* No level awaited, the ZCL command alone identifies the frame */
+#define BENCH_ANY_LEVEL                 -1
+
+#define BENCH_APP_BUF_SIZE              8192
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+/* A synthetic App, its stream is framed as the gateway sends it */
+typedef struct {
+    int fd;
+    u32 used;
+    u32 reports;                      //!< Reports received since the last reset
+    u8 gotReport;                     //!< The report of the awaited device came in
+    u8 buf[BENCH_APP_BUF_SIZE];
+} bench_app_t;
+
+/* Latency samples of one measurement, in us */
+typedef struct {
+    const char *name;
+    u32 *samples;
+    u32 num;
+    u32 lost;
+} bench_hist_t;
+
+typedef struct {
+    u32 appNum;
+    u32 lightNum;
+    u32 cmdNum;
+    u32 iterations;
+    u16 port;
+    u8 verbose;
+
+    int master;
+    int slave;
+    pid_t child;
+    bench_app_t *apps;
+
+    /* The UART frame and the report being waited for. A frame with the
+     * seq of the one before is a retry of the previous command. */
+    u16 waitAddr;
+    u16 waitCluster;
+    u8 waitCmdID;
+    int waitLevel;                    //!< Level in the payload, BENCH_ANY_LEVEL if none
+    int lastSeq;                      //!< Seq of the last frame waited for, -1 if none
+    u8 uartSeen;
+    u32 reportApps;                   //!< Apps which have the awaited report
+
+    u32 uartFrames;
+    u64 lastUartUs;                   //!< Time of the last ZCL frame on the UART
+    u8 *sentinelSeen;                 //!< Per light, for the end of the throughput run
+
+    double cmdSeconds;
+    bench_hist_t fanout;
+    bench_hist_t light;
+    bench_hist_t level;
+    bench_hist_t query;
+} bench_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+bench_ctrl_t bench_vs;
+bench_ctrl_t *bench_v = &bench_vs;
+
+/* The simulator answers every frame at once, pacing would only measure
+ * the scheduler */
+static char *bench_gwOpts[] = { "-b", "115200", "-k", "0", "-r", "0", NULL };
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static void usage(char *exeName);
+
+
+/*********************************************************************
+ * @fn      bench_frameCb
+ *
+ * @brief   Watch the ZCL commands the gateway writes to the UART
+ *
+ * @param   frame - the frame, SOF to FCS
+ * @param   len - length of the frame
+ *
+ * @return  none
+ */
+static void bench_frameCb(const u8 *frame, u16 len)
+{
+    gw_app_cmd_t *pCmd = (gw_app_cmd_t*)&frame[1];
+    data_cmd_t *pData = &pCmd->data.dataCmd;
+    u16 idx;
+
+    if (pCmd->cmd1 != 0x00 || pData->clusterID == 0xFFFF) {
+        return;
+    }
+    bench_v->uartFrames++;
+    bench_v->lastUartUs = swTimer_nowUs();
+
+    if (!bench_v->uartSeen && pData->dstNwkAddr == bench_v->waitAddr &&
+        pData->clusterID == bench_v->waitCluster && pData->cmdID == bench_v->waitCmdID &&
+        (bench_v->waitLevel == BENCH_ANY_LEVEL || pData->payload[0] == bench_v->waitLevel) &&
+        (int)pData->zclTransSeqNo != bench_v->lastSeq) {
+        bench_v->lastSeq = pData->zclTransSeqNo;
+        bench_v->uartSeen = TRUE;
+    }
+
+    idx = pData->dstNwkAddr - SIM_NWK_ADDR_BASE;
+    if (pData->clusterID == ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL && idx < bench_v->lightNum) {
+        bench_v->sentinelSeen[idx] = TRUE;
+    }
+}
+
+/*********************************************************************
+ * @fn      bench_appParse
+ *
+ * @brief   Take the complete messages out of the stream of an App
+ *
+ * @param   app - the App
+ *
+ * @return  none
+ */
+static void bench_appParse(bench_app_t *app)
+{
+    gw_reportCmd_t *pReport;
+    u32 off = 0;
+    u32 msgLen;
+
+    while (off < app->used) {
+        if (app->buf[off] != APP_CMD_SOF) {
+            off++;
+            continue;
+        }
+        if (app->used - off < APP_CMD_HDR_LEN) {
+            break;
+        }
+
+        switch (app->buf[off + 1]) {
+        case CMD_REPORT:
+            msgLen = sizeof(gw_reportCmd_t);
+            break;
+        case CMD_GROUP_RSP:
+            msgLen = sizeof(gw_groupRspCmd_t);
+            break;
+        default:
+            off++;
+            continue;
+        }
+        if (app->used - off < msgLen) {
+            break;
+        }
+
+        if (app->buf[off + 1] == CMD_REPORT) {
+            pReport = (gw_reportCmd_t*)&app->buf[off];
+            app->reports++;
+            if (pReport->nwkAddr == bench_v->waitAddr && !app->gotReport) {
+                app->gotReport = TRUE;
+                bench_v->reportApps++;
+            }
+        }
+        off += msgLen;
+    }
+
+    memmove(app->buf, app->buf + off, app->used - off);
+    app->used -= off;
+}
+
+/*********************************************************************
+ * @fn      bench_pump
+ *
+ * @brief   Move data between the gateway, the simulated network and
+ *          the Apps, waits for up to a given time
+ *
+ * @param   timeoutMs - longest time to wait, -1 for ever
+ *
+ * @return  none
+ */
+static void bench_pump(int timeoutMs)
+{
+    struct pollfd pfd[BENCH_MAX_APPS + 1];
+    bench_app_t *app;
+    int timerMs = swTimer_nextTimeout();
+    u32 i;
+    int n;
+
+    if (timerMs != SW_TIMER_NONE && (timeoutMs < 0 || timerMs < timeoutMs)) {
+        timeoutMs = timerMs;
+    }
+
+    pfd[0].fd = bench_v->master;
+    pfd[0].events = POLLIN | (sim_txPending() ? POLLOUT : 0);
+    for (i = 0; i < bench_v->appNum; i++) {
+        pfd[i + 1].fd = bench_v->apps[i].fd;
+        pfd[i + 1].events = POLLIN;
+    }
+
+    if (poll(pfd, bench_v->appNum + 1, timeoutMs) > 0) {
+        if (pfd[0].revents) {
+            sim_pump(0);
+        }
+        for (i = 0; i < bench_v->appNum; i++) {
+            if (!pfd[i + 1].revents) {
+                continue;
+            }
+            app = &bench_v->apps[i];
+            while ((n = recv(app->fd, app->buf + app->used, BENCH_APP_BUF_SIZE - app->used,
+                             MSG_DONTWAIT)) > 0) {
+                app->used += n;
+                bench_appParse(app);
+            }
+        }
+    }
+
+    swTimer_process();
+
+    /* Device frames the timers just queued */
+    if (sim_txPending()) {
+        sim_pump(0);
+    }
+}
+
+/*********************************************************************
+ * @fn      bench_send
+ *
+ * @brief   Send a command of an App, the gateway is served meanwhile if
+ *          the socket is full
+ *
+ * @param   app - the App
+ * @param   buf - the command
+ * @param   len - length of the command
+ *
+ * @return  0 on success, -1 on error
+ */
+static int bench_send(bench_app_t *app, const void *buf, u32 len)
+{
+    const u8 *p = (const u8*)buf;
+    int n;
+
+    while (len) {
+        n = send(app->fd, p, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) {
+            p += n;
+            len -= n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            bench_pump(1);
+        } else {
+            perror("send");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      bench_lightCmd
+ *
+ * @brief   Send a CMD_LIGHT for a light
+ *
+ * @param   app - the App sending it
+ * @param   nwkAddr - the light
+ * @param   opCode - 0 off, 1 on
+ *
+ * @return  0 on success, -1 on error
+ */
+static int bench_lightCmd(bench_app_t *app, u16 nwkAddr, u8 opCode)
+{
+    gw_lightCmd_t cmd;
+
+    cmd.sof = APP_CMD_SOF;
+    cmd.cmd = CMD_LIGHT;
+    cmd.addrMode = ADDR_MODE_SHORT_ADDR;
+    cmd.addr = nwkAddr;
+    cmd.opCode = opCode;
+    return bench_send(app, &cmd, sizeof(cmd));
+}
+
+/*********************************************************************
+ * @fn      bench_levelCmd
+ *
+ * @brief   Send a CMD_LEVEL for a light
+ *
+ * @param   app - the App sending it
+ * @param   nwkAddr - the light
+ * @param   level - the level
+ *
+ * @return  0 on success, -1 on error
+ */
+static int bench_levelCmd(bench_app_t *app, u16 nwkAddr, u8 level)
+{
+    gw_levelCmd_t cmd;
+
+    cmd.sof = APP_CMD_SOF;
+    cmd.cmd = CMD_LEVEL;
+    cmd.addrMode = ADDR_MODE_SHORT_ADDR;
+    cmd.addr = nwkAddr;
+    cmd.opCode = 0;
+    cmd.level = level;
+    cmd.transTime = 0;
+    return bench_send(app, &cmd, sizeof(cmd));
+}
+
+/*********************************************************************
+ * @fn      bench_resetWait
+ *
+ * @brief   Start waiting for a UART frame or a report
+ *
+ * @param   nwkAddr - the device
+ * @param   clusterID - cluster of the UART frame, 0 if none is awaited
+ * @param   cmdID - ZCL command of the UART frame
+ * @param   level - level in its payload, BENCH_ANY_LEVEL if none
+ *
+ * @return  none
+ */
+static void bench_resetWait(u16 nwkAddr, u16 clusterID, u8 cmdID, int level)
+{
+    u32 i;
+
+    bench_v->waitAddr = nwkAddr;
+    bench_v->waitCluster = clusterID;
+    bench_v->waitCmdID = cmdID;
+    bench_v->waitLevel = level;
+    bench_v->uartSeen = FALSE;
+    bench_v->reportApps = 0;
+    for (i = 0; i < bench_v->appNum; i++) {
+        bench_v->apps[i].gotReport = FALSE;
+        bench_v->apps[i].reports = 0;
+    }
+}
+
+/*********************************************************************
+ * @fn      bench_waitUntil
+ *
+ * @brief   Serve the gateway until a condition holds or time runs out
+ *
+ * @param   done - the condition, checked after each round
+ * @param   start - when the measured operation began, swTimer_nowUs()
+ * @param   timeoutMs - longest time to wait from start
+ *
+ * @return  time it took in us, 0 on timeout
+ */
+static u32 bench_waitUntil(int (*done)(void), u64 start, u32 timeoutMs)
+{
+    u64 end = start + (u64)timeoutMs * 1000;
+    u64 now;
+
+    while (!done()) {
+        now = swTimer_nowUs();
+        if (now >= end) {
+            return 0;
+        }
+        bench_pump((end - now + 999) / 1000);
+    }
+    now = swTimer_nowUs();
+    return (now > start) ? (u32)(now - start) : 1;
+}
+
+static int bench_uartDone(void)
+{
+    return bench_v->uartSeen;
+}
+
+static int bench_fanoutDone(void)
+{
+    return bench_v->reportApps == bench_v->appNum;
+}
+
+static int bench_queryDone(void)
+{
+    return bench_v->apps[0].reports >= bench_v->lightNum;
+}
+
+static int bench_announcedDone(void)
+{
+    u32 i;
+
+    for (i = 0; i < bench_v->appNum; i++) {
+        if (bench_v->apps[i].reports < bench_v->lightNum) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static int bench_sentinelDone(void)
+{
+    u32 i;
+
+    for (i = 0; i < bench_v->appNum && i < bench_v->lightNum; i++) {
+        if (!bench_v->sentinelSeen[i]) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*********************************************************************
+ * @fn      bench_histAdd
+ *
+ * @brief   Add a sample to a histogram
+ *
+ * @param   hist - the histogram
+ * @param   us - the sample, 0 if it was lost
+ *
+ * @return  none
+ */
+static void bench_histAdd(bench_hist_t *hist, u32 us)
+{
+    if (us == 0) {
+        hist->lost++;
+    } else {
+        hist->samples[hist->num++] = us;
+    }
+}
+
+static int bench_cmpU32(const void *a, const void *b)
+{
+    u32 x = *(const u32*)a;
+    u32 y = *(const u32*)b;
+
+    return (x > y) - (x < y);
+}
+
+/*********************************************************************
+ * @fn      bench_histPct
+ *
+ * @brief   Get a percentile of sorted samples, nearest rank
+ *
+ * @param   hist - the histogram, sorted
+ * @param   pct - the percentile, 0 - 100
+ *
+ * @return  the sample in us, 0 if there is none
+ */
+static u32 bench_histPct(bench_hist_t *hist, double pct)
+{
+    u32 rank;
+
+    if (hist->num == 0) {
+        return 0;
+    }
+    rank = (u32)(pct * hist->num / 100.0 + 0.999999);
+    return hist->samples[(rank > 0 ? rank : 1) - 1];
+}
+
+/*********************************************************************
+ * @fn      bench_histWrite
+ *
+ * @brief   Write a histogram as a JSON object
+ *
+ * @param   fp - the file
+ * @param   hist - the histogram, sorted
+ *
+ * @return  none
+ */
+static void bench_histWrite(FILE *fp, bench_hist_t *hist)
+{
+    u64 sum = 0;
+    u32 i;
+
+    for (i = 0; i < hist->num; i++) {
+        sum += hist->samples[i];
+    }
+
+    fprintf(fp, "{\"samples\": %u, \"lost\": %u, \"min_us\": %u, \"mean_us\": %llu, "
+            "\"p50_us\": %u, \"p99_us\": %u, \"p999_us\": %u, \"max_us\": %u}",
+            hist->num, hist->lost, hist->num ? hist->samples[0] : 0,
+            hist->num ? (unsigned long long)(sum / hist->num) : 0ULL,
+            bench_histPct(hist, 50), bench_histPct(hist, 99), bench_histPct(hist, 99.9),
+            hist->num ? hist->samples[hist->num - 1] : 0);
+}
+
+/*********************************************************************
+ * @fn      bench_histPrint
+ *
+ * @brief   Print a line of summary of a histogram
+ *
+ * @param   hist - the histogram, sorted
+ *
+ * @return  none
+ */
+static void bench_histPrint(bench_hist_t *hist)
+{
+    printf("%-14s p50 %7u us  p99 %7u us  p999 %7u us  max %7u us  lost %u/%u\n",
+           hist->name, bench_histPct(hist, 50), bench_histPct(hist, 99), bench_histPct(hist, 99.9),
+           hist->num ? hist->samples[hist->num - 1] : 0, hist->lost, hist->num + hist->lost);
+}
+
+/*********************************************************************
+ * @fn      bench_drain
+ *
+ * @brief   Serve the gateway until the UART has been quiet for
+ *          BENCH_QUIET_MS, so no retry of an earlier phase can end a
+ *          latency sample
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void bench_drain(void)
+{
+    u64 start = swTimer_nowUs();
+    u64 quietEnd;
+    u64 now;
+
+    bench_v->lastUartUs = start;
+    bench_v->lastSeq = -1;
+    while ((now = swTimer_nowUs()) < (quietEnd = bench_v->lastUartUs + BENCH_QUIET_MS * 1000ULL)) {
+        if (now - start >= BENCH_SETTLE_TIMEOUT_MS * 1000ULL) {
+            fprintf(stderr, "latency: the UART did not go quiet\n");
+            return;
+        }
+        bench_pump((quietEnd - now + 999) / 1000);
+    }
+}
+
+/*********************************************************************
+ * @fn      bench_runThroughput
+ *
+ * @brief   Flood the gateway with CMD_LIGHT from all the Apps. Each App
+ *          ends with a CMD_LEVEL to its own light: once all of those
+ *          reached the UART, every command before them was handled.
+ *
+ * @param   none
+ *
+ * @return  0 on success, -1 on error
+ */
+static int bench_runThroughput(void)
+{
+    u64 start;
+    u32 i;
+
+    bench_resetWait(0, 0, 0, BENCH_ANY_LEVEL);
+    bench_v->uartFrames = 0;
+    memset(bench_v->sentinelSeen, 0, bench_v->lightNum);
+
+    start = swTimer_nowUs();
+    for (i = 0; i < bench_v->cmdNum; i++) {
+        if (bench_lightCmd(&bench_v->apps[i % bench_v->appNum],
+                           SIM_NWK_ADDR_BASE + i % bench_v->lightNum, i & 1) != 0) {
+            return -1;
+        }
+        bench_pump(0);
+    }
+    for (i = 0; i < bench_v->appNum; i++) {
+        if (bench_levelCmd(&bench_v->apps[i], SIM_NWK_ADDR_BASE + i % bench_v->lightNum, 0x80) != 0) {
+            return -1;
+        }
+    }
+
+    if (bench_waitUntil(bench_sentinelDone, start, BENCH_SETTLE_TIMEOUT_MS) == 0) {
+        fprintf(stderr, "throughput: not all commands reached the UART\n");
+    }
+    bench_v->cmdSeconds = (swTimer_nowUs() - start) / 1e6;
+
+    /* Let the responses of the devices drain before the next phase */
+    bench_pump(100);
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      bench_runLatency
+ *
+ * @brief   Time single commands from an App until they are on the UART,
+ *          and queries until the App has every report
+ *
+ * @param   none
+ *
+ * @return  0 on success, -1 on error
+ */
+static int bench_runLatency(void)
+{
+    bench_app_t *app;
+    u8 query[APP_CMD_HDR_LEN] = { APP_CMD_SOF, CMD_QUERY_REQ };
+    u16 nwkAddr;
+    u64 start;
+    u32 i;
+
+    bench_drain();
+    for (i = 0; i < bench_v->iterations; i++) {
+        app = &bench_v->apps[i % bench_v->appNum];
+        nwkAddr = SIM_NWK_ADDR_BASE + i % bench_v->lightNum;
+
+        bench_resetWait(nwkAddr, ZCL_CLUSTER_ID_GEN_ON_OFF, (i & 1) ? COMMAND_ON_OFF_ON : COMMAND_ON_OFF_OFF,
+                        BENCH_ANY_LEVEL);
+        start = swTimer_nowUs();
+        if (bench_lightCmd(app, nwkAddr, i & 1) != 0) {
+            return -1;
+        }
+        bench_histAdd(&bench_v->light, bench_waitUntil(bench_uartDone, start, BENCH_SAMPLE_TIMEOUT_MS));
+
+        bench_resetWait(nwkAddr, ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL, COMMAND_LEVEL_MOVE_TO_LEVEL_WITH_ONOFF, i & 0xFF);
+        start = swTimer_nowUs();
+        if (bench_levelCmd(app, nwkAddr, i & 0xFF) != 0) {
+            return -1;
+        }
+        bench_histAdd(&bench_v->level, bench_waitUntil(bench_uartDone, start, BENCH_SAMPLE_TIMEOUT_MS));
+    }
+
+    /* Queries always go out of the first App, bench_queryDone() watches it */
+    app = &bench_v->apps[0];
+    for (i = 0; i < bench_v->iterations; i++) {
+        bench_resetWait(0, 0, 0, BENCH_ANY_LEVEL);
+        start = swTimer_nowUs();
+        if (bench_send(app, query, sizeof(query)) != 0) {
+            return -1;
+        }
+        bench_histAdd(&bench_v->query, bench_waitUntil(bench_queryDone, start, BENCH_SAMPLE_TIMEOUT_MS));
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      bench_runFanout
+ *
+ * @brief   Time device announces from the UART until every App has the
+ *          report
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void bench_runFanout(void)
+{
+    u64 start;
+    u32 idx;
+    u32 i;
+
+    for (i = 0; i < bench_v->iterations; i++) {
+        idx = i % bench_v->lightNum;
+        bench_resetWait(SIM_NWK_ADDR_BASE + idx, 0, 0, BENCH_ANY_LEVEL);
+        start = swTimer_nowUs();
+        sim_announceDev(idx, 0);
+        bench_histAdd(&bench_v->fanout, bench_waitUntil(bench_fanoutDone, start, BENCH_SAMPLE_TIMEOUT_MS));
+    }
+}
+
+/*********************************************************************
+ * @fn      bench_writeResults
+ *
+ * @brief   Write the results as JSON and a summary to stdout
+ *
+ * @param   path - the JSON file, "-" for stdout
+ *
+ * @return  0 on success, -1 on error
+ */
+static int bench_writeResults(const char *path)
+{
+    bench_hist_t *hists[] = { &bench_v->fanout, &bench_v->light, &bench_v->level, &bench_v->query };
+    double secs = (bench_v->cmdSeconds > 0) ? bench_v->cmdSeconds : 1e-6;
+    FILE *fp;
+    u32 i;
+
+    for (i = 0; i < sizeof(hists) / sizeof(hists[0]); i++) {
+        qsort(hists[i]->samples, hists[i]->num, sizeof(u32), bench_cmpU32);
+    }
+
+    printf("%u Apps, %u lights\n", bench_v->appNum, bench_v->lightNum);
+    printf("%-14s %.0f UART frames/s, from %.0f commands/s in\n", "throughput",
+           bench_v->uartFrames / secs, bench_v->cmdNum / secs);
+    for (i = 0; i < sizeof(hists) / sizeof(hists[0]); i++) {
+        bench_histPrint(hists[i]);
+    }
+
+    fp = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"config\": {\"apps\": %u, \"lights\": %u, \"commands\": %u, \"iterations\": %u},\n",
+            bench_v->appNum, bench_v->lightNum, bench_v->cmdNum, bench_v->iterations);
+    fprintf(fp, "  \"cmd_throughput\": {\"commands\": %u, \"uart_frames\": %u, \"seconds\": %.6f, "
+            "\"uart_frames_per_s\": %.1f, \"commands_in_per_s\": %.1f},\n",
+            bench_v->cmdNum, bench_v->uartFrames, bench_v->cmdSeconds,
+            bench_v->uartFrames / secs, bench_v->cmdNum / secs);
+    fprintf(fp, "  \"report_fanout\": ");
+    bench_histWrite(fp, &bench_v->fanout);
+    fprintf(fp, ",\n  \"latency\": {\n    \"light\": ");
+    bench_histWrite(fp, &bench_v->light);
+    fprintf(fp, ",\n    \"level\": ");
+    bench_histWrite(fp, &bench_v->level);
+    fprintf(fp, ",\n    \"query\": ");
+    bench_histWrite(fp, &bench_v->query);
+    fprintf(fp, "\n  }\n}\n");
+
+    if (fp != stdout) {
+        fclose(fp);
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      bench_removeDir
+ *
+ * @brief   Remove the work directory and what the gateway left in it
+ *
+ * @param   path - the directory
+ *
+ * @return  none
+ */
+static void bench_removeDir(const char *path)
+{
+    char name[PATH_MAX];
+    struct dirent *ent;
+    DIR *dir;
+
+    dir = opendir(path);
+    if (dir) {
+        while ((ent = readdir(dir)) != NULL) {
+            if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, "..")) {
+                snprintf(name, sizeof(name), "%s/%s", path, ent->d_name);
+                unlink(name);
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+/*********************************************************************
+ * @fn      bench_start
+ *
+ * @brief   Start the gateway on a simulated network of lights, connect
+ *          the Apps and wait until they all know every light
+ *
+ * @param   exe - the gateway executable
+ *
+ * @return  0 on success, -1 on error
+ */
+static int bench_start(char *exe)
+{
+    sim_cfg_t cfg;
+    char *ptyName;
+    u32 i;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.lightNum = bench_v->lightNum;
+
+    ptyName = tool_openPty(&bench_v->master, &bench_v->slave);
+    if (!ptyName || sim_init(&cfg, bench_v->master) != 0) {
+        return -1;
+    }
+    sim_setFrameCb(bench_frameCb);
+
+    bench_v->child = tool_spawnGateway(exe, bench_gwOpts, bench_v->port, ptyName, bench_v->verbose ? NULL : "/dev/null");
+    if (bench_v->child < 0 ||
+        tool_waitGateway(bench_v->port, TOOL_GW_START_TIMEOUT_MS, sim_pump) != 0) {
+        return -1;
+    }
+
+    for (i = 0; i < bench_v->appNum; i++) {
+        bench_v->apps[i].fd = tool_connect(bench_v->port);
+        if (bench_v->apps[i].fd < 0) {
+            perror("connect");
+            return -1;
+        }
+    }
+
+    bench_resetWait(0, 0, 0, BENCH_ANY_LEVEL);
+    sim_announceAll();
+    if (bench_waitUntil(bench_announcedDone, swTimer_nowUs(), BENCH_SETTLE_TIMEOUT_MS) == 0) {
+        fprintf(stderr, "the Apps did not get all the lights\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    bench_hist_t *hists[] = { &bench_v->fanout, &bench_v->light, &bench_v->level, &bench_v->query };
+    const char *names[] = { "report_fanout", "light", "level", "query" };
+    char *outPath = "bench.json";
+    char *exe = NULL;
+    char exePath[PATH_MAX];
+    char outFull[PATH_MAX];
+    char workDir[] = "/tmp/gwBench.XXXXXX";
+    int ret;
+    int opt;
+    u32 i;
+
+    bench_v->appNum = BENCH_DEF_APPS;
+    bench_v->lightNum = BENCH_DEF_LIGHTS;
+    bench_v->cmdNum = BENCH_DEF_CMDS;
+    bench_v->iterations = BENCH_DEF_ITERATIONS;
+    bench_v->port = TOOL_GW_PORT;
+
+    while ((opt = getopt(argc, argv, "c:l:n:i:p:g:o:v")) != -1) {
+        switch (opt) {
+        case 'c':
+            bench_v->appNum = atoi(optarg);
+            break;
+        case 'l':
+            bench_v->lightNum = atoi(optarg);
+            break;
+        case 'n':
+            bench_v->cmdNum = atoi(optarg);
+            break;
+        case 'i':
+            bench_v->iterations = atoi(optarg);
+            break;
+        case 'p':
+            bench_v->port = atoi(optarg);
+            break;
+        case 'g':
+            exe = optarg;
+            break;
+        case 'o':
+            outPath = optarg;
+            break;
+        case 'v':
+            bench_v->verbose = TRUE;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc || !exe || bench_v->appNum == 0 || bench_v->appNum > BENCH_MAX_APPS ||
+        bench_v->lightNum == 0 || bench_v->lightNum > SIM_MAX_DEVICES || bench_v->iterations == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* The gateway runs in a directory of its own, so it starts with an
+     * empty node database and leaves none behind */
+    if (!realpath(exe, exePath)) {
+        perror(exe);
+        return 1;
+    }
+    if (strcmp(outPath, "-") && outPath[0] != '/') {
+        if (!getcwd(outFull, sizeof(outFull) - strlen(outPath) - 1)) {
+            perror("getcwd");
+            return 1;
+        }
+        strcat(outFull, "/");
+        strcat(outFull, outPath);
+        outPath = outFull;
+    }
+    if (!mkdtemp(workDir) || chdir(workDir) != 0) {
+        perror(workDir);
+        return 1;
+    }
+
+    bench_v->apps = calloc(bench_v->appNum, sizeof(bench_app_t));
+    bench_v->sentinelSeen = calloc(bench_v->lightNum, 1);
+    for (i = 0; i < sizeof(hists) / sizeof(hists[0]); i++) {
+        hists[i]->name = names[i];
+        hists[i]->samples = calloc(bench_v->iterations, sizeof(u32));
+        if (!hists[i]->samples) {
+            return 1;
+        }
+    }
+    if (!bench_v->apps || !bench_v->sentinelSeen) {
+        return 1;
+    }
+
+    ret = bench_start(exePath);
+    if (ret == 0) {
+        ret = bench_runThroughput();
+    }
+    if (ret == 0) {
+        bench_runFanout();
+        ret = bench_runLatency();
+    }
+
+    tool_stopGateway(bench_v->child, bench_v->port);
+    bench_removeDir(workDir);
+
+    if (ret == 0) {
+        ret = bench_writeResults(outPath);
+    }
+    return (ret == 0) ? 0 : 1;
+}
+
+static void usage(char* exeName)
+{
+    printf("Usage: %s -g gateway [options]\n", exeName);
+    printf("  -g gateway  the gateway executable to measure\n");
+    printf("  -c num      Apps connected, %u by default\n", BENCH_DEF_APPS);
+    printf("  -l num      lights, %u by default\n", BENCH_DEF_LIGHTS);
+    printf("  -n num      commands of the throughput run, %u by default\n", BENCH_DEF_CMDS);
+    printf("  -i num      samples of each latency, %u by default\n", BENCH_DEF_ITERATIONS);
+    printf("  -p port     TCP port of the gateway, %u by default\n", TOOL_GW_PORT);
+    printf("  -o file     JSON results, bench.json by default, - for stdout\n");
+    printf("  -v          show the console of the gateway\n");
+    printf("Eample: %s -g ./gateway -c 50 -o bench.json\n", exeName);
+}
@@ -0,0 +1,230 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "swTimer.h"
+#include "log.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* None */
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+/*
+ * Records are appended to a memory buffer and written out when it fills
+ * up, when the flush timer expires and when the capture is closed. The
+ * main loop never waits for the disk for more than one block.
+ */
+typedef struct {
+    u64 startUs;
+    u32 used;
+    u32 records;
+    u32 failed;                       //!< Blocks which could not be written
+    u8 atExit;
+    swTimer_t flushTimer;
+    u8 buf[CAPTURE_BUF_SIZE];
+} capture_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+capture_ctrl_t capture_vs;
+capture_ctrl_t *capture_v = &capture_vs;
+
+int capture_fd = -1;
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* None */
+
+
+/*********************************************************************
+ * @fn      capture_writeOut
+ *
+ * @brief   Write a block to the capture file
+ *
+ * @param   buf - the data
+ * @param   len - length of data
+ *
+ * @return  0 on success, -1 on error
+ */
+static int capture_writeOut(const u8 *buf, u32 len)
+{
+    int n;
+
+    while (len) {
+        n = write(capture_fd, buf, len);
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      capture_flushTimerCb
+ *
+ * @brief   Write records which have been buffered for too long
+ *
+ * @param   arg - unused
+ *
+ * @return  none
+ */
+static void capture_flushTimerCb(void *arg)
+{
+    capture_flush();
+}
+
+/*********************************************************************
+ * @fn      capture_open
+ *
+ * @brief   Start recording frames to a file. A running capture is
+ *          closed first.
+ *
+ * @param   path - the capture file, truncated if it exists
+ *
+ * @return  0 on success, -1 on error
+ */
+int capture_open(const char *path)
+{
+    capture_fileHdr_t hdr;
+    int fd;
+
+    capture_close();
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    capture_v->startUs = swTimer_nowUs();
+    capture_v->used = 0;
+    capture_v->records = 0;
+    capture_v->failed = 0;
+
+    hdr.magic = CAPTURE_MAGIC;
+    hdr.version = CAPTURE_VERSION;
+    hdr.hdrSize = sizeof(capture_recHdr_t);
+    hdr.startUs = capture_v->startUs;
+    memcpy(capture_v->buf, &hdr, sizeof(hdr));
+    capture_v->used = sizeof(hdr);
+
+    if (!capture_v->atExit) {
+        atexit(capture_close);
+        capture_v->atExit = TRUE;
+    }
+
+    capture_fd = fd;
+    LOG_INFO(LOG_MOD_SOC, "capture: recording to %s", path);
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      capture_flush
+ *
+ * @brief   Write the buffered records to the file
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void capture_flush(void)
+{
+    swTimer_stop(&capture_v->flushTimer);
+    if (capture_fd < 0 || capture_v->used == 0) {
+        return;
+    }
+
+    if (capture_writeOut(capture_v->buf, capture_v->used) != 0) {
+        capture_v->failed++;
+    }
+    capture_v->used = 0;
+}
+
+/*********************************************************************
+ * @fn      capture_close
+ *
+ * @brief   Write what is buffered and stop recording
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void capture_close(void)
+{
+    if (capture_fd < 0) {
+        return;
+    }
+
+    capture_flush();
+    close(capture_fd);
+    capture_fd = -1;
+
+    LOG_INFO(LOG_MOD_SOC, "capture: %u records, %u blocks lost", capture_v->records, capture_v->failed);
+}
+
+/*********************************************************************
+ * @fn      capture_record
+ *
+ * @brief   Add a record to the capture, use the CAPTURE() macro so
+ *          nothing is done when no capture is running
+ *
+ * @param   type - CAPTURE_SOC_RX ...
+ * @param   connId - the App, CAPTURE_NO_CONN if none
+ * @param   buf - the frame
+ * @param   len - length of the frame
+ *
+ * @return  none
+ */
+void capture_record(u8 type, u32 connId, const u8 *buf, u32 len)
+{
+    capture_recHdr_t hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.timeUs = swTimer_nowUs() - capture_v->startUs;
+    hdr.type = type;
+    hdr.connId = connId;
+    hdr.len = len;
+
+    if (capture_v->used + sizeof(hdr) + len > CAPTURE_BUF_SIZE) {
+        capture_flush();
+    }
+
+    if (sizeof(hdr) + len > CAPTURE_BUF_SIZE) {
+        /* Too big to buffer, goes straight to the file */
+        if (capture_writeOut((u8*)&hdr, sizeof(hdr)) != 0 || capture_writeOut(buf, len) != 0) {
+            capture_v->failed++;
+        }
+    } else {
+        memcpy(capture_v->buf + capture_v->used, &hdr, sizeof(hdr));
+        if (len) {
+            memcpy(capture_v->buf + capture_v->used + sizeof(hdr), buf, len);
+        }
+        capture_v->used += sizeof(hdr) + len;
+    }
+    capture_v->records++;
+
+    if (!capture_v->flushTimer.active) {
+        swTimer_start(&capture_v->flushTimer, CAPTURE_FLUSH_DELAY_MS, capture_flushTimerCb, NULL);
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef  __CAPTURE_H__
+#define  __CAPTURE_H__
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+#define CAPTURE_MAGIC                   0x50435747      //!< "GWCP"
+#define CAPTURE_VERSION                 1
+
+/* Records are collected and written in blocks of this size */
+#define CAPTURE_BUF_SIZE                65536
+
+/* Buffered records reach the file at most this long after they happen */
+#define CAPTURE_FLUSH_DELAY_MS          1000
+
+/* Connection of records which are not about a single App */
+#define CAPTURE_NO_CONN                 0xFFFFFFFF
+
+/*********************************************************************
+ * ENUMS
+ */
+enum {
+    CAPTURE_SOC_RX = 1,               //!< RPC frame from the SoC, SOF to FCS
+    CAPTURE_SOC_TX,                   //!< RPC frame written to the SoC, SOF to FCS
+    CAPTURE_APP_OPEN,                 //!< App connected, no data
+    CAPTURE_APP_CLOSE,                //!< App disconnected, no data
+    CAPTURE_APP_RX,                   //!< Bytes received from an App
+    CAPTURE_APP_TX,                   //!< Message sent to an App
+};
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+/* On-disk layout, little endian. The file header is followed by
+ * records, each one a record header and len bytes of data. */
+#pragma pack(push, 1)
+typedef struct {
+    u32 magic;
+    u16 version;
+    u16 hdrSize;                      //!< Size of a record header
+    u64 startUs;                      //!< Monotonic time the capture started
+} capture_fileHdr_t;
+
+typedef struct {
+    u64 timeUs;                       //!< Monotonic time since startUs
+    u8 type;
+    u8 reserved[3];
+    u32 connId;                       //!< App of the record, CAPTURE_NO_CONN if none
+    u32 len;
+} capture_recHdr_t;
+#pragma pack(pop)
+
+/* File of the running capture, -1 if none. Checked inline by the hooks,
+ * a gateway that is not capturing pays a single compare. */
+extern int capture_fd;
+
+#define CAPTURE(type, connId, buf, len) \
+    do { \
+        if (capture_fd >= 0) { \
+            capture_record(type, connId, buf, len); \
+        } \
+    } while (0)
+
+
+/*********************************************************************
+ * Public Functions
+ */
+int  capture_open(const char *path);
+void capture_close(void);
+void capture_flush(void);
+void capture_record(u8 type, u32 connId, const u8 *buf, u32 len);
+
+#endif  /* __CAPTURE_H__ */
@@ -4,9 +4,20 @@
  * INCLUDES
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "types.h"
 #include "socCmd.h"
 #include "server.h"
+#include "trans.h"
+#include "nodeDb.h"
+#include "evLoop.h"
+#include "log.h"
+#include "capture.h"
+#include "stats.h"
+#include "groups.h"
+#include "attrCache.h"
 
 /**********************************************************************
  * LOCAL CONSTANTS
@@ -41,23 +52,31 @@ u32 getParam( char *cmdBuff, char *paramId, u32 *paramInt);
 void processConsoleCommand(void)
 {
     char cmdBuff[MAX_CONSOLE_CMD_LEN];
-    u32 bytesRead;
+    int bytesRead;
     u16 nwkAddr;
     u8 addrMode;
     u8 endpoint;
     u8 value;
     u16 transitionTime;
     u16 groupId;
+    char logMod[16];
+    char logLevel[16];
+    char capPath[MAX_CONSOLE_CMD_LEN];
 
     //read stdin
     bytesRead = read(0, cmdBuff, (MAX_CONSOLE_CMD_LEN-1));
+    if (bytesRead <= 0) {
+        /* Console closed, stop watching it */
+        evLoop_del(0);
+        return;
+    }
     cmdBuff[bytesRead] = '\0';
 
     getConsoleCommandParams(cmdBuff, &nwkAddr, &addrMode, &endpoint, &value, &transitionTime, &groupId);
 
     if((strstr(cmdBuff, "touchlink")) != 0) {
         zllSocTouchLink();
-        printf("touchlink command executed\n\n");
+        LOG_INFO(LOG_MOD_CLI, "touchlink command executed");
     }
     else if((strstr(cmdBuff, "sendresettofn")) != 0) {
         //sending of reset to fn must happen within a touchlink
@@ -68,56 +87,49 @@ void processConsoleCommand(void)
     }
     else if((strstr(cmdBuff, "resettofn")) != 0) {
         zllSocResetToFn();
-        printf("resettofn command executed\n\n");
+        LOG_INFO(LOG_MOD_CLI, "resettofn command executed");
     }
     else if((strstr(cmdBuff, "setonoff")) != 0) {
         zllSocSetState(value, nwkAddr, endpoint, addrMode);
-        printf("setstate command executed with params: \n");
-        printf("    Network Addr    :0x%04x\n    End Point       :0x%02x\n    Addr Mode       :0x%02x\n    Value           :0x%02x\n\n",
+        LOG_INFO(LOG_MOD_CLI, "setstate: nwk 0x%04x ep 0x%02x mode 0x%02x value 0x%02x",
             nwkAddr, endpoint, addrMode, value);
     } else if((strstr(cmdBuff, "setlevel")) != 0) {
         zllSocSetLevel(value, transitionTime, nwkAddr, endpoint, addrMode);
-        printf("setlevel command executed with params: \n");
-        printf("    Network Addr    :0x%04x\n    End Point       :0x%02x\n    Addr Mode       :0x%02x\n    Value           :0x%02x\n    Transition Time :0x%04x\n\n",
-          nwkAddr, endpoint, addrMode, value, transitionTime);
+        LOG_INFO(LOG_MOD_CLI, "setlevel: nwk 0x%04x ep 0x%02x mode 0x%02x value 0x%02x time 0x%04x",
+            nwkAddr, endpoint, addrMode, value, transitionTime);
     } else if((strstr(cmdBuff, "sethue")) != 0) {
         zllSocSetHue(value, transitionTime, nwkAddr, endpoint, addrMode);
-        printf("sethue command executed with params: \n");
-        printf("    Network Addr    :0x%04x\n    End Point       :0x%02x\n    Addr Mode       :0x%02x\n    Value           :0x%02x\n    Transition Time :0x%04x\n\n",
-          nwkAddr, endpoint, addrMode, value, transitionTime);
+        LOG_INFO(LOG_MOD_CLI, "sethue: nwk 0x%04x ep 0x%02x mode 0x%02x value 0x%02x time 0x%04x",
+            nwkAddr, endpoint, addrMode, value, transitionTime);
     } else if((strstr(cmdBuff, "setsat")) != 0) {
         zllSocSetSat(value, transitionTime, nwkAddr, endpoint, addrMode);
-        printf("setsat command executed with params: \n");
-        printf("    Network Addr    :0x%04x\n    End Point       :0x%02x\n    Addr Mode       :0x%02x\n    Value           :0x%02x\n    Transition Time :0x%04x\n\n",
-          nwkAddr, endpoint, addrMode, value, transitionTime);
+        LOG_INFO(LOG_MOD_CLI, "setsat: nwk 0x%04x ep 0x%02x mode 0x%02x value 0x%02x time 0x%04x",
+            nwkAddr, endpoint, addrMode, value, transitionTime);
     } else if((strstr(cmdBuff, "getstate")) != 0) {
         zllSocGetState(nwkAddr, endpoint, addrMode);
-        printf("getstate command executed wtih params: \n");
-        printf("    Network Addr    :0x%04x\n    End Point       :0x%02x\n    Addr Mode       :0x%02x\n\n",
-          nwkAddr, endpoint, addrMode);
+        LOG_INFO(LOG_MOD_CLI, "getstate: nwk 0x%04x ep 0x%02x mode 0x%02x",
+            nwkAddr, endpoint, addrMode);
     } else if((strstr(cmdBuff, "getlevel")) != 0) {
         zllSocGetLevel(nwkAddr, endpoint, addrMode);
-        printf("getlevel command executed with params: \n");
-        printf("    Network Addr    :0x%04x\n    End Point       :0x%02x\n    Addr Mode       :0x%02x\n\n",
-          nwkAddr, endpoint, addrMode);
+        LOG_INFO(LOG_MOD_CLI, "getlevel: nwk 0x%04x ep 0x%02x mode 0x%02x",
+            nwkAddr, endpoint, addrMode);
     } else if((strstr(cmdBuff, "gethue")) != 0) {
         zllSocGetHue(nwkAddr, endpoint, addrMode);
-        printf("gethue command executed with params: \n");
-        printf("    Network Addr    :0x%04x\n    End Point       :0x%02x\n    Addr Mode       :0x%02x\n\n",
-          nwkAddr, endpoint, addrMode);
+        LOG_INFO(LOG_MOD_CLI, "gethue: nwk 0x%04x ep 0x%02x mode 0x%02x",
+            nwkAddr, endpoint, addrMode);
     } else if((strstr(cmdBuff, "getsat")) != 0) {
         zllSocGetSat(nwkAddr, endpoint, addrMode);
-        printf("getsat command executed with params: \n");
-        printf("    Network Addr    :0x%04x\n    End Point       :0x%02x\n    Addr Mode       :0x%02x\n\n",
-          nwkAddr, endpoint, addrMode);
+        LOG_INFO(LOG_MOD_CLI, "getsat: nwk 0x%04x ep 0x%02x mode 0x%02x",
+            nwkAddr, endpoint, addrMode);
+    } else if((strstr(cmdBuff, "coordinfo")) != 0) {
+        zllSocGetCoordInfo();
     } else if((strstr(cmdBuff, "getnodes")) != 0) {
         //send the get nodes command to zc.
         zllSocGetNodes();
     } else if((strstr(cmdBuff, "addgroup")) != 0) {
         zllSocAddGroup(groupId, nwkAddr, endpoint, addrMode);
-        printf("addgroup command executed with params: \n");
-        printf("    Network Addr    :0x%04x\n    End Point       :0x%02x\n    Addr Mode       :0x%02x\n    GroupID       :0x%2x\n",
-          nwkAddr, endpoint, addrMode, groupId);
+        LOG_INFO(LOG_MOD_CLI, "addgroup: nwk 0x%04x ep 0x%02x mode 0x%02x group 0x%04x",
+            nwkAddr, endpoint, addrMode, groupId);
     } else if((strstr(cmdBuff, "setbind")) != 0) {
         if (addrMode == 1) {
             zllSocDemoBind(addrMode, nwkAddr);
@@ -125,25 +137,47 @@ void processConsoleCommand(void)
             zllSocDemoBind(addrMode, nwkAddr);
         }
 
-        printf("setbind command executed with params: \n");
-        printf("    Network Addr    :0x%04x\n    End Point       :0x%02x\n    Addr Mode       :0x%02x\n    GroupID       :0x%2x\n",
-          nwkAddr, endpoint, addrMode, groupId);
+        LOG_INFO(LOG_MOD_CLI, "setbind: nwk 0x%04x ep 0x%02x mode 0x%02x group 0x%04x",
+            nwkAddr, endpoint, addrMode, groupId);
     } else if((strstr(cmdBuff, "resetflash")) != 0) {
         zllSocFlashReset(nwkAddr, endpoint, addrMode);
-        printf("reset command executed with params: \n");
-        printf("    Network Addr    :0x%04x\n    End Point       :0x%02x\n    Addr Mode       :0x%02x\n\n",
-          nwkAddr, endpoint, addrMode);
+        LOG_INFO(LOG_MOD_CLI, "reset: nwk 0x%04x ep 0x%02x mode 0x%02x",
+            nwkAddr, endpoint, addrMode);
     } else if((strstr(cmdBuff, "enddevbind")) != 0) {
         zllSocEndDevBind(nwkAddr, endpoint, addrMode);
     } else if((strstr(cmdBuff, "selectlight")) != 0) {
         zllSocIdentify(transitionTime, nwkAddr, endpoint, addrMode);
-        printf("identify command executed with params: \n");
-        printf("    Network Addr    :0x%04x\n    End Point       :0x%02x\n    Addr Mode       :0x%02x\n    Value           :0x%02x\n\n",
+        LOG_INFO(LOG_MOD_CLI, "identify: nwk 0x%04x ep 0x%02x mode 0x%02x value 0x%02x",
             nwkAddr, endpoint, addrMode, value);
+    } else if((strstr(cmdBuff, "capture")) != 0) {
+        if (sscanf(cmdBuff, "capture %49s", capPath) != 1) {
+            printf("usage: capture <file|off>\n\n");
+        } else if (strcmp(capPath, "off") == 0) {
+            capture_close();
+        } else {
+            capture_open(capPath);
+        }
+    } else if((strstr(cmdBuff, "stats")) != 0) {
+        if (strstr(cmdBuff, "reset")) {
+            stats_reset();
+        } else {
+            stats_print(stdout);
+        }
+    } else if((strstr(cmdBuff, "attrs")) != 0) {
+        attrCache_print(stdout);
+    } else if((strstr(cmdBuff, "groups")) != 0) {
+        groups_print(stdout);
+    } else if((strstr(cmdBuff, "latency")) != 0) {
+        trans_printStats();
+    } else if((strstr(cmdBuff, "log")) != 0) {
+        if (sscanf(cmdBuff, "log %15s %15s", logMod, logLevel) != 2 || log_setLevelByName(logMod, logLevel) != 0) {
+            printf("usage: log <soc|server|app|nodes|cli|all> <none|error|warn|info|debug>\n\n");
+        }
     } else if((strstr(cmdBuff, "exit")) != 0) {
         printf("Closing. \n");
         socClose();
         server_close();
+        nodeDb_close();
         exit(0);
     } else {
         printf("invalid command\n\n");
@@ -155,7 +189,7 @@ void processConsoleCommand(void)
 void getConsoleCommandParams(char* cmdBuff, u16 *nwkAddr, u8 *addrMode, u8 *ep, u8 *value, u16 *transitionTime, u16 *groupId)
 {
   //set some default values
-  uint32_t tmpInt;
+  u32 tmpInt;
 
   if( getParam( cmdBuff, "-n", &tmpInt) )
   {
@@ -24,5 +24,6 @@
  * Public Functions
  */
 void processSocCmd(void);
+void processConsoleCommand(void);
 
 #endif  /* __CLI_H__ */
@@ -8,6 +8,73 @@
 #define APP_USE_CLI                 1
 #define APP_USE_SMARTPHONE          1
 
+/* Node list snapshot, the journal is kept next to it */
+#define NODE_DB_PATH                "gateway.db"
+
+/* TCP port the Apps connect to */
+#define SERVER_LISTEN_PORT          16000
+
+/* Apps connected at a time, further connections are refused */
+#define SERVER_MAX_CONN_NUM         1024
+
+/* An App with more unsent bytes than this, or whose socket took none
+ * of its output for this long, is disconnected */
+#define SERVER_CONN_TX_HIGH_WATER   (64 * 1024)
+#define SERVER_CONN_TX_STALL_MS     5000
+
+/* Local socket answering every connection with the runtime stats */
+#define STATS_SOCKET_PATH           "gateway.stats"
+
+/* Age of a cached attribute still good for an App which does not ask
+ * for a bound of its own */
+#define ATTR_CACHE_DEFAULT_MAX_AGE_MS   10000
+
+/* Frames per second sent into the mesh at most, the rate backs off
+ * down to SCHED_MIN_RATE on losses. SCHED_BURST frames may go at once. */
+#define SCHED_MAX_RATE              40
+#define SCHED_MIN_RATE              5
+#define SCHED_BURST                 10
+
+/* Frames per second and burst to a single node or group */
+#define SCHED_DST_RATE              5
+#define SCHED_DST_BURST             3
+
+/* Airtime of a groupcast or broadcast, in unicast frames */
+#define SCHED_BCAST_COST            4
+
+/* Sends of a unicast command after the first one gets no response,
+ * by class. The first retry waits about TRANS_RETRY_BASE_MS, each
+ * further one twice as long. */
+#define TRANS_RETRIES_INTERACTIVE   3
+#define TRANS_RETRIES_BULK          1
+#define TRANS_RETRY_BASE_MS         250
+
+/* Time the coordinator has to answer an SREQ once it is written, and
+ * SREQs waiting behind the outstanding one before new ones are refused */
+#define SOC_REQ_TIMEOUT_MS          1000
+#define SOC_REQ_MAX_QUEUED          32
+
+/* UART rates tried with the coordinator when none is given on the
+ * command line, fastest first. A rate is kept once SOC_LINK_PROBE_PINGS
+ * pings in a row are answered without line errors. RTS/CTS flow control
+ * is then tried the same way if SOC_LINK_RTSCTS is set. */
+#define SOC_LINK_BAUDS              921600, 460800, 230400, 115200
+#define SOC_LINK_PROBE_PINGS        3
+#define SOC_LINK_RTSCTS             1
+
+/* A line quiet for this long is pinged, after SOC_LINK_KEEPALIVE_MISSES
+ * pings in a row go unanswered the port is reopened. Only armed when the
+ * rate probe saw the coordinator answer a ping, with an SRSP or an RPC
+ * error: firmware which answers no SREQ would be reopened for nothing.
+ * Without it, and with a rate given on the command line, a lost link is
+ * only told by a hangup, end of file or an error of the port. */
+#define SOC_LINK_KEEPALIVE_MS       5000
+#define SOC_LINK_KEEPALIVE_MISSES   2
+
+/* Log records above this level are compiled out, LOG_LEVEL_NONE for a
+ * build without logging */
+#define LOG_COMPILE_LEVEL           LOG_LEVEL_DEBUG
+
 
 
 
@@ -0,0 +1,229 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "evLoop.h"
+#include "swTimer.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+#define EV_LOOP_INIT_FD_NUM             64
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+typedef struct {
+    evLoopCb_t cb;                    //!< NULL if the fd is not registered
+    void *arg;
+    u32 gen;                          //!< Bumped on every add, detects reused fds
+} evLoop_handler_t;
+
+/*
+ * Handlers are indexed by fd, fds are small and dense. The epoll data
+ * carries fd and generation, so an event fetched for an fd which has
+ * been closed (and maybe reused) in the same wakeup is dropped.
+ */
+typedef struct {
+    int epfd;
+    evLoop_handler_t *handlers;
+    u32 handlerNum;
+    u32 genCnt;
+    u64 wakeUs;                       //!< Monotonic time the last wait returned
+} evLoop_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+evLoop_ctrl_t evLoop_vs = { .epfd = -1 };
+evLoop_ctrl_t *evLoop_v = &evLoop_vs;
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* None */
+
+
+/*********************************************************************
+ * @fn      evLoop_init
+ *
+ * @brief   Create the epoll instance
+ *
+ * @param   none
+ *
+ * @return  0 on success, -1 on error
+ */
+int evLoop_init(void)
+{
+    evLoop_v->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (evLoop_v->epfd < 0) {
+        perror("evLoop: epoll_create1 failed");
+        return -1;
+    }
+
+    evLoop_v->handlers = calloc(EV_LOOP_INIT_FD_NUM, sizeof(evLoop_handler_t));
+    if (!evLoop_v->handlers) {
+        close(evLoop_v->epfd);
+        evLoop_v->epfd = -1;
+        return -1;
+    }
+    evLoop_v->handlerNum = EV_LOOP_INIT_FD_NUM;
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      evLoop_add
+ *
+ * @brief   Register a file descriptor. Callers asking for EPOLLET must
+ *          drain the fd until EAGAIN in their callback.
+ *
+ * @param   fd - the file descriptor
+ * @param   events - EPOLLxxx mask
+ * @param   cb - called with the ready events
+ * @param   arg - passed to cb
+ *
+ * @return  0 on success, -1 on error
+ */
+int evLoop_add(int fd, u32 events, evLoopCb_t cb, void *arg)
+{
+    struct epoll_event ev;
+    evLoop_handler_t *h;
+    u32 num;
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    if ((u32)fd >= evLoop_v->handlerNum) {
+        num = evLoop_v->handlerNum;
+        while (num <= (u32)fd) {
+            num *= 2;
+        }
+        h = realloc(evLoop_v->handlers, num * sizeof(evLoop_handler_t));
+        if (!h) {
+            return -1;
+        }
+        memset(&h[evLoop_v->handlerNum], 0, (num - evLoop_v->handlerNum) * sizeof(evLoop_handler_t));
+        evLoop_v->handlers = h;
+        evLoop_v->handlerNum = num;
+    }
+
+    h = &evLoop_v->handlers[fd];
+    h->cb = cb;
+    h->arg = arg;
+    h->gen = ++evLoop_v->genCnt;
+
+    ev.events = events;
+    ev.data.u64 = ((u64)h->gen << 32) | (u32)fd;
+    if (epoll_ctl(evLoop_v->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        perror("evLoop: epoll_ctl add failed");
+        h->cb = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      evLoop_mod
+ *
+ * @brief   Change the events a registered fd is watched for
+ *
+ * @param   fd - the file descriptor
+ * @param   events - EPOLLxxx mask
+ *
+ * @return  0 on success, -1 on error
+ */
+int evLoop_mod(int fd, u32 events)
+{
+    struct epoll_event ev;
+
+    if (fd < 0 || (u32)fd >= evLoop_v->handlerNum || !evLoop_v->handlers[fd].cb) {
+        return -1;
+    }
+
+    ev.events = events;
+    ev.data.u64 = ((u64)evLoop_v->handlers[fd].gen << 32) | (u32)fd;
+    return epoll_ctl(evLoop_v->epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+/*********************************************************************
+ * @fn      evLoop_del
+ *
+ * @brief   Unregister a file descriptor, to be called before closing
+ *          it. Safe from within a callback.
+ *
+ * @param   fd - the file descriptor
+ *
+ * @return  none
+ */
+void evLoop_del(int fd)
+{
+    if (fd < 0 || (u32)fd >= evLoop_v->handlerNum || !evLoop_v->handlers[fd].cb) {
+        return;
+    }
+
+    epoll_ctl(evLoop_v->epfd, EPOLL_CTL_DEL, fd, NULL);
+    evLoop_v->handlers[fd].cb = NULL;
+}
+
+/*********************************************************************
+ * @fn      evLoop_poll
+ *
+ * @brief   Wait for events and dispatch every ready fd
+ *
+ * @param   timeoutMs - longest time to wait, -1 for no limit
+ *
+ * @return  number of events dispatched, -1 on error
+ */
+int evLoop_poll(int timeoutMs)
+{
+    struct epoll_event events[EV_LOOP_MAX_EVENTS];
+    evLoop_handler_t *h;
+    int i, n, fd;
+
+    n = epoll_wait(evLoop_v->epfd, events, EV_LOOP_MAX_EVENTS, timeoutMs);
+    evLoop_v->wakeUs = swTimer_nowUs();
+    if (n < 0) {
+        if (errno != EINTR) {
+            perror("evLoop: epoll_wait failed");
+            return -1;
+        }
+        return 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        fd = (int)(u32)events[i].data.u64;
+        h = &evLoop_v->handlers[fd];
+        if (h->cb && h->gen == (u32)(events[i].data.u64 >> 32)) {
+            h->cb(fd, events[i].events, h->arg);
+        }
+    }
+    return n;
+}
+
+/*********************************************************************
+ * @fn      evLoop_wakeUs
+ *
+ * @brief   Get the time the last evLoop_poll() stopped waiting, the
+ *          work done since is the busy part of the loop pass
+ *
+ * @param   none
+ *
+ * @return  monotonic time in us
+ */
+u64 evLoop_wakeUs(void)
+{
+    return evLoop_v->wakeUs;
+}
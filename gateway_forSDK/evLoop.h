@@ -0,0 +1,39 @@
+#ifndef  __EV_LOOP_H__
+#define  __EV_LOOP_H__
+
+#include <sys/epoll.h>
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* Ready events fetched from the kernel per wakeup */
+#define EV_LOOP_MAX_EVENTS              64
+
+/*********************************************************************
+ * ENUMS
+ */
+
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+/* events is the EPOLLxxx mask reported for fd */
+typedef void (*evLoopCb_t)(int fd, u32 events, void *arg);
+
+
+/*********************************************************************
+ * Public Functions
+ */
+int  evLoop_init(void);
+int  evLoop_add(int fd, u32 events, evLoopCb_t cb, void *arg);
+int  evLoop_mod(int fd, u32 events);
+void evLoop_del(int fd);
+int  evLoop_poll(int timeoutMs);
+u64  evLoop_wakeUs(void);
+
+#endif  /* __EV_LOOP_H__ */
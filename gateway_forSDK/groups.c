@@ -0,0 +1,433 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "groups.h"
+#include "log.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* None */
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+/*
+ * Groups are kept sorted by ID in a dense table, members sorted by
+ * network address. Membership is learnt from the group responses of the
+ * devices, so the table only holds what the network confirmed.
+ */
+typedef struct {
+    group_t *tbl;
+    u32 num;
+    u32 size;
+} groups_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+groups_ctrl_t groups_vs;
+groups_ctrl_t *groups_v = &groups_vs;
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* None */
+
+
+/*********************************************************************
+ * @fn      groups_search
+ *
+ * @brief   Binary search of a sorted u16 array
+ *
+ * @param   arr - the array
+ * @param   num - number of entries
+ * @param   value - the value to look for
+ * @param   pos - returns its index, or where it would be inserted
+ *
+ * @return  TRUE if it was found
+ */
+static int groups_search(const u16 *arr, u32 num, u16 value, u32 *pos)
+{
+    u32 lo = 0, hi = num, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (arr[mid] < value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *pos = lo;
+    return (lo < num && arr[lo] == value);
+}
+
+/*********************************************************************
+ * @fn      groups_find
+ *
+ * @brief   Find a group by ID
+ *
+ * @param   groupId - the group
+ * @param   pos - returns its index, or where it would be inserted
+ *
+ * @return  the group, NULL if it is unknown
+ */
+static group_t* groups_find(u16 groupId, u32 *pos)
+{
+    u32 lo = 0, hi = groups_v->num, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (groups_v->tbl[mid].groupId < groupId) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *pos = lo;
+    return (lo < groups_v->num && groups_v->tbl[lo].groupId == groupId) ? &groups_v->tbl[lo] : NULL;
+}
+
+/*********************************************************************
+ * @fn      groups_delete
+ *
+ * @brief   Remove a group which has no members left
+ *
+ * @param   pos - index of the group
+ *
+ * @return  none
+ */
+static void groups_delete(u32 pos)
+{
+    free(groups_v->tbl[pos].members);
+    groups_v->num--;
+    memmove(&groups_v->tbl[pos], &groups_v->tbl[pos + 1], (groups_v->num - pos) * sizeof(group_t));
+}
+
+/*********************************************************************
+ * @fn      groups_reset
+ *
+ * @brief   Forget all the groups
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void groups_reset(void)
+{
+    u32 i;
+
+    for (i = 0; i < groups_v->num; i++) {
+        free(groups_v->tbl[i].members);
+    }
+    free(groups_v->tbl);
+    memset(groups_v, 0, sizeof(groups_ctrl_t));
+}
+
+/*********************************************************************
+ * @fn      groups_addMember
+ *
+ * @brief   Record that a device is a member of a group
+ *
+ * @param   groupId - the group
+ * @param   nwkAddr - the device
+ *
+ * @return  0 on success, -1 if out of memory
+ */
+int groups_addMember(u16 groupId, u16 nwkAddr)
+{
+    group_t *group;
+    group_t *tbl;
+    u16 *members;
+    u32 pos;
+
+    group = groups_find(groupId, &pos);
+    if (!group) {
+        if (groups_v->num == groups_v->size) {
+            tbl = realloc(groups_v->tbl, (groups_v->size ? groups_v->size * 2 : GROUPS_TBL_INIT_SIZE) * sizeof(group_t));
+            if (!tbl) {
+                return -1;
+            }
+            groups_v->tbl = tbl;
+            groups_v->size = groups_v->size ? groups_v->size * 2 : GROUPS_TBL_INIT_SIZE;
+        }
+        memmove(&groups_v->tbl[pos + 1], &groups_v->tbl[pos], (groups_v->num - pos) * sizeof(group_t));
+        groups_v->num++;
+        group = &groups_v->tbl[pos];
+        memset(group, 0, sizeof(group_t));
+        group->groupId = groupId;
+    }
+
+    if (groups_search(group->members, group->memberNum, nwkAddr, &pos)) {
+        return 0;
+    }
+
+    if (group->memberNum == group->memberSize) {
+        members = realloc(group->members, (group->memberSize ? group->memberSize * 2 : GROUPS_MEMBERS_INIT_SIZE) * sizeof(u16));
+        if (!members) {
+            return -1;
+        }
+        group->members = members;
+        group->memberSize = group->memberSize ? group->memberSize * 2 : GROUPS_MEMBERS_INIT_SIZE;
+    }
+    memmove(&group->members[pos + 1], &group->members[pos], (group->memberNum - pos) * sizeof(u16));
+    group->members[pos] = nwkAddr;
+    group->memberNum++;
+
+    LOG_DEBUG(LOG_MOD_NODES, "groups: 0x%04x joined group 0x%04x, %u members", nwkAddr, groupId, group->memberNum);
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      groups_removeMember
+ *
+ * @brief   Record that a device left a group
+ *
+ * @param   groupId - the group
+ * @param   nwkAddr - the device
+ *
+ * @return  none
+ */
+void groups_removeMember(u16 groupId, u16 nwkAddr)
+{
+    group_t *group;
+    u32 groupPos, pos;
+
+    group = groups_find(groupId, &groupPos);
+    if (!group || !groups_search(group->members, group->memberNum, nwkAddr, &pos)) {
+        return;
+    }
+
+    group->memberNum--;
+    memmove(&group->members[pos], &group->members[pos + 1], (group->memberNum - pos) * sizeof(u16));
+    if (group->memberNum == 0) {
+        groups_delete(groupPos);
+    }
+}
+
+/*********************************************************************
+ * @fn      groups_removeNode
+ *
+ * @brief   Take a device out of every group
+ *
+ * @param   nwkAddr - the device
+ *
+ * @return  none
+ */
+void groups_removeNode(u16 nwkAddr)
+{
+    u32 i = groups_v->num;
+
+    /* Backwards, an emptied group is deleted */
+    while (i--) {
+        groups_removeMember(groups_v->tbl[i].groupId, nwkAddr);
+    }
+}
+
+/*********************************************************************
+ * @fn      groups_setMembership
+ *
+ * @brief   Replace the groups of a device with the ones it reported
+ *
+ * @param   nwkAddr - the device
+ * @param   groupIds - its groups
+ * @param   num - number of groups
+ *
+ * @return  none
+ */
+void groups_setMembership(u16 nwkAddr, const u16 *groupIds, u32 num)
+{
+    u32 i;
+
+    groups_removeNode(nwkAddr);
+    for (i = 0; i < num; i++) {
+        groups_addMember(groupIds[i], nwkAddr);
+    }
+}
+
+/*********************************************************************
+ * @fn      groups_renameNode
+ *
+ * @brief   Keep the groups of a device which rejoined with a new
+ *          network address. The member is renamed in place, so a group
+ *          it is the only member of is not deleted on the way.
+ *
+ * @param   oldAddr - its previous address
+ * @param   newAddr - its new address
+ *
+ * @return  none
+ */
+void groups_renameNode(u16 oldAddr, u16 newAddr)
+{
+    group_t *group;
+    u32 i;
+    u32 pos;
+
+    for (i = 0; i < groups_v->num; i++) {
+        group = &groups_v->tbl[i];
+        if (!groups_search(group->members, group->memberNum, oldAddr, &pos)) {
+            continue;
+        }
+
+        group->memberNum--;
+        memmove(&group->members[pos], &group->members[pos + 1], (group->memberNum - pos) * sizeof(u16));
+
+        /* Already listed under the new address, the old entry was stale */
+        if (groups_search(group->members, group->memberNum, newAddr, &pos)) {
+            continue;
+        }
+        memmove(&group->members[pos + 1], &group->members[pos], (group->memberNum - pos) * sizeof(u16));
+        group->members[pos] = newAddr;
+        group->memberNum++;
+    }
+}
+
+/*********************************************************************
+ * @fn      groups_get
+ *
+ * @brief   Get the members of a group
+ *
+ * @param   groupId - the group
+ *
+ * @return  the group, NULL if no member is known. Valid until the
+ *          membership changes.
+ */
+const group_t* groups_get(u16 groupId)
+{
+    u32 pos;
+
+    return groups_find(groupId, &pos);
+}
+
+static int groups_cmpAddr(const void *a, const void *b)
+{
+    return (int)*(const u16*)a - (int)*(const u16*)b;
+}
+
+static int groups_cmpSize(const void *a, const void *b)
+{
+    return (int)(*(group_t* const*)b)->memberNum - (int)(*(group_t* const*)a)->memberNum;
+}
+
+/*********************************************************************
+ * @fn      groups_cover
+ *
+ * @brief   Pick groups to reach a set of devices with fewer frames.
+ *          Only groups whose members are all targets qualify, and no
+ *          device is covered twice, so a toggle still acts once per
+ *          device. Larger groups are tried first.
+ *
+ * @param   addrs - the target network addresses, returns the ones
+ *                  left for unicast, sorted and without duplicates
+ * @param   num - number of targets, returns the number left
+ * @param   groupIds - returns the groups to send to
+ * @param   maxGroups - room in groupIds
+ *
+ * @return  number of groups picked
+ */
+u32 groups_cover(u16 *addrs, u32 *num, u16 *groupIds, u32 maxGroups)
+{
+    group_t **cand;
+    group_t *group;
+    u8 *covered;
+    u32 candNum = 0;
+    u32 groupNum = 0;
+    u32 n = 0;
+    u32 i, j, pos;
+
+    if (*num == 0) {
+        return 0;
+    }
+
+    qsort(addrs, *num, sizeof(u16), groups_cmpAddr);
+    for (i = 1; i < *num; i++) {
+        if (addrs[i] != addrs[n]) {
+            addrs[++n] = addrs[i];
+        }
+    }
+    *num = n + 1;
+
+    cand = malloc((groups_v->num + 1) * sizeof(group_t*));
+    covered = calloc(*num, 1);
+    if (!cand || !covered) {
+        free(cand);
+        free(covered);
+        return 0;
+    }
+
+    for (i = 0; i < groups_v->num; i++) {
+        group = &groups_v->tbl[i];
+        if (group->memberNum >= GROUPS_MIN_CAST_MEMBERS && group->memberNum <= *num) {
+            cand[candNum++] = group;
+        }
+    }
+    qsort(cand, candNum, sizeof(group_t*), groups_cmpSize);
+
+    for (i = 0; i < candNum && groupNum < maxGroups; i++) {
+        group = cand[i];
+        for (j = 0; j < group->memberNum; j++) {
+            if (!groups_search(addrs, *num, group->members[j], &pos) || covered[pos]) {
+                break;
+            }
+        }
+        if (j < group->memberNum) {
+            continue;
+        }
+
+        for (j = 0; j < group->memberNum; j++) {
+            groups_search(addrs, *num, group->members[j], &pos);
+            covered[pos] = TRUE;
+        }
+        groupIds[groupNum++] = group->groupId;
+    }
+
+    /* Keep what no group reaches */
+    for (i = 0, n = 0; i < *num; i++) {
+        if (!covered[i]) {
+            addrs[n++] = addrs[i];
+        }
+    }
+    *num = n;
+
+    free(cand);
+    free(covered);
+    return groupNum;
+}
+
+/*********************************************************************
+ * @fn      groups_print
+ *
+ * @brief   Print every group and its members
+ *
+ * @param   fp - where to print
+ *
+ * @return  none
+ */
+void groups_print(FILE *fp)
+{
+    group_t *group;
+    u32 i, j;
+
+    fprintf(fp, "Groups: %u\n", groups_v->num);
+    for (i = 0; i < groups_v->num; i++) {
+        group = &groups_v->tbl[i];
+        fprintf(fp, "    0x%04x (%u):", group->groupId, group->memberNum);
+        for (j = 0; j < group->memberNum; j++) {
+            fprintf(fp, " 0x%04x", group->members[j]);
+        }
+        fprintf(fp, "\n");
+    }
+    fprintf(fp, "\n");
+}
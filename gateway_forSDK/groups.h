@@ -0,0 +1,53 @@
+#ifndef  __GROUPS_H__
+#define  __GROUPS_H__
+
+#include <stdio.h>
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* Initial capacity of the group table and of a member list, both
+ * double when full */
+#define GROUPS_TBL_INIT_SIZE            16
+#define GROUPS_MEMBERS_INIT_SIZE        8
+
+/* A groupcast is a network wide broadcast, smaller groups are cheaper
+ * to reach by unicast */
+#define GROUPS_MIN_CAST_MEMBERS         3
+
+/*********************************************************************
+ * ENUMS
+ */
+
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+/* Members of a group as reported by the devices themselves */
+typedef struct {
+    u16 groupId;
+    u16 memberNum;
+    u16 memberSize;
+    u16 *members;                     //!< Network addresses, sorted
+} group_t;
+
+
+/*********************************************************************
+ * Public Functions
+ */
+void groups_reset(void);
+int  groups_addMember(u16 groupId, u16 nwkAddr);
+void groups_removeMember(u16 groupId, u16 nwkAddr);
+void groups_setMembership(u16 nwkAddr, const u16 *groupIds, u32 num);
+void groups_removeNode(u16 nwkAddr);
+void groups_renameNode(u16 oldAddr, u16 newAddr);
+const group_t* groups_get(u16 groupId);
+u32  groups_cover(u16 *addrs, u32 *num, u16 *groupIds, u32 maxGroups);
+void groups_print(FILE *fp);
+
+#endif  /* __GROUPS_H__ */
@@ -0,0 +1,388 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "log.h"
+#include "swTimer.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* Output is collected and written in blocks of this size */
+#define LOG_OUT_BUF_SIZE                16384
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+typedef struct {
+    u64 timeUs;
+    u8 mod;
+    u8 level;
+    u16 len;
+    char text[LOG_REC_TEXT_LEN];
+} log_rec_t;
+
+/*
+ * Single producer (the main loop), single consumer (the writer thread)
+ * ring. head is only written by the producer and tail only by the
+ * consumer, so the indexes need ordering but no locks.
+ */
+typedef struct {
+    log_rec_t ring[LOG_RING_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint dropped;
+    atomic_int running;
+    pthread_t writer;
+    u64 startUs;
+    char out[LOG_OUT_BUF_SIZE];
+} log_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+log_ctrl_t log_vs;
+log_ctrl_t *log_v = &log_vs;
+
+u8 log_levels[LOG_MOD_NUM] = {
+    [LOG_MOD_SOC]    = LOG_LEVEL_INFO,
+    [LOG_MOD_SERVER] = LOG_LEVEL_INFO,
+    [LOG_MOD_APP]    = LOG_LEVEL_INFO,
+    [LOG_MOD_NODES]  = LOG_LEVEL_INFO,
+    [LOG_MOD_CLI]    = LOG_LEVEL_INFO,
+};
+
+static const char *log_modNames[LOG_MOD_NUM] = {
+    [LOG_MOD_SOC]    = "soc",
+    [LOG_MOD_SERVER] = "server",
+    [LOG_MOD_APP]    = "app",
+    [LOG_MOD_NODES]  = "nodes",
+    [LOG_MOD_CLI]    = "cli",
+};
+
+static const char *log_levelNames[] = {
+    [LOG_LEVEL_NONE]  = "none",
+    [LOG_LEVEL_ERROR] = "error",
+    [LOG_LEVEL_WARN]  = "warn",
+    [LOG_LEVEL_INFO]  = "info",
+    [LOG_LEVEL_DEBUG] = "debug",
+};
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* None */
+
+
+/*********************************************************************
+ * @fn      log_writeOut
+ *
+ * @brief   Write a block of text to stdout
+ *
+ * @param   buf - the text
+ * @param   len - length of text
+ *
+ * @return  none
+ */
+static void log_writeOut(const char *buf, u32 len)
+{
+    int n;
+
+    while (len) {
+        n = write(STDOUT_FILENO, buf, len);
+        if (n <= 0) {
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+/*********************************************************************
+ * @fn      log_drain
+ *
+ * @brief   Format and write all queued records
+ *
+ * @param   none
+ *
+ * @return  number of records written
+ */
+static u32 log_drain(void)
+{
+    u32 tail = atomic_load_explicit(&log_v->tail, memory_order_relaxed);
+    u32 head = atomic_load_explicit(&log_v->head, memory_order_acquire);
+    u32 dropped, num = 0, outLen = 0;
+    log_rec_t *rec;
+
+    while (tail != head) {
+        if (outLen > LOG_OUT_BUF_SIZE - LOG_REC_TEXT_LEN - 64) {
+            log_writeOut(log_v->out, outLen);
+            outLen = 0;
+        }
+
+        rec = &log_v->ring[tail & (LOG_RING_SIZE - 1)];
+        outLen += snprintf(log_v->out + outLen, LOG_OUT_BUF_SIZE - outLen, "[%5u.%06u] %-6s %c: %.*s\n",
+                           (u32)(rec->timeUs / 1000000), (u32)(rec->timeUs % 1000000),
+                           log_modNames[rec->mod], "-EWID"[rec->level], rec->len, rec->text);
+
+        tail++;
+        num++;
+        atomic_store_explicit(&log_v->tail, tail, memory_order_release);
+        if (tail == head) {
+            head = atomic_load_explicit(&log_v->head, memory_order_acquire);
+        }
+    }
+
+    dropped = atomic_exchange_explicit(&log_v->dropped, 0, memory_order_relaxed);
+    if (dropped) {
+        outLen += snprintf(log_v->out + outLen, LOG_OUT_BUF_SIZE - outLen, "log: %u records dropped\n", dropped);
+    }
+
+    if (outLen) {
+        log_writeOut(log_v->out, outLen);
+    }
+    return num;
+}
+
+/*********************************************************************
+ * @fn      log_writerThread
+ *
+ * @brief   Background writer, keeps console I/O out of the main loop
+ *
+ * @param   arg - unused
+ *
+ * @return  NULL
+ */
+static void* log_writerThread(void *arg)
+{
+    while (atomic_load_explicit(&log_v->running, memory_order_acquire)) {
+        if (log_drain() == 0) {
+            usleep(LOG_WRITER_IDLE_US);
+        }
+    }
+
+    log_drain();
+    return NULL;
+}
+
+/*********************************************************************
+ * @fn      log_init
+ *
+ * @brief   Start the writer thread. Records made before are kept and
+ *          written once it runs.
+ *
+ * @param   none
+ *
+ * @return  0 on success, -1 on error
+ */
+int log_init(void)
+{
+    log_v->startUs = swTimer_nowUs();
+    atomic_store(&log_v->running, 1);
+
+    if (pthread_create(&log_v->writer, NULL, log_writerThread, NULL) != 0) {
+        atomic_store(&log_v->running, 0);
+        perror("log: writer thread");
+        return -1;
+    }
+
+    atexit(log_close);
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      log_close
+ *
+ * @brief   Write what is queued and stop the writer thread
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void log_close(void)
+{
+    if (atomic_exchange(&log_v->running, 0)) {
+        pthread_join(log_v->writer, NULL);
+    }
+}
+
+/*********************************************************************
+ * @fn      log_alloc
+ *
+ * @brief   Get the next free record of the ring
+ *
+ * @param   mod - module of the record
+ * @param   level - level of the record
+ *
+ * @return  the record, NULL if the ring is full
+ */
+static log_rec_t* log_alloc(u8 mod, u8 level)
+{
+    u32 head = atomic_load_explicit(&log_v->head, memory_order_relaxed);
+    u32 tail = atomic_load_explicit(&log_v->tail, memory_order_acquire);
+    log_rec_t *rec;
+
+    if (head - tail >= LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&log_v->dropped, 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    rec = &log_v->ring[head & (LOG_RING_SIZE - 1)];
+    rec->timeUs = swTimer_nowUs() - log_v->startUs;
+    rec->mod = mod;
+    rec->level = level;
+    return rec;
+}
+
+/*********************************************************************
+ * @fn      log_commit
+ *
+ * @brief   Hand a filled record to the writer
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void log_commit(void)
+{
+    atomic_store_explicit(&log_v->head, atomic_load_explicit(&log_v->head, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+/*********************************************************************
+ * @fn      log_write
+ *
+ * @brief   Queue a formatted record, use the LOG_xxx macros instead
+ *
+ * @param   mod - module of the record
+ * @param   level - level of the record
+ * @param   fmt - printf format
+ *
+ * @return  none
+ */
+void log_write(u8 mod, u8 level, const char *fmt, ...)
+{
+    log_rec_t *rec = log_alloc(mod, level);
+    va_list ap;
+    int n;
+
+    if (!rec) {
+        return;
+    }
+
+    va_start(ap, fmt);
+    n = vsnprintf(rec->text, LOG_REC_TEXT_LEN, fmt, ap);
+    va_end(ap);
+
+    rec->len = (n < 0) ? 0 : (n >= LOG_REC_TEXT_LEN) ? LOG_REC_TEXT_LEN - 1 : n;
+    log_commit();
+}
+
+/*********************************************************************
+ * @fn      log_hex
+ *
+ * @brief   Queue a hex dump record, use LOG_HEX instead
+ *
+ * @param   mod - module of the record
+ * @param   level - level of the record
+ * @param   title - printed before the bytes
+ * @param   buf - the bytes
+ * @param   len - number of bytes
+ *
+ * @return  none
+ */
+void log_hex(u8 mod, u8 level, const char *title, const u8 *buf, u32 len)
+{
+    static const char hex[] = "0123456789abcdef";
+    log_rec_t *rec = log_alloc(mod, level);
+    u32 pos, i;
+
+    if (!rec) {
+        return;
+    }
+
+    pos = snprintf(rec->text, LOG_REC_TEXT_LEN, "%s (%u):", title, len);
+    if (pos >= LOG_REC_TEXT_LEN) {
+        pos = LOG_REC_TEXT_LEN - 1;
+    }
+
+    for (i = 0; i < len && pos + 3 <= LOG_REC_TEXT_LEN - 4; i++) {
+        rec->text[pos++] = ' ';
+        rec->text[pos++] = hex[buf[i] >> 4];
+        rec->text[pos++] = hex[buf[i] & 0x0F];
+    }
+    if (i < len) {
+        memcpy(&rec->text[pos], " ..", 3);
+        pos += 3;
+    }
+
+    rec->len = pos;
+    log_commit();
+}
+
+/*********************************************************************
+ * @fn      log_setLevel
+ *
+ * @brief   Set the runtime level of a module
+ *
+ * @param   mod - the module, LOG_MOD_NUM for all modules
+ * @param   level - records up to this level are written
+ *
+ * @return  none
+ */
+void log_setLevel(u8 mod, u8 level)
+{
+    u8 i;
+
+    for (i = 0; i < LOG_MOD_NUM; i++) {
+        if (mod == LOG_MOD_NUM || mod == i) {
+            log_levels[i] = level;
+        }
+    }
+}
+
+/*********************************************************************
+ * @fn      log_setLevelByName
+ *
+ * @brief   Set the runtime level of a module by names, for the console
+ *
+ * @param   modName - "soc", "server", "app", "nodes", "cli" or "all"
+ * @param   levelName - "none", "error", "warn", "info" or "debug"
+ *
+ * @return  0 on success, -1 if a name is unknown
+ */
+int log_setLevelByName(const char *modName, const char *levelName)
+{
+    u8 mod, level;
+
+    for (mod = 0; mod < LOG_MOD_NUM; mod++) {
+        if (!strcmp(modName, log_modNames[mod])) {
+            break;
+        }
+    }
+    if (mod == LOG_MOD_NUM && strcmp(modName, "all")) {
+        return -1;
+    }
+
+    for (level = 0; level <= LOG_LEVEL_DEBUG; level++) {
+        if (!strcmp(levelName, log_levelNames[level])) {
+            log_setLevel(mod, level);
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,92 @@
+#ifndef  __LOG_H__
+#define  __LOG_H__
+
+#include "types.h"
+#include "config.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* Records above this level are compiled out */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL               LOG_LEVEL_DEBUG
+#endif
+
+/* Records waiting for the writer, a power of two. Records are dropped,
+ * never waited for, when it is full. */
+#define LOG_RING_SIZE                   1024
+
+/* Text of a record beyond this is cut off */
+#define LOG_REC_TEXT_LEN                232
+
+/* Pause of the writer when there is nothing to write */
+#define LOG_WRITER_IDLE_US              5000
+
+/*********************************************************************
+ * ENUMS
+ */
+enum {
+    LOG_LEVEL_NONE,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG,
+};
+
+enum {
+    LOG_MOD_SOC,
+    LOG_MOD_SERVER,
+    LOG_MOD_APP,
+    LOG_MOD_NODES,
+    LOG_MOD_CLI,
+
+    LOG_MOD_NUM,
+};
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+/* Runtime level of each module, read inline by the macros below */
+extern u8 log_levels[LOG_MOD_NUM];
+
+/*
+ * A record costs one compare when its level is off at run time and
+ * nothing at all when it is above LOG_COMPILE_LEVEL. The arguments are
+ * not evaluated in either case.
+ */
+#define LOG_ON(mod, lvl)    ((lvl) <= LOG_COMPILE_LEVEL && (lvl) <= log_levels[mod])
+
+#define LOG(mod, lvl, ...) \
+    do { \
+        if (LOG_ON(mod, lvl)) { \
+            log_write(mod, lvl, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_ERR(mod, ...)       LOG(mod, LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(mod, ...)      LOG(mod, LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(mod, ...)      LOG(mod, LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(mod, ...)     LOG(mod, LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#define LOG_HEX(mod, lvl, title, buf, len) \
+    do { \
+        if (LOG_ON(mod, lvl)) { \
+            log_hex(mod, lvl, title, buf, len); \
+        } \
+    } while (0)
+
+
+/*********************************************************************
+ * Public Functions
+ */
+int  log_init(void);
+void log_close(void);
+void log_write(u8 mod, u8 level, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+void log_hex(u8 mod, u8 level, const char *title, const u8 *buf, u32 len);
+void log_setLevel(u8 mod, u8 level);
+int  log_setLevelByName(const char *modName, const char *levelName);
+
+#endif  /* __LOG_H__ */
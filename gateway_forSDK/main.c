@@ -4,17 +4,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
-#include <poll.h>
+#include <unistd.h>
 
+#include "config.h"
 #include "socCmd.h"
+#include "socTx.h"
+#include "evLoop.h"
+#include "swTimer.h"
+#include "trans.h"
 #include "server.h"
+#include "cli.h"
 #include "nodes.h"
+#include "nodeDb.h"
+#include "log.h"
+#include "capture.h"
+#include "stats.h"
+#include "sched.h"
+#include "socLink.h"
 
 /**********************************************************************
  * LOCAL CONSTANTS
  */
 
-#define MAX_POLL_FD_NUM           10
+/* None */
 
 /**********************************************************************
  * LOCAL TYPES
@@ -27,13 +39,14 @@
  * LOCAL VARIABLES
  */
 
-struct pollfd pollFds[MAX_POLL_FD_NUM];
+/* None */
 
 
 /**********************************************************************
  * LOCAL FUNCTIONS
  */
 void usage( char* exeName );
+static void main_stdinEvent(int fd, u32 events, void *arg);
 
 
 /**********************************************************************
@@ -45,30 +58,83 @@ int main(int argc, char* argv[])
     int retval = 0;
     int soc_fd;
     int server_fd;
-    int clients_fd[10];
-    int clients_num = 0;
-    int i;
+    int opt;
+    u32 baud = 0;
+    u16 port = SERVER_LISTEN_PORT;
+    u32 maxConn = SERVER_MAX_CONN_NUM;
+    u32 txHighWater = SERVER_CONN_TX_HIGH_WATER;
+    u32 txStallMs = SERVER_CONN_TX_STALL_MS;
+    char *capPath = NULL;
 
     printf("%s -- %s %s\n", argv[0], __DATE__, __TIME__ );
 
-    if( argc != 2 ) {
+    log_init();
+    stats_reset();
+    sched_init(SCHED_MAX_RATE);
+    socLink_init(SOC_LINK_KEEPALIVE_MS);
+
+    while ((opt = getopt(argc, argv, "b:c:k:m:p:q:r:s:")) != -1) {
+        if (opt == 'r') {
+            sched_init(atoi(optarg));
+        } else if (opt == 'b') {
+            baud = atoi(optarg);
+        } else if (opt == 'k') {
+            socLink_init(atoi(optarg));
+        } else if (opt == 'c') {
+            capPath = optarg;
+        } else if (opt == 'm') {
+            maxConn = atoi(optarg);
+        } else if (opt == 'p') {
+            port = atoi(optarg);
+        } else if (opt == 'q') {
+            txHighWater = atoi(optarg);
+        } else if (opt == 's') {
+            txStallMs = atoi(optarg);
+        } else {
+            usage(argv[0]);
+            exit(-1);
+        }
+    }
+
+    /* The serial port is polled from the time it is set up */
+    if (evLoop_init() != 0) {
+        exit(-1);
+    }
+
+    /* Frames read while the rate is negotiated already reach the
+     * handlers, a running coordinator announces devices at any time */
+    nodes_reset();
+    trans_init();
+    nodeDb_open(NODE_DB_PATH);
+    server_init();
+    server_setPort(port);
+    server_setMaxConn(maxConn);
+    server_setTxLimits(txHighWater, txStallMs);
+
+    if( optind != argc - 1 ) {
         usage(argv[0]);
         printf("attempting to use /dev/ttyACM0\n");
-        soc_fd = socOpen( "/dev/ttyACM0" );
+        soc_fd = socOpen( "/dev/ttyACM0", baud );
     } else {
-        soc_fd = socOpen( argv[1] );
+        soc_fd = socOpen( argv[optind], baud );
     }
 
     if( soc_fd == -1 ) {
         exit(-1);
     }
 
-    nodes_reset();
-    server_init();
+    /* Started after the link is negotiated, a replay runs at a fixed rate */
+    if (capPath && capture_open(capPath) != 0) {
+        exit(-1);
+    }
+
     server_fd = server_open();
     if( server_fd == -1 ) {
         exit(-1);
     }
+    if (stats_open(STATS_SOCKET_PATH) != 0) {
+        printf("stats socket %s not available\n", STATS_SOCKET_PATH);
+    }
 
     //zllSocRegisterCallbacks( zllSocCbs );
 
@@ -79,50 +145,23 @@ int main(int argc, char* argv[])
     //savedValue = 0x0;
     //savedTransitionTime = 0x1;
 
-    while(1) {
-        //set the zllSoC serial port FD in the poll file descriptors
-        pollFds[0].fd = soc_fd;
-        pollFds[0].events = POLLIN;
-
-        //set the stdin FD in the poll file descriptors
-        pollFds[1].fd = 0; //stdin
-        pollFds[1].events = POLLIN;
-
-        //set the Tcp Server FD in the poll file descriptors
-        pollFds[2].fd = server_fd; //stdin
-        pollFds[2].events = POLLIN;
-
-        clients_num = 0;
-        socketPool_get(clients_fd, &clients_num);
-
-        for(i = 3; i < 3 + clients_num; i++) {
-            pollFds[i].fd = clients_fd[i-3];
-            pollFds[i].events = POLLIN;
-        }
+    /* The console reads one line per call, keep it level triggered */
+    if (evLoop_add(0, EPOLLIN, main_stdinEvent, NULL) != 0) {
+        printf("stdin can not be polled, console disabled\n");
+    }
 
-        poll(pollFds, 3 + clients_num, -1);
+    while(1) {
+        evLoop_poll(swTimer_nextTimeout());
 
-        //did the poll unblock because of the zllSoC serial?
-        if(pollFds[0].revents) {
-            processSocCmd();
-        }
-        //did the poll unblock because of the stdin?
-        else if(pollFds[1].revents) {
-            processConsoleCommand();
-        }
-        else if (pollFds[2].revents) {
-            server_acceptNewConn();
-        }
-        else {
-            for(i = 3; i < 3 + clients_num; i++) {
-                if (pollFds[i].revents) {
-                    processTcpCmd(clients_fd[i-3]);
-                }
-            }
+        swTimer_process();
 
+        /* Frames queued by this round of events, UART edges only tell
+         * about space freed after a short write */
+        if (socTx_pending()) {
+            socTx_flush();
         }
 
-        usleep(10);
+        stats_histAdd(&stats_v->loop, (u32)(swTimer_nowUs() - evLoop_wakeUs()));
     }
 
     return retval;
@@ -130,9 +169,37 @@ int main(int argc, char* argv[])
 }
 
 
+/*********************************************************************
+ * @fn      main_stdinEvent
+ *
+ * @brief   Event callback of the console
+ *
+ * @param   fd - stdin
+ * @param   events - ready events
+ * @param   arg - unused
+ *
+ * @return  none
+ */
+static void main_stdinEvent(int fd, u32 events, void *arg)
+{
+    processConsoleCommand();
+}
+
 void usage( char* exeName )
 {
-    printf("Usage: ./%s <port>\n", exeName);
+    printf("Usage: ./%s [-b baud] [-c capture] [-k ms] [-m num] [-p tcpport] [-q bytes] [-r rate] [-s ms] <port>\n", exeName);
+    printf("  -b baud     rate of the UART, 0 to take the fastest one the coordinator answers at (default 0)\n");
+    printf("  -c capture  record all SoC and App frames to a file, see replay\n");
+    printf("  -k ms       ping the coordinator after this long without a frame from it, 0 never; only if it\n"
+           "              answered the rate probe (default %d)\n",
+           SOC_LINK_KEEPALIVE_MS);
+    printf("  -m num      most Apps connected at a time (default %d)\n", SERVER_MAX_CONN_NUM);
+    printf("  -p tcpport  TCP port the Apps connect to (default %d)\n", SERVER_LISTEN_PORT);
+    printf("  -q bytes    most unsent bytes an App may have before it is dropped (default %d)\n",
+           SERVER_CONN_TX_HIGH_WATER);
+    printf("  -r rate     most frames per second sent into the mesh, 0 for no pacing (default %d)\n", SCHED_MAX_RATE);
+    printf("  -s ms       longest time an App may take none of its output before it is dropped (default %d)\n",
+           SERVER_CONN_TX_STALL_MS);
     printf("Eample: ./%s /dev/ttyACM0\n", exeName);
 }
 
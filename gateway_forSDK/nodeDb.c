@@ -0,0 +1,510 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "nodeDb.h"
+#include "swTimer.h"
+#include "log.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+#define NODE_DB_MAX_PATH                256
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+/*
+ * The node list is stored as a snapshot plus an append-only journal of
+ * add/remove records. Both are replayed at start up, a torn record at the
+ * end of the journal (crash during write) is cut off. When the journal
+ * grows, a new snapshot is written next to the old one and renamed over
+ * it before the journal is emptied, so a crash at any point leaves a
+ * consistent pair behind.
+ */
+typedef struct {
+    char snapPath[NODE_DB_MAX_PATH];
+    char jnlPath[NODE_DB_MAX_PATH];
+    char tmpPath[NODE_DB_MAX_PATH];
+    int jnlFd;
+    u32 jnlRecs;
+    u8 loading;
+    u8 dirty;                         //!< Journal has writes not yet synced
+    swTimer_t syncTimer;
+} nodeDb_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+nodeDb_ctrl_t nodeDb_vs = { .jnlFd = -1 };
+nodeDb_ctrl_t *nodeDb_v = &nodeDb_vs;
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static void nodeDb_compact(void);
+
+
+/*********************************************************************
+ * @fn      nodeDb_crc32
+ *
+ * @brief   CRC-32 (IEEE 802.3) of a buffer
+ *
+ * @param   crc - initial value, 0 to start
+ * @param   buf - the data
+ * @param   len - length of data
+ *
+ * @return  the CRC
+ */
+static u32 nodeDb_crc32(u32 crc, const u8 *buf, u32 len)
+{
+    int i;
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+/*********************************************************************
+ * @fn      nodeDb_fillRec
+ *
+ * @brief   Build the on-disk image of a node
+ *
+ * @param   rec - the record to fill
+ * @param   entry - the node
+ *
+ * @return  none
+ */
+static void nodeDb_fillRec(nodeDb_rec_t *rec, nodeInfo_t *entry)
+{
+    rec->nwkAddr = entry->nwkAddr;
+    memcpy(rec->extAddr, entry->extAddr, 8);
+    rec->devId = entry->devId;
+    rec->endpoint = entry->endpoint;
+    rec->capability = entry->capability;
+    rec->devType = entry->devType;
+}
+
+/*********************************************************************
+ * @fn      nodeDb_apply
+ *
+ * @brief   Apply a stored record to the node list
+ *
+ * @param   op - NODE_DB_OP_ADD or NODE_DB_OP_REMOVE
+ * @param   rec - the record
+ *
+ * @return  none
+ */
+static void nodeDb_apply(u8 op, nodeDb_rec_t *rec)
+{
+    nodeInfo_t *entry;
+
+    if (op == NODE_DB_OP_ADD) {
+        nodes_add(rec->nwkAddr, rec->extAddr, rec->capability, rec->devId, rec->endpoint);
+    } else if (op == NODE_DB_OP_REMOVE) {
+        entry = nodes_searchByExt(rec->extAddr);
+        if (entry) {
+            nodes_remove(entry->nwkAddr);
+        }
+    }
+}
+
+/*********************************************************************
+ * @fn      nodeDb_readFile
+ *
+ * @brief   Read a whole file into memory
+ *
+ * @param   fd - the file
+ * @param   len - returns the file length
+ *
+ * @return  the data (to be freed), NULL if empty or on error
+ */
+static u8* nodeDb_readFile(int fd, u32 *len)
+{
+    struct stat st;
+    u8 *buf;
+    ssize_t n;
+    u32 got = 0;
+
+    *len = 0;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        return NULL;
+    }
+
+    buf = malloc(st.st_size);
+    if (!buf) {
+        return NULL;
+    }
+
+    while (got < st.st_size) {
+        n = pread(fd, buf + got, st.st_size - got, got);
+        if (n <= 0) {
+            break;
+        }
+        got += n;
+    }
+
+    *len = got;
+    return buf;
+}
+
+/*********************************************************************
+ * @fn      nodeDb_loadSnapshot
+ *
+ * @brief   Load the node list from the snapshot file
+ *
+ * @param   none
+ *
+ * @return  number of nodes loaded
+ */
+static u32 nodeDb_loadSnapshot(void)
+{
+    nodeDb_hdr_t *hdr;
+    nodeDb_rec_t *recs;
+    u32 len, i, count = 0;
+    u8 *buf;
+    int fd;
+
+    fd = open(nodeDb_v->snapPath, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    buf = nodeDb_readFile(fd, &len);
+    close(fd);
+    if (!buf) {
+        return 0;
+    }
+
+    hdr = (nodeDb_hdr_t*)buf;
+    recs = (nodeDb_rec_t*)(buf + sizeof(nodeDb_hdr_t));
+    if (len < sizeof(nodeDb_hdr_t) ||
+        hdr->magic != NODE_DB_MAGIC ||
+        hdr->version != NODE_DB_VERSION ||
+        hdr->recSize != sizeof(nodeDb_rec_t) ||
+        len - sizeof(nodeDb_hdr_t) < (u64)hdr->count * sizeof(nodeDb_rec_t) ||
+        hdr->crc != nodeDb_crc32(0, (u8*)recs, hdr->count * sizeof(nodeDb_rec_t))) {
+        LOG_WARN(LOG_MOD_NODES, "nodeDb: %s is corrupted, ignored", nodeDb_v->snapPath);
+    } else {
+        count = hdr->count;
+        for (i = 0; i < count; i++) {
+            nodeDb_apply(NODE_DB_OP_ADD, &recs[i]);
+        }
+    }
+
+    free(buf);
+    return count;
+}
+
+/*********************************************************************
+ * @fn      nodeDb_openJournal
+ *
+ * @brief   Open the journal, replay its valid records and cut off
+ *          anything after the first invalid one
+ *
+ * @param   none
+ *
+ * @return  0 on success, -1 on error
+ */
+static int nodeDb_openJournal(void)
+{
+    nodeDb_hdr_t hdr;
+    nodeDb_jnlRec_t *rec;
+    u32 len, off;
+    u8 *buf;
+    int fd;
+
+    fd = open(nodeDb_v->jnlPath, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(nodeDb_v->jnlPath);
+        return -1;
+    }
+
+    nodeDb_v->jnlRecs = 0;
+    buf = nodeDb_readFile(fd, &len);
+    off = 0;
+
+    if (buf && len >= sizeof(nodeDb_hdr_t) &&
+        ((nodeDb_hdr_t*)buf)->magic == NODE_DB_JNL_MAGIC &&
+        ((nodeDb_hdr_t*)buf)->version == NODE_DB_VERSION &&
+        ((nodeDb_hdr_t*)buf)->recSize == sizeof(nodeDb_rec_t)) {
+        off = sizeof(nodeDb_hdr_t);
+        while (off + sizeof(nodeDb_jnlRec_t) <= len) {
+            rec = (nodeDb_jnlRec_t*)(buf + off);
+            if (rec->crc != nodeDb_crc32(0, buf + off, sizeof(nodeDb_jnlRec_t) - sizeof(u32))) {
+                break;
+            }
+            nodeDb_apply(rec->op, &rec->rec);
+            nodeDb_v->jnlRecs++;
+            off += sizeof(nodeDb_jnlRec_t);
+        }
+        if (off != len) {
+            LOG_WARN(LOG_MOD_NODES, "nodeDb: dropping %u bytes of torn journal", len - off);
+        }
+    }
+    free(buf);
+
+    if (off == 0) {
+        /* New or unusable journal, start over */
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.magic = NODE_DB_JNL_MAGIC;
+        hdr.version = NODE_DB_VERSION;
+        hdr.recSize = sizeof(nodeDb_rec_t);
+        if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+            perror(nodeDb_v->jnlPath);
+            close(fd);
+            return -1;
+        }
+        off = sizeof(hdr);
+    }
+
+    if (ftruncate(fd, off) != 0 || lseek(fd, off, SEEK_SET) < 0) {
+        perror(nodeDb_v->jnlPath);
+        close(fd);
+        return -1;
+    }
+    fdatasync(fd);
+
+    nodeDb_v->jnlFd = fd;
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      nodeDb_open
+ *
+ * @brief   Load the node list from disk and start journaling changes
+ *
+ * @param   path - path of the snapshot, the journal gets a .jnl suffix
+ *
+ * @return  0 on success, -1 if changes cannot be persisted
+ */
+int nodeDb_open(const char *path)
+{
+    u64 start = swTimer_nowUs();
+    u32 snapNum;
+
+    snprintf(nodeDb_v->snapPath, NODE_DB_MAX_PATH, "%s", path);
+    snprintf(nodeDb_v->jnlPath, NODE_DB_MAX_PATH, "%s.jnl", path);
+    snprintf(nodeDb_v->tmpPath, NODE_DB_MAX_PATH, "%s.tmp", path);
+
+    nodeDb_v->loading = TRUE;
+    snapNum = nodeDb_loadSnapshot();
+    if (nodeDb_openJournal() != 0) {
+        nodeDb_v->loading = FALSE;
+        return -1;
+    }
+    nodeDb_v->loading = FALSE;
+
+    LOG_INFO(LOG_MOD_NODES, "nodeDb: %u nodes loaded (%u from snapshot, %u journal records) in %u us",
+           nodes_curNum(), snapNum, nodeDb_v->jnlRecs, (u32)(swTimer_nowUs() - start));
+
+    if (nodeDb_v->jnlRecs > NODE_DB_MIN_COMPACT_RECS) {
+        nodeDb_compact();
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      nodeDb_sync
+ *
+ * @brief   Make all journal writes durable
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void nodeDb_sync(void)
+{
+    swTimer_stop(&nodeDb_v->syncTimer);
+    if (nodeDb_v->dirty && nodeDb_v->jnlFd >= 0) {
+        fdatasync(nodeDb_v->jnlFd);
+    }
+    nodeDb_v->dirty = FALSE;
+}
+
+/*********************************************************************
+ * @fn      nodeDb_syncTimerCb
+ *
+ * @brief   Batched journal sync
+ *
+ * @param   arg - unused
+ *
+ * @return  none
+ */
+static void nodeDb_syncTimerCb(void *arg)
+{
+    nodeDb_sync();
+}
+
+/*********************************************************************
+ * @fn      nodeDb_close
+ *
+ * @brief   Sync and close the journal
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void nodeDb_close(void)
+{
+    nodeDb_sync();
+    if (nodeDb_v->jnlFd >= 0) {
+        close(nodeDb_v->jnlFd);
+        nodeDb_v->jnlFd = -1;
+    }
+}
+
+/*********************************************************************
+ * @fn      nodeDb_compact
+ *
+ * @brief   Write the whole node list to a new snapshot and empty the
+ *          journal
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void nodeDb_compact(void)
+{
+    nodeDb_hdr_t *hdr;
+    nodeDb_rec_t *recs;
+    u32 num = nodes_curNum();
+    u32 len = sizeof(nodeDb_hdr_t) + num * sizeof(nodeDb_rec_t);
+    u32 i;
+    u8 *buf;
+    int fd;
+
+    buf = malloc(len);
+    if (!buf) {
+        return;
+    }
+
+    hdr = (nodeDb_hdr_t*)buf;
+    recs = (nodeDb_rec_t*)(buf + sizeof(nodeDb_hdr_t));
+    for (i = 0; i < num; i++) {
+        nodeDb_fillRec(&recs[i], nodes_get(i));
+    }
+    hdr->magic = NODE_DB_MAGIC;
+    hdr->version = NODE_DB_VERSION;
+    hdr->recSize = sizeof(nodeDb_rec_t);
+    hdr->count = num;
+    hdr->crc = nodeDb_crc32(0, (u8*)recs, num * sizeof(nodeDb_rec_t));
+
+    fd = open(nodeDb_v->tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(nodeDb_v->tmpPath);
+        free(buf);
+        return;
+    }
+    if (write(fd, buf, len) != len || fsync(fd) != 0) {
+        perror(nodeDb_v->tmpPath);
+        close(fd);
+        unlink(nodeDb_v->tmpPath);
+        free(buf);
+        return;
+    }
+    close(fd);
+    free(buf);
+
+    if (rename(nodeDb_v->tmpPath, nodeDb_v->snapPath) != 0) {
+        perror(nodeDb_v->snapPath);
+        return;
+    }
+
+    /* The snapshot now holds everything, the journal can go */
+    if (ftruncate(nodeDb_v->jnlFd, sizeof(nodeDb_hdr_t)) == 0) {
+        lseek(nodeDb_v->jnlFd, sizeof(nodeDb_hdr_t), SEEK_SET);
+        fdatasync(nodeDb_v->jnlFd);
+        nodeDb_v->jnlRecs = 0;
+        nodeDb_v->dirty = FALSE;
+        swTimer_stop(&nodeDb_v->syncTimer);
+    }
+}
+
+/*********************************************************************
+ * @fn      nodeDb_append
+ *
+ * @brief   Append a record to the journal, the sync is batched
+ *
+ * @param   op - NODE_DB_OP_ADD or NODE_DB_OP_REMOVE
+ * @param   entry - the node
+ *
+ * @return  none
+ */
+static void nodeDb_append(u8 op, nodeInfo_t *entry)
+{
+    nodeDb_jnlRec_t rec;
+    u32 limit;
+
+    if (nodeDb_v->loading || nodeDb_v->jnlFd < 0) {
+        return;
+    }
+
+    rec.op = op;
+    nodeDb_fillRec(&rec.rec, entry);
+    rec.crc = nodeDb_crc32(0, (u8*)&rec, sizeof(rec) - sizeof(u32));
+
+    if (write(nodeDb_v->jnlFd, &rec, sizeof(rec)) != sizeof(rec)) {
+        perror(nodeDb_v->jnlPath);
+        return;
+    }
+    nodeDb_v->jnlRecs++;
+
+    if (!nodeDb_v->dirty) {
+        nodeDb_v->dirty = TRUE;
+        swTimer_start(&nodeDb_v->syncTimer, NODE_DB_SYNC_DELAY_MS, nodeDb_syncTimerCb, NULL);
+    }
+
+    limit = nodes_curNum() * 2;
+    if (limit < NODE_DB_MIN_COMPACT_RECS) {
+        limit = NODE_DB_MIN_COMPACT_RECS;
+    }
+    if (nodeDb_v->jnlRecs > limit) {
+        nodeDb_compact();
+    }
+}
+
+/*********************************************************************
+ * @fn      nodeDb_logAdd
+ *
+ * @brief   Persist a node which was added or changed
+ *
+ * @param   entry - the node
+ *
+ * @return  none
+ */
+void nodeDb_logAdd(nodeInfo_t *entry)
+{
+    nodeDb_append(NODE_DB_OP_ADD, entry);
+}
+
+/*********************************************************************
+ * @fn      nodeDb_logRemove
+ *
+ * @brief   Persist the removal of a node
+ *
+ * @param   entry - copy of the node, already out of the node list
+ *
+ * @return  none
+ */
+void nodeDb_logRemove(nodeInfo_t *entry)
+{
+    nodeDb_append(NODE_DB_OP_REMOVE, entry);
+}
@@ -0,0 +1,70 @@
+#ifndef  __NODE_DB_H__
+#define  __NODE_DB_H__
+
+#include "types.h"
+#include "nodes.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+#define NODE_DB_MAGIC                   0x42445747      //!< "GWDB"
+#define NODE_DB_JNL_MAGIC               0x4C4A5747      //!< "GWJL"
+#define NODE_DB_VERSION                 1
+
+/* Journal writes are made durable at most this long after they happen */
+#define NODE_DB_SYNC_DELAY_MS           200
+
+/* Rewrite the snapshot when the journal gets longer than this */
+#define NODE_DB_MIN_COMPACT_RECS        256
+
+/*********************************************************************
+ * ENUMS
+ */
+enum {
+    NODE_DB_OP_ADD = 1,               //!< Node added or updated
+    NODE_DB_OP_REMOVE,
+};
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+/* On-disk image of a node, little endian */
+#pragma pack(push, 1)
+typedef struct {
+    u16 nwkAddr;
+    u8 extAddr[8];
+    u16 devId;
+    u8 endpoint;
+    u8 capability;
+    u8 devType;
+} nodeDb_rec_t;
+
+typedef struct {
+    u32 magic;
+    u16 version;
+    u16 recSize;
+    u32 count;                        //!< Snapshot only, 0 in the journal
+    u32 crc;                          //!< CRC32 of the snapshot records
+} nodeDb_hdr_t;
+
+typedef struct {
+    u8 op;
+    nodeDb_rec_t rec;
+    u32 crc;                          //!< CRC32 of op and rec
+} nodeDb_jnlRec_t;
+#pragma pack(pop)
+
+
+/*********************************************************************
+ * Public Functions
+ */
+int  nodeDb_open(const char *path);
+void nodeDb_close(void);
+void nodeDb_logAdd(nodeInfo_t *entry);
+void nodeDb_logRemove(nodeInfo_t *entry);
+void nodeDb_sync(void);
+
+#endif  /* __NODE_DB_H__ */
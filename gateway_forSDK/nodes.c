@@ -6,23 +6,39 @@
 
 #include "appCmd.h"
 #include "nodes.h"
+#include "nodeDb.h"
+#include "groups.h"
+#include "attrCache.h"
+#include "log.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 /**********************************************************************
  * LOCAL CONSTANTS
  */
 
-/* None */
+/* Hash slot value of an unused slot, others hold node index + 1 */
+#define NODE_HASH_EMPTY                  0
 
 /**********************************************************************
  * LOCAL TYPES
  */
 
+/*
+ * Nodes are kept dense in nodeTbl[0 .. curNodeNum - 1] so iteration is a
+ * plain array walk. Two open addressing hash tables index them by network
+ * address and by extended address.
+ */
 typedef struct {
-	nodeInfo_t nodeTbl[MAX_NODE_NUM];
-	u8 curNodeNum;
+	nodeInfo_t *nodeTbl;
+	u32 tblSize;
+	u32 curNodeNum;
+	u32 *nwkHash;
+	u32 *extHash;
+	u32 hashSize;
 } node_ctrl_t;
 
 
@@ -36,7 +52,205 @@ node_ctrl_t *node_v = &node_vs;
 /**********************************************************************
  * LOCAL FUNCTIONS
  */
+static void nodes_hashInsert(u32 index);
+
+
+/*********************************************************************
+ * @fn      nodes_extToU64
+ *
+ * @brief   Load an extended address as a 64 bit integer
+ *
+ * @param   extAddr - 8 byte extended address
+ *
+ * @return  the address
+ */
+static u64 nodes_extToU64(const u8 *extAddr)
+{
+	u64 addr = 0;
+	int i;
+
+	for (i = 7; i >= 0; i--) {
+		addr = (addr << 8) | extAddr[i];
+	}
+	return addr;
+}
+
+/*********************************************************************
+ * @fn      nodes_nwkSlot
+ *
+ * @brief   Home slot of a network address in the hash table
+ *
+ * @param   nwkAddr
+ *
+ * @return  the slot
+ */
+static u32 nodes_nwkSlot(u16 nwkAddr)
+{
+	return ((u32)nwkAddr * 0x9E3779B1u) & (node_v->hashSize - 1);
+}
+
+/*********************************************************************
+ * @fn      nodes_extSlot
+ *
+ * @brief   Home slot of an extended address in the hash table
+ *
+ * @param   extAddr - the address as a 64 bit integer
+ *
+ * @return  the slot
+ */
+static u32 nodes_extSlot(u64 extAddr)
+{
+	extAddr ^= extAddr >> 33;
+	extAddr *= 0xFF51AFD7ED558CCDull;
+	extAddr ^= extAddr >> 33;
+	return (u32)extAddr & (node_v->hashSize - 1);
+}
+
+/*********************************************************************
+ * @fn      nodes_nwkFind
+ *
+ * @brief   Find the hash slot of a network address
+ *
+ * @param   nwkAddr
+ *
+ * @return  the slot, which holds NODE_HASH_EMPTY if the address is unknown
+ */
+static u32 nodes_nwkFind(u16 nwkAddr)
+{
+	u32 mask = node_v->hashSize - 1;
+	u32 slot = nodes_nwkSlot(nwkAddr);
+
+	while (node_v->nwkHash[slot] != NODE_HASH_EMPTY &&
+	       node_v->nodeTbl[node_v->nwkHash[slot] - 1].nwkAddr != nwkAddr) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+/*********************************************************************
+ * @fn      nodes_extFind
+ *
+ * @brief   Find the hash slot of an extended address
+ *
+ * @param   extAddr
+ *
+ * @return  the slot, which holds NODE_HASH_EMPTY if the address is unknown
+ */
+static u32 nodes_extFind(const u8 *extAddr)
+{
+	u32 mask = node_v->hashSize - 1;
+	u32 slot = nodes_extSlot(nodes_extToU64(extAddr));
+
+	while (node_v->extHash[slot] != NODE_HASH_EMPTY &&
+	       memcmp(node_v->nodeTbl[node_v->extHash[slot] - 1].extAddr, extAddr, 8)) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+/*********************************************************************
+ * @fn      nodes_hashErase
+ *
+ * @brief   Empty a slot of a linear probing table, moving back the
+ *          entries of the same probe run so lookups keep working
+ *
+ * @param   hash - nwkHash or extHash
+ * @param   slot - the slot to empty
+ * @param   isExt - TRUE for the extended address table
+ *
+ * @return  none
+ */
+static void nodes_hashErase(u32 *hash, u32 slot, u8 isExt)
+{
+	u32 mask = node_v->hashSize - 1;
+	u32 next = slot;
+	u32 home;
+	nodeInfo_t *entry;
+
+	hash[slot] = NODE_HASH_EMPTY;
+
+	while (1) {
+		next = (next + 1) & mask;
+		if (hash[next] == NODE_HASH_EMPTY) {
+			return;
+		}
+
+		entry = &node_v->nodeTbl[hash[next] - 1];
+		home = isExt ? nodes_extSlot(nodes_extToU64(entry->extAddr)) : nodes_nwkSlot(entry->nwkAddr);
+
+		/* Move back unless the home slot lies cyclically in (slot, next] */
+		if (((next - home) & mask) >= ((next - slot) & mask)) {
+			hash[slot] = hash[next];
+			hash[next] = NODE_HASH_EMPTY;
+			slot = next;
+		}
+	}
+}
+
+/*********************************************************************
+ * @fn      nodes_hashInsert
+ *
+ * @brief   Index a node in both hash tables
+ *
+ * @param   index - the node index in nodeTbl
+ *
+ * @return  none
+ */
+static void nodes_hashInsert(u32 index)
+{
+	nodeInfo_t *entry = &node_v->nodeTbl[index];
+
+	node_v->nwkHash[nodes_nwkFind(entry->nwkAddr)] = index + 1;
+	node_v->extHash[nodes_extFind(entry->extAddr)] = index + 1;
+}
+
+/*********************************************************************
+ * @fn      nodes_grow
+ *
+ * @brief   Double the node table, and rehash when the hash tables would
+ *          become more than half full
+ *
+ * @param   none
+ *
+ * @return  0 on success, -1 if out of memory
+ */
+static int nodes_grow(void)
+{
+	u32 newSize = node_v->tblSize ? node_v->tblSize * 2 : NODE_TBL_INIT_SIZE;
+	nodeInfo_t *tbl;
+	u32 *nwkHash, *extHash;
+	u32 i;
+
+	tbl = realloc(node_v->nodeTbl, newSize * sizeof(nodeInfo_t));
+	if (!tbl) {
+		return -1;
+	}
+	node_v->nodeTbl = tbl;
+	node_v->tblSize = newSize;
+
+	if (newSize * 2 <= node_v->hashSize) {
+		return 0;
+	}
+
+	nwkHash = calloc(newSize * 2, sizeof(u32));
+	extHash = calloc(newSize * 2, sizeof(u32));
+	if (!nwkHash || !extHash) {
+		free(nwkHash);
+		free(extHash);
+		return -1;
+	}
+
+	free(node_v->nwkHash);
+	free(node_v->extHash);
+	node_v->nwkHash = nwkHash;
+	node_v->extHash = extHash;
+	node_v->hashSize = newSize * 2;
 
+	for (i = 0; i < node_v->curNodeNum; i++) {
+		nodes_hashInsert(i);
+	}
+	return 0;
+}
 
 /*********************************************************************
  * @fn      nodes_reset
@@ -49,12 +263,14 @@ node_ctrl_t *node_v = &node_vs;
  */
 void nodes_reset(void)
 {
-    int i = 0;
-	node_v->curNodeNum = 0;
-
-	for(i = 0; i < MAX_NODE_NUM; i++) {
-        memset(&(node_v->nodeTbl[i]), INVALID_NODE_INFO, sizeof(nodeInfo_t));
-        node_v->nodeTbl[i].fInGroup = FALSE;
+	free(node_v->nodeTbl);
+	free(node_v->nwkHash);
+	free(node_v->extHash);
+	memset(node_v, 0, sizeof(node_ctrl_t));
+
+	if (nodes_grow() != 0) {
+		LOG_ERR(LOG_MOD_NODES, "nodes: out of memory");
+		exit(-1);
 	}
 }
 
@@ -66,25 +282,57 @@ void nodes_reset(void)
  * @param   nwkAddr
  * @param   extAddr
  *
- * @return  none
+ * @return  the node, NULL if not found
  */
 nodeInfo_t* nodes_search(u16 nwkAddr, u8* extAddr)
 {
-	int i = 0;
-	for(i = 0; i < MAX_NODE_NUM; i++) {
-		if (node_v->nodeTbl[i].nwkAddr == nwkAddr) {
-			if (0 == memcmp(extAddr, node_v->nodeTbl[i].extAddr, 8)) {
-				return &node_v->nodeTbl[i];
-			}
-		}
+	nodeInfo_t *entry = nodes_searchByExt(extAddr);
+
+	if (entry && entry->nwkAddr == nwkAddr) {
+		return entry;
 	}
 	return NULL;
 }
 
+/*********************************************************************
+ * @fn      nodes_searchByNwk
+ *
+ * @brief   Search node through specified network address
+ *
+ * @param   nwkAddr
+ *
+ * @return  the node, NULL if not found
+ */
+nodeInfo_t* nodes_searchByNwk(u16 nwkAddr)
+{
+	u32 idx = node_v->nwkHash[nodes_nwkFind(nwkAddr)];
+
+	return (idx == NODE_HASH_EMPTY) ? NULL : &node_v->nodeTbl[idx - 1];
+}
+
+/*********************************************************************
+ * @fn      nodes_searchByExt
+ *
+ * @brief   Search node through specified extended address
+ *
+ * @param   extAddr
+ *
+ * @return  the node, NULL if not found
+ */
+nodeInfo_t* nodes_searchByExt(u8* extAddr)
+{
+	u32 idx = node_v->extHash[nodes_extFind(extAddr)];
+
+	return (idx == NODE_HASH_EMPTY) ? NULL : &node_v->nodeTbl[idx - 1];
+}
+
 /*********************************************************************
  * @fn      nodes_add
  *
- * @brief   Add node to the node list
+ * @brief   Add node to the node list. A known device which rejoined with
+ *          a new network address is updated in place. A node still
+ *          holding the network address of a different device is stale
+ *          and gets removed.
  *
  * @param   nwkAddr
  * @param   extAddr
@@ -92,52 +340,125 @@ nodeInfo_t* nodes_search(u16 nwkAddr, u8* extAddr)
  * @param   devID
  * @param   endpoint
  *
- * @return  none
+ * @return  the node, NULL if out of memory. Valid until the next
+ *          nodes_add() or nodes_remove().
  */
-void nodes_add(u16 nwkAddr, u8* extAddr, u8 capability, u16 devID, u8 endpoint)
+nodeInfo_t* nodes_add(u16 nwkAddr, u8* extAddr, u8 capability, u16 devID, u8 endpoint)
 {
 	nodeInfo_t *entry;
-	u8 empty[8] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+	u8 changed = FALSE;
+	u8 devType;
+	u32 slot;
 
-	if (NULL != nodes_search(nwkAddr, extAddr)) {
-		return;
+	entry = nodes_searchByNwk(nwkAddr);
+	if (entry && memcmp(entry->extAddr, extAddr, 8)) {
+		nodes_remove(nwkAddr);
 	}
 
-	/* Not Found */
-	entry = nodes_search(EMPTY_NODE_NWK_ADDR, empty);
-	if (!entry) {
-		return;
-	}
+	entry = nodes_searchByExt(extAddr);
+	if (entry) {
+		if (entry->nwkAddr != nwkAddr) {
+			/* Rejoined with a new network address */
+			groups_renameNode(entry->nwkAddr, nwkAddr);
+			attrCache_renameNode(entry->nwkAddr, nwkAddr);
+			nodes_hashErase(node_v->nwkHash, nodes_nwkFind(entry->nwkAddr), FALSE);
+			entry->nwkAddr = nwkAddr;
+			node_v->nwkHash[nodes_nwkFind(nwkAddr)] = (entry - node_v->nodeTbl) + 1;
+			changed = TRUE;
+		}
+	} else {
+		if (node_v->curNodeNum == node_v->tblSize && nodes_grow() != 0) {
+			LOG_ERR(LOG_MOD_NODES, "nodes: out of memory, 0x%04x not added", nwkAddr);
+			return NULL;
+		}
 
-	/* Fill to an empty entry */
-	memcpy((u8*)&entry->nwkAddr, (u8*)&nwkAddr, 2);
-	memcpy(entry->extAddr, extAddr, 8);
-	entry->capability = capability;
-	entry->devId = devID;
-	entry->fInGroup = 0;
-	entry->endpoint = endpoint;
+		entry = &node_v->nodeTbl[node_v->curNodeNum];
+		memset(entry, 0, sizeof(nodeInfo_t));
+		entry->nwkAddr = nwkAddr;
+		memcpy(entry->extAddr, extAddr, 8);
 
+		slot = node_v->curNodeNum++;
+		nodes_hashInsert(slot);
+		changed = TRUE;
+	}
 
 	switch (devID) {
     case HA_DEV_ONOFF_LIGHT:
     case HA_DEV_DIMMABLE_LIGHT:
     case HA_DEV_COLOR_DIMMABLE_LIGHT:
     case 0x0210:
-        entry->devType = DEV_TYPE_LIGHT;
+        devType = DEV_TYPE_LIGHT;
         break;
 
     case HA_DEV_ONOFF_SWITCH:
     case HA_DEV_ONOFF_LIGHT_SWITCH:
     case HA_DEV_DIMMER_SWITCH:
     case HA_DEV_COLOR_DIMMER_SWITCH:
-        entry->devType = DEV_TYPE_ONOFF_SWITCH;
+        devType = DEV_TYPE_ONOFF_SWITCH;
         break;
 
     default:
-        entry->devType = DEV_TYPE_UNKNOWN;
+        devType = DEV_TYPE_UNKNOWN;
+	}
+
+	if (entry->capability != capability || entry->devId != devID ||
+		entry->endpoint != endpoint || entry->devType != devType) {
+		changed = TRUE;
+	}
+
+	entry->capability = capability;
+	entry->devId = devID;
+	entry->endpoint = endpoint;
+	entry->devType = devType;
+
+	/* Announcements of unchanged devices are not worth a disk write */
+	if (changed) {
+		nodeDb_logAdd(entry);
 	}
 
-	node_v->curNodeNum++;
+	return entry;
+}
+
+/*********************************************************************
+ * @fn      nodes_remove
+ *
+ * @brief   Remove a node from the node list. The last node is moved
+ *          into the freed slot to keep the table dense.
+ *
+ * @param   nwkAddr
+ *
+ * @return  none
+ */
+void nodes_remove(u16 nwkAddr)
+{
+	u32 slot = nodes_nwkFind(nwkAddr);
+	u32 idx = node_v->nwkHash[slot];
+	u32 last;
+	nodeInfo_t *entry;
+	nodeInfo_t removed;
+
+	if (idx == NODE_HASH_EMPTY) {
+		return;
+	}
+
+	idx--;
+	entry = &node_v->nodeTbl[idx];
+	removed = *entry;
+	groups_removeNode(nwkAddr);
+	attrCache_removeNode(nwkAddr);
+	nodes_hashErase(node_v->nwkHash, slot, FALSE);
+	nodes_hashErase(node_v->extHash, nodes_extFind(entry->extAddr), TRUE);
+
+	last = --node_v->curNodeNum;
+	if (idx != last) {
+		*entry = node_v->nodeTbl[last];
+		node_v->nwkHash[nodes_nwkFind(entry->nwkAddr)] = idx + 1;
+		node_v->extHash[nodes_extFind(entry->extAddr)] = idx + 1;
+	}
+
+	/* Journaled once the node is gone, a compaction the record
+	 * triggers must not snapshot it */
+	nodeDb_logRemove(&removed);
 }
 
 /*********************************************************************
@@ -145,11 +466,11 @@ void nodes_add(u16 nwkAddr, u8* extAddr, u8 capability, u16 devID, u8 endpoint)
  *
  * @brief   Get specified node through index
  *
- * @param   none
+ * @param   index - 0 .. nodes_curNum() - 1
  *
- * @return  Number of current nodes
+ * @return  the node
  */
-nodeInfo_t* nodes_get(u8 index)
+nodeInfo_t* nodes_get(u32 index)
 {
 	return &node_v->nodeTbl[index];
 }
@@ -163,45 +484,43 @@ nodeInfo_t* nodes_get(u8 index)
  *
  * @return  Number of current nodes
  */
-u8 nodes_curNum(void)
+u32 nodes_curNum(void)
 {
 	return node_v->curNodeNum;
 }
 
-#if 0
-void nodes_writeToFile(void)
-{
-    int i;
-    nodeInfo_t *entry;
-
-    for(i = 0; i < MAX_NODE_NUM; i++) {
-        entry = nodes_get(i);
-        if (entry->nwkAddr != EMPTY_NODE_NWK_ADDR) {
-            (entry->devType, entry->nwkAddr, entry->extAddr);
-        }
-    }
-}
-
-
-void nodes_writeEntryToFile(nodeInfo_t *entry)
+/*********************************************************************
+ * @fn      nodes_recordRtt
+ *
+ * @brief   Account a command round trip time sample to a node
+ *
+ * @param   nwkAddr - the node which was addressed
+ * @param   rttUs - round trip time of the command
+ * @param   timedOut - TRUE if the command got no response
+ *
+ * @return  none
+ */
+void nodes_recordRtt(u16 nwkAddr, u32 rttUs, u8 timedOut)
 {
-    FILE* fp;
-
-    if ( NULL == (fp=fopen("gateway.txt", "a+")) ) {
-        printf("the file %s opened failed!\n", filename);
-        return;
-    }
-
-    fprintf(fp, "[node]\n");
-    fprintf(fp, "devType = %d\n", devType);
-    fprintf(fp, "nwkAddr = %d\n", nwk)
-}
-
+	nodeInfo_t *entry = nodes_searchByNwk(nwkAddr);
 
+	if (!entry) {
+		return;
+	}
 
-void nodes_readFromFile(void)
-{
+	if (timedOut) {
+		entry->timeouts++;
+		return;
+	}
 
+	entry->rttLastUs = rttUs;
+	if (entry->rttSamples == 0) {
+		entry->rttAvgUs = rttUs;
+	} else {
+		/* Smooth with a 1/8 gain, as TCP does for its RTT */
+		entry->rttAvgUs += ((s32)rttUs - (s32)entry->rttAvgUs) / 8;
+	}
+	if (entry->rttSamples < 0xFFFF) {
+		entry->rttSamples++;
+	}
 }
-
-#endif
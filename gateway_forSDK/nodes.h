@@ -7,10 +7,9 @@
  * CONSTANTS
  */
 
-#define MAX_NODE_NUM                     10
+/* Initial capacity of the node table, it doubles when full */
+#define NODE_TBL_INIT_SIZE               64
 
-#define NODE_NOT_FOUND                   0xff
-#define INVALID_NODE_INFO                0xff
 #define EMPTY_NODE_NWK_ADDR              0xffff
 
 /*********************************************************************
@@ -78,7 +77,10 @@ typedef struct {
     u8 capability;
     u16 nwkAddr;
     u8 extAddr[8];
-    u8 fInGroup;
+    u32 rttLastUs;                    //!< Last command round trip time
+    u32 rttAvgUs;                     //!< Smoothed command round trip time
+    u16 rttSamples;
+    u16 timeouts;
 } nodeInfo_t;
 
 
@@ -87,9 +89,13 @@ typedef struct {
  */
 void nodes_reset(void);
 nodeInfo_t* nodes_search(u16 nwkAddr, u8* extAddr);
-void nodes_add(u16 nwkAddr, u8* extAddr, u8 capability, u16 devID, u8 endpoint);
-u8 nodes_curNum(void);
-nodeInfo_t* nodes_get(u8 index);
+nodeInfo_t* nodes_searchByNwk(u16 nwkAddr);
+nodeInfo_t* nodes_searchByExt(u8* extAddr);
+nodeInfo_t* nodes_add(u16 nwkAddr, u8* extAddr, u8 capability, u16 devID, u8 endpoint);
+void nodes_remove(u16 nwkAddr);
+u32 nodes_curNum(void);
+nodeInfo_t* nodes_get(u32 index);
+void nodes_recordRtt(u16 nwkAddr, u32 rttUs, u8 timedOut);
 
 
 #endif  /* __NODES_H__ */
@@ -0,0 +1,445 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "types.h"
+#include "capture.h"
+#include "swTimer.h"
+#include "tool.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* Apps replayed at a time */
+#define REPLAY_MAX_CONN                 256
+
+/* Time the gateway gets to answer the last record */
+#define REPLAY_SETTLE_MS                500
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+typedef struct {
+    u32 id;                           //!< connId of the capture
+    int fd;
+} replay_conn_t;
+
+/*
+ * The capture is loaded into memory and played against a gateway whose
+ * serial port is the slave side of a pty. SoC frames are written to the
+ * master side, App bytes are sent over TCP connections opened like the
+ * captured ones. What the gateway writes to the SoC is compared with the
+ * frames it wrote during the capture.
+ */
+typedef struct {
+    u8 *file;
+    u32 fileLen;
+    u8 *expect;                       //!< Captured SoC output, back to back
+    u32 expectLen;
+    u32 received;                     //!< Output compared with expect so far
+    u32 mismatchOff;                  //!< First difference, expectLen if none
+    u32 extra;                        //!< Output beyond expect
+
+    int master;
+    int slave;
+    pid_t child;
+    u16 port;
+    u8 fast;
+    double speed;
+
+    const u8 *out;                    //!< Frame being written to the pty
+    u32 outLen;
+
+    replay_conn_t conns[REPLAY_MAX_CONN];
+    u32 connNum;
+
+    u32 socFrames;
+    u32 socBytes;
+    u32 appCmds;
+    u32 appRxBytes;                   //!< Bytes the gateway sent to our Apps
+} replay_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+replay_ctrl_t replay_vs;
+replay_ctrl_t *replay_v = &replay_vs;
+
+/* Pacing reorders frames by priority, replays run without it so the
+ * output keeps the order of the input */
+static char *replay_gwOpts[] = { "-b", "115200", "-k", "0", "-r", "0", NULL };
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static void usage(char *exeName);
+
+
+/*********************************************************************
+ * @fn      replay_load
+ *
+ * @brief   Read a capture file and collect the SoC output it holds
+ *
+ * @param   path - the capture file
+ *
+ * @return  0 on success, -1 on error
+ */
+static int replay_load(const char *path)
+{
+    capture_fileHdr_t *hdr;
+    capture_recHdr_t *rec;
+    FILE *fp;
+    long size;
+    u32 off;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    replay_v->file = malloc(size);
+    replay_v->expect = malloc(size);
+    if (!replay_v->file || !replay_v->expect || fread(replay_v->file, 1, size, fp) != (size_t)size) {
+        fprintf(stderr, "%s: can not be read\n", path);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    replay_v->fileLen = size;
+
+    hdr = (capture_fileHdr_t*)replay_v->file;
+    if (size < sizeof(*hdr) || hdr->magic != CAPTURE_MAGIC || hdr->version != CAPTURE_VERSION ||
+        hdr->hdrSize != sizeof(capture_recHdr_t)) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        return -1;
+    }
+
+    /* A capture cut short by a crash ends with a torn record, drop it */
+    for (off = sizeof(*hdr); off + sizeof(*rec) <= replay_v->fileLen; off += sizeof(*rec) + rec->len) {
+        rec = (capture_recHdr_t*)(replay_v->file + off);
+        if (rec->len > replay_v->fileLen - off - sizeof(*rec)) {
+            break;
+        }
+        if (rec->type == CAPTURE_SOC_TX) {
+            memcpy(replay_v->expect + replay_v->expectLen, rec + 1, rec->len);
+            replay_v->expectLen += rec->len;
+        }
+    }
+    replay_v->fileLen = off;
+    replay_v->mismatchOff = replay_v->expectLen;
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      replay_checkOutput
+ *
+ * @brief   Compare what the gateway wrote to the SoC with the capture
+ *
+ * @param   buf - bytes read from the pty
+ * @param   len - number of bytes
+ *
+ * @return  none
+ */
+static void replay_checkOutput(const u8 *buf, u32 len)
+{
+    u32 pos = replay_v->received;
+    u32 i;
+
+    for (i = 0; i < len; i++, pos++) {
+        if (pos >= replay_v->expectLen) {
+            replay_v->extra += len - i;
+            break;
+        }
+        if (replay_v->mismatchOff == replay_v->expectLen && buf[i] != replay_v->expect[pos]) {
+            replay_v->mismatchOff = pos;
+        }
+    }
+    replay_v->received = (pos < replay_v->expectLen) ? pos : replay_v->expectLen;
+}
+
+/*********************************************************************
+ * @fn      replay_pump
+ *
+ * @brief   Move data between the gateway and us until the timeout
+ *          expires, or until the pending pty write is done
+ *
+ * @param   timeoutMs - longest time to wait, 0 to only take what is ready
+ *
+ * @return  none
+ */
+static void replay_pump(int timeoutMs)
+{
+    struct pollfd fds[REPLAY_MAX_CONN + 1];
+    u64 end = swTimer_nowUs() + (u64)timeoutMs * 1000;
+    u8 buf[4096];
+    u8 written = FALSE;
+    int n, wait;
+    u32 i;
+
+    do {
+        wait = (int)((end > swTimer_nowUs()) ? (end - swTimer_nowUs() + 999) / 1000 : 0);
+
+        fds[0].fd = replay_v->master;
+        fds[0].events = POLLIN | (replay_v->outLen ? POLLOUT : 0);
+        for (i = 0; i < replay_v->connNum; i++) {
+            fds[i + 1].fd = replay_v->conns[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+
+        n = poll(fds, replay_v->connNum + 1, wait);
+        if (n < 0 && errno != EINTR) {
+            perror("poll");
+            return;
+        }
+        if (n <= 0) {
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            while ((n = read(replay_v->master, buf, sizeof(buf))) > 0) {
+                replay_checkOutput(buf, n);
+            }
+        }
+        if ((fds[0].revents & POLLOUT) && replay_v->outLen) {
+            n = write(replay_v->master, replay_v->out, replay_v->outLen);
+            if (n > 0) {
+                replay_v->out += n;
+                replay_v->outLen -= n;
+                written = (replay_v->outLen == 0);
+            }
+        }
+
+        for (i = 0; i < replay_v->connNum; i++) {
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                n = recv(replay_v->conns[i].fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if (n > 0) {
+                    replay_v->appRxBytes += n;
+                }
+            }
+        }
+    } while (!written && swTimer_nowUs() < end);
+}
+
+/*********************************************************************
+ * @fn      replay_findConn
+ *
+ * @brief   Get the connection replaying an App of the capture
+ *
+ * @param   id - connId of the capture
+ * @param   open - open it if it does not exist
+ *
+ * @return  the connection, NULL if there is none
+ */
+static replay_conn_t* replay_findConn(u32 id, u8 open)
+{
+    replay_conn_t *conn;
+    u32 i;
+
+    for (i = 0; i < replay_v->connNum; i++) {
+        if (replay_v->conns[i].id == id) {
+            return &replay_v->conns[i];
+        }
+    }
+
+    if (!open || replay_v->connNum == REPLAY_MAX_CONN) {
+        return NULL;
+    }
+
+    conn = &replay_v->conns[replay_v->connNum];
+    conn->id = id;
+    conn->fd = tool_connect(replay_v->port);
+    if (conn->fd < 0) {
+        fprintf(stderr, "App %u: can not connect to the gateway\n", id);
+        return NULL;
+    }
+    replay_v->connNum++;
+    return conn;
+}
+
+/*********************************************************************
+ * @fn      replay_closeConn
+ *
+ * @brief   Close the connection replaying an App of the capture
+ *
+ * @param   id - connId of the capture
+ *
+ * @return  none
+ */
+static void replay_closeConn(u32 id)
+{
+    replay_conn_t *conn = replay_findConn(id, FALSE);
+
+    if (conn) {
+        close(conn->fd);
+        *conn = replay_v->conns[--replay_v->connNum];
+    }
+}
+
+/*********************************************************************
+ * @fn      replay_record
+ *
+ * @brief   Play one record of the capture
+ *
+ * @param   rec - the record, its data follows it
+ *
+ * @return  none
+ */
+static void replay_record(capture_recHdr_t *rec)
+{
+    replay_conn_t *conn;
+    const u8 *data = (const u8*)(rec + 1);
+
+    switch (rec->type) {
+    case CAPTURE_SOC_RX:
+        replay_v->out = data;
+        replay_v->outLen = rec->len;
+        while (replay_v->outLen) {
+            replay_pump(REPLAY_SETTLE_MS);
+        }
+        replay_v->socFrames++;
+        replay_v->socBytes += rec->len;
+        break;
+
+    case CAPTURE_APP_OPEN:
+        replay_findConn(rec->connId, TRUE);
+        break;
+
+    case CAPTURE_APP_RX:
+        conn = replay_findConn(rec->connId, TRUE);
+        if (conn && send(conn->fd, data, rec->len, MSG_NOSIGNAL) == rec->len) {
+            replay_v->appCmds++;
+        }
+        break;
+
+    case CAPTURE_APP_CLOSE:
+        replay_closeConn(rec->connId);
+        break;
+
+    default:
+        /* Output of the gateway, checked as it comes */
+        break;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    capture_recHdr_t *rec;
+    char *exe = NULL;
+    char *ptyName;
+    u64 start, due, elapsed;
+    u32 off, records = 0;
+    int opt;
+
+    replay_v->port = TOOL_GW_PORT;
+    replay_v->speed = 1.0;
+
+    while ((opt = getopt(argc, argv, "fs:p:g:")) != -1) {
+        switch (opt) {
+        case 'f':
+            replay_v->fast = TRUE;
+            break;
+        case 's':
+            replay_v->speed = atof(optarg);
+            break;
+        case 'p':
+            replay_v->port = atoi(optarg);
+            break;
+        case 'g':
+            exe = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1 || replay_v->speed <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (replay_load(argv[optind]) != 0) {
+        return 1;
+    }
+
+    ptyName = tool_openPty(&replay_v->master, &replay_v->slave);
+    if (!ptyName) {
+        return 1;
+    }
+    if (exe) {
+        replay_v->child = tool_spawnGateway(exe, replay_gwOpts, replay_v->port, ptyName, NULL);
+    } else {
+        printf("start the gateway with: gateway -p %u %s\n", replay_v->port, ptyName);
+    }
+    if (replay_v->child < 0 ||
+        tool_waitGateway(replay_v->port, exe ? TOOL_GW_START_TIMEOUT_MS : -1, replay_pump) != 0) {
+        tool_stopGateway(replay_v->child, replay_v->port);
+        return 1;
+    }
+
+    start = swTimer_nowUs();
+    for (off = sizeof(capture_fileHdr_t); off < replay_v->fileLen; off += sizeof(*rec) + rec->len) {
+        rec = (capture_recHdr_t*)(replay_v->file + off);
+
+        /* Keep the captured pacing, the gateway's timers see the same gaps */
+        if (!replay_v->fast) {
+            due = start + (u64)(rec->timeUs / replay_v->speed);
+            if (due > swTimer_nowUs()) {
+                replay_pump((int)((due - swTimer_nowUs()) / 1000));
+            }
+        }
+        replay_pump(0);
+
+        replay_record(rec);
+        records++;
+    }
+    elapsed = swTimer_nowUs() - start;
+
+    replay_pump(REPLAY_SETTLE_MS);
+    tool_stopGateway(replay_v->child, replay_v->port);
+
+    printf("replayed %u records in %u us\n", records, (u32)elapsed);
+    printf("  SoC frames in:   %u (%u bytes, %u frames/s)\n", replay_v->socFrames, replay_v->socBytes,
+           elapsed ? (u32)((u64)replay_v->socFrames * 1000000 / elapsed) : 0);
+    printf("  App commands:    %u, %u bytes back\n", replay_v->appCmds, replay_v->appRxBytes);
+    printf("  SoC output:      %u of %u bytes received, %u extra\n", replay_v->received, replay_v->expectLen,
+           replay_v->extra);
+
+    if (replay_v->mismatchOff != replay_v->expectLen) {
+        printf("  output differs from the capture at byte %u\n", replay_v->mismatchOff);
+        return 2;
+    }
+    if (replay_v->received != replay_v->expectLen || replay_v->extra) {
+        printf("  output length differs from the capture\n");
+        return 2;
+    }
+    printf("  output matches the capture\n");
+    return 0;
+}
+
+static void usage(char* exeName)
+{
+    printf("Usage: %s [-f] [-s speed] [-p port] [-g gateway] <capture>\n", exeName);
+    printf("  -f          play as fast as the gateway takes it, ignore the timestamps\n");
+    printf("  -s speed    play faster (>1) or slower (<1) than captured\n");
+    printf("  -p port     TCP port of the gateway, %u by default\n", TOOL_GW_PORT);
+    printf("  -g gateway  start this gateway executable on the pty\n");
+    printf("Eample: %s -g ./gateway incident.cap\n", exeName);
+}
@@ -0,0 +1,297 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "ringBuf.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* None */
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+/* None */
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+
+/* None */
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+
+/*********************************************************************
+ * @fn      ringBuf_init
+ *
+ * @brief   Attach storage to a ring buffer and empty it
+ *
+ * @param   rb - the ring buffer
+ * @param   storage - backing memory
+ * @param   size - size of storage, must be a power of two
+ *
+ * @return  none
+ */
+void ringBuf_init(ringBuf_t *rb, u8 *storage, u32 size)
+{
+    rb->buf = storage;
+    rb->size = size;
+    rb->head = 0;
+    rb->tail = 0;
+}
+
+/*********************************************************************
+ * @fn      ringBuf_reset
+ *
+ * @brief   Discard all buffered bytes
+ *
+ * @param   rb - the ring buffer
+ *
+ * @return  none
+ */
+void ringBuf_reset(ringBuf_t *rb)
+{
+    rb->head = 0;
+    rb->tail = 0;
+}
+
+/*********************************************************************
+ * @fn      ringBuf_used
+ *
+ * @brief   Get the number of buffered bytes
+ *
+ * @param   rb - the ring buffer
+ *
+ * @return  bytes available for reading
+ */
+u32 ringBuf_used(ringBuf_t *rb)
+{
+    return rb->head - rb->tail;
+}
+
+/*********************************************************************
+ * @fn      ringBuf_space
+ *
+ * @brief   Get the free space of the ring buffer
+ *
+ * @param   rb - the ring buffer
+ *
+ * @return  bytes available for writing
+ */
+u32 ringBuf_space(ringBuf_t *rb)
+{
+    return rb->size - (rb->head - rb->tail);
+}
+
+/*********************************************************************
+ * @fn      ringBuf_write
+ *
+ * @brief   Append data to the ring buffer
+ *
+ * @param   rb - the ring buffer
+ * @param   data - the data to append
+ * @param   len - length of data
+ *
+ * @return  number of bytes actually appended
+ */
+u32 ringBuf_write(ringBuf_t *rb, const u8 *data, u32 len)
+{
+    u32 pos = rb->head & (rb->size - 1);
+    u32 first;
+
+    if (len > ringBuf_space(rb)) {
+        len = ringBuf_space(rb);
+    }
+
+    first = rb->size - pos;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&rb->buf[pos], data, first);
+    memcpy(rb->buf, data + first, len - first);
+
+    rb->head += len;
+    return len;
+}
+
+/*********************************************************************
+ * @fn      ringBuf_peek
+ *
+ * @brief   Read one byte without consuming it
+ *
+ * @param   rb - the ring buffer
+ * @param   offset - offset from the read position, must be < used
+ *
+ * @return  the byte
+ */
+u8 ringBuf_peek(ringBuf_t *rb, u32 offset)
+{
+    return rb->buf[(rb->tail + offset) & (rb->size - 1)];
+}
+
+/*********************************************************************
+ * @fn      ringBuf_copy
+ *
+ * @brief   Copy bytes out of the ring buffer without consuming them
+ *
+ * @param   rb - the ring buffer
+ * @param   offset - offset from the read position
+ * @param   dst - destination buffer
+ * @param   len - number of bytes, offset + len must be <= used
+ *
+ * @return  none
+ */
+void ringBuf_copy(ringBuf_t *rb, u32 offset, u8 *dst, u32 len)
+{
+    u32 pos = (rb->tail + offset) & (rb->size - 1);
+    u32 first = rb->size - pos;
+
+    if (first > len) {
+        first = len;
+    }
+    memcpy(dst, &rb->buf[pos], first);
+    memcpy(dst + first, rb->buf, len - first);
+}
+
+/*********************************************************************
+ * @fn      ringBuf_drop
+ *
+ * @brief   Consume bytes from the read position
+ *
+ * @param   rb - the ring buffer
+ * @param   len - number of bytes to consume
+ *
+ * @return  none
+ */
+void ringBuf_drop(ringBuf_t *rb, u32 len)
+{
+    if (len > ringBuf_used(rb)) {
+        len = ringBuf_used(rb);
+    }
+    rb->tail += len;
+}
+
+/*********************************************************************
+ * @fn      ringBuf_find
+ *
+ * @brief   Search for a byte value in the buffered data
+ *
+ * @param   rb - the ring buffer
+ * @param   offset - offset from the read position to start searching
+ * @param   val - the value to search for
+ *
+ * @return  offset of the first match, or RING_BUF_NOT_FOUND
+ */
+int ringBuf_find(ringBuf_t *rb, u32 offset, u8 val)
+{
+    u32 used = ringBuf_used(rb);
+    u32 pos, first;
+    u8 *p;
+
+    if (offset >= used) {
+        return RING_BUF_NOT_FOUND;
+    }
+
+    pos = (rb->tail + offset) & (rb->size - 1);
+    first = rb->size - pos;
+    if (first > used - offset) {
+        first = used - offset;
+    }
+
+    p = memchr(&rb->buf[pos], val, first);
+    if (p) {
+        return offset + (p - &rb->buf[pos]);
+    }
+
+    p = memchr(rb->buf, val, used - offset - first);
+    if (p) {
+        return offset + first + (p - rb->buf);
+    }
+
+    return RING_BUF_NOT_FOUND;
+}
+
+/*********************************************************************
+ * @fn      ringBuf_readFd
+ *
+ * @brief   Fill the free space of the ring buffer from a file descriptor
+ *          using a single read system call
+ *
+ * @param   rb - the ring buffer
+ * @param   fd - the (non-blocking) file descriptor
+ *
+ * @return  the result of readv(), 0 if the buffer is full
+ */
+int ringBuf_readFd(ringBuf_t *rb, int fd)
+{
+    struct iovec iov[2];
+    u32 space = ringBuf_space(rb);
+    u32 pos = rb->head & (rb->size - 1);
+    u32 first = rb->size - pos;
+    int n;
+
+    if (space == 0) {
+        return 0;
+    }
+
+    if (first > space) {
+        first = space;
+    }
+    iov[0].iov_base = &rb->buf[pos];
+    iov[0].iov_len = first;
+    iov[1].iov_base = rb->buf;
+    iov[1].iov_len = space - first;
+
+    n = readv(fd, iov, (space > first) ? 2 : 1);
+    if (n > 0) {
+        rb->head += n;
+    }
+    return n;
+}
+
+/*********************************************************************
+ * @fn      ringBuf_usedIov
+ *
+ * @brief   Describe the buffered bytes as up to two memory blocks, for
+ *          writing them out with a single system call
+ *
+ * @param   rb - the ring buffer
+ * @param   iov - returns the blocks, room for two entries
+ *
+ * @return  number of blocks, 0 if the buffer is empty
+ */
+int ringBuf_usedIov(ringBuf_t *rb, struct iovec *iov)
+{
+    u32 used = ringBuf_used(rb);
+    u32 pos = rb->tail & (rb->size - 1);
+    u32 first = rb->size - pos;
+
+    if (used == 0) {
+        return 0;
+    }
+
+    if (first >= used) {
+        iov[0].iov_base = &rb->buf[pos];
+        iov[0].iov_len = used;
+        return 1;
+    }
+
+    iov[0].iov_base = &rb->buf[pos];
+    iov[0].iov_len = first;
+    iov[1].iov_base = rb->buf;
+    iov[1].iov_len = used - first;
+    return 2;
+}
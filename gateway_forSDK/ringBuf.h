@@ -0,0 +1,51 @@
+#ifndef  __RING_BUF_H__
+#define  __RING_BUF_H__
+
+#include <sys/uio.h>
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+#define RING_BUF_NOT_FOUND              -1
+
+/*********************************************************************
+ * ENUMS
+ */
+
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+/*
+ * Byte ring buffer. The size must be a power of two, head and tail are
+ * free running counters and are masked on access.
+ */
+typedef struct {
+    u8 *buf;
+    u32 size;
+    u32 head;                         //!< Write position
+    u32 tail;                         //!< Read position
+} ringBuf_t;
+
+
+/*********************************************************************
+ * Public Functions
+ */
+void ringBuf_init(ringBuf_t *rb, u8 *storage, u32 size);
+void ringBuf_reset(ringBuf_t *rb);
+u32  ringBuf_used(ringBuf_t *rb);
+u32  ringBuf_space(ringBuf_t *rb);
+u32  ringBuf_write(ringBuf_t *rb, const u8 *data, u32 len);
+u8   ringBuf_peek(ringBuf_t *rb, u32 offset);
+void ringBuf_copy(ringBuf_t *rb, u32 offset, u8 *dst, u32 len);
+void ringBuf_drop(ringBuf_t *rb, u32 len);
+int  ringBuf_find(ringBuf_t *rb, u32 offset, u8 val);
+int  ringBuf_readFd(ringBuf_t *rb, int fd);
+int  ringBuf_usedIov(ringBuf_t *rb, struct iovec *iov);
+
+#endif  /* __RING_BUF_H__ */
@@ -0,0 +1,300 @@
+
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "sched.h"
+#include "config.h"
+#include "swTimer.h"
+#include "log.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* None */
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+/*
+ * Pacing of the frames sent into the mesh. A frame leaves when the global
+ * bucket and the bucket of its destination both hold its tokens. The
+ * global rate goes up by a step per delivered frame and is halved on a
+ * loss, so it settles just below what the mesh delivers.
+ */
+typedef struct {
+    u32 maxRate;                      //!< In 1/1000 frame/s, 0 when pacing is off
+    u32 rate;
+    u64 backoffUs;                    //!< Time of the last rate cut
+    sched_bucket_t global;
+    sched_bucket_t dst[SCHED_DST_TBL_SIZE];
+    sched_stats_t stats;
+} sched_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+sched_ctrl_t sched_vs;
+sched_ctrl_t *sched_v = &sched_vs;
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* None */
+
+
+/*********************************************************************
+ * @fn      sched_init
+ *
+ * @brief   Reset the buckets and the counters
+ *
+ * @param   maxRate - most frames per second sent into the mesh, 0 to
+ *                    send frames as soon as the UART takes them
+ *
+ * @return  none
+ */
+void sched_init(u32 maxRate)
+{
+    memset(sched_v, 0, sizeof(sched_ctrl_t));
+    sched_v->maxRate = maxRate * 1000;
+    sched_v->rate = sched_v->maxRate;
+    sched_v->global.level = SCHED_BURST * 1000;
+    sched_v->global.lastUs = swTimer_nowUs();
+}
+
+/*********************************************************************
+ * @fn      sched_dstKey
+ *
+ * @brief   Build the destination key of a frame
+ *
+ * @param   addrMode - address mode of the frame
+ * @param   dstAddr - network address or group ID
+ *
+ * @return  the key, never SCHED_DST_NONE
+ */
+u32 sched_dstKey(u8 addrMode, u16 dstAddr)
+{
+    return ((u32)(addrMode + 1) << 16) | dstAddr;
+}
+
+/*********************************************************************
+ * @fn      sched_refill
+ *
+ * @brief   Add the tokens earned since the last refill. The time of a
+ *          part token is kept for the next refill, so frequent refills
+ *          do not round the rate down.
+ *
+ * @param   bucket - the bucket
+ * @param   rate - its rate in 1/1000 frame/s
+ * @param   burst - its size in 1/1000 frame
+ * @param   now - monotonic time in us
+ *
+ * @return  none
+ */
+static void sched_refill(sched_bucket_t *bucket, u32 rate, u32 burst, u64 now)
+{
+    u64 earned = (now - bucket->lastUs) * rate / 1000000;
+    u64 level = bucket->level + earned;
+
+    if (level >= burst || rate == 0) {
+        bucket->level = burst < level ? burst : (u32)level;
+        bucket->lastUs = now;
+        return;
+    }
+    bucket->level = (u32)level;
+    bucket->lastUs += earned * 1000000 / rate;
+}
+
+/*********************************************************************
+ * @fn      sched_waitUs
+ *
+ * @brief   Get the time until a bucket holds some tokens
+ *
+ * @param   bucket - the bucket
+ * @param   rate - its rate in 1/1000 frame/s
+ * @param   need - tokens needed in 1/1000 frame
+ *
+ * @return  the time in us, at least 1
+ */
+static u32 sched_waitUs(sched_bucket_t *bucket, u32 rate, u32 need)
+{
+    return (u32)((u64)(need - bucket->level) * 1000000 / rate) + 1;
+}
+
+/*********************************************************************
+ * @fn      sched_globalWait
+ *
+ * @brief   Check whether the global bucket holds the tokens of a frame
+ *
+ * @param   cost - frames worth of airtime
+ *
+ * @return  0 if it does, otherwise the time in us until it will
+ */
+u32 sched_globalWait(u8 cost)
+{
+    if (sched_v->maxRate == 0 || cost == 0) {
+        return 0;
+    }
+
+    sched_refill(&sched_v->global, sched_v->rate, SCHED_BURST * 1000, swTimer_nowUs());
+    if (sched_v->global.level >= cost * 1000u) {
+        return 0;
+    }
+    sched_v->stats.deferred++;
+    return sched_waitUs(&sched_v->global, sched_v->rate, cost * 1000);
+}
+
+/*********************************************************************
+ * @fn      sched_take
+ *
+ * @brief   Take the tokens of a frame. The global bucket is charged the
+ *          cost of the frame, the bucket of its destination one frame.
+ *
+ * @param   dst - key of the destination, SCHED_DST_NONE for the global
+ *                bucket only
+ * @param   cost - frames worth of airtime, 0 for frames which do not go
+ *                 into the mesh
+ *
+ * @return  0 if the frame may leave, otherwise the time in us until it
+ *          could
+ */
+u32 sched_take(u32 dst, u8 cost)
+{
+    sched_bucket_t *bucket = NULL;
+    u64 now;
+    u32 wait = 0;
+
+    if (sched_v->maxRate == 0 || cost == 0) {
+        sched_v->stats.admitted++;
+        return 0;
+    }
+
+    now = swTimer_nowUs();
+    sched_refill(&sched_v->global, sched_v->rate, SCHED_BURST * 1000, now);
+    if (sched_v->global.level < cost * 1000u) {
+        wait = sched_waitUs(&sched_v->global, sched_v->rate, cost * 1000);
+    }
+
+    if (dst != SCHED_DST_NONE) {
+        bucket = &sched_v->dst[(dst ^ (dst >> 10)) % SCHED_DST_TBL_SIZE];
+        if (bucket->key != dst) {
+            bucket->key = dst;
+            bucket->level = SCHED_DST_BURST * 1000;
+            bucket->lastUs = now;
+        }
+        sched_refill(bucket, SCHED_DST_RATE * 1000, SCHED_DST_BURST * 1000, now);
+        if (bucket->level < 1000 && sched_waitUs(bucket, SCHED_DST_RATE * 1000, 1000) > wait) {
+            wait = sched_waitUs(bucket, SCHED_DST_RATE * 1000, 1000);
+        }
+    }
+
+    if (wait) {
+        sched_v->stats.deferred++;
+        return wait;
+    }
+
+    sched_v->global.level -= cost * 1000;
+    if (bucket) {
+        bucket->level -= 1000;
+    }
+    sched_v->stats.admitted++;
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      sched_onResult
+ *
+ * @brief   Adapt the rate to the fate of a frame
+ *
+ * @param   delivered - TRUE if the device answered with success, FALSE
+ *                      on a timeout or a failed default response
+ *
+ * @return  none
+ */
+void sched_onResult(u8 delivered)
+{
+    u64 now;
+
+    if (delivered) {
+        sched_v->stats.delivered++;
+        sched_v->rate += SCHED_RATE_STEP_MFPS;
+        if (sched_v->rate > sched_v->maxRate) {
+            sched_v->rate = sched_v->maxRate;
+        }
+        return;
+    }
+
+    sched_v->stats.losses++;
+    now = swTimer_nowUs();
+    if (sched_v->maxRate == 0 || sched_v->rate <= SCHED_MIN_RATE * 1000 ||
+        now - sched_v->backoffUs < (u64)SCHED_BACKOFF_HOLD_MS * 1000) {
+        return;
+    }
+
+    sched_v->backoffUs = now;
+    sched_v->rate /= 2;
+    if (sched_v->rate < SCHED_MIN_RATE * 1000) {
+        sched_v->rate = SCHED_MIN_RATE * 1000;
+    }
+    sched_v->stats.backoffs++;
+    LOG_INFO(LOG_MOD_SOC, "sched: loss, rate cut to %u.%03u frames/s", sched_v->rate / 1000, sched_v->rate % 1000);
+}
+
+/*********************************************************************
+ * @fn      sched_rate
+ *
+ * @brief   Get the current global rate
+ *
+ * @param   none
+ *
+ * @return  the rate in 1/1000 frame/s, 0 when pacing is off
+ */
+u32 sched_rate(void)
+{
+    return sched_v->rate;
+}
+
+/*********************************************************************
+ * @fn      sched_getStats
+ *
+ * @brief   Get the pacing counters
+ *
+ * @param   none
+ *
+ * @return  the counters
+ */
+sched_stats_t* sched_getStats(void)
+{
+    return &sched_v->stats;
+}
+
+/*********************************************************************
+ * @fn      sched_print
+ *
+ * @brief   Print the rate and the pacing counters
+ *
+ * @param   fp - where to print
+ *
+ * @return  none
+ */
+void sched_print(FILE *fp)
+{
+    sched_stats_t *st = &sched_v->stats;
+
+    if (sched_v->maxRate == 0) {
+        fprintf(fp, "Pacing: off, %u frames\n", st->admitted);
+        return;
+    }
+    fprintf(fp, "Pacing: %u.%03u of %u frames/s, %u admitted, %u deferred, %u delivered, %u losses, %u backoffs\n",
+            sched_v->rate / 1000, sched_v->rate % 1000, sched_v->maxRate / 1000,
+            st->admitted, st->deferred, st->delivered, st->losses, st->backoffs);
+}
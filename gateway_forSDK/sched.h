@@ -0,0 +1,63 @@
+#ifndef  __SCHED_H__
+#define  __SCHED_H__
+
+#include <stdio.h>
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* Buckets of destinations, direct mapped by address. Two destinations
+ * sharing a slot reset each other's bucket to full. */
+#define SCHED_DST_TBL_SIZE              1024
+
+/* Destination of frames which only pass the global bucket */
+#define SCHED_DST_NONE                  0
+
+/* A loss within this time of the last rate cut is the same congestion */
+#define SCHED_BACKOFF_HOLD_MS           1000
+
+/* Rate gained per delivered frame, in 1/1000 frame/s */
+#define SCHED_RATE_STEP_MFPS            250
+
+/*********************************************************************
+ * ENUMS
+ */
+
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+/* Token bucket, levels and rates in 1/1000 frame */
+typedef struct {
+    u32 key;
+    u32 level;
+    u64 lastUs;                       //!< Last refill
+} sched_bucket_t;
+
+typedef struct {
+    u32 admitted;
+    u32 deferred;                     //!< Times a frame had to wait for tokens
+    u32 delivered;
+    u32 losses;                       //!< Timeouts and failed default responses
+    u32 backoffs;                     //!< Rate cuts
+} sched_stats_t;
+
+
+/*********************************************************************
+ * Public Functions
+ */
+void sched_init(u32 maxRate);
+u32  sched_dstKey(u8 addrMode, u16 dstAddr);
+u32  sched_globalWait(u8 cost);
+u32  sched_take(u32 dst, u8 cost);
+void sched_onResult(u8 delivered);
+u32  sched_rate(void);
+sched_stats_t* sched_getStats(void);
+void sched_print(FILE *fp);
+
+#endif  /* __SCHED_H__ */
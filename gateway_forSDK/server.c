@@ -7,19 +7,24 @@
 #include <netdb.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "config.h"
 #include "server.h"
 #include "appCmd.h"
+#include "evLoop.h"
+#include "log.h"
+#include "capture.h"
+#include "stats.h"
 
 /**********************************************************************
  * LOCAL CONSTANTS
  */
 
-#define TCP_SERVER_LISTHEN_PORT    16000
-
-#define SOCKET_NOT_FOUND           -1
-#define INVALID_SOCKET             -1
-#define EMPTY_SOCKET_VAL           -1
+/* None */
 
 /**********************************************************************
  * LOCAL TYPES
@@ -28,7 +33,15 @@
 typedef struct {
     int tcp_server_sock;
     struct sockaddr_in tcp_server_listenAddr;
-    socketPool_t sockPool;
+    u16 listenPort;
+    server_conn_t **connTbl;          //!< Dense, connNum entries in use
+    u32 connNum;
+    u32 connTblSize;
+    u32 maxConnNum;
+    u32 txHighWater;
+    u32 txStallMs;
+    u32 nextConnId;
+    swTimer_t reapTimer;
 } server_ctrl_t;
 
 
@@ -43,20 +56,89 @@ server_ctrl_t* server_v = &server_vars;
 /**********************************************************************
  * LOCAL FUNCTIONS
  */
-int socketPool_search(int sock);
-void socketPool_add(int newSock);
-void socketPook_del(int delSock);
+static server_conn_t* server_connAdd(int sock, struct sockaddr_in *addr);
+static void server_dropConn(server_conn_t *conn);
+static void server_flushConn(server_conn_t *conn);
+static void server_queueMsg(server_conn_t *conn, server_msg_t *msg);
+static void server_listenEvent(int fd, u32 events, void *arg);
+static void server_clientEvent(int fd, u32 events, void *arg);
 
 
 /**********************************************************************
  * FUNCTIONS IMPLEMEMTATION
  */
 
+/*********************************************************************
+ * @fn      server_init
+ *
+ * @brief   Init the connection table
+ *
+ * @param   none
+ *
+ * @return  0 on success, -1 if out of memory
+ */
 int server_init(void)
 {
-    /* Init socket pool */
-    memset(server_v->sockPool.sockets, 0xff, sizeof(int) * MAX_SOCKET_NUM);
-    server_v->sockPool.curNum = 0;
+    server_v->connTbl = calloc(SERVER_CONN_TBL_INIT_SIZE, sizeof(server_conn_t*));
+    if (!server_v->connTbl) {
+        return -1;
+    }
+    server_v->connTblSize = SERVER_CONN_TBL_INIT_SIZE;
+    server_v->connNum = 0;
+    server_v->listenPort = SERVER_LISTEN_PORT;
+    server_v->maxConnNum = SERVER_MAX_CONN_NUM;
+    server_v->txHighWater = SERVER_CONN_TX_HIGH_WATER;
+    server_v->txStallMs = SERVER_CONN_TX_STALL_MS;
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      server_setPort
+ *
+ * @brief   Set the TCP port the server listens on, before server_open
+ *
+ * @param   port - the port
+ *
+ * @return  none
+ */
+void server_setPort(u16 port)
+{
+    server_v->listenPort = port;
+}
+
+/*********************************************************************
+ * @fn      server_setMaxConn
+ *
+ * @brief   Set the number of Apps which may be connected at a time,
+ *          connections above it are refused. Existing connections are
+ *          kept.
+ *
+ * @param   maxNum - the limit
+ *
+ * @return  none
+ */
+void server_setMaxConn(u32 maxNum)
+{
+    server_v->maxConnNum = maxNum;
+}
+
+/*********************************************************************
+ * @fn      server_setTxLimits
+ *
+ * @brief   Set how far an App may fall behind before it is
+ *          disconnected. Both limits are checked from the next message
+ *          queued or written on.
+ *
+ * @param   highWater - most unsent bytes per App
+ * @param   stallMs - longest time the socket of an App may take
+ *                    nothing while bytes are queued
+ *
+ * @return  none
+ */
+void server_setTxLimits(u32 highWater, u32 stallMs)
+{
+    server_v->txHighWater = highWater;
+    server_v->txStallMs = stallMs;
 }
 
  /*********************************************************************
@@ -81,7 +163,7 @@ int server_open(void)
     bzero((void*)&server_v->tcp_server_listenAddr, sizeof(struct sockaddr_in));
 
     server_v->tcp_server_listenAddr.sin_family = AF_INET;
-    server_v->tcp_server_listenAddr.sin_port = htons(TCP_SERVER_LISTHEN_PORT);
+    server_v->tcp_server_listenAddr.sin_port = htons(server_v->listenPort);
     server_v->tcp_server_listenAddr.sin_addr.s_addr = INADDR_ANY;//inet_addr(LOCAL_RECV_ADDR);
 
     /* set socket non-block */
@@ -102,6 +184,10 @@ int server_open(void)
         return -1;
     }
 
+    if(-1 == evLoop_add(server_v->tcp_server_sock, EPOLLIN | EPOLLET, server_listenEvent, NULL)) {
+        return -1;
+    }
+
     return server_v->tcp_server_sock;
 }
 
@@ -117,6 +203,7 @@ int server_open(void)
  */
 void server_close(void)
 {
+    evLoop_del(server_v->tcp_server_sock);
     close(server_v->tcp_server_sock);
 }
 
@@ -124,7 +211,8 @@ void server_close(void)
 /*********************************************************************
  * @fn      server_acceptNewConn
  *
- * @brief   handle new client accept command
+ * @brief   handle new client accept command, takes every pending
+ *          connection
  *
  * @param   none
  *
@@ -135,174 +223,615 @@ void server_acceptNewConn(void)
     int tempSock;
     struct linger m_sLinger;
     struct sockaddr_in fromAddr;
-    int fromLen = sizeof(struct sockaddr_in);
-    u8 extAddr[8] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
+    socklen_t fromLen;
+    server_conn_t *conn;
+
+    while (1) {
+        fromLen = sizeof(struct sockaddr_in);
+        tempSock = accept(server_v->tcp_server_sock, (struct sockaddr*)(&fromAddr), &fromLen);
+        if (-1 == tempSock) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERR(LOG_MOD_SERVER, "net_recv: accept error! errno = %d", errno);
+            }
+            return;
+        }
 
-    if (-1 == (tempSock = accept(server_v->tcp_server_sock, (struct sockaddr*)(&fromAddr), &fromLen))) {
-        printf("net_recv: accept error! errno = %d\n", errno);
-        return;
+        m_sLinger.l_onoff = 1;
+        m_sLinger.l_linger = 0;
+        setsockopt(tempSock, SOL_SOCKET, SO_LINGER, (const char*)&m_sLinger,sizeof(m_sLinger));
+
+        if (server_v->connNum >= server_v->maxConnNum) {
+            /* Full, reset the connection so the App sees the refusal */
+            stats_v->tcpRejects++;
+            LOG_WARN(LOG_MOD_SERVER, "server: %u Apps connected, refused %s:%u", server_v->connNum,
+                   inet_ntoa(fromAddr.sin_addr), ntohs(fromAddr.sin_port));
+            close(tempSock);
+            continue;
+        }
+
+        fcntl(tempSock, F_SETFL, O_NONBLOCK);
+
+        conn = server_connAdd(tempSock, &fromAddr);
+        if (!conn) {
+            close(tempSock);
+            continue;
+        }
+        stats_v->tcpAccepts++;
+
+        if (-1 == evLoop_add(tempSock, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, server_clientEvent, conn)) {
+            server_closeConn(conn);
+        }
     }
+}
 
-    m_sLinger.l_onoff = 1;
-    m_sLinger.l_linger = 0;
-    setsockopt(tempSock, SOL_SOCKET, SO_LINGER, (const char*)&m_sLinger,sizeof(m_sLinger));
+/*********************************************************************
+ * @fn      server_listenEvent
+ *
+ * @brief   Event callback of the listen socket
+ *
+ * @param   fd - the listen socket
+ * @param   events - ready events
+ * @param   arg - unused
+ *
+ * @return  none
+ */
+static void server_listenEvent(int fd, u32 events, void *arg)
+{
+    server_acceptNewConn();
+}
 
-    /* Add to socket pool */
-    socketPool_add(tempSock);
+/*********************************************************************
+ * @fn      server_clientEvent
+ *
+ * @brief   Event callback of a client socket
+ *
+ * @param   fd - the client socket
+ * @param   events - ready events
+ * @param   arg - the connection
+ *
+ * @return  none
+ */
+static void server_clientEvent(int fd, u32 events, void *arg)
+{
+    server_conn_t *conn = (server_conn_t*)arg;
 
+    if (events & EPOLLOUT) {
+        server_flushConn(conn);
+    }
+    if ((events & ~EPOLLOUT) && !conn->dropped) {
+        processTcpCmd(conn);
+    }
+}
 
-    /* for test */
-    //app_sendDeviceReportCmd(DEV_TYPE_LIGHT, 0x0001, extAddr);
+/*********************************************************************
+ * @fn      server_msgAlloc
+ *
+ * @brief   Allocate a message, the caller holds the only reference and
+ *          fills in the data
+ *
+ * @param   len - length of the message
+ *
+ * @return  the message, NULL if out of memory
+ */
+server_msg_t* server_msgAlloc(u32 len)
+{
+    server_msg_t *msg = malloc(sizeof(server_msg_t) + len);
 
+    if (msg) {
+        msg->refCnt = 1;
+        msg->len = len;
+    }
+    return msg;
 }
 
 /*********************************************************************
- * @fn      server_send
+ * @fn      server_msgUnref
  *
- * @brief   send data to connected client
+ * @brief   Drop a reference to a message
  *
- * @param   none
+ * @param   msg - the message
  *
  * @return  none
  */
-void server_send(int clientSock, u8* buf, u8 len)
+void server_msgUnref(server_msg_t *msg)
 {
-    /* send TCP message */
-    int i;
-    printf("send to App:\n");
-    for (i = 0; i < len; i++) {
-        printf("0x%x ", buf[i]);
+    if (--msg->refCnt == 0) {
+        free(msg);
     }
-    printf("\n");
+}
 
-    if (-1 == send(clientSock, buf, len, 0)) {
-        printf("send error! errno = %d\n", errno);
-        return;
+/*********************************************************************
+ * @fn      server_stallTimerCb
+ *
+ * @brief   Output of an App made no progress in time
+ *
+ * @param   arg - the connection
+ *
+ * @return  none
+ */
+static void server_stallTimerCb(void *arg)
+{
+    server_conn_t *conn = (server_conn_t*)arg;
+
+    LOG_WARN(LOG_MOD_SERVER, "server: App %s:%u stalled with %u bytes unsent, dropped", inet_ntoa(conn->addr.sin_addr),
+           ntohs(conn->addr.sin_port), conn->txBytes);
+    server_dropConn(conn);
+}
+
+/*********************************************************************
+ * @fn      server_flushConn
+ *
+ * @brief   Write as much of the queued output as the socket takes,
+ *          many messages per system call
+ *
+ * @param   conn - the client
+ *
+ * @return  none
+ */
+static void server_flushConn(server_conn_t *conn)
+{
+    struct iovec iov[SERVER_TX_MAX_IOV];
+    struct msghdr hdr;
+    server_msg_t *msg;
+    u32 mask = conn->txQSize - 1;
+    u32 i;
+    int cnt, n;
+    u8 progress = FALSE;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = iov;
+
+    while (!conn->dropped && conn->txHead != conn->txTail) {
+        cnt = 0;
+        for (i = conn->txHead; i != conn->txTail && cnt < SERVER_TX_MAX_IOV; i++) {
+            msg = conn->txQ[i & mask];
+            iov[cnt].iov_base = msg->data;
+            iov[cnt].iov_len = msg->len;
+            cnt++;
+        }
+        iov[0].iov_base = conn->txQ[conn->txHead & mask]->data + conn->txOff;
+        iov[0].iov_len -= conn->txOff;
+        hdr.msg_iovlen = cnt;
+
+        n = sendmsg(conn->sock, &hdr, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                server_dropConn(conn);
+            }
+            break;
+        }
+
+        /* Release what the kernel took */
+        progress |= (n > 0);
+        stats_v->tcpTxBytes += n;
+        conn->txBytes -= n;
+        n += conn->txOff;
+        while (conn->txHead != conn->txTail && n >= conn->txQ[conn->txHead & mask]->len) {
+            msg = conn->txQ[conn->txHead & mask];
+            n -= msg->len;
+            server_msgUnref(msg);
+            conn->txHead++;
+        }
+        conn->txOff = n;
+
+        if (conn->txOff || cnt < SERVER_TX_MAX_IOV) {
+            /* Short write or all done */
+            break;
+        }
+    }
+
+    if (conn->txHead == conn->txTail) {
+        swTimer_stop(&conn->stallTimer);
+    } else if (progress && !conn->dropped) {
+        /* Only an App which takes nothing for txStallMs is dropped, one
+         * keeping up with a steady backlog is not */
+        swTimer_start(&conn->stallTimer, server_v->txStallMs, server_stallTimerCb, conn);
     }
 }
 
- /*********************************************************************
- * @fn      processTcpCmd
+/*********************************************************************
+ * @fn      server_txQGrow
  *
- * @brief   handle the tcp command send from client
+ * @brief   Make room for more messages in the output queue of an App
  *
- * @param   none
+ * @param   conn - the client
+ *
+ * @return  0 on success, -1 if out of memory
+ */
+static int server_txQGrow(server_conn_t *conn)
+{
+    u32 size = conn->txQSize ? conn->txQSize * 2 : SERVER_CONN_TXQ_INIT_SIZE;
+    u32 num = conn->txTail - conn->txHead;
+    server_msg_t **q;
+    u32 i;
+
+    q = malloc(size * sizeof(server_msg_t*));
+    if (!q) {
+        return -1;
+    }
+
+    for (i = 0; i < num; i++) {
+        q[i] = conn->txQ[(conn->txHead + i) & (conn->txQSize - 1)];
+    }
+    free(conn->txQ);
+
+    conn->txQ = q;
+    conn->txQSize = size;
+    conn->txHead = 0;
+    conn->txTail = num;
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      server_queueMsg
+ *
+ * @brief   Send a message to an App. It is written straight away if
+ *          nothing is queued. Otherwise, or if the socket does not take
+ *          all of it, a reference is queued and written when the socket
+ *          becomes writable.
+ *
+ * @param   conn - the client
+ * @param   msg - the message, the caller keeps its reference
  *
  * @return  none
  */
-void processTcpCmd(int clientSocket)
+static void server_queueMsg(server_conn_t *conn, server_msg_t *msg)
 {
-    int fromLen = 0;
-    int recvLen = 0;
-    u8 buf[50];
+    int n = 0;
 
+    if (conn->dropped) {
+        return;
+    }
 
-    fromLen = sizeof(struct sockaddr_in);
-    recvLen = recv(clientSocket, buf, MAX_APP_PACKET_LEN, 0);
+    if (conn->txHead == conn->txTail) {
+        n = send(conn->sock, msg->data, msg->len, MSG_NOSIGNAL);
+        if (n > 0) {
+            stats_v->tcpTxBytes += n;
+        }
+        if (n == msg->len) {
+            return;
+        }
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                server_dropConn(conn);
+                return;
+            }
+            n = 0;
+        }
+    }
+
+    if (conn->txBytes + (msg->len - n) > server_v->txHighWater) {
+        LOG_WARN(LOG_MOD_SERVER, "server: App %s:%u is %u bytes behind, dropped", inet_ntoa(conn->addr.sin_addr),
+               ntohs(conn->addr.sin_port), conn->txBytes);
+        server_dropConn(conn);
+        return;
+    }
 
-    if(recvLen == 0) {
-        /* Disconnected */
-        close(clientSocket);
-        socketPool_del(clientSocket);
+    if (conn->txTail - conn->txHead == conn->txQSize && server_txQGrow(conn) != 0) {
+        server_dropConn(conn);
         return;
     }
 
-    if (recvLen > 0) {
-        app_cmdHandler(buf, recvLen);
+    if (conn->txHead == conn->txTail) {
+        conn->txOff = n;
+        swTimer_start(&conn->stallTimer, server_v->txStallMs, server_stallTimerCb, conn);
+    }
+
+    msg->refCnt++;
+    conn->txQ[conn->txTail++ & (conn->txQSize - 1)] = msg;
+    conn->txBytes += msg->len - n;
+    if (conn->txBytes > conn->txPeakBytes) {
+        conn->txPeakBytes = conn->txBytes;
     }
 }
 
+/*********************************************************************
+ * @fn      server_sendMsg
+ *
+ * @brief   Send a message to an App
+ *
+ * @param   conn - the client
+ * @param   msg - the message, the caller keeps its reference
+ *
+ * @return  none
+ */
+void server_sendMsg(server_conn_t *conn, server_msg_t *msg)
+{
+    CAPTURE(CAPTURE_APP_TX, conn->id, msg->data, msg->len);
+    server_queueMsg(conn, msg);
+}
 
- /*********************************************************************
- * @fn      socketPool_search
+/*********************************************************************
+ * @fn      server_broadcastMsg
  *
- * @brief   search the specified socket from pool
+ * @brief   Send a message to all connected Apps, they share the data.
+ *          A capture records it once.
  *
- * @param   sock - The socket to be searched
+ * @param   msg - the message, the caller keeps its reference
  *
- * @return  the index of search result
+ * @return  none
  */
-int socketPool_search(int sock)
+void server_broadcastMsg(server_msg_t *msg)
 {
-    int i;
-    for(i = 0; i < MAX_SOCKET_NUM; i++) {
-        if (server_v->sockPool.sockets[i] == sock) {
-            return i;
-        }
+    u32 i;
+
+    CAPTURE(CAPTURE_APP_TX, CAPTURE_NO_CONN, msg->data, msg->len);
+    for (i = 0; i < server_v->connNum; i++) {
+        server_queueMsg(server_v->connTbl[i], msg);
     }
-    return SOCKET_NOT_FOUND;
 }
 
- /*********************************************************************
- * @fn      socketPool_add
+/*********************************************************************
+ * @fn      server_send
  *
- * @brief   add the specified socket to the pool
+ * @brief   send data to connected client
  *
- * @param   newSock - The socket to add
+ * @param   conn - the client
+ * @param   buf - the data
+ * @param   len - length of data
  *
  * @return  none
  */
-void socketPool_add(int newSock)
+void server_send(server_conn_t *conn, u8* buf, u8 len)
 {
-    int index = socketPool_search(newSock);
-    if (SOCKET_NOT_FOUND != index) {
+    server_msg_t *msg = server_msgAlloc(len);
+
+    if (!msg) {
         return;
     }
+    memcpy(msg->data, buf, len);
+    server_sendMsg(conn, msg);
+    server_msgUnref(msg);
+}
+
+/*********************************************************************
+ * @fn      server_broadcast
+ *
+ * @brief   send data to all connected clients
+ *
+ * @param   buf - the data
+ * @param   len - length of data
+ *
+ * @return  none
+ */
+void server_broadcast(u8* buf, u8 len)
+{
+    server_msg_t *msg = server_msgAlloc(len);
 
-    index = socketPool_search(EMPTY_SOCKET_VAL);
-    if (SOCKET_NOT_FOUND == index) {
-        /* Table already full */
+    if (!msg) {
         return;
     }
-
-    server_v->sockPool.sockets[index] = newSock;
-    server_v->sockPool.curNum++;
+    memcpy(msg->data, buf, len);
+    server_broadcastMsg(msg);
+    server_msgUnref(msg);
 }
 
- /*********************************************************************
- * @fn      socketPool_del
+/*********************************************************************
+ * @fn      processTcpCmd
  *
- * @brief   delete the specified socket from pool
+ * @brief   handle the tcp command send from client
  *
- * @param   delSock - The socket to delete
+ * @param   conn - the client
  *
  * @return  none
  */
-void socketPool_del(int delSock)
+void processTcpCmd(server_conn_t *conn)
 {
-    int index = socketPool_search(delSock);
-    if (SOCKET_NOT_FOUND == index) {
+    int recvLen = 0;
+    u32 used;
+
+    /* Edge triggered, read until the socket is empty */
+    while (1) {
+        recvLen = recv(conn->sock, conn->rxBuf + conn->rxLen, SERVER_CONN_RX_BUF_SIZE - conn->rxLen, 0);
+
+        if (recvLen > 0) {
+            CAPTURE(CAPTURE_APP_RX, conn->id, conn->rxBuf + conn->rxLen, recvLen);
+            stats_v->tcpRxBytes += recvLen;
+            conn->rxLen += recvLen;
+            used = app_frameCmds(conn, conn->rxBuf, conn->rxLen);
+
+            /* Keep the incomplete command for the next read */
+            conn->rxLen -= used;
+            if (conn->rxLen && used) {
+                memmove(conn->rxBuf, conn->rxBuf + used, conn->rxLen);
+            }
+
+            if (conn->dropped) {
+                return;
+            }
+            continue;
+        }
+
+        if (recvLen < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (recvLen == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            /* Disconnected */
+            server_closeConn(conn);
+        }
         return;
     }
+}
+
+
+/*********************************************************************
+ * @fn      server_connAdd
+ *
+ * @brief   Create the state of a new connection and put it into the
+ *          connection table
+ *
+ * @param   sock - the accepted socket
+ * @param   addr - address of the App
+ *
+ * @return  the connection, NULL if out of memory
+ */
+static server_conn_t* server_connAdd(int sock, struct sockaddr_in *addr)
+{
+    server_conn_t **tbl;
+    server_conn_t *conn;
+
+    if (server_v->connNum == server_v->connTblSize) {
+        tbl = realloc(server_v->connTbl, server_v->connTblSize * 2 * sizeof(server_conn_t*));
+        if (!tbl) {
+            return NULL;
+        }
+        server_v->connTbl = tbl;
+        server_v->connTblSize *= 2;
+    }
 
-    server_v->sockPool.sockets[index] = INVALID_SOCKET;
-    server_v->sockPool.curNum--;
+    conn = calloc(1, sizeof(server_conn_t));
+    if (!conn) {
+        return NULL;
+    }
+    conn->sock = sock;
+    conn->addr = *addr;
+    conn->maxPktLen = APP_DEFAULT_PACKET_LEN;
+    conn->index = server_v->connNum;
+    conn->id = server_v->nextConnId++;
+    server_v->connTbl[server_v->connNum++] = conn;
+    CAPTURE(CAPTURE_APP_OPEN, conn->id, NULL, 0);
+
+    return conn;
 }
 
 /*********************************************************************
- * @fn      socketPool_get
+ * @fn      server_reap
  *
- * @brief   get all the clients socket
+ * @brief   Close the connections dropped during this loop pass
  *
- * @param   retSocks - The return value of all clients socket
- * @param   number - The returned clients number
+ * @param   arg - unused
  *
  * @return  none
  */
-void socketPool_get(int* retSocks, int* number)
+static void server_reap(void *arg)
 {
-    int i;
-    *number = 0;
-    for(i = 0; i < MAX_SOCKET_NUM; i++) {
-        if (server_v->sockPool.sockets[i] != INVALID_SOCKET) {
-            retSocks[(*number)++] = server_v->sockPool.sockets[i];
+    u32 i = server_v->connNum;
+
+    /* Backwards, closing moves the last connection into the slot */
+    while (i--) {
+        if (server_v->connTbl[i]->dropped) {
+            server_closeConn(server_v->connTbl[i]);
         }
     }
 }
 
+/*********************************************************************
+ * @fn      server_dropConn
+ *
+ * @brief   Disconnect an App once the current event has been handled.
+ *          The connection stays valid until then so callers up the
+ *          stack may still look at it.
+ *
+ * @param   conn - the connection
+ *
+ * @return  none
+ */
+static void server_dropConn(server_conn_t *conn)
+{
+    if (conn->dropped) {
+        return;
+    }
+
+    conn->dropped = TRUE;
+    stats_v->tcpDrops++;
+    swTimer_stop(&conn->stallTimer);
+    swTimer_start(&server_v->reapTimer, 0, server_reap, NULL);
+}
+
+/*********************************************************************
+ * @fn      server_closeConn
+ *
+ * @brief   Close a connection and free its state. The last connection
+ *          of the table is moved into the freed slot.
+ *
+ * @param   conn - the connection
+ *
+ * @return  none
+ */
+void server_closeConn(server_conn_t *conn)
+{
+    server_conn_t *last;
+
+    CAPTURE(CAPTURE_APP_CLOSE, conn->id, NULL, 0);
+    stats_v->tcpCloses++;
+    evLoop_del(conn->sock);
+    close(conn->sock);
+    swTimer_stop(&conn->stallTimer);
+    while (conn->txHead != conn->txTail) {
+        server_msgUnref(conn->txQ[conn->txHead++ & (conn->txQSize - 1)]);
+    }
+    free(conn->txQ);
 
+    last = server_v->connTbl[--server_v->connNum];
+    last->index = conn->index;
+    server_v->connTbl[conn->index] = last;
+    server_v->connTbl[server_v->connNum] = NULL;
 
+    free(conn);
+}
 
+/*********************************************************************
+ * @fn      server_connNum
+ *
+ * @brief   Get the number of connected Apps
+ *
+ * @param   none
+ *
+ * @return  number of connections
+ */
+u32 server_connNum(void)
+{
+    return server_v->connNum;
+}
 
+/*********************************************************************
+ * @fn      server_connById
+ *
+ * @brief   Find a connection by its ID
+ *
+ * @param   id - the ID
+ *
+ * @return  the connection, NULL if it is closed or being dropped
+ */
+server_conn_t* server_connById(u32 id)
+{
+    server_conn_t *conn;
+    u32 i;
 
+    for (i = 0; i < server_v->connNum; i++) {
+        conn = server_v->connTbl[i];
+        if (conn->id == id) {
+            return conn->dropped ? NULL : conn;
+        }
+    }
+    return NULL;
+}
 
+/*********************************************************************
+ * @fn      server_printConns
+ *
+ * @brief   Print the output queue of every connected App
+ *
+ * @param   fp - where to print
+ *
+ * @return  none
+ */
+void server_printConns(FILE *fp)
+{
+    server_conn_t *conn;
+    u32 i;
+
+    for (i = 0; i < server_v->connNum; i++) {
+        conn = server_v->connTbl[i];
+        fprintf(fp, "    App %u %s:%u: %u messages, %u bytes queued, peak %u bytes%s\n", conn->id,
+                inet_ntoa(conn->addr.sin_addr), ntohs(conn->addr.sin_port), conn->txTail - conn->txHead,
+                conn->txBytes, conn->txPeakBytes, conn->dropped ? ", dropped" : "");
+    }
+}
@@ -1,10 +1,29 @@
 #ifndef  __SERVER_H__
 #define  __SERVER_H__
 
+#include <stdio.h>
+#include <netinet/in.h>
+
+#include "types.h"
+#include "swTimer.h"
+#include "appCmd.h"
+
 /*********************************************************************
  * CONSTANTS
  */
-#define MAX_SOCKET_NUM              10
+
+/* Initial size of the connection table, it grows on demand */
+#define SERVER_CONN_TBL_INIT_SIZE   16
+
+/* Received bytes a connection can hold, a partial command stays here
+ * until the rest of it arrives */
+#define SERVER_CONN_RX_BUF_SIZE     MAX_APP_PACKET_LEN
+
+/* Initial number of messages a connection can queue, grows on demand */
+#define SERVER_CONN_TXQ_INIT_SIZE   16
+
+/* Messages written per system call */
+#define SERVER_TX_MAX_IOV           64
 
 /*********************************************************************
  * ENUMS
@@ -16,10 +35,37 @@
  * TYPES
  */
 
+/*
+ * Message for Apps. Encoded once and queued by reference to every App it
+ * goes to, freed when the last reference is dropped.
+ */
 typedef struct {
-    int sockets[MAX_SOCKET_NUM];
-    int curNum;
-} socketPool_t;
+    u32 refCnt;
+    u32 len;
+    u8 data[];
+} server_msg_t;
+
+/*
+ * State of a connected App
+ */
+typedef struct server_conn_tag {
+    int sock;
+    u32 index;                        //!< Slot in the connection table
+    u32 id;                           //!< Never reused, names the App in captures
+    struct sockaddr_in addr;
+    u8 dropped;                       //!< Closed at the end of this loop pass
+    u16 rxLen;
+    u16 maxPktLen;                    //!< Longest command accepted, see CMD_PKT_LEN_REQ
+    u8 rxBuf[SERVER_CONN_RX_BUF_SIZE];
+    server_msg_t **txQ;               //!< Messages the socket did not take yet
+    u32 txQSize;                      //!< Power of two, 0 until the first backlog
+    u32 txHead;                       //!< Free running, masked on access
+    u32 txTail;
+    u32 txOff;                        //!< Bytes of the head message already sent
+    u32 txBytes;                      //!< Unsent bytes in the queue
+    u32 txPeakBytes;                  //!< Most txBytes seen
+    swTimer_t stallTimer;             //!< Running while txQ is not empty, restarted on progress
+} server_conn_t;
 
 
 
@@ -29,9 +75,21 @@ typedef struct {
 int  server_init(void);
 int  server_open(void);
 void server_close(void);
-void processTcpCmd(int socket);
+void processTcpCmd(server_conn_t *conn);
 void server_acceptNewConn(void);
+void server_closeConn(server_conn_t *conn);
+void server_setPort(u16 port);
+void server_setMaxConn(u32 maxNum);
+void server_setTxLimits(u32 highWater, u32 stallMs);
 
-void socketPool_get(int* retSocks, int* number);
+server_msg_t* server_msgAlloc(u32 len);
+void server_msgUnref(server_msg_t *msg);
+void server_sendMsg(server_conn_t *conn, server_msg_t *msg);
+void server_broadcastMsg(server_msg_t *msg);
+server_conn_t* server_connById(u32 id);
+void server_send(server_conn_t *conn, u8* buf, u8 len);
+void server_broadcast(u8* buf, u8 len);
+u32  server_connNum(void);
+void server_printConns(FILE *fp);
 
 #endif  /* __SERVER_H__ */
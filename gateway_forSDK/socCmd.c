@@ -3,13 +3,33 @@
 /**********************************************************************
  * INCLUDES
  */
+#include <stdio.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <string.h>
 #include <termios.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 
 #include "types.h"
 #include "config.h"
 #include "socCmd.h"
 #include "appCmd.h"
+#include "ringBuf.h"
+#include "socTx.h"
+#include "socRx.h"
+#include "socReq.h"
+#include "socLink.h"
+#include "trans.h"
+#include "nodes.h"
+#include "log.h"
+#include "capture.h"
+#include "stats.h"
+#include "groups.h"
+#include "attrCache.h"
+#include "sched.h"
+#include "zclEnc.h"
 
 /**********************************************************************
  * LOCAL CONSTANTS
@@ -18,7 +38,7 @@
 #define APPCMDHEADER(len) \
 0xFE,                                                                             \
 len,   /*RPC payload Len                                      */     \
-0x29, /*MT_RPC_CMD_AREQ + MT_RPC_SYS_APP        */     \
+0x49, /*MT_RPC_CMD_AREQ + MT_RPC_SYS_APP        */     \
 0x00, /*MT_APP_MSG                                                   */     \
 0x0B, /*Application Endpoint                                  */     \
 0x02, /*short Addr 0x0002                                     */     \
@@ -45,17 +65,19 @@ len,   /*RPC payload Len                                      */     \
 
 #define MT_DEBUG_MSG                                    0x80
 
-#define COMMAND_LIGHTING_MOVE_TO_HUE                    0x00
-#define COMMAND_LIGHTING_MOVE_TO_SATURATION             0x03
-#define COMMAND_LEVEL_MOVE_TO_LEVEL                     0x00
-#define COMMAND_LEVEL_MOVE_TO_LEVEL_WITH_ONOFF          0x04
-
 /*** Foundation Command IDs ***/
 #define ZCL_CMD_READ                                    0x00
 #define ZCL_CMD_READ_RSP                                0x01
 #define ZCL_CMD_WRITE                                   0x02
 #define ZCL_CMD_WRITE_UNDIVIDED                         0x03
 #define ZCL_CMD_WRITE_RSP                               0x04
+#define ZCL_CMD_REPORT_ATTR                             0x0A
+#define ZCL_CMD_DEFAULT_RSP                             0x0B
+
+#define ZCL_STATUS_SUCCESS                              0x00
+
+/* 0xFFF8 - 0xFFFF are broadcast network addresses */
+#define ZCL_BROADCAST_ADDR_MIN                          0xFFF8
 
 // General Clusters
 #define ZCL_CLUSTER_ID_GEN_IDENTIFY                          0x0003
@@ -66,79 +88,70 @@ len,   /*RPC payload Len                                      */     \
 // Lighting Clusters
 #define ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL                0x0300
 
-/*******************************/
-/*** Scenes Cluster Commands ***/
-/*******************************/
-#define COMMAND_SCENE_STORE                               0x04
-#define COMMAND_SCENE_RECALL                              0x05
-
-/*******************************/
-/*** Groups Cluster Commands ***/
-/*******************************/
-#define COMMAND_GROUP_ADD                                 0x00
-
-#define ATTRID_ON_OFF                                     0x0000
-#define ATTRID_LEVEL_CURRENT_LEVEL                        0x0000
-#define ATTRID_LIGHTING_COLOR_CONTROL_CURRENT_HUE         0x0000
-#define ATTRID_LIGHTING_COLOR_CONTROL_CURRENT_SATURATION  0x0001
-
-/* The 3 MSB's of the 1st command field byte are for command type. */
-#define MT_RPC_CMD_TYPE_MASK  0xE0
-
-/* The 5 LSB's of the 1st command field byte are for the subsystem. */
-#define MT_RPC_SUBSYSTEM_MASK 0x1F
-
-#define MT_RPC_SOF         0xFE
-
-typedef enum {
-  MT_RPC_CMD_POLL = 0x00,
-  MT_RPC_CMD_SREQ = 0x20,
-  MT_RPC_CMD_AREQ = 0x40,
-  MT_RPC_CMD_SRSP = 0x60,
-  MT_RPC_CMD_RES4 = 0x80,
-  MT_RPC_CMD_RES5 = 0xA0,
-  MT_RPC_CMD_RES6 = 0xC0,
-  MT_RPC_CMD_RES7 = 0xE0
-} mtRpcCmdType_t;
-
-typedef enum {
-  MT_RPC_SYS_RES0,   /* Reserved. */
-  MT_RPC_SYS_SYS,
-  MT_RPC_SYS_MAC,
-  MT_RPC_SYS_NWK,
-  MT_RPC_SYS_AF,
-  MT_RPC_SYS_ZDO,
-  MT_RPC_SYS_SAPI,   /* Simple API. */
-  MT_RPC_SYS_UTIL,
-  MT_RPC_SYS_DBG,
-  MT_RPC_SYS_APP,
-  MT_RPC_SYS_OTA,
-  MT_RPC_SYS_ZNP,
-  MT_RPC_SYS_SPARE_12,
-  MT_RPC_SYS_UBL = 13,  // 13 to be compatible with existing RemoTI.
-  MT_RPC_SYS_MAX        // Maximum value, must be last (so 14-32 available, not yet assigned).
-} mtRpcSysType_t;
+#define SOC_MAX_FRAME_LEN       (0xFF + MT_RPC_FRAME_OVERHEAD)
+
+/* Receive ring buffer, big enough for a burst of device announces */
+#define SOC_RX_BUF_SIZE         4096
+
+/* Bytes of the data and control messages before their payloads */
+#define SOC_DATA_HDR_LEN        offsetof(data_cmd_t, payload)
+#define SOC_CTRL_HDR_LEN        offsetof(ctrl_cmd_t, payload)
+
+/* Frame control, sequence number and command ID, counted in dataLen */
+#define ZCL_HDR_LEN             3
+
 
 
 /**********************************************************************
  * LOCAL TYPES
  */
 
-/* None */
+/* Handler of a control message, with the shortest parameters it takes */
+typedef struct {
+    void (*handler)(const u8 *payload, u8 len);
+    u8 minLen;
+} soc_ctrlEntry_t;
 
 
 /**********************************************************************
  * LOCAL VARIABLES
  */
-int serialPortFd = 0;
+int serialPortFd = -1;
 u8 transSeqNumber = 0;
 
+static u8 socRxStorage[SOC_RX_BUF_SIZE];
+static ringBuf_t socRxBuf;
+
+/* Port given to socOpen(), opened again by socReopen() */
+static char *socDevicePath;
+
 
 /**********************************************************************
  * LOCAL FUNCTIONS
  */
+static void soc_registerHandlers(void);
 
 
+ /*********************************************************************
+ * @fn      soc_xorSum
+ *
+ * @brief   XOR all the bytes of a buffer, as used by the RPC FCS
+ *
+ * @param   buf - the data
+ * @param   len - length of data
+ *
+ * @return  the XOR of all the bytes
+ */
+static u8 soc_xorSum(u8 *buf, int len)
+{
+    u8 result = 0;
+
+    while (len-- > 0) {
+        result ^= *buf++;
+    }
+    return result;
+}
+
  /*********************************************************************
  * @fn      calcFcs
  *
@@ -150,15 +163,61 @@ u8 transSeqNumber = 0;
  */
 void calcFcs(u8 *msg, int size)
 {
-	u8 result = 0;
-	int idx = 1; //skip SOF
-	int len = (size - 1);  // skip FCS
+	/* skip SOF and FCS */
+	msg[(size-1)] = soc_xorSum(&msg[1], size - 2);
+}
 
-	while ((len--) != 0) {
-		result ^= msg[idx++];
-	}
 
-	msg[(size-1)] = result;
+/*********************************************************************
+ * @fn      soc_sendZcl
+ *
+ * @brief   encode a ZCL command straight into a transmit frame and
+ *          queue it for the UART. A unicast gets its seq and its entry
+ *          in the pending transaction table when it is admitted.
+ *
+ * @param   key - coalesce key of the frame
+ * @param   cmd - ZCL_ENC_* command
+ * @param   addrMode - address mode of the destination
+ * @param   dstAddr - network address or group ID
+ * @param   endpoint - destination endpoint
+ * @param   ... - payload fields of the command, see zclEnc_descTbl
+ *
+ * @return  0 on success, -1 if the frame was dropped
+ */
+static int soc_sendZcl(u64 key, u8 cmd, u8 addrMode, u16 dstAddr, u8 endpoint, ...)
+{
+    const zclEnc_desc_t *desc = zclEnc_desc(cmd);
+    socTxFrame_t *txFrame = socTx_alloc();
+    va_list args;
+
+    if (!txFrame) {
+        return -1;
+    }
+
+    va_start(args, endpoint);
+    txFrame->len = zclEnc_vencode(txFrame->data, sizeof(txFrame->data), cmd, addrMode, dstAddr, endpoint,
+                                  transSeqNumber, args);
+    va_end(args);
+    if (txFrame->len == 0) {
+        LOG_ERR(LOG_MOD_SOC, "ZCL command %u to 0x%04x does not fit a frame", cmd, dstAddr);
+        socTx_free(txFrame);
+        return -1;
+    }
+    txFrame->prio = desc->prio;
+    txFrame->cost = 1;
+    txFrame->paceDst = sched_dstKey(addrMode, dstAddr);
+    txFrame->key = key;
+
+    /* Group and broadcast commands get no single response */
+    if (addrMode != ADDR_MODE_GROUP && dstAddr < ZCL_BROADCAST_ADDR_MIN) {
+        trans_queue(txFrame, (desc->prio == SOC_TX_PRIO_INTERACTIVE) ? TRANS_RETRIES_INTERACTIVE : TRANS_RETRIES_BULK);
+    } else {
+        txFrame->cost = SCHED_BCAST_COST;
+        transSeqNumber++;
+    }
+
+    socTx_commit(txFrame, key);
+    return 0;
 }
 
 
@@ -168,43 +227,80 @@ void calcFcs(u8 *msg, int size)
  * @brief   opens the serial port to the ZigBee chip.
  *
  * @param   devicePath - path to the UART device
+ * @param   baud - rate of the UART, 0 to negotiate the fastest one the
+ *                 chip answers at
  *
  * @return  status
  */
-int socOpen(char *devicePath)
+int socOpen(char *devicePath, u32 baud)
 {
-    int i;
-    struct termios tio;
-
     /* open the device to be non-blocking (read will return immediatly) */
     serialPortFd = open(devicePath, O_RDWR | O_NOCTTY | O_NONBLOCK);
     if (serialPortFd <0) {
         perror(devicePath);
-        printf("%s open failed\n",devicePath);
+        LOG_ERR(LOG_MOD_SOC, "%s open failed", devicePath);
         return(-1);
     }
+    socDevicePath = devicePath;
+
+    ringBuf_init(&socRxBuf, socRxStorage, SOC_RX_BUF_SIZE);
+    soc_registerHandlers();
+    socTx_init(serialPortFd);
 
-    /* c-iflags
-     B115200 : set board rate to 115200
-     CRTSCTS : HW flow control (disabled below)
-     CS8     : 8n1 (8bit,no parity,1 stopbit)
-     CLOCAL  : local connection, no modem contol
-     CREAD   : enable receiving characters*/
-    tio.c_cflag = B115200 | /*CRTSCTS |*/ CS8 | CLOCAL | CREAD;
-    /* c-iflags
-     ICRNL   : maps 0xD (CR) to 0x10 (LR), we do not want this.
-     IGNPAR  : ignore bits with parity erros, I guess it is
-     better to ignStateore an erronious bit then interprit it incorrectly. */
-    tio.c_iflag = IGNPAR  & ~ICRNL;
-    tio.c_oflag = 0;
-    tio.c_lflag = 0;
-
-    tcflush(serialPortFd, TCIFLUSH);
-    tcsetattr(serialPortFd,TCSANOW,&tio);
+    /* Negotiating talks to the chip, the handlers must be in place */
+    if (socLink_open(serialPortFd, baud) != 0) {
+        printf("%s: serial settings not accepted\n", devicePath);
+        close(serialPortFd);
+        serialPortFd = -1;
+        return(-1);
+    }
 
     return serialPortFd;
 }
 
+/*********************************************************************
+ * @fn      socReopen
+ *
+ * @brief   Open the port of socOpen() again after it was lost. Its
+ *          settings are left to the caller.
+ *
+ * @param   none
+ *
+ * @return  the port, -1 if it is not back yet
+ */
+int socReopen(void)
+{
+    int fd = open(socDevicePath, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    if (fd < 0) {
+        LOG_DEBUG(LOG_MOD_SOC, "%s: %s", socDevicePath, strerror(errno));
+        return -1;
+    }
+
+    /* The rest of a frame cut short by the loss never comes */
+    ringBuf_init(&socRxBuf, socRxStorage, SOC_RX_BUF_SIZE);
+    serialPortFd = fd;
+    return fd;
+}
+
+/*********************************************************************
+ * @fn      socDrop
+ *
+ * @brief   Close the serial port after it was lost, without writing
+ *          what is queued
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void socDrop(void)
+{
+    if (serialPortFd >= 0) {
+        close(serialPortFd);
+        serialPortFd = -1;
+    }
+}
+
 
 /*********************************************************************
  * @fn      socClose
@@ -217,216 +313,507 @@ int socOpen(char *devicePath)
  */
 void socClose( void )
 {
-    tcflush(serialPortFd, TCOFLUSH);
+    if (serialPortFd < 0) {
+        return;
+    }
+
+    /* Give queued commands a last chance before dropping the rest */
+    socTx_flush();
+    tcdrain(serialPortFd);
     close(serialPortFd);
+    serialPortFd = -1;
     return;
 }
 
- /*********************************************************************
- * @fn      zll_ctrlRspHandler
+/*********************************************************************
+ * @fn      zll_devAnnHandler
  *
- * @brief   process the contrl pipe command
+ * @brief   A device joined, add it to the node list and report it to the
+ *          Apps
  *
- * @param   none
+ * @param   payload - parameters of the control message
+ * @param   len - length of the parameters
  *
  * @return  none
  */
-void zll_ctrlRspHandler(ctrl_cmd_t* pCmd)
+static void zll_devAnnHandler(const u8 *payload, u8 len)
 {
     u16 nwkAddr, devID;
     u8 extAddr[8];
     u8 devType;
-    u8 i, j;
-    if (pCmd->cmdID == ZLL_CTRL_CMD_DEV_ANN_IND) {
-        nwkAddr = *((u16*)&pCmd->payload[0]);
-        memcpy(extAddr, &pCmd->payload[2], 8);
-        printf("\nNew light join:\n    Network Addr : 0x%04x\n", nwkAddr);
-        printf("    Long Addr    : ");
-        for (i = 0; i < 8; i++) {
-            printf("0x%02x ", extAddr[i]);
-        }
-        printf("\n\n");
-
-        /* Report the data to apps */
-        devID = *((u16*)&pCmd->payload[12]);
-        if (devID == 0x0100 || devID == 0x0101 || devID == 0x0102 || devID == 0x0210) {
-            devType = DEV_TYPE_LIGHT;
-        } else if (devID = 0x0000) {
-            devType = DEV_TYPE_ONOFF_SWITCH;
-        } else {
-            devType = DEV_TYPE_UNKNOWN;
-        }
-        nodes_add(nwkAddr, extAddr, pCmd->payload[10], devID, pCmd->payload[11]);
-        app_sendDeviceReportCmd(devType, nwkAddr, extAddr);
+
+    nwkAddr = BUILD_UINT16(payload[0], payload[1]);
+    memcpy(extAddr, &payload[2], 8);
+    LOG_INFO(LOG_MOD_SOC, "New light join: 0x%04x %02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x", nwkAddr,
+             extAddr[0], extAddr[1], extAddr[2], extAddr[3], extAddr[4], extAddr[5], extAddr[6], extAddr[7]);
+
+    /* Report the data to apps */
+    devID = BUILD_UINT16(payload[12], payload[13]);
+    if (devID == 0x0100 || devID == 0x0101 || devID == 0x0102 || devID == 0x0210) {
+        devType = DEV_TYPE_LIGHT;
+    } else if (devID == 0x0000) {
+        devType = DEV_TYPE_ONOFF_SWITCH;
+    } else {
+        devType = DEV_TYPE_UNKNOWN;
     }
-    else if (pCmd->cmdID == ZLL_CTRL_CMD_GET_NODES) {
-        u8 *ptr = (u8*)&pCmd->payload[0];
-        u8 nodeNum = *ptr++;
-        printf("Node List (%d Node(s)) is:\n", nodeNum);
-        for (i=0; i<nodeNum; i++) {
-            printf("Node %d: \n", i + 1);
-            nwkAddr = *((u16*)ptr);
-            ptr += 2;
-            printf("\tNetwork Addr : 0x%04x\n", nwkAddr);
-        }
-        printf("\n\n");
+    nodes_add(nwkAddr, extAddr, payload[10], devID, payload[11]);
+    app_sendDeviceReportCmd(devType, nwkAddr, extAddr);
+}
+
+/*********************************************************************
+ * @fn      zll_getNodesHandler
+ *
+ * @brief   Log the node list of the coordinator
+ *
+ * @param   payload - parameters of the control message
+ * @param   len - length of the parameters
+ *
+ * @return  none
+ */
+static void zll_getNodesHandler(const u8 *payload, u8 len)
+{
+    u8 nodeNum = payload[0];
+    u8 i;
+
+    LOG_INFO(LOG_MOD_SOC, "Node List (%d Node(s))", nodeNum);
+    for (i = 0; i < nodeNum && 1 + 2 * (i + 1) <= len; i++) {
+        LOG_INFO(LOG_MOD_SOC, "Node %d: 0x%04x", i + 1, BUILD_UINT16(payload[1 + 2 * i], payload[2 + 2 * i]));
+    }
+}
+
+/*
+ * Handlers of the control messages, by @ref zll_ctrl_command_id
+ */
+static const soc_ctrlEntry_t soc_ctrlTbl[] = {
+    [ZLL_CTRL_CMD_DEV_ANN_IND] = { zll_devAnnHandler, 14 },
+    [ZLL_CTRL_CMD_GET_NODES] = { zll_getNodesHandler, 1 },
+};
+
+ /*********************************************************************
+ * @fn      zll_ctrlRspHandler
+ *
+ * @brief   process the contrl pipe command
+ *
+ * @param   frame - the RPC frame
+ *
+ * @return  none
+ */
+static void zll_ctrlRspHandler(const socRx_mt_t *frame)
+{
+    const ctrl_cmd_t *pCmd = (const ctrl_cmd_t*)frame->payload;
+    const soc_ctrlEntry_t *entry = NULL;
+    u8 len = frame->len - SOC_CTRL_HDR_LEN;
+
+    if (pCmd->cmdID < sizeof(soc_ctrlTbl) / sizeof(soc_ctrlTbl[0])) {
+        entry = &soc_ctrlTbl[pCmd->cmdID];
+    }
+    if (!entry || !entry->handler) {
+        stats_v->rxUnknown++;
+        LOG_DEBUG(LOG_MOD_SOC, "unknown control message 0x%02x", pCmd->cmdID);
+        return;
     }
+    if (len < entry->minLen) {
+        stats_v->rxShort++;
+        LOG_WARN(LOG_MOD_SOC, "control message 0x%02x: %u bytes, %u needed", pCmd->cmdID, len, entry->minLen);
+        return;
+    }
+    entry->handler(pCmd->payload, len);
 }
 
  /*********************************************************************
- * @fn      zll_dataRspHandler
+ * @fn      zll_attrValueLen
  *
- * @brief   process the data pipe command, ZCL
+ * @brief   Get the length of an attribute value from its ZCL data type
  *
- * @param   none
+ * @param   type - ZCL data type
+ * @param   p - the value
+ * @param   end - end of the payload
+ *
+ * @return  length of the value, 0 for types which can not be skipped
+ */
+static u32 zll_attrValueLen(u8 type, const u8 *p, const u8 *end)
+{
+    /* Data, bool, bitmap, unsigned and signed integers of 1 to 8 bytes */
+    if (type >= 0x08 && type <= 0x2F) {
+        return (type & 0x07) + 1;
+    }
+
+    switch (type) {
+    case 0x30:                                /* enum8 */
+        return 1;
+    case 0x31:                                /* enum16 */
+    case 0x38:                                /* semi-precision */
+    case 0xE8:                                /* cluster ID */
+    case 0xE9:                                /* attribute ID */
+        return 2;
+    case 0x39:                                /* single precision */
+    case 0xE0:                                /* time of day */
+    case 0xE1:                                /* date */
+    case 0xE2:                                /* UTC time */
+    case 0xEA:                                /* BACnet OID */
+        return 4;
+    case 0x3A:                                /* double precision */
+    case 0xF0:                                /* IEEE address */
+        return 8;
+    case 0xF1:                                /* security key */
+        return 16;
+    case 0x41:                                /* octet string */
+    case 0x42:                                /* character string */
+        return (p < end) ? 1 + p[0] : 0;
+    case 0x43:                                /* long octet string */
+    case 0x44:                                /* long character string */
+        return (p + 1 < end) ? 2 + BUILD_UINT16(p[0], p[1]) : 0;
+    default:
+        return 0;
+    }
+}
+
+/*********************************************************************
+ * @fn      zll_attrRspHandler
+ *
+ * @brief   Store the attributes of a read attributes response or an
+ *          attribute report in the cache, and pass the cached ones on
+ *          to the Apps
+ *
+ * @param   frame - the ZCL frame
  *
  * @return  none
  */
-void zll_dataRspHandler(data_cmd_t *pData)
+static void zll_attrRspHandler(const socRx_zcl_t *frame)
 {
-    //if (transSeqNumber-1 != pData->zclTransSeqNo) {
-    //    printf("not last command response\n");
-    //}
+    const u8 *p = frame->payload;
+    const u8 *end = frame->payload + frame->len;
+    u16 attrId;
     u8 status;
-    u16 groupID;
+    u32 len;
+    int attr;
+
+    while (p + 3 <= end) {
+        attrId = BUILD_UINT16(p[0], p[1]);
+        attr = attrCache_attrOf(frame->clusterID, attrId);
+        p += 2;
+
+        /* Read responses carry a status, and a value only on success */
+        status = (frame->cmdID == ZCL_CMD_READ_RSP) ? *p++ : ZCL_STATUS_SUCCESS;
+        if (status != ZCL_STATUS_SUCCESS) {
+            if (attr >= 0) {
+                attrCache_invalidate(frame->srcAddr, frame->srcEndpoint, frame->clusterID);
+                app_sendAttrRspCmd(frame->srcAddr, frame->srcEndpoint, attr, status, 0);
+            }
+            continue;
+        }
 
-    switch (pData->clusterID) {
-    case ZCL_CLUSTER_ID_GEN_ON_OFF:
-        if ( pData->payload[0] == 4 ) {
-            printf("resetflash ");
+        if (p >= end) {
             break;
         }
-        #if 0
-        printf("setstate ");
-        if (pData->payload[0] == 1) {
-            printf("on ");
-        } else if (pData->payload[0] == 0) {
-            printf("off ");
-        } else if (pData->payload[0] == 2) {
-            printf("toggle ");
-        }
-        #endif
-         printf("received ZCL command ");
-        if (pData->cmdID == 1) {
-            printf("on \n");
-        } else if (pData->cmdID == 0) {
-            printf("off \n");
-        } else if (pData->cmdID == 2) {
-            printf("toggle \n");
-        }
-        break;
-
-    case ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL:
-        printf("setlevel ");
-        if (pData->payload[0] == 4) {
-            printf("moveToLevWithOnoff ");
-        } else if (pData->payload[0] == 0) {
-            printf("moveToLev ");
-        } else if (pData->payload[0] == 2) {
-            printf("step ");
-        }
-        break;
-
-    case ZCL_CLUSTER_ID_GEN_GROUPS:
-        printf("group command ");
-        if (pData->cmdID == 0x0B) {
-            /* Default Response */
+        len = zll_attrValueLen(p[0], p + 1, end);
+        p++;
+        if (len == 0 || p + len > end) {
+            LOG_WARN(LOG_MOD_SOC, "attribute 0x%04x of 0x%04x: bad value", attrId, frame->srcAddr);
             break;
         }
-        status = pData->payload[0];
-        memcpy((u8*)&groupID, &pData->payload[1], 2);
-        if (pData->cmdID == 0) {
-            printf("add group response: 0x%x, groupID: 0x%x\n", status, groupID);
+
+        if (attr >= 0 && len == 1) {
+            attrCache_update(frame->srcAddr, frame->srcEndpoint, attr, p[0]);
+            app_sendAttrRspCmd(frame->srcAddr, frame->srcEndpoint, attr, ZCL_STATUS_SUCCESS, p[0]);
         }
+        p += len;
+    }
+}
 
-        app_sendGroupRspCmd(pData->dstNwkAddr, groupID, pData->cmdID, status);
+/*********************************************************************
+ * @fn      zll_defaultRspHandler
+ *
+ * @brief   Log a command a device refused, the transaction it ends is
+ *          already matched
+ *
+ * @param   frame - the ZCL frame
+ *
+ * @return  none
+ */
+static void zll_defaultRspHandler(const socRx_zcl_t *frame)
+{
+    if (frame->payload[1] != ZCL_STATUS_SUCCESS) {
+        LOG_DEBUG(LOG_MOD_SOC, "command 0x%02x of cluster 0x%04x failed on 0x%04x: 0x%02x",
+                  frame->payload[0], frame->clusterID, frame->srcAddr, frame->payload[1]);
+    }
+}
 
-    default:
+/*********************************************************************
+ * @fn      zll_onOffCmdHandler
+ *
+ * @brief   Log an on/off command sent by a device, such as a switch
+ *
+ * @param   frame - the ZCL frame
+ *
+ * @return  none
+ */
+static void zll_onOffCmdHandler(const socRx_zcl_t *frame)
+{
+    LOG_DEBUG(LOG_MOD_SOC, "received ZCL command %s from 0x%04x",
+              (frame->cmdID == COMMAND_ON_OFF_ON) ? "on" : (frame->cmdID == COMMAND_ON_OFF_OFF) ? "off" :
+              (frame->cmdID == COMMAND_ON_OFF_TOGGLE) ? "toggle" : "resetflash", frame->srcAddr);
+}
 
-        break;
+/*********************************************************************
+ * @fn      zll_levelCmdHandler
+ *
+ * @brief   Log a level command sent by a device, such as a dimmer
+ *
+ * @param   frame - the ZCL frame
+ *
+ * @return  none
+ */
+static void zll_levelCmdHandler(const socRx_zcl_t *frame)
+{
+    LOG_DEBUG(LOG_MOD_SOC, "setlevel %s from 0x%04x",
+              (frame->cmdID == COMMAND_LEVEL_MOVE_TO_LEVEL_WITH_ONOFF) ? "moveToLevWithOnoff" :
+              (frame->cmdID == COMMAND_LEVEL_MOVE_TO_LEVEL) ? "moveToLev" : "step", frame->srcAddr);
+}
+
+/*********************************************************************
+ * @fn      zll_groupRspHandler
+ *
+ * @brief   Keep the membership index current from the add, view and
+ *          remove group responses, and pass them on to the Apps
+ *
+ * @param   frame - the ZCL frame: status, group ID
+ *
+ * @return  none
+ */
+static void zll_groupRspHandler(const socRx_zcl_t *frame)
+{
+    u8 status = frame->payload[0];
+    u16 groupID = BUILD_UINT16(frame->payload[1], frame->payload[2]);
+
+    if (frame->cmdID == COMMAND_GROUP_ADD) {
+        LOG_INFO(LOG_MOD_SOC, "add group response from 0x%04x: 0x%x, groupID: 0x%x", frame->srcAddr, status, groupID);
     }
 
-    //if (pData->payload[1] == 0) {
-    //    printf("success!\n\n");
-    //} else {
-    //    printf("fail! error code: 0x%x\n\n", pData->payload[1]);
-    //}
+    if (status == ZCL_STATUS_SUCCESS && frame->cmdID == COMMAND_GROUP_ADD) {
+        groups_addMember(groupID, frame->srcAddr);
+    } else if (status == ZCL_STATUS_SUCCESS && frame->cmdID == COMMAND_GROUP_REMOVE) {
+        groups_removeMember(groupID, frame->srcAddr);
+    }
+
+    app_sendGroupRspCmd(frame->srcAddr, groupID, frame->cmdID, status);
 }
 
- /*********************************************************************
- * @fn      processSocCmd
+/*********************************************************************
+ * @fn      zll_groupMembershipHandler
  *
- * @brief   read and process the RPC from the ZLL controller
+ * @brief   Replace the groups of a device from its get group membership
+ *          response
  *
- * @param   none
+ * @param   frame - the ZCL frame: capacity, count, group list
  *
  * @return  none
  */
-static u8 retryAttempts = 0;
-void processSocCmd(void)
+static void zll_groupMembershipHandler(const socRx_zcl_t *frame)
 {
-    u8 rpcLen, bytesRead, *rpcBuff, rpcBuffIdx;
-    u8 rspLen;
-    u8 rspBuf[50];
-    u8 sof;
+    u16 groupIDs[0xFF];
+    u32 num = (frame->len - 2) / 2;
+    u32 i;
 
-    int i;
-    gw_app_cmd_t* pCmd;
+    if (frame->payload[1] < num) {
+        num = frame->payload[1];
+    }
+    for (i = 0; i < num; i++) {
+        groupIDs[i] = BUILD_UINT16(frame->payload[2 + 2 * i], frame->payload[3 + 2 * i]);
+    }
+    groups_setMembership(frame->srcAddr, groupIDs, num);
+}
 
-    read(serialPortFd, &sof, 1);
-    if (sof != 0xFE) {
-        printf("zllSocProcessRpc: soc failed\n");
+/*********************************************************************
+ * @fn      zll_dataRspHandler
+ *
+ * @brief   process the data pipe command, ZCL
+ *
+ * @param   frame - the RPC frame
+ *
+ * @return  none
+ */
+static void zll_dataRspHandler(const socRx_mt_t *frame)
+{
+    const data_cmd_t *pData = (const data_cmd_t*)frame->payload;
+    socRx_zcl_t zcl;
+    u8 rspStatus = ZCL_STATUS_SUCCESS;
+    u8 isRsp;
+    int rtt;
+
+    /* dataLen counts the ZCL header, the rest must be in the frame */
+    if (pData->dataLen < ZCL_HDR_LEN || pData->dataLen - ZCL_HDR_LEN > frame->len - SOC_DATA_HDR_LEN) {
+        stats_v->badFrames++;
         return;
     }
 
-    read(serialPortFd, &rspLen, 1);
-    rspBuf[0] = rspLen;
-
-    rpcBuffIdx = 1;
-    while(rspLen > 0) {
-        bytesRead = read(serialPortFd, &(rspBuf[rpcBuffIdx]), rspLen);
-
-        //check for error
-        if (bytesRead > rspLen) {
-          //there was an error
-          //printf("zllSocProcessRpc: read of %d bytes failed - %s\n", rpcLen, strerror(errno) );
-
-            if (retryAttempts++ < 5 ) {
-                //sleep for 10ms
-	            usleep(10000);
-                //try again
-                bytesRead = 0;
-            } else {
-                //something went wrong.
-                printf("zllSocProcessRpc: failed\n");
-                return;
-            }
+    zcl.srcAddr = pData->dstNwkAddr;
+    zcl.srcEndpoint = pData->dstEndpoint;
+    zcl.clusterID = pData->clusterID;
+    zcl.addrMode = pData->addrMode;
+    zcl.frameCtrl = pData->zclFrameCtrl;
+    zcl.seq = pData->zclTransSeqNo;
+    zcl.cmdID = pData->cmdID;
+    zcl.len = pData->dataLen - ZCL_HDR_LEN;
+    zcl.payload = pData->payload;
+
+    /* Match a response to the command it answers. Reports and the
+     * commands of switches carry seqs of their own, they answer nothing. */
+    if (zcl.frameCtrl & ZCL_FRAME_CTRL_CLUSTER) {
+        isRsp = (zcl.frameCtrl & ZCL_FRAME_CTRL_TO_CLIENT) != 0;
+    } else {
+        isRsp = (zcl.cmdID == ZCL_CMD_DEFAULT_RSP || zcl.cmdID == ZCL_CMD_READ_RSP);
+        if (zcl.cmdID == ZCL_CMD_DEFAULT_RSP && zcl.len >= 2) {
+            rspStatus = zcl.payload[1];
         }
-
-        rspLen -= bytesRead;
-        rpcBuffIdx += bytesRead;
     }
-
-    printf("received ZC command:\n");
-    for (i = 0; i < rpcBuffIdx; i++) {
-        printf("0x%x ", rspBuf[i]);
+    if (isRsp) {
+        rtt = trans_match(zcl.seq, zcl.srcAddr, zcl.clusterID, rspStatus);
+        if (rtt != TRANS_NO_MATCH) {
+            LOG_DEBUG(LOG_MOD_SOC, "seq 0x%02x from 0x%04x: status 0x%02x after %d us",
+                   zcl.seq, zcl.srcAddr, rspStatus, rtt);
+        }
     }
-    printf("\n");
 
-    pCmd = (gw_app_cmd_t*)&rspBuf;
-    switch (pCmd->cmd1) {
-    case 0x80:
-        zll_dataRspHandler(&pCmd->data.dataCmd);
-        break;
+    socRx_dispatchZcl(&zcl);
+}
 
-    case 0x81:
-        zll_ctrlRspHandler(&pCmd->data.ctrlCmd);
-        break;
+/*********************************************************************
+ * @fn      soc_registerHandlers
+ *
+ * @brief   Register the handlers of the frames the SoC sends
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void soc_registerHandlers(void)
+{
+    socRx_init();
+    socReq_init();
 
-    default:
-        break;
+    socRx_register(MT_RPC_CMD_AREQ | MT_RPC_SYS_APP, MT_APP_RSP, SOC_DATA_HDR_LEN, zll_dataRspHandler);
+    socRx_register(MT_RPC_CMD_AREQ | MT_RPC_SYS_APP, MT_APP_ZLL_TL_IND, SOC_CTRL_HDR_LEN, zll_ctrlRspHandler);
+
+    socRx_registerFoundation(ZCL_CMD_READ_RSP, 0, zll_attrRspHandler);
+    socRx_registerFoundation(ZCL_CMD_REPORT_ATTR, 0, zll_attrRspHandler);
+    socRx_registerFoundation(ZCL_CMD_DEFAULT_RSP, 2, zll_defaultRspHandler);
+
+    socRx_registerZcl(ZCL_CLUSTER_ID_GEN_ON_OFF, COMMAND_ON_OFF_OFF, 0, zll_onOffCmdHandler);
+    socRx_registerZcl(ZCL_CLUSTER_ID_GEN_ON_OFF, COMMAND_ON_OFF_ON, 0, zll_onOffCmdHandler);
+    socRx_registerZcl(ZCL_CLUSTER_ID_GEN_ON_OFF, COMMAND_ON_OFF_TOGGLE, 0, zll_onOffCmdHandler);
+    socRx_registerZcl(ZCL_CLUSTER_ID_GEN_ON_OFF, COMMAND_ON_OFF_FLASH_RESET, 0, zll_onOffCmdHandler);
+
+    socRx_registerZcl(ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL, COMMAND_LEVEL_MOVE_TO_LEVEL, 0, zll_levelCmdHandler);
+    socRx_registerZcl(ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL, COMMAND_LEVEL_STEP, 0, zll_levelCmdHandler);
+    socRx_registerZcl(ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL, COMMAND_LEVEL_MOVE_TO_LEVEL_WITH_ONOFF, 0, zll_levelCmdHandler);
+
+    socRx_registerZcl(ZCL_CLUSTER_ID_GEN_GROUPS, COMMAND_GROUP_ADD, 3, zll_groupRspHandler);
+    socRx_registerZcl(ZCL_CLUSTER_ID_GEN_GROUPS, COMMAND_GROUP_VIEW, 3, zll_groupRspHandler);
+    socRx_registerZcl(ZCL_CLUSTER_ID_GEN_GROUPS, COMMAND_GROUP_GET_MEMBERSHIP, 2, zll_groupMembershipHandler);
+    socRx_registerZcl(ZCL_CLUSTER_ID_GEN_GROUPS, COMMAND_GROUP_REMOVE, 3, zll_groupRspHandler);
+}
+
+ /*********************************************************************
+ * @fn      soc_parseFrames
+ *
+ * @brief   extract and dispatch every complete RPC frame in the receive
+ *          ring buffer. Garbage is skipped up to the next SOF, a partial
+ *          frame is left in the buffer until the rest of it arrives.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void soc_parseFrames(void)
+{
+    u8 frame[SOC_MAX_FRAME_LEN];
+    socRx_mt_t mt;
+    u32 used, frameLen;
+    u8 len;
+    int sof;
+
+    while ((used = ringBuf_used(&socRxBuf)) > 0) {
+        /* Resync on the next SOF */
+        if (ringBuf_peek(&socRxBuf, 0) != MT_RPC_SOF) {
+            sof = ringBuf_find(&socRxBuf, 1, MT_RPC_SOF);
+            ringBuf_drop(&socRxBuf, (sof == RING_BUF_NOT_FOUND) ? used : (u32)sof);
+            stats_v->resyncs++;
+            continue;
+        }
+
+        if (used < 2) {
+            break;
+        }
+
+        /* The length field covers cmd0, cmd1 and the payload */
+        len = ringBuf_peek(&socRxBuf, 1);
+        if (len < 2) {
+            ringBuf_drop(&socRxBuf, 1);
+            stats_v->badFrames++;
+            continue;
+        }
+
+        frameLen = len + MT_RPC_FRAME_OVERHEAD;
+        if (used < frameLen) {
+            /* Wait for the rest of the frame */
+            break;
+        }
+
+        ringBuf_copy(&socRxBuf, 0, frame, frameLen);
+        if (soc_xorSum(&frame[1], len + 1) != frame[frameLen - 1]) {
+            /* Might have locked onto a 0xFE inside a payload, skip it */
+            ringBuf_drop(&socRxBuf, 1);
+            stats_v->fcsErrors++;
+            continue;
+        }
+
+        ringBuf_drop(&socRxBuf, frameLen);
+        stats_v->rxFrames[frame[2] & STATS_MT_SYS_MASK]++;
+        CAPTURE(CAPTURE_SOC_RX, CAPTURE_NO_CONN, frame, frameLen);
+        LOG_HEX(LOG_MOD_SOC, LOG_LEVEL_DEBUG, "rx", &frame[1], len + 1);
+        mt.cmd0 = frame[2];
+        mt.cmd1 = frame[3];
+        mt.len = len - 2;
+        mt.payload = &frame[4];
+        socRx_dispatch(&mt);
     }
+}
 
+ /*********************************************************************
+ * @fn      processSocCmd
+ *
+ * @brief   read and process the RPC from the ZLL controller
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void processSocCmd(void)
+{
+    int bytesRead;
+
+    /* Edge triggered, read until the driver is empty */
+    do {
+        /* Take everything the driver has buffered in one go */
+        bytesRead = ringBuf_readFd(&socRxBuf, serialPortFd);
+        if (bytesRead > 0) {
+            stats_v->uartRxBytes += bytesRead;
+        } else if (bytesRead < 0 && errno == EINTR) {
+            stats_v->uartReadRetries++;
+        } else if (bytesRead == 0 && ringBuf_space(&socRxBuf)) {
+            /* End of file, the device went away */
+            socLink_lost("port hung up");
+            return;
+        } else if (bytesRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            stats_v->uartReadErrors++;
+            perror("zllSocProcessRpc: read failed");
+            socLink_lost("read failed");
+            return;
+        }
+
+        soc_parseFrames();
+    } while (bytesRead > 0 || (bytesRead < 0 && errno == EINTR));
 }
 
 
@@ -454,8 +841,7 @@ void zllSocTouchLink(void)
     };
 
     calcFcs(tlCmd, sizeof(tlCmd));
-    write(serialPortFd,tlCmd, sizeof(tlCmd));
-    tcflush(serialPortFd, TCOFLUSH);
+    socTx_enqueue(tlCmd, sizeof(tlCmd), SOC_TX_NO_COALESCE);
 }
 
 /*********************************************************************
@@ -469,7 +855,7 @@ void zllSocTouchLink(void)
  */
 void zllSocGetNodes(void)
 {
-    u8 cmd[30];
+    u8 cmd[30] = {0};
   	int i;
   	cmd[0] = 0xFE;
   	gw_app_cmd_t *pCmd = (gw_app_cmd_t*)(&cmd[1]);
@@ -486,8 +872,8 @@ void zllSocGetNodes(void)
     //}
     //printf("\n");
 
-    write(serialPortFd,cmd,sizeof(cmd));
-    tcflush(serialPortFd, TCOFLUSH);
+    calcFcs(cmd, pCmd->len + MT_RPC_FRAME_OVERHEAD);
+    socTx_enqueue(cmd, pCmd->len + MT_RPC_FRAME_OVERHEAD, SOC_TX_NO_COALESCE);
 
 }
 
@@ -504,11 +890,11 @@ void zllSocGetNodes(void)
  */
 void zllSocDemoBind(u8 addrMode, u16 addr)
 {
-    u8 cmd[30];
+    u8 cmd[30] = {0};
   	int i;
   	cmd[0] = 0xFE;
   	gw_app_cmd_t *pCmd = (gw_app_cmd_t*)(&cmd[1]);
-  	pCmd->len = 15;
+  	pCmd->len = 18;
   	pCmd->cmd0 = 0x49;
   	pCmd->cmd1 = 0x00;
   	pCmd->data.ctrlCmd.endpoint = 0xB;
@@ -521,13 +907,9 @@ void zllSocDemoBind(u8 addrMode, u16 addr)
     pCmd->data.ctrlCmd.payload[1] = (addr & 0xff00) >> 8;
     pCmd->data.ctrlCmd.payload[2] = addrMode;
 
-    for(i=0; i<20; i++) {
-        printf("0x%x ", cmd[i]);
-    }
-    printf("\n");
 
-    write(serialPortFd,cmd,sizeof(cmd));
-    tcflush(serialPortFd, TCOFLUSH);
+    calcFcs(cmd, pCmd->len + MT_RPC_FRAME_OVERHEAD);
+    socTx_enqueue(cmd, pCmd->len + MT_RPC_FRAME_OVERHEAD, SOC_TX_NO_COALESCE);
 
 }
 /*********************************************************************
@@ -554,8 +936,7 @@ void zllSocResetToFn(void)
     };
 
     calcFcs(tlCmd, sizeof(tlCmd));
-    write(serialPortFd,tlCmd, sizeof(tlCmd));
-    tcflush(serialPortFd, TCOFLUSH);
+    socTx_enqueue(tlCmd, sizeof(tlCmd), SOC_TX_NO_COALESCE);
 }
 
 /*********************************************************************
@@ -582,8 +963,7 @@ void zllSocSendResetToFn(void)
     };
 
     calcFcs(tlCmd, sizeof(tlCmd));
-    write(serialPortFd,tlCmd, sizeof(tlCmd));
-    tcflush(serialPortFd, TCOFLUSH);
+    socTx_enqueue(tlCmd, sizeof(tlCmd), SOC_TX_NO_COALESCE);
 }
 
 /*********************************************************************
@@ -600,30 +980,10 @@ void zllSocSendResetToFn(void)
  */
 void zllSocSetState(u8 state, u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-  	u8 cmd[30];
-  	int i;
-  	cmd[0] = 0xFE;
-  	gw_app_cmd_t *pCmd = (gw_app_cmd_t*)(&(cmd[1]));
-  	pCmd->len = 13;
-  	pCmd->cmd0 = 0x49;
-  	pCmd->cmd1 = 0x00;
-  	pCmd->data.dataCmd.endpoint = 0xB;
-  	pCmd->data.dataCmd.dstNwkAddr = dstAddr;
-  	pCmd->data.dataCmd.dstEndpoint = endpoint;
-  	pCmd->data.dataCmd.clusterID = ZCL_CLUSTER_ID_GEN_ON_OFF;
-  	pCmd->data.dataCmd.dataLen = 3;
-  	pCmd->data.dataCmd.addrMode = addrMode;
-  	pCmd->data.dataCmd.zclFrameCtrl = 0x01;
-  	pCmd->data.dataCmd.zclTransSeqNo = transSeqNumber++;
-  	pCmd->data.dataCmd.cmdID = (state ? 1:0);
-
-    for(i=0; i<pCmd->len+1; i++) {
-        printf("0x%x ", cmd[i]);
+    if (soc_sendZcl(socTx_dataKey(addrMode, dstAddr, endpoint, ZCL_CLUSTER_ID_GEN_ON_OFF, 0),
+                    state ? ZCL_ENC_ON : ZCL_ENC_OFF, addrMode, dstAddr, endpoint) == 0) {
+        attrCache_cmdSent(addrMode, dstAddr, endpoint, ATTR_CACHE_ON_OFF, state ? 1 : 0);
     }
-    printf("\n");
-
-    write(serialPortFd,cmd,sizeof(cmd));
-    tcflush(serialPortFd, TCOFLUSH);
 }
 
 /*********************************************************************
@@ -632,6 +992,7 @@ void zllSocSetState(u8 state, u16 dstAddr, u8 endpoint, u8 addrMode)
  * @brief   Send the level command to a ZLL light.
  *
  * @param   level - 0-128 = 0-100%
+ * @param   time - transition time in 1/10 s
  * @param   dstAddr - Nwk Addr or Group ID of the Light(s) to be controled.
  * @param   endpoint - endpoint of the Light.
  * @param   addrMode - Unicast or Group cast.
@@ -640,35 +1001,13 @@ void zllSocSetState(u8 state, u16 dstAddr, u8 endpoint, u8 addrMode)
  */
 void zllSocSetLevel(u8 level, u16 time, u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-  	u8 cmd[30];
-  	int i;
-  	cmd[0] = 0xFE;
-  	gw_app_cmd_t *pCmd = (gw_app_cmd_t*)(&(cmd[1]));
-  	pCmd->len = 16;
-  	pCmd->cmd0 = 0x49;
-  	pCmd->cmd1 = 0x00;
-  	pCmd->data.dataCmd.endpoint = 0xB;
-  	pCmd->data.dataCmd.dstNwkAddr = dstAddr;
-  	pCmd->data.dataCmd.dstEndpoint = endpoint;
-  	pCmd->data.dataCmd.clusterID = ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL;
-  	pCmd->data.dataCmd.dataLen = 6;
-  	pCmd->data.dataCmd.addrMode = addrMode;
-  	pCmd->data.dataCmd.zclFrameCtrl = 0x01;
-  	pCmd->data.dataCmd.zclTransSeqNo = transSeqNumber++;
-  	pCmd->data.dataCmd.cmdID = COMMAND_LEVEL_MOVE_TO_LEVEL_WITH_ONOFF;
-
-  	pCmd->data.dataCmd.payload[0] = level;
-  	pCmd->data.dataCmd.payload[1] = (time & 0xff);
-  	pCmd->data.dataCmd.payload[2] = (time & 0xff00) >> 8;
-
-    for(i=0; i<pCmd->len+1; i++) {
-        printf("0x%x ", cmd[i]);
+    if (soc_sendZcl(socTx_dataKey(addrMode, dstAddr, endpoint, ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL,
+                                  COMMAND_LEVEL_MOVE_TO_LEVEL_WITH_ONOFF),
+                    ZCL_ENC_MOVE_TO_LEVEL_ONOFF, addrMode, dstAddr, endpoint, level, time) == 0) {
+        /* Move to level with on/off also switches the light */
+        attrCache_cmdSent(addrMode, dstAddr, endpoint, ATTR_CACHE_LEVEL, level);
+        attrCache_cmdSent(addrMode, dstAddr, endpoint, ATTR_CACHE_ON_OFF, level ? 1 : 0);
     }
-    printf("\n");
-
-
-    write(serialPortFd,cmd,sizeof(cmd));
-    tcflush(serialPortFd, TCOFLUSH);
 }
 
 
@@ -677,6 +1016,7 @@ void zllSocSetLevel(u8 level, u16 time, u16 dstAddr, u8 endpoint, u8 addrMode)
  *
  * @brief   Send the Identify command to a ZLL light.
  *
+ * @param   time - identify time in s
  * @param   dstAddr - Nwk Addr or Group ID of the Light(s) to be controled.
  * @param   endpoint - endpoint of the Light.
  * @param   addrMode - Unicast or Group cast.
@@ -685,34 +1025,7 @@ void zllSocSetLevel(u8 level, u16 time, u16 dstAddr, u8 endpoint, u8 addrMode)
  */
 void zllSocIdentify(u16 time, u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-  	u8 cmd[30];
-  	int i;
-  	cmd[0] = 0xFE;
-  	gw_app_cmd_t *pCmd = (gw_app_cmd_t*)(&(cmd[1]));
-  	pCmd->len = 16;
-  	pCmd->cmd0 = 0x49;
-  	pCmd->cmd1 = 0x00;
-  	pCmd->data.dataCmd.endpoint = 0xB;
-  	pCmd->data.dataCmd.dstNwkAddr = dstAddr;
-  	pCmd->data.dataCmd.dstEndpoint = endpoint;
-  	pCmd->data.dataCmd.clusterID = ZCL_CLUSTER_ID_GEN_IDENTIFY;
-  	pCmd->data.dataCmd.dataLen = 6;
-  	pCmd->data.dataCmd.addrMode = addrMode;
-  	pCmd->data.dataCmd.zclFrameCtrl = 0x01;
-  	pCmd->data.dataCmd.zclTransSeqNo = transSeqNumber++;
-  	pCmd->data.dataCmd.cmdID = 0; // identify
-
-  	pCmd->data.dataCmd.payload[0] = (time & 0xff);
-  	pCmd->data.dataCmd.payload[1] = (time & 0xff00) >> 8;
-
-    for(i=0; i<pCmd->len+1; i++) {
-        printf("0x%x ", cmd[i]);
-    }
-    printf("\n");
-
-
-    write(serialPortFd,cmd,sizeof(cmd));
-    tcflush(serialPortFd, TCOFLUSH);
+    soc_sendZcl(SOC_TX_NO_COALESCE, ZCL_ENC_IDENTIFY, addrMode, dstAddr, endpoint, time);
 }
 
 /*********************************************************************
@@ -721,6 +1034,7 @@ void zllSocIdentify(u16 time, u16 dstAddr, u8 endpoint, u8 addrMode)
  * @brief   Send the hue command to a ZLL light.
  *
  * @param   hue - 0-128 represent the 360Deg hue color wheel : 0=red, 42=blue, 85=green
+ * @param   time - transition time in 1/10 s
  * @param   dstAddr - Nwk Addr or Group ID of the Light(s) to be controled.
  * @param   endpoint - endpoint of the Light.
  * @param   addrMode - Unicast or Group cast.
@@ -729,34 +1043,12 @@ void zllSocIdentify(u16 time, u16 dstAddr, u8 endpoint, u8 addrMode)
  */
 void zllSocSetHue(u8 hue, u16 time, u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-	u8 cmd[30];
-  	int i;
-  	cmd[0] = 0xFE;
-  	gw_app_cmd_t *pCmd = (gw_app_cmd_t*)(&(cmd[1]));
-  	pCmd->len = 16;
-  	pCmd->cmd0 = 0x49;
-  	pCmd->cmd1 = 0x00;
-  	pCmd->data.dataCmd.endpoint = 0xB;
-  	pCmd->data.dataCmd.dstNwkAddr = dstAddr;
-  	pCmd->data.dataCmd.dstEndpoint = endpoint;
-  	pCmd->data.dataCmd.clusterID = ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL;
-  	pCmd->data.dataCmd.dataLen = 8;
-  	pCmd->data.dataCmd.addrMode = addrMode;
-  	pCmd->data.dataCmd.zclFrameCtrl = 0x01;
-  	pCmd->data.dataCmd.zclTransSeqNo = transSeqNumber++;
-  	pCmd->data.dataCmd.cmdID = COMMAND_LIGHTING_MOVE_TO_HUE;
-
-  	pCmd->data.dataCmd.payload[0] = hue;
-  	pCmd->data.dataCmd.payload[1] = (time & 0xff);
-  	pCmd->data.dataCmd.payload[2] = (time & 0xff00) >> 8;
-
-    for(i=0; i<pCmd->len+1; i++) {
-        printf("0x%x ", cmd[i]);
+    /* Direction 0: shortest distance around the color wheel */
+    if (soc_sendZcl(socTx_dataKey(addrMode, dstAddr, endpoint, ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL,
+                                  COMMAND_LIGHTING_MOVE_TO_HUE),
+                    ZCL_ENC_MOVE_TO_HUE, addrMode, dstAddr, endpoint, hue, 0, time) == 0) {
+        attrCache_cmdSent(addrMode, dstAddr, endpoint, ATTR_CACHE_HUE, hue);
     }
-    printf("\n");
-
-    write(serialPortFd,cmd,sizeof(cmd));
-    tcflush(serialPortFd, TCOFLUSH);
 }
 
 /*********************************************************************
@@ -765,6 +1057,7 @@ void zllSocSetHue(u8 hue, u16 time, u16 dstAddr, u8 endpoint, u8 addrMode)
  * @brief   Send the satuartion command to a ZLL light.
  *
  * @param   sat - 0-128 : 0=white, 128: fully saturated color
+ * @param   time - transition time in 1/10 s
  * @param   dstAddr - Nwk Addr or Group ID of the Light(s) to be controled.
  * @param   endpoint - endpoint of the Light.
  * @param   addrMode - Unicast or Group cast.
@@ -773,31 +1066,11 @@ void zllSocSetHue(u8 hue, u16 time, u16 dstAddr, u8 endpoint, u8 addrMode)
  */
 void zllSocSetSat(u8 sat, u16 time, u16 dstAddr, u8  endpoint, u8 addrMode)
 {
-  u8 cmd[] = {
-		0xFE,
-		14,   //RPC payload Len
-		0x29, //MT_RPC_CMD_AREQ + MT_RPC_SYS_APP
-		0x00, //MT_APP_MSG
-		0x0B, //Application Endpoint
-		(dstAddr & 0x00ff),
-		(dstAddr & 0xff00) >> 8,
-		endpoint, //Dst EP
-  	(ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL & 0x00ff),
-  	(ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL & 0xff00) >> 8,
-		0x07, //Data Len
-		addrMode,
-		0x01, //0x01 ZCL frame control field.  (send to the light cluster only)
-    transSeqNumber++,
-		COMMAND_LIGHTING_MOVE_TO_SATURATION,
-		(sat & 0xff),
-		(time & 0xff),
-		(time & 0xff00) >> 8,
-		0x00       //FCS - fill in later
-	};
-
-	calcFcs(cmd, sizeof(cmd));
-  write(serialPortFd,cmd,sizeof(cmd));
-  tcflush(serialPortFd, TCOFLUSH);
+    if (soc_sendZcl(socTx_dataKey(addrMode, dstAddr, endpoint, ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL,
+                                  COMMAND_LIGHTING_MOVE_TO_SATURATION),
+                    ZCL_ENC_MOVE_TO_SAT, addrMode, dstAddr, endpoint, sat, time) == 0) {
+        attrCache_cmdSent(addrMode, dstAddr, endpoint, ATTR_CACHE_SAT, sat);
+    }
 }
 
 /*********************************************************************
@@ -807,6 +1080,7 @@ void zllSocSetSat(u8 sat, u16 time, u16 dstAddr, u8  endpoint, u8 addrMode)
  *
  * @param   hue - 0-128 represent the 360Deg hue color wheel : 0=red, 42=blue, 85=green
  * @param   sat - 0-128 : 0=white, 128: fully saturated color
+ * @param   time - transition time in 1/10 s
  * @param   dstAddr - Nwk Addr or Group ID of the Light(s) to be controled.
  * @param   endpoint - endpoint of the Light.
  * @param   addrMode - Unicast or Group cast.
@@ -815,32 +1089,12 @@ void zllSocSetSat(u8 sat, u16 time, u16 dstAddr, u8  endpoint, u8 addrMode)
  */
 void zllSocSetHueSat(u8 hue, u8 sat, u16 time, u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-	u8 cmd[] = {
-		0xFE,
-		15, //RPC payload Len
-		0x29, //MT_RPC_CMD_AREQ + MT_RPC_SYS_APP
-		0x00, //MT_APP_MSG
-		0x0B, //Application Endpoint
-		(dstAddr & 0x00ff),
-		(dstAddr & 0xff00) >> 8,
-		endpoint, //Dst EP
-  	(ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL & 0x00ff),
-  	(ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL & 0xff00) >> 8,
-		0x08, //Data Len
-    addrMode,
-		0x01, //ZCL Header Frame Control
-		transSeqNumber++,
-		0x06, //ZCL Header Frame Command (COMMAND_LEVEL_MOVE_TO_HUE_AND_SAT)
-		hue, //HUE - fill it in later
-		sat, //SAT - fill it in later
-		(time & 0xff),
-		(time & 0xff00) >> 8,
-		0x00 //fcs
-  };
-
-  calcFcs(cmd, sizeof(cmd));
-  write(serialPortFd,cmd,sizeof(cmd));
-  tcflush(serialPortFd, TCOFLUSH);
+    if (soc_sendZcl(socTx_dataKey(addrMode, dstAddr, endpoint, ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL,
+                                  COMMAND_LIGHTING_MOVE_TO_HUE_AND_SATURATION),
+                    ZCL_ENC_MOVE_TO_HUE_SAT, addrMode, dstAddr, endpoint, hue, sat, time) == 0) {
+        attrCache_cmdSent(addrMode, dstAddr, endpoint, ATTR_CACHE_HUE, hue);
+        attrCache_cmdSent(addrMode, dstAddr, endpoint, ATTR_CACHE_SAT, sat);
+    }
 }
 
 /*********************************************************************
@@ -857,67 +1111,10 @@ void zllSocSetHueSat(u8 hue, u8 sat, u16 time, u16 dstAddr, u8 endpoint, u8 addr
  */
 void zllSocAddGroup(u16 groupId, u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-#if 0
-	u8 cmd[] = {
-		0xFE,
-		14,   /*RPC payload Len */
-		0x29, /*MT_RPC_CMD_AREQ + MT_RPC_SYS_APP */
-		0x00, /*MT_APP_MSG  */
-		0x0B, /*Application Endpoint */
-		(dstAddr & 0x00ff),
-		(dstAddr & 0xff00) >> 8,
-		endpoint, /*Dst EP */
-		(ZCL_CLUSTER_ID_GEN_GROUPS & 0x00ff),
-		(ZCL_CLUSTER_ID_GEN_GROUPS & 0xff00) >> 8,
-		0x07, //Data Len
-		addrMode,
-		0x01, //0x01 ZCL frame control field.  (send to the light cluster only)
-		transSeqNumber++,
-		COMMAND_GROUP_ADD,
- 		(groupId & 0x00ff),
-		(groupId & 0xff00) >> 8,
-		0, //Null group name - Group Name not pushed to the devices
-		0x00       //FCS - fill in later
-	};
-
-	printf("zllSocAddGroup: dstAddr 0x%x\n", dstAddr);
-
-	calcFcs(cmd, sizeof(cmd));
-#endif
+    LOG_DEBUG(LOG_MOD_SOC, "zllSocAddGroup: dstAddr 0x%x", dstAddr);
 
-    u8 cmd[30];
-  	int i;
-  	cmd[0] = 0xFE;
-  	gw_app_cmd_t *pCmd = (gw_app_cmd_t*)(&(cmd[1]));
-  	pCmd->len = 16;
-  	pCmd->cmd0 = 0x49;
-  	pCmd->cmd1 = 0x00;
-  	pCmd->data.dataCmd.endpoint = 0xB;
-  	pCmd->data.dataCmd.dstNwkAddr = dstAddr;
-  	pCmd->data.dataCmd.dstEndpoint = endpoint;
-  	pCmd->data.dataCmd.clusterID = ZCL_CLUSTER_ID_GEN_GROUPS;
-  	pCmd->data.dataCmd.dataLen = 7;
-  	pCmd->data.dataCmd.addrMode = addrMode;
-  	pCmd->data.dataCmd.zclFrameCtrl = 0x01;
-  	pCmd->data.dataCmd.zclTransSeqNo = transSeqNumber++;
-  	pCmd->data.dataCmd.cmdID = COMMAND_GROUP_ADD;
-
-  	pCmd->data.dataCmd.payload[0] = (groupId & 0xff);
-  	pCmd->data.dataCmd.payload[1] = (groupId & 0xff00) >> 8;
-  	pCmd->data.dataCmd.payload[2] = 0; //Null group name - Group Name not pushed to the devices
-  	pCmd->data.dataCmd.payload[3] = 0; // FCS
-
-    //for(i=0; i<pCmd->len+1; i++) {
-    //    printf("0x%x ", cmd[i]);
-    //}
-    //printf("\n");
-
-
-    write(serialPortFd,cmd,sizeof(cmd));
-    tcflush(serialPortFd, TCOFLUSH);
-
-  write(serialPortFd,cmd,sizeof(cmd));
-  tcflush(serialPortFd, TCOFLUSH);
+    /* Group Name not pushed to the devices */
+    soc_sendZcl(SOC_TX_NO_COALESCE, ZCL_ENC_ADD_GROUP, addrMode, dstAddr, endpoint, groupId, NULL);
 }
 
 /*********************************************************************
@@ -935,32 +1132,7 @@ void zllSocAddGroup(u16 groupId, u16 dstAddr, u8 endpoint, u8 addrMode)
  */
 void zllSocStoreScene(u16 groupId, u8 sceneId, u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-	u8 cmd[] = {
-		0xFE,
-		14,   /*RPC payload Len */
-		0x29, /*MT_RPC_CMD_AREQ + MT_RPC_SYS_APP */
-		0x00, /*MT_APP_MSG  */
-		0x0B, /*Application Endpoint */
-		(dstAddr & 0x00ff),
-		(dstAddr & 0xff00) >> 8,
-		endpoint, /*Dst EP */
-		(ZCL_CLUSTER_ID_GEN_SCENES & 0x00ff),
-		(ZCL_CLUSTER_ID_GEN_SCENES & 0xff00) >> 8,
-		0x07, //Data Len
-		addrMode,
-		0x01, //0x01 ZCL frame control field.  (send to the light cluster only)
-		transSeqNumber++,
-		COMMAND_SCENE_STORE,
- 		(groupId & 0x00ff),
-		(groupId & 0xff00) >> 8,
-		sceneId++,
-		0x00       //FCS - fill in later
-	};
-
-	calcFcs(cmd, sizeof(cmd));
-
-  write(serialPortFd,cmd,sizeof(cmd));
-  tcflush(serialPortFd, TCOFLUSH);
+    soc_sendZcl(SOC_TX_NO_COALESCE, ZCL_ENC_STORE_SCENE, addrMode, dstAddr, endpoint, groupId, sceneId);
 }
 
 /*********************************************************************
@@ -968,7 +1140,6 @@ void zllSocStoreScene(u16 groupId, u8 sceneId, u16 dstAddr, u8 endpoint, u8 addr
  *
  * @brief   Send the flash reset command to a ZLL light.
  *
- * @param   state - 0: Off, 1: On.
  * @param   dstAddr - Nwk Addr or Group ID of the Light(s) to be controled.
  * @param   endpoint - endpoint of the Light.
  * @param   addrMode - Unicast or Group cast.
@@ -977,29 +1148,7 @@ void zllSocStoreScene(u16 groupId, u8 sceneId, u16 dstAddr, u8 endpoint, u8 addr
  */
 void zllSocFlashReset(u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-  	u8 cmd[30];
-  	int i;
-  	gw_app_cmd_t *pCmd = (gw_app_cmd_t*)&cmd;
-  	pCmd->len = 13;
-  	pCmd->cmd0 = 0x49;
-  	pCmd->cmd1 = 0x00;
-  	pCmd->data.dataCmd.endpoint = 0xB;
-  	pCmd->data.dataCmd.dstNwkAddr = dstAddr;
-  	pCmd->data.dataCmd.dstEndpoint = endpoint;
-  	pCmd->data.dataCmd.clusterID = ZCL_CLUSTER_ID_GEN_ON_OFF;
-  	pCmd->data.dataCmd.dataLen = 3;
-  	pCmd->data.dataCmd.addrMode = addrMode;
-  	pCmd->data.dataCmd.zclFrameCtrl = 0x01;
-  	pCmd->data.dataCmd.zclTransSeqNo = transSeqNumber++;
-  	pCmd->data.dataCmd.cmdID = 0x04;
-
-    //for(i=0; i<pCmd->len+1; i++) {
-    //    printf("0x%x ", cmd[i]);
-    //}
-    //printf("\n");
-
-    write(serialPortFd,cmd,sizeof(cmd));
-    tcflush(serialPortFd, TCOFLUSH);
+    soc_sendZcl(SOC_TX_NO_COALESCE, ZCL_ENC_FLASH_RESET, addrMode, dstAddr, endpoint);
 }
 
 
@@ -1018,32 +1167,7 @@ void zllSocFlashReset(u16 dstAddr, u8 endpoint, u8 addrMode)
  */
 void zllSocRecallScene(u16 groupId, u8 sceneId, u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-	u8 cmd[] = {
-		0xFE,
-		14,   /*RPC payload Len */
-		0x29, /*MT_RPC_CMD_AREQ + MT_RPC_SYS_APP */
-		0x00, /*MT_APP_MSG  */
-		0x0B, /*Application Endpoint */
-		(dstAddr & 0x00ff),
-		(dstAddr & 0xff00) >> 8,
-		endpoint, /*Dst EP */
-		(ZCL_CLUSTER_ID_GEN_SCENES & 0x00ff),
-		(ZCL_CLUSTER_ID_GEN_SCENES & 0xff00) >> 8,
-		0x07, //Data Len
-		addrMode,
-		0x01, //0x01 ZCL frame control field.  (send to the light cluster only)
-		transSeqNumber++,
-		COMMAND_SCENE_RECALL,
- 		(groupId & 0x00ff),
-		(groupId & 0xff00) >> 8,
-		sceneId++,
-		0x00       //FCS - fill in later
-	};
-
-	calcFcs(cmd, sizeof(cmd));
-
-  write(serialPortFd,cmd,sizeof(cmd));
-  tcflush(serialPortFd, TCOFLUSH);
+    soc_sendZcl(SOC_TX_NO_COALESCE, ZCL_ENC_RECALL_SCENE, addrMode, dstAddr, endpoint, groupId, sceneId);
 }
 
 /*********************************************************************
@@ -1059,31 +1183,8 @@ void zllSocRecallScene(u16 groupId, u8 sceneId, u16 dstAddr, u8 endpoint, u8 add
  */
 void zllSocGetState(u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-  	u8 cmd[] = {
-  		0xFE,
-  		13,   /*RPC payload Len */
-  		0x29, /*MT_RPC_CMD_AREQ + MT_RPC_SYS_APP */
-  		0x00, /*MT_APP_MSG  */
-  		0x0B, /*Application Endpoint */
-  		(dstAddr & 0x00ff),
-  		(dstAddr & 0xff00) >> 8,
-  		endpoint, /*Dst EP */
-  		(ZCL_CLUSTER_ID_GEN_ON_OFF & 0x00ff),
-  		(ZCL_CLUSTER_ID_GEN_ON_OFF & 0xff00) >> 8,
-  		0x06, //Data Len
-  		addrMode,
-  		0x00, //0x00 ZCL frame control field.  not specific to a cluster (i.e. a SCL founadation command)
-  		transSeqNumber++,
-  		ZCL_CMD_READ,
-  		(ATTRID_ON_OFF & 0x00ff),
-  		(ATTRID_ON_OFF & 0xff00) >> 8,
-  		0x00       //FCS - fill in later
-  	};
-
-  	calcFcs(cmd, sizeof(cmd));
-
-    write(serialPortFd,cmd,sizeof(cmd));
-    tcflush(serialPortFd, TCOFLUSH);
+    soc_sendZcl(SOC_TX_NO_COALESCE, ZCL_ENC_READ_ATTR, addrMode, dstAddr, endpoint,
+                ZCL_CLUSTER_ID_GEN_ON_OFF, ATTRID_ON_OFF);
 }
 
 /*********************************************************************
@@ -1099,31 +1200,8 @@ void zllSocGetState(u16 dstAddr, u8 endpoint, u8 addrMode)
  */
 void zllSocGetLevel(u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-  	u8 cmd[] = {
-  		0xFE,
-  		13,   /*RPC payload Len */
-  		0x29, /*MT_RPC_CMD_AREQ + MT_RPC_SYS_APP */
-  		0x00, /*MT_APP_MSG  */
-  		0x0B, /*Application Endpoint */
-  		(dstAddr & 0x00ff),
-  		(dstAddr & 0xff00) >> 8,
-  		endpoint, /*Dst EP */
-  		(ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL & 0x00ff),
-  		(ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL & 0xff00) >> 8,
-  		0x06, //Data Len
-  		addrMode,
-  		0x00, //0x00 ZCL frame control field.  not specific to a cluster (i.e. a SCL founadation command)
-  		transSeqNumber++,
-  		ZCL_CMD_READ,
-  		(ATTRID_LEVEL_CURRENT_LEVEL & 0x00ff),
-  		(ATTRID_LEVEL_CURRENT_LEVEL & 0xff00) >> 8,
-  		0x00       //FCS - fill in later
-  	};
-
-  	calcFcs(cmd, sizeof(cmd));
-
-    write(serialPortFd,cmd,sizeof(cmd));
-    tcflush(serialPortFd, TCOFLUSH);
+    soc_sendZcl(SOC_TX_NO_COALESCE, ZCL_ENC_READ_ATTR, addrMode, dstAddr, endpoint,
+                ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL, ATTRID_LEVEL_CURRENT_LEVEL);
 }
 
 /*********************************************************************
@@ -1139,31 +1217,8 @@ void zllSocGetLevel(u16 dstAddr, u8 endpoint, u8 addrMode)
  */
 void zllSocGetHue(u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-  	u8 cmd[] = {
-  		0xFE,
-  		13,   /*RPC payload Len */
-  		0x29, /*MT_RPC_CMD_AREQ + MT_RPC_SYS_APP */
-  		0x00, /*MT_APP_MSG  */
-  		0x0B, /*Application Endpoint */
-  		(dstAddr & 0x00ff),
-  		(dstAddr & 0xff00) >> 8,
-  		endpoint, /*Dst EP */
-  		(ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL & 0x00ff),
-  		(ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL & 0xff00) >> 8,
-  		0x06, //Data Len
-  		addrMode,
-  		0x00, //0x00 ZCL frame control field.  not specific to a cluster (i.e. a SCL founadation command)
-  		transSeqNumber++,
-  		ZCL_CMD_READ,
-  		(ATTRID_LIGHTING_COLOR_CONTROL_CURRENT_HUE & 0x00ff),
-  		(ATTRID_LIGHTING_COLOR_CONTROL_CURRENT_HUE & 0xff00) >> 8,
-  		0x00       //FCS - fill in later
-  	};
-
-  	calcFcs(cmd, sizeof(cmd));
-
-    write(serialPortFd,cmd,sizeof(cmd));
-    tcflush(serialPortFd, TCOFLUSH);
+    soc_sendZcl(SOC_TX_NO_COALESCE, ZCL_ENC_READ_ATTR, addrMode, dstAddr, endpoint,
+                ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL, ATTRID_LIGHTING_COLOR_CONTROL_CURRENT_HUE);
 }
 
 /*********************************************************************
@@ -1179,31 +1234,71 @@ void zllSocGetHue(u16 dstAddr, u8 endpoint, u8 addrMode)
  */
 void zllSocGetSat(u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-  	u8 cmd[] = {
-  		0xFE,
-  		13,   /*RPC payload Len */
-  		0x29, /*MT_RPC_CMD_AREQ + MT_RPC_SYS_APP */
-  		0x00, /*MT_APP_MSG  */
-  		0x0B, /*Application Endpoint */
-  		(dstAddr & 0x00ff),
-  		(dstAddr & 0xff00) >> 8,
-  		endpoint, /*Dst EP */
-  		(ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL & 0x00ff),
-  		(ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL & 0xff00) >> 8,
-  		0x06, //Data Len
-  		addrMode,
-  		0x00, //0x00 ZCL frame control field.  not specific to a cluster (i.e. a SCL founadation command)
-  		transSeqNumber++,
-  		ZCL_CMD_READ,
-  		(ATTRID_LIGHTING_COLOR_CONTROL_CURRENT_SATURATION & 0x00ff),
-  		(ATTRID_LIGHTING_COLOR_CONTROL_CURRENT_SATURATION & 0xff00) >> 8,
-  		0x00       //FCS - fill in later
-  	};
-
-  	calcFcs(cmd, sizeof(cmd));
-
-    write(serialPortFd,cmd,sizeof(cmd));
-    tcflush(serialPortFd, TCOFLUSH);
+    soc_sendZcl(SOC_TX_NO_COALESCE, ZCL_ENC_READ_ATTR, addrMode, dstAddr, endpoint,
+                ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL, ATTRID_LIGHTING_COLOR_CONTROL_CURRENT_SATURATION);
+}
+
+/*********************************************************************
+ * @fn      soc_pingRspCb
+ *
+ * @brief   Log the MT subsystems the coordinator firmware has
+ *
+ * @param   arg - unused
+ * @param   status - SOC_REQ_*
+ * @param   payload - SRSP of SYS_PING: capabilities
+ * @param   len - length of the payload
+ *
+ * @return  none
+ */
+static void soc_pingRspCb(void *arg, u8 status, const u8 *payload, u8 len)
+{
+    if (status != SOC_REQ_SUCCESS || len < 2) {
+        LOG_WARN(LOG_MOD_SOC, "coordinator ping failed: %u", status);
+        return;
+    }
+    LOG_INFO(LOG_MOD_SOC, "coordinator MT capabilities 0x%04x", BUILD_UINT16(payload[0], payload[1]));
+}
+
+/*********************************************************************
+ * @fn      soc_deviceInfoRspCb
+ *
+ * @brief   Log the address and state of the coordinator
+ *
+ * @param   arg - unused
+ * @param   status - SOC_REQ_*
+ * @param   payload - SRSP of UTIL_GET_DEVICE_INFO: status, IEEE address,
+ *                    short address, device type, state, ...
+ * @param   len - length of the payload
+ *
+ * @return  none
+ */
+static void soc_deviceInfoRspCb(void *arg, u8 status, const u8 *payload, u8 len)
+{
+    if (status != SOC_REQ_SUCCESS || len < 13 || payload[0] != ZCL_STATUS_SUCCESS) {
+        LOG_WARN(LOG_MOD_SOC, "coordinator device info failed: %u", status);
+        return;
+    }
+
+    /* The IEEE address is sent least significant byte first */
+    LOG_INFO(LOG_MOD_SOC, "coordinator %02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x nwk 0x%04x type 0x%02x state %u",
+             payload[8], payload[7], payload[6], payload[5], payload[4], payload[3], payload[2], payload[1],
+             BUILD_UINT16(payload[9], payload[10]), payload[11], payload[12]);
+}
+
+/*********************************************************************
+ * @fn      zllSocGetCoordInfo
+ *
+ * @brief   Ask the coordinator for its MT capabilities and device info,
+ *          the answers are logged when they come
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void zllSocGetCoordInfo(void)
+{
+    socReq_send(MT_RPC_SYS_SYS, MT_SYS_PING, NULL, 0, soc_pingRspCb, NULL);
+    socReq_send(MT_RPC_SYS_UTIL, MT_UTIL_GET_DEVICE_INFO, NULL, 0, soc_deviceInfoRspCb, NULL);
 }
 
 /*********************************************************************
@@ -1219,7 +1314,7 @@ void zllSocGetSat(u16 dstAddr, u8 endpoint, u8 addrMode)
  */
 void zllSocEndDevBind(u16 dstAddr, u8 endpoint, u8 addrMode)
 {
-  	u8 cmd[30];
+  	u8 cmd[30] = {0};
   	int i;
   	cmd[0] = 0xFE;
   	gw_app_cmd_t *pCmd = (gw_app_cmd_t*)(&cmd[1]);
@@ -1236,7 +1331,7 @@ void zllSocEndDevBind(u16 dstAddr, u8 endpoint, u8 addrMode)
     //}
     //printf("\n");
 
-    write(serialPortFd,cmd,sizeof(cmd));
-    tcflush(serialPortFd, TCOFLUSH);
+    calcFcs(cmd, pCmd->len + MT_RPC_FRAME_OVERHEAD);
+    socTx_enqueue(cmd, pCmd->len + MT_RPC_FRAME_OVERHEAD, SOC_TX_NO_COALESCE);
 }
 
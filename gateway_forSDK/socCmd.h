@@ -3,7 +3,7 @@
 
 #include "types.h"
 
-#pragma pack(1)
+#pragma pack(push, 1)
 
 /*********************************************************************
  * CONSTANTS
@@ -44,12 +44,92 @@
 #define ZCL_CLUSTER_ID_GEN_SCENES                       0x0005
 #define ZCL_CLUSTER_ID_GEN_ON_OFF                       0x0006
 #define ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL                0x0008
+#define ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL           0x0300
 /** @} end of group zll_ctrl_command_id */
 
+
+/** @addtogroup zcl_cluster_cmd_id ZCL Cluster Command ID
+ * @{
+ */
+#define COMMAND_ON_OFF_OFF                              0x00
+#define COMMAND_ON_OFF_ON                               0x01
+#define COMMAND_ON_OFF_TOGGLE                           0x02
+#define COMMAND_ON_OFF_FLASH_RESET                      0x04
+#define COMMAND_IDENTIFY                                0x00
+#define COMMAND_LEVEL_MOVE_TO_LEVEL                     0x00
+#define COMMAND_LEVEL_STEP                              0x02
+#define COMMAND_LEVEL_MOVE_TO_LEVEL_WITH_ONOFF          0x04
+#define COMMAND_LIGHTING_MOVE_TO_HUE                    0x00
+#define COMMAND_LIGHTING_MOVE_TO_SATURATION             0x03
+#define COMMAND_LIGHTING_MOVE_TO_HUE_AND_SATURATION     0x06
+#define COMMAND_GROUP_ADD                               0x00
+#define COMMAND_GROUP_VIEW                              0x01
+#define COMMAND_GROUP_GET_MEMBERSHIP                    0x02
+#define COMMAND_GROUP_REMOVE                            0x03
+#define COMMAND_SCENE_STORE                             0x04
+#define COMMAND_SCENE_RECALL                            0x05
+/** @} end of group zcl_cluster_cmd_id */
+
+#define ATTRID_ON_OFF                                   0x0000
+#define ATTRID_LEVEL_CURRENT_LEVEL                      0x0000
+#define ATTRID_LIGHTING_COLOR_CONTROL_CURRENT_HUE       0x0000
+#define ATTRID_LIGHTING_COLOR_CONTROL_CURRENT_SATURATION 0x0001
+
+/* Frame type bit of the ZCL frame control, clear for foundation commands */
+#define ZCL_FRAME_CTRL_CLUSTER                          0x01
+
+/* Direction bit of the ZCL frame control, set from a server to its client */
+#define ZCL_FRAME_CTRL_TO_CLIENT                        0x08
+
+/* Application endpoint of the gateway on the coordinator */
+#define SOC_GW_ENDPOINT                                 0x0B
+
+/* The 3 MSB's of the 1st command field byte are for command type. */
+#define MT_RPC_CMD_TYPE_MASK                            0xE0
+
+/* The 5 LSB's of the 1st command field byte are for the subsystem. */
+#define MT_RPC_SUBSYSTEM_MASK                           0x1F
+
+#define MT_RPC_SOF                                      0xFE
+
+/* SOF, length and FCS around cmd0, cmd1 and the payload */
+#define MT_RPC_FRAME_OVERHEAD                           3
+
+#define MT_SYS_PING                                     0x01
+#define MT_UTIL_GET_DEVICE_INFO                         0x00
+
 /*********************************************************************
  * ENUMS
  */
 
+typedef enum {
+  MT_RPC_CMD_POLL = 0x00,
+  MT_RPC_CMD_SREQ = 0x20,
+  MT_RPC_CMD_AREQ = 0x40,
+  MT_RPC_CMD_SRSP = 0x60,
+  MT_RPC_CMD_RES4 = 0x80,
+  MT_RPC_CMD_RES5 = 0xA0,
+  MT_RPC_CMD_RES6 = 0xC0,
+  MT_RPC_CMD_RES7 = 0xE0
+} mtRpcCmdType_t;
+
+typedef enum {
+  MT_RPC_SYS_RES0,   /* Reserved. */
+  MT_RPC_SYS_SYS,
+  MT_RPC_SYS_MAC,
+  MT_RPC_SYS_NWK,
+  MT_RPC_SYS_AF,
+  MT_RPC_SYS_ZDO,
+  MT_RPC_SYS_SAPI,   /* Simple API. */
+  MT_RPC_SYS_UTIL,
+  MT_RPC_SYS_DBG,
+  MT_RPC_SYS_APP,
+  MT_RPC_SYS_OTA,
+  MT_RPC_SYS_ZNP,
+  MT_RPC_SYS_SPARE_12,
+  MT_RPC_SYS_UBL = 13,  // 13 to be compatible with existing RemoTI.
+  MT_RPC_SYS_MAX        // Maximum value, must be last (so 14-32 available, not yet assigned).
+} mtRpcSysType_t;
 
 
 /*********************************************************************
@@ -95,7 +175,10 @@ typedef struct {
 /*********************************************************************
  * Public Functions
  */
-int  socOpen(char *devicePath);
+void calcFcs(u8 *msg, int size);
+int  socOpen(char *devicePath, u32 baud);
+int  socReopen(void);
+void socDrop(void);
 void socClose(void);
 void processSocCmd(void);
 
@@ -103,6 +186,14 @@ void zllSocSetState(u8 state, u16 dstAddr, u8 endpoint, u8 addrMode);
 void zllSocSetLevel(u8 level, u16 time, u16 dstAddr, u8 endpoint, u8 addrMode);
 void zllSocSetHue(u8 hue, u16 time, u16 dstAddr, u8 endpoint, u8 addrMode);
 void zllSocAddGroup(u16 groupId, u16 dstAddr, u8 endpoint, u8 addrMode);
+void zllSocGetState(u16 dstAddr, u8 endpoint, u8 addrMode);
+void zllSocGetNodes(void);
+void zllSocGetLevel(u16 dstAddr, u8 endpoint, u8 addrMode);
+void zllSocGetHue(u16 dstAddr, u8 endpoint, u8 addrMode);
+void zllSocGetSat(u16 dstAddr, u8 endpoint, u8 addrMode);
 void zllSocDemoBind(u8 addrMode, u16 addr);
+void zllSocGetCoordInfo(void);
+
+#pragma pack(pop)
 
 #endif  /* __SOC_CMD_H__ */
@@ -0,0 +1,638 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+#include "socLink.h"
+#include "socCmd.h"
+#include "socTx.h"
+#include "socReq.h"
+#include "config.h"
+#include "swTimer.h"
+#include "evLoop.h"
+#include "stats.h"
+#include "log.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* Status of a ping still on its way, apart from the SOC_REQ_* ones */
+#define SOC_LINK_PING_WAIT              0xFF
+
+/* Bits on the line per byte: start, 8 data, stop */
+#define SOC_LINK_BITS_PER_BYTE          10
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+typedef struct {
+    u32 baud;
+    speed_t speed;
+} socLink_rate_t;
+
+/*
+ * Settings and supervision of the UART to the SoC. Without a rate given,
+ * the rates of SOC_LINK_BAUDS are tried fastest first with pings, the
+ * SoC only answers at the rate its firmware runs. Once up, the port is
+ * watched for hangups, errors and, if it answered the probe, a SoC gone
+ * silent; a lost port is reopened with the same settings while the Apps
+ * stay connected.
+ */
+typedef struct {
+    int fd;
+    u32 baud;
+    u8 rtscts;                        //!< RTS/CTS flow control is on
+    u8 icount;                        //!< The driver counts line errors
+    u8 pingStatus;                    //!< SOC_REQ_* of the last ping
+    u8 answered;                      //!< The SoC answered a ping, the keepalive may run
+    u8 up;                            //!< The port is open and polled
+    u8 pinging;                       //!< A keepalive ping is outstanding
+    u8 misses;                        //!< Keepalive pings unanswered in a row
+    u32 keepaliveMs;                  //!< 0 to never ping
+    u32 retryMs;                      //!< Wait before the next reopen
+    u64 lastRxBytes;                  //!< Bytes received at the last keepalive
+    swTimer_t keepaliveTimer;
+    swTimer_t retryTimer;
+    struct serial_icounter_struct icountBase;
+    socLink_stats_t stats;
+} socLink_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+socLink_ctrl_t socLink_vs;
+socLink_ctrl_t *socLink_v = &socLink_vs;
+
+static const socLink_rate_t socLink_rates[] = {
+    { 921600, B921600 },
+    { 460800, B460800 },
+    { 230400, B230400 },
+    { 115200, B115200 },
+    { 57600,  B57600 },
+    { 38400,  B38400 },
+    { 19200,  B19200 },
+    { 9600,   B9600 },
+};
+
+static const u32 socLink_probeBauds[] = { SOC_LINK_BAUDS };
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* None */
+
+
+/*********************************************************************
+ * @fn      socLink_speed
+ *
+ * @brief   Get the termios speed of a rate
+ *
+ * @param   baud - the rate
+ *
+ * @return  the speed, B0 if termios has none for the rate
+ */
+static speed_t socLink_speed(u32 baud)
+{
+    int i;
+
+    for (i = 0; i < (int)(sizeof(socLink_rates) / sizeof(socLink_rates[0])); i++) {
+        if (socLink_rates[i].baud == baud) {
+            return socLink_rates[i].speed;
+        }
+    }
+    return B0;
+}
+
+/*********************************************************************
+ * @fn      socLink_setLine
+ *
+ * @brief   Set the rate and flow control of the UART, anything still in
+ *          the driver is dropped as it was sent at the old rate
+ *
+ * @param   baud - the rate
+ * @param   rtscts - TRUE for RTS/CTS flow control
+ *
+ * @return  0 on success, -1 if the driver does not take the settings
+ */
+static int socLink_setLine(u32 baud, u8 rtscts)
+{
+    speed_t speed = socLink_speed(baud);
+    struct termios tio;
+    struct termios set;
+
+    if (speed == B0) {
+        LOG_ERR(LOG_MOD_SOC, "link: no termios speed for %u baud", baud);
+        return -1;
+    }
+
+    /* Raw 8n1: no parity, no modem control, no mapping of CR or NL, which
+     * are plain data bytes in RPC frames. Bytes with a parity error are
+     * dropped, the frame check sequence catches the frame. */
+    memset(&tio, 0, sizeof(tio));
+    tio.c_cflag = CS8 | CLOCAL | CREAD | (rtscts ? CRTSCTS : 0);
+    tio.c_iflag = IGNPAR;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    /* An empty port reads EAGAIN, a read of 0 bytes is a hangup */
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    if (cfsetispeed(&tio, speed) != 0 || cfsetospeed(&tio, speed) != 0) {
+        LOG_ERR(LOG_MOD_SOC, "link: %u baud refused", baud);
+        return -1;
+    }
+
+    tcflush(socLink_v->fd, TCIOFLUSH);
+    if (tcsetattr(socLink_v->fd, TCSANOW, &tio) != 0) {
+        LOG_ERR(LOG_MOD_SOC, "link: setting %u baud failed: %s", baud, strerror(errno));
+        return -1;
+    }
+
+    /* tcsetattr() succeeds when any of the settings was taken */
+    if (tcgetattr(socLink_v->fd, &set) != 0 || cfgetospeed(&set) != speed ||
+        (set.c_cflag & CRTSCTS) != (tio.c_cflag & CRTSCTS)) {
+        LOG_WARN(LOG_MOD_SOC, "link: driver does not take %u baud%s", baud, rtscts ? " with RTS/CTS" : "");
+        return -1;
+    }
+
+    socLink_v->baud = baud;
+    socLink_v->rtscts = rtscts;
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      socLink_pingCb
+ *
+ * @brief   A probe ping ended
+ *
+ * @param   arg - unused
+ * @param   status - SOC_REQ_*
+ * @param   payload - unused
+ * @param   len - unused
+ *
+ * @return  none
+ */
+static void socLink_pingCb(void *arg, u8 status, const u8 *payload, u8 len)
+{
+    socLink_v->pingStatus = status;
+    if (status == SOC_REQ_SUCCESS || status == SOC_REQ_RPC_ERROR) {
+        socLink_v->answered = TRUE;
+    }
+}
+
+/*********************************************************************
+ * @fn      socLink_ping
+ *
+ * @brief   Ping the SoC and wait for the answer. The event loop is not
+ *          running yet, this polls the UART itself.
+ *
+ * @param   timeoutMs - longest wait for the answer
+ *
+ * @return  SOC_REQ_* status of the ping
+ */
+static u8 socLink_ping(u32 timeoutMs)
+{
+    struct pollfd pfd;
+    u64 deadline = swTimer_nowUs() + timeoutMs * 1000ULL;
+    int wait;
+
+    socLink_v->stats.probes++;
+    socLink_v->pingStatus = SOC_LINK_PING_WAIT;
+    if (socReq_send(MT_RPC_SYS_SYS, MT_SYS_PING, NULL, 0, socLink_pingCb, NULL) != 0) {
+        return SOC_REQ_ABORTED;
+    }
+
+    while (socLink_v->pingStatus == SOC_LINK_PING_WAIT) {
+        if (socTx_pending()) {
+            socTx_flush();
+        }
+
+        if (swTimer_nowUs() > deadline) {
+            socReq_abort();
+            break;
+        }
+
+        wait = swTimer_nextTimeout();
+        if (wait == SW_TIMER_NONE || wait > SOC_LINK_POLL_MS) {
+            wait = SOC_LINK_POLL_MS;
+        }
+        pfd.fd = socLink_v->fd;
+        pfd.events = POLLIN | (socTx_pending() ? POLLOUT : 0);
+        pfd.revents = 0;
+        if (poll(&pfd, 1, wait) > 0 && (pfd.revents & ~POLLOUT)) {
+            processSocCmd();
+            if (pfd.revents & (POLLHUP | POLLERR)) {
+                socReq_abort();
+                break;
+            }
+        }
+        swTimer_process();
+    }
+
+    return socLink_v->pingStatus;
+}
+
+/*********************************************************************
+ * @fn      socLink_probe
+ *
+ * @brief   Tell whether the SoC talks at the current settings. The
+ *          first ping may meet garbage sent at another rate, the ones
+ *          after it must see a clean line. An RPC error is an answer
+ *          too, the SoC parsed the ping.
+ *
+ * @param   firstMs - longest wait for the first answer
+ *
+ * @return  0 if every ping was answered, -1 otherwise
+ */
+static int socLink_probe(u32 firstMs)
+{
+    u32 errors = 0;
+    u8 status;
+    int i;
+
+    for (i = 0; i < SOC_LINK_PROBE_PINGS; i++) {
+        /* The SREQ timeout only runs once the ping is written */
+        status = socLink_ping(i ? 2 * SOC_REQ_TIMEOUT_MS : firstMs);
+        if (status != SOC_REQ_SUCCESS && status != SOC_REQ_RPC_ERROR) {
+            socLink_v->stats.probeFailures++;
+            return -1;
+        }
+        if (i == 0) {
+            errors = stats_v->fcsErrors + stats_v->badFrames + stats_v->resyncs;
+        } else if (errors != stats_v->fcsErrors + stats_v->badFrames + stats_v->resyncs) {
+            socLink_v->stats.probeFailures++;
+            LOG_WARN(LOG_MOD_SOC, "link: line errors at %u baud", socLink_v->baud);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      socLink_negotiate
+ *
+ * @brief   Find the fastest rate the SoC answers at, then try flow
+ *          control at that rate. When no rate gets an answer to its
+ *          first ping, the SoC does not answer pings: probing stops and
+ *          the default rate is kept.
+ *
+ * @param   none
+ *
+ * @return  0 on success, -1 if the UART can not be set up
+ */
+static int socLink_negotiate(void)
+{
+    int i;
+
+    for (i = 0; i < (int)(sizeof(socLink_probeBauds) / sizeof(socLink_probeBauds[0])); i++) {
+        if (socLink_setLine(socLink_probeBauds[i], FALSE) == 0 && socLink_probe(SOC_LINK_PROBE_MS) == 0) {
+            break;
+        }
+    }
+
+    if (i == (int)(sizeof(socLink_probeBauds) / sizeof(socLink_probeBauds[0]))) {
+        LOG_WARN(LOG_MOD_SOC, "link: no answer from the SoC, staying at %u baud", SOC_LINK_DEFAULT_BAUD);
+        return socLink_setLine(SOC_LINK_DEFAULT_BAUD, FALSE);
+    }
+
+    /* Without CTS wired or driven, nothing leaves the UART and the
+     * pings time out */
+    if (SOC_LINK_RTSCTS) {
+        if (socLink_setLine(socLink_v->baud, TRUE) != 0 || socLink_probe(2 * SOC_REQ_TIMEOUT_MS) != 0) {
+            return socLink_setLine(socLink_v->baud, FALSE);
+        }
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      socLink_countLineErrors
+ *
+ * @brief   Add the line errors the driver counted since the last look
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void socLink_countLineErrors(void)
+{
+    struct serial_icounter_struct icount;
+
+    if (!socLink_v->icount || ioctl(socLink_v->fd, TIOCGICOUNT, &icount) != 0) {
+        return;
+    }
+
+    socLink_v->stats.frame += icount.frame - socLink_v->icountBase.frame;
+    socLink_v->stats.overrun += (icount.overrun - socLink_v->icountBase.overrun) +
+                                (icount.buf_overrun - socLink_v->icountBase.buf_overrun);
+    socLink_v->stats.parity += icount.parity - socLink_v->icountBase.parity;
+    socLink_v->stats.brk += icount.brk - socLink_v->icountBase.brk;
+    socLink_v->icountBase = icount;
+}
+
+/*********************************************************************
+ * @fn      socLink_event
+ *
+ * @brief   Event callback of the serial port
+ *
+ * @param   fd - the serial port
+ * @param   events - ready events
+ * @param   arg - unused
+ *
+ * @return  none
+ */
+static void socLink_event(int fd, u32 events, void *arg)
+{
+    if (events & EPOLLOUT) {
+        socTx_flush();
+    }
+    if (socLink_v->up && (events & ~EPOLLOUT)) {
+        processSocCmd();
+    }
+
+    /* Not every driver also reads end of file after a hangup */
+    if (socLink_v->up && (events & (EPOLLHUP | EPOLLERR))) {
+        socLink_lost("port hung up");
+    }
+}
+
+/*********************************************************************
+ * @fn      socLink_keepaliveRspCb
+ *
+ * @brief   A keepalive ping ended
+ *
+ * @param   arg - unused
+ * @param   status - SOC_REQ_*
+ * @param   payload - unused
+ * @param   len - unused
+ *
+ * @return  none
+ */
+static void socLink_keepaliveRspCb(void *arg, u8 status, const u8 *payload, u8 len)
+{
+    socLink_v->pinging = FALSE;
+
+    if (status == SOC_REQ_TIMEOUT) {
+        socLink_v->stats.keepaliveMisses++;
+        if (++socLink_v->misses >= SOC_LINK_KEEPALIVE_MISSES) {
+            socLink_lost("no answer from the SoC");
+        }
+    } else if (status != SOC_REQ_ABORTED) {
+        socLink_v->misses = 0;
+    }
+}
+
+/*********************************************************************
+ * @fn      socLink_keepaliveCb
+ *
+ * @brief   Ping the SoC if nothing came from it since the last time
+ *
+ * @param   arg - unused
+ *
+ * @return  none
+ */
+static void socLink_keepaliveCb(void *arg)
+{
+    swTimer_start(&socLink_v->keepaliveTimer, socLink_v->keepaliveMs, socLink_keepaliveCb, NULL);
+
+    if (stats_v->uartRxBytes != socLink_v->lastRxBytes) {
+        socLink_v->lastRxBytes = stats_v->uartRxBytes;
+        socLink_v->misses = 0;
+        return;
+    }
+    if (socLink_v->pinging) {
+        return;
+    }
+
+    socLink_v->stats.keepalives++;
+    socLink_v->pinging = TRUE;
+    if (socReq_send(MT_RPC_SYS_SYS, MT_SYS_PING, NULL, 0, socLink_keepaliveRspCb, NULL) != 0) {
+        socLink_v->pinging = FALSE;
+    }
+}
+
+/*********************************************************************
+ * @fn      socLink_up
+ *
+ * @brief   Start polling and supervising the port
+ *
+ * @param   none
+ *
+ * @return  0 on success, -1 if the port can not be polled
+ */
+static int socLink_up(void)
+{
+    /* The UART is drained on EPOLLIN and written on EPOLLOUT edges */
+    if (evLoop_add(socLink_v->fd, EPOLLIN | EPOLLOUT | EPOLLET, socLink_event, NULL) != 0) {
+        return -1;
+    }
+
+    /* USB CDC and pseudo terminals have no line to count errors on */
+    socLink_v->icount = (ioctl(socLink_v->fd, TIOCGICOUNT, &socLink_v->icountBase) == 0);
+    socLink_v->up = TRUE;
+    socLink_v->misses = 0;
+    socLink_v->lastRxBytes = stats_v->uartRxBytes;
+    if (socLink_v->keepaliveMs && socLink_v->answered) {
+        swTimer_start(&socLink_v->keepaliveTimer, socLink_v->keepaliveMs, socLink_keepaliveCb, NULL);
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      socLink_retryCb
+ *
+ * @brief   Try to reopen the lost port, wait longer each time it is not
+ *          back
+ *
+ * @param   arg - unused
+ *
+ * @return  none
+ */
+static void socLink_retryCb(void *arg)
+{
+    socLink_v->fd = socReopen();
+    if (socLink_v->fd >= 0) {
+        if (socLink_setLine(socLink_v->baud, socLink_v->rtscts) == 0 && socLink_up() == 0) {
+            socLink_v->stats.reconnects++;
+            LOG_INFO(LOG_MOD_SOC, "link: port back, %u baud, RTS/CTS %s", socLink_v->baud,
+                     socLink_v->rtscts ? "on" : "off");
+
+            /* Frames queued meanwhile go out now. Devices may have
+             * joined or left while the link was down. */
+            socTx_relink(socLink_v->fd);
+            zllSocGetNodes();
+            return;
+        }
+        socDrop();
+        socLink_v->fd = -1;
+    }
+
+    socLink_v->retryMs *= 2;
+    if (socLink_v->retryMs > SOC_LINK_RETRY_MAX_MS) {
+        socLink_v->retryMs = SOC_LINK_RETRY_MAX_MS;
+    }
+    swTimer_start(&socLink_v->retryTimer, socLink_v->retryMs, socLink_retryCb, NULL);
+}
+
+/*********************************************************************
+ * @fn      socLink_init
+ *
+ * @brief   Set how the link is supervised, call before socLink_open()
+ *
+ * @param   keepaliveMs - time the line may be quiet before the SoC is
+ *                        pinged, 0 to never ping. Only used if the SoC
+ *                        answered the rate probe.
+ *
+ * @return  none
+ */
+void socLink_init(u32 keepaliveMs)
+{
+    socLink_v->fd = -1;
+    socLink_v->keepaliveMs = keepaliveMs;
+}
+
+/*********************************************************************
+ * @fn      socLink_open
+ *
+ * @brief   Set up the UART to the SoC and start polling it. Call once
+ *          the frame handlers, the transmit queue and the event loop are
+ *          ready, negotiating sends pings.
+ *
+ * @param   fd - the UART
+ * @param   baud - the rate, 0 to negotiate the fastest one
+ *
+ * @return  0 on success, -1 if the UART can not be set up
+ */
+int socLink_open(int fd, u32 baud)
+{
+    int ret;
+
+    socLink_v->fd = fd;
+    if (baud) {
+        ret = socLink_setLine(baud, FALSE);
+    } else {
+        ret = socLink_negotiate();
+    }
+    if (ret != 0 || socLink_up() != 0) {
+        return -1;
+    }
+
+    LOG_INFO(LOG_MOD_SOC, "link: %u baud, RTS/CTS %s", socLink_v->baud, socLink_v->rtscts ? "on" : "off");
+    if (socLink_v->keepaliveMs && !socLink_v->answered) {
+        LOG_INFO(LOG_MOD_SOC, "link: keepalive off, no ping answer seen");
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      socLink_lost
+ *
+ * @brief   The port hung up, failed or the SoC stopped answering. Close
+ *          it and try to reopen it after SOC_LINK_RETRY_MIN_MS. Frames
+ *          not written yet wait for the port to come back, requests to
+ *          the SoC end with SOC_REQ_ABORTED.
+ *
+ * @param   why - for the log
+ *
+ * @return  none
+ */
+void socLink_lost(const char *why)
+{
+    /* Only a port which was up, a probe just sees its pings fail */
+    if (!socLink_v->up) {
+        return;
+    }
+
+    LOG_WARN(LOG_MOD_SOC, "link: %s, reopening the port", why);
+    socLink_v->up = FALSE;
+    socLink_v->stats.losses++;
+    socLink_countLineErrors();
+    socLink_v->icount = FALSE;
+    swTimer_stop(&socLink_v->keepaliveTimer);
+
+    evLoop_del(socLink_v->fd);
+    socDrop();
+    socLink_v->fd = -1;
+    socTx_relink(-1);
+    socReq_abort();
+
+    socLink_v->retryMs = SOC_LINK_RETRY_MIN_MS;
+    swTimer_start(&socLink_v->retryTimer, socLink_v->retryMs, socLink_retryCb, NULL);
+}
+
+/*********************************************************************
+ * @fn      socLink_baud
+ *
+ * @brief   Get the rate of the UART
+ *
+ * @param   none
+ *
+ * @return  the rate
+ */
+u32 socLink_baud(void)
+{
+    return socLink_v->baud;
+}
+
+/*********************************************************************
+ * @fn      socLink_getStats
+ *
+ * @brief   Get the link counters, the line errors as of now
+ *
+ * @param   none
+ *
+ * @return  the counters
+ */
+socLink_stats_t* socLink_getStats(void)
+{
+    socLink_countLineErrors();
+    return &socLink_v->stats;
+}
+
+/*********************************************************************
+ * @fn      socLink_print
+ *
+ * @brief   Print the settings of the UART, how busy it was since the
+ *          stats were reset and its error counters
+ *
+ * @param   fp - where to print
+ *
+ * @return  none
+ */
+void socLink_print(FILE *fp)
+{
+    socLink_stats_t *st = socLink_getStats();
+    u64 capacity = (u64)socLink_v->baud * (swTimer_nowUs() - stats_v->startUs) / 1000000;
+    u32 rxPermille = 0;
+    u32 txPermille = 0;
+
+    /* Bytes the line could have carried each way */
+    capacity /= SOC_LINK_BITS_PER_BYTE;
+    if (capacity) {
+        rxPermille = (u32)(stats_v->uartRxBytes * 1000 / capacity);
+        txPermille = (u32)(stats_v->uartTxBytes * 1000 / capacity);
+    }
+
+    fprintf(fp, "Link: %s, %u baud, RTS/CTS %s, %u.%u%% busy in, %u.%u%% out, %u probes, %u failed\n",
+            socLink_v->up ? "up" : "down", socLink_v->baud, socLink_v->rtscts ? "on" : "off",
+            rxPermille / 10, rxPermille % 10, txPermille / 10, txPermille % 10, st->probes, st->probeFailures);
+    fprintf(fp, "Link losses: %u, %u reconnects, %u keepalive pings, %u unanswered\n",
+            st->losses, st->reconnects, st->keepalives, st->keepaliveMisses);
+    if (socLink_v->icount) {
+        fprintf(fp, "Line errors: %u framing, %u overrun, %u parity, %u breaks\n",
+                st->frame, st->overrun, st->parity, st->brk);
+    } else {
+        fprintf(fp, "Line errors: not counted by the driver\n");
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef  __SOC_LINK_H__
+#define  __SOC_LINK_H__
+
+#include <stdio.h>
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* Rate of the UART when none is set and no rate could be negotiated */
+#define SOC_LINK_DEFAULT_BAUD           115200
+
+/* Longest wait of the probe between two looks at its ping */
+#define SOC_LINK_POLL_MS                100
+
+/* Wait for the first ping at a rate. A SoC answers in a few ms at any
+ * rate, a sweep where none does ends quickly. */
+#define SOC_LINK_PROBE_MS               250
+
+/* Waits between attempts to reopen a lost port, doubling from the
+ * first to the last */
+#define SOC_LINK_RETRY_MIN_MS           250
+#define SOC_LINK_RETRY_MAX_MS           8000
+
+/*********************************************************************
+ * ENUMS
+ */
+
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+typedef struct {
+    u32 probes;                       //!< Pings sent while negotiating
+    u32 probeFailures;                //!< Pings without an answer, or with line errors
+    u32 frame;                        //!< Framing errors seen by the driver
+    u32 overrun;                      //!< Bytes lost by the UART or the driver
+    u32 parity;
+    u32 brk;                          //!< Breaks received
+    u32 losses;                       //!< Hangups, port errors and stalls
+    u32 reconnects;
+    u32 keepalives;                   //!< Pings sent on a quiet line
+    u32 keepaliveMisses;
+} socLink_stats_t;
+
+
+/*********************************************************************
+ * Public Functions
+ */
+void socLink_init(u32 keepaliveMs);
+int  socLink_open(int fd, u32 baud);
+void socLink_lost(const char *why);
+u32  socLink_baud(void);
+socLink_stats_t* socLink_getStats(void);
+void socLink_print(FILE *fp);
+
+#endif  /* __SOC_LINK_H__ */
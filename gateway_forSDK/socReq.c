@@ -0,0 +1,367 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "socReq.h"
+#include "socCmd.h"
+#include "socRx.h"
+#include "socTx.h"
+#include "config.h"
+#include "swTimer.h"
+#include "log.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* SOF, length, cmd0, cmd1 */
+#define SOC_REQ_HDR_LEN                 4
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+typedef struct socReq_tag {
+    struct socReq_tag *next;
+    socReq_cb_t cb;
+    void *arg;
+    u16 len;                          //!< Length of the frame, SOF to FCS
+    u8 frame[SOC_TX_MAX_FRAME_LEN];
+} socReq_t;
+
+/*
+ * Synchronous requests to the SoC. MT allows one SREQ on the wire until
+ * its SRSP is back, so the others wait here while AREQs keep flowing
+ * through socTx. The timeout of a request runs from the time its frame
+ * was written, not from the time it was queued.
+ */
+typedef struct {
+    socReq_t *cur;                    //!< Outstanding request, NULL if none
+    socReq_t *head;
+    socReq_t *tail;
+    u32 queued;
+    swTimer_t timer;
+    socReq_stats_t stats;
+} socReq_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+socReq_ctrl_t socReq_vs;
+socReq_ctrl_t *socReq_v = &socReq_vs;
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static void socReq_next(void);
+
+
+/*********************************************************************
+ * @fn      socReq_complete
+ *
+ * @brief   End the outstanding request, tell its caller and start the
+ *          next one
+ *
+ * @param   status - SOC_REQ_*
+ * @param   payload - payload of the SRSP, NULL if none
+ * @param   len - length of the payload
+ *
+ * @return  none
+ */
+static void socReq_complete(u8 status, const u8 *payload, u8 len)
+{
+    socReq_t *req = socReq_v->cur;
+
+    swTimer_stop(&socReq_v->timer);
+    socReq_v->cur = NULL;
+
+    /* The callback may send the next request itself */
+    req->cb(req->arg, status, payload, len);
+    free(req);
+
+    if (!socReq_v->cur) {
+        socReq_next();
+    }
+}
+
+/*********************************************************************
+ * @fn      socReq_timeoutCb
+ *
+ * @brief   The SRSP of the outstanding request did not come
+ *
+ * @param   arg - unused
+ *
+ * @return  none
+ */
+static void socReq_timeoutCb(void *arg)
+{
+    socReq_t *req = socReq_v->cur;
+
+    if (!req) {
+        return;
+    }
+    socReq_v->stats.timeouts++;
+    LOG_WARN(LOG_MOD_SOC, "SREQ 0x%02x 0x%02x: no SRSP", req->frame[2], req->frame[3]);
+    socReq_complete(SOC_REQ_TIMEOUT, NULL, 0);
+}
+
+/*********************************************************************
+ * @fn      socReq_srspHandler
+ *
+ * @brief   An SRSP arrived, it answers the outstanding request if that
+ *          has the same subsystem and command
+ *
+ * @param   frame - the SRSP
+ *
+ * @return  none
+ */
+static void socReq_srspHandler(const socRx_mt_t *frame)
+{
+    socReq_t *req = socReq_v->cur;
+
+    if (!req || (req->frame[2] & MT_RPC_SUBSYSTEM_MASK) != (frame->cmd0 & MT_RPC_SUBSYSTEM_MASK) ||
+        req->frame[3] != frame->cmd1) {
+        socReq_v->stats.stray++;
+        LOG_DEBUG(LOG_MOD_SOC, "SRSP 0x%02x 0x%02x: no request waits for it", frame->cmd0, frame->cmd1);
+        return;
+    }
+
+    socReq_v->stats.answered++;
+    socReq_complete(SOC_REQ_SUCCESS, frame->payload, frame->len);
+}
+
+/*********************************************************************
+ * @fn      socReq_rpcErrorHandler
+ *
+ * @brief   The SoC refused an SREQ: bad subsystem, command, parameter
+ *          or length
+ *
+ * @param   frame - the RPC error: error code, cmd0, cmd1
+ *
+ * @return  none
+ */
+static void socReq_rpcErrorHandler(const socRx_mt_t *frame)
+{
+    socReq_t *req = socReq_v->cur;
+
+    if (!req || req->frame[2] != frame->payload[1] || req->frame[3] != frame->payload[2]) {
+        socReq_v->stats.stray++;
+        LOG_WARN(LOG_MOD_SOC, "RPC error 0x%02x for 0x%02x 0x%02x", frame->payload[0],
+                 frame->payload[1], frame->payload[2]);
+        return;
+    }
+
+    socReq_v->stats.rpcErrors++;
+    LOG_WARN(LOG_MOD_SOC, "SREQ 0x%02x 0x%02x: RPC error 0x%02x", req->frame[2], req->frame[3], frame->payload[0]);
+    socReq_complete(SOC_REQ_RPC_ERROR, frame->payload, frame->len);
+}
+
+/*********************************************************************
+ * @fn      socReq_next
+ *
+ * @brief   Put the next waiting request on the wire
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void socReq_next(void)
+{
+    socTxFrame_t *txFrame;
+    socReq_t *req;
+
+    while ((req = socReq_v->head) != NULL) {
+        socReq_v->head = req->next;
+        if (!socReq_v->head) {
+            socReq_v->tail = NULL;
+        }
+        socReq_v->queued--;
+
+        txFrame = socTx_alloc();
+        if (txFrame) {
+            memcpy(txFrame->data, req->frame, req->len);
+            txFrame->len = req->len;
+            txFrame->prio = SOC_TX_PRIO_CONTROL;
+            txFrame->sreq = TRUE;
+
+            /* The SRSP goes to the SRSP table of the subsystem */
+            socRx_register(MT_RPC_CMD_SRSP | (req->frame[2] & MT_RPC_SUBSYSTEM_MASK), req->frame[3], 0,
+                           socReq_srspHandler);
+            socReq_v->cur = req;
+            socReq_v->stats.sent++;
+            socTx_commit(txFrame, SOC_TX_NO_COALESCE);
+            return;
+        }
+
+        socReq_v->stats.aborted++;
+        req->cb(req->arg, SOC_REQ_ABORTED, NULL, 0);
+        free(req);
+    }
+}
+
+/*********************************************************************
+ * @fn      socReq_init
+ *
+ * @brief   Register the RPC error handler. Call after socRx_init().
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void socReq_init(void)
+{
+    socRx_register(MT_RPC_CMD_SRSP | MT_RPC_SYS_RES0, SOC_REQ_RPC_ERROR_CMD1, 3, socReq_rpcErrorHandler);
+}
+
+/*********************************************************************
+ * @fn      socReq_send
+ *
+ * @brief   Queue an SREQ. It is written once the SRSP of the one before
+ *          it is back, and cb is called when it ends.
+ *
+ * @param   sys - MT_RPC_SYS_* subsystem
+ * @param   cmd1 - the command
+ * @param   payload - parameters of the command
+ * @param   len - length of the parameters
+ * @param   cb - called with the result; from within this call only with
+ *               SOC_REQ_ABORTED, when the transmit queue is full
+ * @param   arg - passed to cb
+ *
+ * @return  0 on success, -1 if the request could not be queued and cb
+ *          will not be called
+ */
+int socReq_send(u8 sys, u8 cmd1, const u8 *payload, u8 len, socReq_cb_t cb, void *arg)
+{
+    socReq_t *req;
+    u8 fcs = 0;
+    int i;
+
+    if (len > SOC_REQ_MAX_PAYLOAD || socReq_v->queued >= SOC_REQ_MAX_QUEUED) {
+        socReq_v->stats.aborted++;
+        return -1;
+    }
+
+    req = malloc(sizeof(socReq_t));
+    if (!req) {
+        socReq_v->stats.aborted++;
+        return -1;
+    }
+
+    req->next = NULL;
+    req->cb = cb;
+    req->arg = arg;
+    req->frame[0] = MT_RPC_SOF;
+    req->frame[1] = len + 2;
+    req->frame[2] = MT_RPC_CMD_SREQ | (sys & MT_RPC_SUBSYSTEM_MASK);
+    req->frame[3] = cmd1;
+    if (len) {
+        memcpy(&req->frame[SOC_REQ_HDR_LEN], payload, len);
+    }
+    for (i = 1; i < SOC_REQ_HDR_LEN + len; i++) {
+        fcs ^= req->frame[i];
+    }
+    req->frame[SOC_REQ_HDR_LEN + len] = fcs;
+    req->len = SOC_REQ_HDR_LEN + len + 1;
+
+    if (socReq_v->tail) {
+        socReq_v->tail->next = req;
+    } else {
+        socReq_v->head = req;
+    }
+    socReq_v->tail = req;
+    socReq_v->queued++;
+
+    if (!socReq_v->cur) {
+        socReq_next();
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      socReq_sent
+ *
+ * @brief   The outstanding SREQ left the UART, give the SoC
+ *          SOC_REQ_TIMEOUT_MS to answer from now on
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void socReq_sent(void)
+{
+    if (socReq_v->cur) {
+        swTimer_start(&socReq_v->timer, SOC_REQ_TIMEOUT_MS, socReq_timeoutCb, NULL);
+    }
+}
+
+/*********************************************************************
+ * @fn      socReq_abort
+ *
+ * @brief   End every request with SOC_REQ_ABORTED, as when the link to
+ *          the SoC is reset and queued frames are lost
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void socReq_abort(void)
+{
+    socReq_t *req;
+
+    swTimer_stop(&socReq_v->timer);
+    while (socReq_v->cur || socReq_v->head) {
+        req = socReq_v->cur;
+        if (req) {
+            socReq_v->cur = NULL;
+        } else {
+            req = socReq_v->head;
+            socReq_v->head = req->next;
+            if (!socReq_v->head) {
+                socReq_v->tail = NULL;
+            }
+            socReq_v->queued--;
+        }
+
+        socReq_v->stats.aborted++;
+        req->cb(req->arg, SOC_REQ_ABORTED, NULL, 0);
+        free(req);
+    }
+}
+
+/*********************************************************************
+ * @fn      socReq_getStats
+ *
+ * @brief   Get the request counters
+ *
+ * @param   none
+ *
+ * @return  the counters
+ */
+socReq_stats_t* socReq_getStats(void)
+{
+    return &socReq_v->stats;
+}
+
+/*********************************************************************
+ * @fn      socReq_print
+ *
+ * @brief   Print the request counters
+ *
+ * @param   fp - where to print
+ *
+ * @return  none
+ */
+void socReq_print(FILE *fp)
+{
+    socReq_stats_t *st = &socReq_v->stats;
+
+    fprintf(fp, "SREQs: %u sent, %u answered, %u timeouts, %u RPC errors, %u aborted, %u stray SRSPs, %u waiting\n",
+            st->sent, st->answered, st->timeouts, st->rpcErrors, st->aborted, st->stray,
+            socReq_v->queued + (socReq_v->cur ? 1 : 0));
+}
@@ -0,0 +1,60 @@
+#ifndef  __SOC_REQ_H__
+#define  __SOC_REQ_H__
+
+#include <stdio.h>
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* Longest SREQ payload, the length byte also counts cmd0 and cmd1 */
+#define SOC_REQ_MAX_PAYLOAD             (0xFF - 2)
+
+/* MT RPC error, sent as SRSP 0x60 0x00 for an SREQ the SoC refuses */
+#define SOC_REQ_RPC_ERROR_CMD1          0x00
+
+/*********************************************************************
+ * ENUMS
+ */
+
+/*
+ * How a request ended
+ */
+enum {
+    SOC_REQ_SUCCESS,                  //!< The SRSP arrived, payload is its payload
+    SOC_REQ_TIMEOUT,                  //!< No SRSP within SOC_REQ_TIMEOUT_MS
+    SOC_REQ_RPC_ERROR,                //!< The SoC refused it, payload is error, cmd0, cmd1
+    SOC_REQ_ABORTED,                  //!< The link was reset or the queue was full
+};
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+/* Completion of a request, payload is only valid during the call */
+typedef void (*socReq_cb_t)(void *arg, u8 status, const u8 *payload, u8 len);
+
+typedef struct {
+    u32 sent;
+    u32 answered;
+    u32 timeouts;
+    u32 rpcErrors;
+    u32 aborted;                      //!< Refused, or lost to a link reset
+    u32 stray;                        //!< SRSPs nobody waited for
+} socReq_stats_t;
+
+
+/*********************************************************************
+ * Public Functions
+ */
+void socReq_init(void);
+int  socReq_send(u8 sys, u8 cmd1, const u8 *payload, u8 len, socReq_cb_t cb, void *arg);
+void socReq_sent(void);
+void socReq_abort(void);
+socReq_stats_t* socReq_getStats(void);
+void socReq_print(FILE *fp);
+
+#endif  /* __SOC_REQ_H__ */
@@ -0,0 +1,288 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "socRx.h"
+#include "socCmd.h"
+#include "stats.h"
+#include "log.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* Commands a subsystem table holds, one per value of cmd1 */
+#define SOC_RX_CMD_NUM                  256
+
+/* Marks a used slot of the ZCL table, above the cluster and command */
+#define SOC_RX_ZCL_USED                 0x01000000
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+typedef struct {
+    socRx_mtHandler_t handler;
+    u8 minLen;
+} socRx_mtEntry_t;
+
+typedef struct {
+    u32 key;                          //!< SOC_RX_ZCL_USED, cluster and command, 0 if free
+    socRx_zclHandler_t handler;
+    u8 minLen;
+} socRx_zclEntry_t;
+
+/*
+ * Handlers of the frames from the SoC. Every slot always holds a handler,
+ * frames nobody registered for reach one which counts them, so a lookup
+ * is an index and a length check. Subsystems without handlers share the
+ * unknown table, a subsystem gets its own on its first registration.
+ * SRSPs have tables apart from the AREQs of their subsystem.
+ */
+typedef struct {
+    socRx_mtEntry_t *sys[SOC_RX_TBL_NUM];
+    socRx_mtEntry_t unknown[SOC_RX_CMD_NUM];
+    socRx_zclEntry_t foundation[SOC_RX_CMD_NUM];
+    socRx_zclEntry_t zcl[SOC_RX_ZCL_TBL_SIZE];
+    socRx_zclEntry_t zclUnknown;
+} socRx_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+socRx_ctrl_t socRx_vs;
+socRx_ctrl_t *socRx_v = &socRx_vs;
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* None */
+
+
+/*********************************************************************
+ * @fn      socRx_mtUnknown
+ *
+ * @brief   Count a frame no handler is registered for
+ *
+ * @param   frame - the frame
+ *
+ * @return  none
+ */
+static void socRx_mtUnknown(const socRx_mt_t *frame)
+{
+    stats_v->rxUnknown++;
+    LOG_DEBUG(LOG_MOD_SOC, "unknown frame 0x%02x 0x%02x, %u bytes", frame->cmd0, frame->cmd1, frame->len);
+}
+
+/*********************************************************************
+ * @fn      socRx_zclUnknown
+ *
+ * @brief   Count a ZCL command no handler is registered for
+ *
+ * @param   frame - the ZCL frame
+ *
+ * @return  none
+ */
+static void socRx_zclUnknown(const socRx_zcl_t *frame)
+{
+    stats_v->zclUnknown++;
+    LOG_DEBUG(LOG_MOD_SOC, "unknown ZCL command 0x%02x of cluster 0x%04x from 0x%04x",
+              frame->cmdID, frame->clusterID, frame->srcAddr);
+}
+
+/*********************************************************************
+ * @fn      socRx_zclSlot
+ *
+ * @brief   Find the slot of a cluster specific command, or the free slot
+ *          it would take
+ *
+ * @param   key - SOC_RX_ZCL_USED, cluster and command
+ *
+ * @return  the slot, NULL if the command is not there and the table is
+ *          full
+ */
+static socRx_zclEntry_t* socRx_zclSlot(u32 key)
+{
+    u32 idx = ((key ^ (key >> 11)) * 0x9E3779B1u) >> 16;
+    socRx_zclEntry_t *entry;
+    int i;
+
+    for (i = 0; i < SOC_RX_ZCL_TBL_SIZE; i++) {
+        entry = &socRx_v->zcl[(idx + i) & (SOC_RX_ZCL_TBL_SIZE - 1)];
+        if (entry->key == key || entry->key == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*********************************************************************
+ * @fn      socRx_init
+ *
+ * @brief   Forget every handler, all frames are unknown until handlers
+ *          are registered again
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void socRx_init(void)
+{
+    int i;
+
+    for (i = 0; i < SOC_RX_TBL_NUM; i++) {
+        if (socRx_v->sys[i] && socRx_v->sys[i] != socRx_v->unknown) {
+            free(socRx_v->sys[i]);
+        }
+        socRx_v->sys[i] = socRx_v->unknown;
+    }
+
+    memset(socRx_v->zcl, 0, sizeof(socRx_v->zcl));
+    socRx_v->zclUnknown.handler = socRx_zclUnknown;
+    socRx_v->zclUnknown.minLen = 0;
+    for (i = 0; i < SOC_RX_CMD_NUM; i++) {
+        socRx_v->unknown[i].handler = socRx_mtUnknown;
+        socRx_v->unknown[i].minLen = 0;
+        socRx_v->foundation[i] = socRx_v->zclUnknown;
+    }
+}
+
+/*********************************************************************
+ * @fn      socRx_register
+ *
+ * @brief   Set the handler of an RPC frame
+ *
+ * @param   cmd0 - cmd0 of the frame, its type must be AREQ or SRSP
+ * @param   cmd1 - cmd1 of the frame
+ * @param   minLen - shortest payload the handler can parse, shorter
+ *                   frames are dropped
+ * @param   handler - the handler
+ *
+ * @return  0 on success, -1 if out of memory
+ */
+int socRx_register(u8 cmd0, u8 cmd1, u8 minLen, socRx_mtHandler_t handler)
+{
+    u8 idx = cmd0 & SOC_RX_CMD0_MASK;
+    socRx_mtEntry_t *tbl = socRx_v->sys[idx];
+
+    if (tbl == socRx_v->unknown) {
+        tbl = malloc(sizeof(socRx_v->unknown));
+        if (!tbl) {
+            LOG_ERR(LOG_MOD_SOC, "socRx: no memory for the handlers of cmd0 0x%02x", cmd0);
+            return -1;
+        }
+        memcpy(tbl, socRx_v->unknown, sizeof(socRx_v->unknown));
+        socRx_v->sys[idx] = tbl;
+    }
+
+    tbl[cmd1].handler = handler;
+    tbl[cmd1].minLen = minLen;
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      socRx_registerFoundation
+ *
+ * @brief   Set the handler of a ZCL foundation command, the same for
+ *          every cluster
+ *
+ * @param   cmdID - the command
+ * @param   minLen - shortest ZCL payload the handler can parse
+ * @param   handler - the handler
+ *
+ * @return  0
+ */
+int socRx_registerFoundation(u8 cmdID, u8 minLen, socRx_zclHandler_t handler)
+{
+    socRx_v->foundation[cmdID].handler = handler;
+    socRx_v->foundation[cmdID].minLen = minLen;
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      socRx_registerZcl
+ *
+ * @brief   Set the handler of a cluster specific ZCL command
+ *
+ * @param   clusterID - the cluster
+ * @param   cmdID - the command
+ * @param   minLen - shortest ZCL payload the handler can parse
+ * @param   handler - the handler
+ *
+ * @return  0 on success, -1 if the table is full
+ */
+int socRx_registerZcl(u16 clusterID, u8 cmdID, u8 minLen, socRx_zclHandler_t handler)
+{
+    u32 key = SOC_RX_ZCL_USED | ((u32)clusterID << 8) | cmdID;
+    socRx_zclEntry_t *entry = socRx_zclSlot(key);
+
+    if (!entry) {
+        LOG_ERR(LOG_MOD_SOC, "socRx: no room for command 0x%02x of cluster 0x%04x", cmdID, clusterID);
+        return -1;
+    }
+
+    entry->key = key;
+    entry->handler = handler;
+    entry->minLen = minLen;
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      socRx_dispatch
+ *
+ * @brief   Pass an RPC frame to its handler
+ *
+ * @param   frame - the frame
+ *
+ * @return  none
+ */
+void socRx_dispatch(const socRx_mt_t *frame)
+{
+    const socRx_mtEntry_t *entry = &socRx_v->sys[frame->cmd0 & SOC_RX_CMD0_MASK][frame->cmd1];
+
+    if (frame->len < entry->minLen) {
+        stats_v->rxShort++;
+        LOG_WARN(LOG_MOD_SOC, "frame 0x%02x 0x%02x: %u bytes, %u needed",
+                 frame->cmd0, frame->cmd1, frame->len, entry->minLen);
+        return;
+    }
+    entry->handler(frame);
+}
+
+/*********************************************************************
+ * @fn      socRx_dispatchZcl
+ *
+ * @brief   Pass a ZCL frame to the handler of its command
+ *
+ * @param   frame - the ZCL frame
+ *
+ * @return  none
+ */
+void socRx_dispatchZcl(const socRx_zcl_t *frame)
+{
+    const socRx_zclEntry_t *entry;
+
+    if (frame->frameCtrl & ZCL_FRAME_CTRL_CLUSTER) {
+        entry = socRx_zclSlot(SOC_RX_ZCL_USED | ((u32)frame->clusterID << 8) | frame->cmdID);
+        if (!entry || entry->key == 0) {
+            entry = &socRx_v->zclUnknown;
+        }
+    } else {
+        entry = &socRx_v->foundation[frame->cmdID];
+    }
+
+    if (frame->len < entry->minLen) {
+        stats_v->rxShort++;
+        LOG_WARN(LOG_MOD_SOC, "ZCL command 0x%02x of cluster 0x%04x from 0x%04x: %u bytes, %u needed",
+                 frame->cmdID, frame->clusterID, frame->srcAddr, frame->len, entry->minLen);
+        return;
+    }
+    entry->handler(frame);
+}
@@ -0,0 +1,65 @@
+#ifndef  __SOC_RX_H__
+#define  __SOC_RX_H__
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* Bits of cmd0 selecting a handler table: the subsystem, and the type
+ * bit telling an SRSP from an AREQ, the two frame types the SoC sends */
+#define SOC_RX_CMD0_MASK                0x3F
+#define SOC_RX_TBL_NUM                  (SOC_RX_CMD0_MASK + 1)
+
+/* Handlers of cluster specific ZCL commands, a power of 2. Kept at least
+ * four times the number registered so a lookup rarely probes twice. */
+#define SOC_RX_ZCL_TBL_SIZE             128
+
+/*********************************************************************
+ * ENUMS
+ */
+
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+/* RPC frame from the SoC, the payload follows cmd0 and cmd1 */
+typedef struct {
+    u8 cmd0;
+    u8 cmd1;
+    u8 len;                           //!< Bytes in payload
+    const u8 *payload;
+} socRx_mt_t;
+
+/* ZCL frame from a device, the payload follows the ZCL header */
+typedef struct {
+    u16 srcAddr;
+    u8 srcEndpoint;
+    u16 clusterID;
+    u8 addrMode;
+    u8 frameCtrl;
+    u8 seq;
+    u8 cmdID;
+    u8 len;                           //!< Bytes in payload
+    const u8 *payload;
+} socRx_zcl_t;
+
+/* A handler is only called with at least the payload it registered for */
+typedef void (*socRx_mtHandler_t)(const socRx_mt_t *frame);
+typedef void (*socRx_zclHandler_t)(const socRx_zcl_t *frame);
+
+
+/*********************************************************************
+ * Public Functions
+ */
+void socRx_init(void);
+int  socRx_register(u8 cmd0, u8 cmd1, u8 minLen, socRx_mtHandler_t handler);
+int  socRx_registerFoundation(u8 cmdID, u8 minLen, socRx_zclHandler_t handler);
+int  socRx_registerZcl(u16 clusterID, u8 cmdID, u8 minLen, socRx_zclHandler_t handler);
+void socRx_dispatch(const socRx_mt_t *frame);
+void socRx_dispatchZcl(const socRx_zcl_t *frame);
+
+#endif  /* __SOC_RX_H__ */
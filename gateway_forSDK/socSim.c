@@ -0,0 +1,919 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/uio.h>
+
+#include "types.h"
+#include "socCmd.h"
+#include "nodes.h"
+#include "ringBuf.h"
+#include "swTimer.h"
+#include "socSim.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+#define SIM_RPC_SOF                     0xFE
+#define SIM_RPC_FRAME_OVERHEAD          3
+#define SIM_MAX_FRAME_LEN               (0xFF + SIM_RPC_FRAME_OVERHEAD)
+
+/* AREQ of the APP subsystem, the only frames the gateway exchanges */
+#define SIM_RPC_APP_AREQ                0x49
+#define SIM_RPC_SUBSYSTEM_MASK          0x1F
+#define SIM_RPC_SYS_APP                 0x09
+#define SIM_MT_APP_MSG                  0x00
+#define SIM_MT_APP_DATA_RSP             0x80
+#define SIM_MT_APP_CTRL_RSP             0x81
+
+/* SREQs of the coordinator itself, answered at once with an SRSP */
+#define SIM_RPC_CMD_TYPE_MASK           0xE0
+#define SIM_RPC_SREQ                    0x20
+#define SIM_RPC_SRSP                    0x60
+#define SIM_RPC_SYS_SYS                 0x01
+#define SIM_RPC_SYS_UTIL                0x07
+#define SIM_SYS_PING                    0x01
+#define SIM_UTIL_GET_DEVICE_INFO        0x00
+#define SIM_RPC_ERR_COMMAND_ID          0x02
+
+/* MT capabilities: SYS, UTIL and APP */
+#define SIM_MT_CAPABILITIES             0x0141
+
+/* Device type bit and device state of a started coordinator */
+#define SIM_DEV_TYPE_COORD              0x01
+#define SIM_DEV_STATE_ZB_COORD          0x09
+
+#define SIM_CTRL_CLUSTER_ID             0xFFFF
+#define SIM_GW_ENDPOINT                 0x0B
+#define SIM_DEV_ENDPOINT                0x0B
+
+#define SIM_MAX_GROUPS                  8
+
+/* Nodes reported per GET_NODES response, the frame is full then */
+#define SIM_MAX_NODES_RSP               100
+
+#define SIM_RX_BUF_SIZE                 4096
+#define SIM_TX_BUF_SIZE                 65536
+
+#define ZCL_FRAME_CTRL_CLUSTER          0x01
+#define ZCL_FRAME_CTRL_TO_CLIENT        0x08
+#define ZCL_FRAME_CTRL_NO_DEFAULT_RSP   0x10
+
+#define ZCL_CMD_DEFAULT_RSP             0x0B
+#define ZCL_STATUS_SUCCESS              0x00
+#define ZCL_STATUS_UNSUP_ATTRIBUTE      0x86
+#define ZCL_DATATYPE_BOOLEAN            0x10
+#define ZCL_DATATYPE_UINT8              0x20
+
+#define ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL           0x0300
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+typedef struct {
+    u16 nwkAddr;
+    u8 extAddr[8];
+    u16 devId;
+    u8 capability;
+    u8 onOff;
+    u8 level;
+    u8 hue;
+    u8 sat;
+    u8 seq;                           //!< ZCL sequence of commands the device sends
+    u8 groupNum;
+    u16 groups[SIM_MAX_GROUPS];
+    swTimer_t toggleTimer;            //!< Switches only
+} sim_dev_t;
+
+/* A frame to the gateway waiting for its simulated air time */
+typedef struct {
+    swTimer_t timer;
+    u16 len;
+    u8 frame[SIM_MAX_FRAME_LEN];
+} sim_event_t;
+
+typedef struct {
+    sim_dev_t *devs;
+    sim_cfg_t cfg;
+    int master;
+    simFrameCb_t frameCb;
+
+    ringBuf_t rxBuf;
+    ringBuf_t txBuf;
+    u8 rxStorage[SIM_RX_BUF_SIZE];
+    u8 txStorage[SIM_TX_BUF_SIZE];
+
+    sim_stats_t stats;
+} sim_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+sim_ctrl_t sim_vs;
+sim_ctrl_t *sim_v = &sim_vs;
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* None */
+
+
+/*********************************************************************
+ * @fn      sim_xorSum
+ *
+ * @brief   XOR all the bytes of a buffer, as used by the RPC FCS
+ *
+ * @param   buf - the data
+ * @param   len - length of data
+ *
+ * @return  the XOR of all the bytes
+ */
+static u8 sim_xorSum(const u8 *buf, int len)
+{
+    u8 result = 0;
+
+    while (len-- > 0) {
+        result ^= *buf++;
+    }
+    return result;
+}
+
+/*********************************************************************
+ * @fn      sim_devNum
+ *
+ * @brief   Get the number of simulated devices
+ *
+ * @param   none
+ *
+ * @return  lights and switches
+ */
+static u32 sim_devNum(void)
+{
+    return sim_v->cfg.lightNum + sim_v->cfg.switchNum;
+}
+
+/*********************************************************************
+ * @fn      sim_findDev
+ *
+ * @brief   Look a device up by network address
+ *
+ * @param   nwkAddr - the address
+ *
+ * @return  the device, NULL if there is none
+ */
+static sim_dev_t* sim_findDev(u16 nwkAddr)
+{
+    u32 idx = (u32)(nwkAddr - SIM_NWK_ADDR_BASE);
+
+    if (nwkAddr < SIM_NWK_ADDR_BASE || idx >= sim_devNum()) {
+        return NULL;
+    }
+    return &sim_v->devs[idx];
+}
+
+/*********************************************************************
+ * @fn      sim_send
+ *
+ * @brief   Queue a frame for the gateway
+ *
+ * @param   frame - the frame, SOF to FCS
+ * @param   len - length of the frame
+ *
+ * @return  none
+ */
+static void sim_send(const u8 *frame, u16 len)
+{
+    if (ringBuf_space(&sim_v->txBuf) < len) {
+        sim_v->stats.overflows++;
+        return;
+    }
+    ringBuf_write(&sim_v->txBuf, frame, len);
+    sim_v->stats.txFrames++;
+}
+
+/*********************************************************************
+ * @fn      sim_eventCb
+ *
+ * @brief   The simulated air time of a frame is over, hand it over
+ *
+ * @param   arg - the event
+ *
+ * @return  none
+ */
+static void sim_eventCb(void *arg)
+{
+    sim_event_t *ev = (sim_event_t*)arg;
+
+    sim_send(ev->frame, ev->len);
+    free(ev);
+}
+
+/*********************************************************************
+ * @fn      sim_delay
+ *
+ * @brief   Get the time a frame takes over the simulated network
+ *
+ * @param   none
+ *
+ * @return  time in ms
+ */
+static u32 sim_delay(void)
+{
+    u32 delay = sim_v->cfg.latencyMs;
+
+    if (sim_v->cfg.jitterMs) {
+        delay += rand() % (2 * sim_v->cfg.jitterMs + 1);
+        delay = (delay > sim_v->cfg.jitterMs) ? delay - sim_v->cfg.jitterMs : 0;
+    }
+    return delay;
+}
+
+/*********************************************************************
+ * @fn      sim_post
+ *
+ * @brief   Build a frame to the gateway and send it after a delay
+ *
+ * @param   cmd1 - SIM_MT_APP_DATA_RSP or SIM_MT_APP_CTRL_RSP
+ * @param   data - the data or control message
+ * @param   len - length of the message
+ * @param   delayMs - time until it is sent
+ *
+ * @return  none
+ */
+static void sim_post(u8 cmd1, const u8 *data, u8 len, u32 delayMs)
+{
+    sim_event_t *ev = malloc(sizeof(sim_event_t));
+
+    if (!ev) {
+        sim_v->stats.overflows++;
+        return;
+    }
+
+    ev->frame[0] = SIM_RPC_SOF;
+    ev->frame[1] = len + 2;
+    ev->frame[2] = SIM_RPC_APP_AREQ;
+    ev->frame[3] = cmd1;
+    memcpy(&ev->frame[4], data, len);
+    ev->frame[4 + len] = sim_xorSum(&ev->frame[1], len + 3);
+    ev->len = len + 2 + SIM_RPC_FRAME_OVERHEAD;
+    memset(&ev->timer, 0, sizeof(ev->timer));
+
+    swTimer_start(&ev->timer, delayMs, sim_eventCb, ev);
+}
+
+/*********************************************************************
+ * @fn      sim_postCtrl
+ *
+ * @brief   Send a control message of the coordinator
+ *
+ * @param   cmdID - @ref zll_ctrl_command_id
+ * @param   payload - parameters of the message
+ * @param   len - length of the parameters
+ * @param   delayMs - time until it is sent
+ *
+ * @return  none
+ */
+static void sim_postCtrl(u8 cmdID, const u8 *payload, u8 len, u32 delayMs)
+{
+    u8 buf[SIM_MAX_FRAME_LEN];
+    ctrl_cmd_t *pCtrl = (ctrl_cmd_t*)buf;
+
+    memset(buf, 0, offsetof(ctrl_cmd_t, payload));
+    pCtrl->endpoint = SIM_GW_ENDPOINT;
+    pCtrl->clusterID = SIM_CTRL_CLUSTER_ID;
+    pCtrl->dataLen = 6 + len;
+    pCtrl->cmdID = cmdID;
+    memcpy(pCtrl->payload, payload, len);
+
+    sim_post(SIM_MT_APP_CTRL_RSP, buf, offsetof(ctrl_cmd_t, payload) + len, delayMs);
+}
+
+/*********************************************************************
+ * @fn      sim_postData
+ *
+ * @brief   Send a ZCL frame of a device
+ *
+ * @param   dev - the sending device
+ * @param   clusterID - ZCL cluster
+ * @param   frameCtrl - ZCL frame control
+ * @param   seq - ZCL transaction sequence number
+ * @param   cmdID - ZCL command
+ * @param   payload - ZCL payload
+ * @param   len - length of the payload
+ * @param   delayMs - time until it is sent
+ *
+ * @return  none
+ */
+static void sim_postData(sim_dev_t *dev, u16 clusterID, u8 frameCtrl, u8 seq, u8 cmdID,
+                         const u8 *payload, u8 len, u32 delayMs)
+{
+    u8 buf[SIM_MAX_FRAME_LEN];
+    data_cmd_t *pData = (data_cmd_t*)buf;
+
+    pData->endpoint = SIM_GW_ENDPOINT;
+    pData->dstNwkAddr = dev->nwkAddr;         /* The source, for frames to the gateway */
+    pData->dstEndpoint = SIM_DEV_ENDPOINT;
+    pData->clusterID = clusterID;
+    pData->dataLen = 3 + len;
+    pData->addrMode = ADDR_MODE_SHORT_ADDR;
+    pData->zclFrameCtrl = frameCtrl;
+    pData->zclTransSeqNo = seq;
+    pData->cmdID = cmdID;
+    if (len) {
+        memcpy(pData->payload, payload, len);
+    }
+
+    sim_post(SIM_MT_APP_DATA_RSP, buf, offsetof(data_cmd_t, payload) + len, delayMs);
+}
+
+/*********************************************************************
+ * @fn      sim_announce
+ *
+ * @brief   Let a device announce itself, as on joining the network
+ *
+ * @param   dev - the device
+ * @param   delayMs - time until it is sent
+ *
+ * @return  none
+ */
+static void sim_announce(sim_dev_t *dev, u32 delayMs)
+{
+    u8 payload[14];
+
+    payload[0] = dev->nwkAddr & 0xff;
+    payload[1] = dev->nwkAddr >> 8;
+    memcpy(&payload[2], dev->extAddr, 8);
+    payload[10] = SIM_DEV_ENDPOINT;
+    payload[11] = dev->capability;
+    payload[12] = dev->devId & 0xff;
+    payload[13] = dev->devId >> 8;
+
+    sim_postCtrl(ZLL_CTRL_CMD_DEV_ANN_IND, payload, sizeof(payload), delayMs);
+}
+
+/*********************************************************************
+ * @fn      sim_announceAll
+ *
+ * @brief   Let every device announce itself, spaced out in time
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void sim_announceAll(void)
+{
+    u32 i;
+
+    for (i = 0; i < sim_devNum(); i++) {
+        sim_announce(&sim_v->devs[i], i * sim_v->cfg.announceMs);
+    }
+}
+
+/*********************************************************************
+ * @fn      sim_toggleTimerCb
+ *
+ * @brief   A switch was pressed, it sends a toggle to the gateway
+ *
+ * @param   arg - the switch
+ *
+ * @return  none
+ */
+static void sim_toggleTimerCb(void *arg)
+{
+    sim_dev_t *dev = (sim_dev_t*)arg;
+
+    sim_postData(dev, ZCL_CLUSTER_ID_GEN_ON_OFF, ZCL_FRAME_CTRL_CLUSTER, dev->seq++, 0x02, NULL, 0, 0);
+    swTimer_start(&dev->toggleTimer, sim_v->cfg.toggleMs, sim_toggleTimerCb, dev);
+}
+
+/*********************************************************************
+ * @fn      sim_initDevs
+ *
+ * @brief   Create the simulated devices, lights first
+ *
+ * @param   none
+ *
+ * @return  0 on success, -1 if out of memory
+ */
+static int sim_initDevs(void)
+{
+    sim_dev_t *dev;
+    u32 i;
+
+    sim_v->devs = calloc(sim_devNum(), sizeof(sim_dev_t));
+    if (!sim_v->devs) {
+        return -1;
+    }
+
+    for (i = 0; i < sim_devNum(); i++) {
+        dev = &sim_v->devs[i];
+        dev->nwkAddr = SIM_NWK_ADDR_BASE + i;
+        dev->extAddr[0] = i & 0xff;
+        dev->extAddr[1] = (i >> 8) & 0xff;
+        dev->extAddr[5] = 0x4b;
+        dev->extAddr[6] = 0x12;
+        dev->extAddr[7] = 0x00;
+        if (i < sim_v->cfg.lightNum) {
+            dev->devId = HA_DEV_DIMMABLE_LIGHT;
+            dev->capability = 0x8E;           /* Router, mains powered */
+            dev->level = 0xFE;
+        } else {
+            dev->devId = HA_DEV_ONOFF_SWITCH;
+            dev->capability = 0x80;           /* Sleepy end device */
+            if (sim_v->cfg.toggleMs) {
+                /* Spread the switches over the interval */
+                swTimer_start(&dev->toggleTimer, sim_v->cfg.toggleMs + rand() % sim_v->cfg.toggleMs,
+                              sim_toggleTimerCb, dev);
+            }
+        }
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      sim_inGroup
+ *
+ * @brief   Check whether a device is a member of a group
+ *
+ * @param   dev - the device
+ * @param   groupId - the group
+ *
+ * @return  TRUE if it is
+ */
+static int sim_inGroup(sim_dev_t *dev, u16 groupId)
+{
+    u8 i;
+
+    for (i = 0; i < dev->groupNum; i++) {
+        if (dev->groups[i] == groupId) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*********************************************************************
+ * @fn      sim_readAttr
+ *
+ * @brief   Build the read attributes response of a light
+ *
+ * @param   dev - the light
+ * @param   clusterID - ZCL cluster
+ * @param   attrId - the attribute
+ * @param   rsp - returns the response payload
+ *
+ * @return  length of the response payload
+ */
+static u8 sim_readAttr(sim_dev_t *dev, u16 clusterID, u16 attrId, u8 *rsp)
+{
+    rsp[0] = attrId & 0xff;
+    rsp[1] = attrId >> 8;
+    rsp[2] = ZCL_STATUS_SUCCESS;
+
+    if (clusterID == ZCL_CLUSTER_ID_GEN_ON_OFF && attrId == 0) {
+        rsp[3] = ZCL_DATATYPE_BOOLEAN;
+        rsp[4] = dev->onOff;
+    } else if (clusterID == ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL && attrId == 0) {
+        rsp[3] = ZCL_DATATYPE_UINT8;
+        rsp[4] = dev->level;
+    } else if (clusterID == ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL && attrId <= 1) {
+        rsp[3] = ZCL_DATATYPE_UINT8;
+        rsp[4] = attrId ? dev->sat : dev->hue;
+    } else {
+        rsp[2] = ZCL_STATUS_UNSUP_ATTRIBUTE;
+        return 3;
+    }
+    return 5;
+}
+
+/*********************************************************************
+ * @fn      sim_devCmd
+ *
+ * @brief   Apply a ZCL command to a device and, for unicasts, answer it
+ *          the way the device would
+ *
+ * @param   dev - the device
+ * @param   pData - the command
+ * @param   len - length of the ZCL payload
+ * @param   unicast - TRUE if the command was sent to this device only
+ *
+ * @return  none
+ */
+static void sim_devCmd(sim_dev_t *dev, data_cmd_t *pData, u8 len, u8 unicast)
+{
+    u8 *p = pData->payload;
+    u8 rsp[8];
+    u8 rspLen;
+    u8 status = ZCL_STATUS_SUCCESS;
+    u16 groupId;
+
+    if (!(pData->zclFrameCtrl & ZCL_FRAME_CTRL_CLUSTER)) {
+        /* Foundation command, reads are the only ones answered */
+        if (pData->cmdID == ZCL_CMD_READ && len >= 2 && unicast) {
+            rspLen = sim_readAttr(dev, pData->clusterID, BUILD_UINT16(p[0], p[1]), rsp);
+            sim_postData(dev, pData->clusterID, ZCL_FRAME_CTRL_TO_CLIENT | ZCL_FRAME_CTRL_NO_DEFAULT_RSP,
+                         pData->zclTransSeqNo, ZCL_CMD_READ_RSP, rsp, rspLen, sim_delay());
+            sim_v->stats.rsps++;
+        }
+        return;
+    }
+
+    switch (pData->clusterID) {
+    case ZCL_CLUSTER_ID_GEN_ON_OFF:
+        if (pData->cmdID <= 1) {
+            dev->onOff = pData->cmdID;
+        } else if (pData->cmdID == 2) {
+            dev->onOff = !dev->onOff;
+        }
+        break;
+
+    case ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL:
+        if ((pData->cmdID == 0x00 || pData->cmdID == 0x04) && len >= 1) {
+            dev->level = p[0];
+            if (pData->cmdID == 0x04) {
+                dev->onOff = (p[0] != 0);
+            }
+        }
+        break;
+
+    case ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL:
+        if (pData->cmdID == 0x00 && len >= 1) {
+            dev->hue = p[0];
+        } else if (pData->cmdID == 0x03 && len >= 1) {
+            dev->sat = p[0];
+        } else if (pData->cmdID == 0x06 && len >= 2) {
+            dev->hue = p[0];
+            dev->sat = p[1];
+        }
+        break;
+
+    case ZCL_CLUSTER_ID_GEN_GROUPS:
+        if (pData->cmdID == 0x00 && len >= 2) {
+            groupId = BUILD_UINT16(p[0], p[1]);
+            if (!sim_inGroup(dev, groupId)) {
+                if (dev->groupNum < SIM_MAX_GROUPS) {
+                    dev->groups[dev->groupNum++] = groupId;
+                } else {
+                    status = 0x89;            /* INSUFFICIENT_SPACE */
+                }
+            }
+            if (unicast) {
+                rsp[0] = status;
+                rsp[1] = p[0];
+                rsp[2] = p[1];
+                sim_postData(dev, pData->clusterID, ZCL_FRAME_CTRL_CLUSTER | ZCL_FRAME_CTRL_TO_CLIENT,
+                             pData->zclTransSeqNo, 0x00, rsp, 3, sim_delay());
+                sim_v->stats.rsps++;
+            }
+            return;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    if (unicast) {
+        rsp[0] = pData->cmdID;
+        rsp[1] = status;
+        sim_postData(dev, pData->clusterID, ZCL_FRAME_CTRL_TO_CLIENT | ZCL_FRAME_CTRL_NO_DEFAULT_RSP,
+                     pData->zclTransSeqNo, ZCL_CMD_DEFAULT_RSP, rsp, 2, sim_delay());
+        sim_v->stats.rsps++;
+    }
+}
+
+/*********************************************************************
+ * @fn      sim_dataCmd
+ *
+ * @brief   Deliver a ZCL command from the gateway to its devices
+ *
+ * @param   pData - the command
+ * @param   len - length of the ZCL payload
+ *
+ * @return  none
+ */
+static void sim_dataCmd(data_cmd_t *pData, u8 len)
+{
+    sim_dev_t *dev;
+    u32 i;
+
+    if (sim_v->cfg.lossPct && (u32)(rand() % 100) < sim_v->cfg.lossPct) {
+        sim_v->stats.lost++;
+        return;
+    }
+
+    if (pData->addrMode == ADDR_MODE_GROUP || pData->dstNwkAddr >= SIM_BROADCAST_ADDR_MIN) {
+        for (i = 0; i < sim_v->cfg.lightNum; i++) {
+            dev = &sim_v->devs[i];
+            if (pData->addrMode != ADDR_MODE_GROUP || sim_inGroup(dev, pData->dstNwkAddr)) {
+                sim_devCmd(dev, pData, len, FALSE);
+            }
+        }
+        return;
+    }
+
+    dev = sim_findDev(pData->dstNwkAddr);
+    if (dev && dev->devId != HA_DEV_ONOFF_SWITCH) {
+        sim_devCmd(dev, pData, len, TRUE);
+    }
+}
+
+/*********************************************************************
+ * @fn      sim_ctrlCmd
+ *
+ * @brief   Handle a control command of the gateway to the coordinator
+ *
+ * @param   pCtrl - the command
+ *
+ * @return  none
+ */
+static void sim_ctrlCmd(ctrl_cmd_t *pCtrl)
+{
+    u8 payload[1 + SIM_MAX_NODES_RSP * 2];
+    u32 i, num;
+
+    switch (pCtrl->cmdID) {
+    case ZLL_CTRL_CMD_GET_NODES:
+        num = (sim_devNum() < SIM_MAX_NODES_RSP) ? sim_devNum() : SIM_MAX_NODES_RSP;
+        payload[0] = num;
+        for (i = 0; i < num; i++) {
+            payload[1 + i * 2] = sim_v->devs[i].nwkAddr & 0xff;
+            payload[2 + i * 2] = sim_v->devs[i].nwkAddr >> 8;
+        }
+        sim_postCtrl(ZLL_CTRL_CMD_GET_NODES, payload, 1 + num * 2, sim_delay());
+        break;
+
+    case ZLL_CTRL_CMD_TOUCHLINK:
+    case ZLL_CTRL_CMD_PERMIT_JOIN:
+        sim_announceAll();
+        break;
+
+    default:
+        break;
+    }
+}
+
+/*********************************************************************
+ * @fn      sim_sreq
+ *
+ * @brief   Answer an SREQ of the gateway, an RPC error for the ones the
+ *          simulated coordinator does not know
+ *
+ * @param   cmd0 - cmd0 of the SREQ
+ * @param   cmd1 - cmd1 of the SREQ
+ *
+ * @return  none
+ */
+static void sim_sreq(u8 cmd0, u8 cmd1)
+{
+    u8 frame[SIM_MAX_FRAME_LEN];
+    u8 *p = &frame[4];
+    u8 sys = cmd0 & SIM_RPC_SUBSYSTEM_MASK;
+    u8 len;
+
+    frame[2] = SIM_RPC_SRSP | sys;
+    frame[3] = cmd1;
+    if (sys == SIM_RPC_SYS_SYS && cmd1 == SIM_SYS_PING) {
+        *p++ = SIM_MT_CAPABILITIES & 0xff;
+        *p++ = SIM_MT_CAPABILITIES >> 8;
+    } else if (sys == SIM_RPC_SYS_UTIL && cmd1 == SIM_UTIL_GET_DEVICE_INFO) {
+        *p++ = ZCL_STATUS_SUCCESS;
+        memset(p, 0, 8);
+        p[0] = 0x01;
+        p[5] = 0x4b;
+        p[6] = 0x12;
+        p += 8;
+        *p++ = 0x00;                          /* short address 0x0000 */
+        *p++ = 0x00;
+        *p++ = SIM_DEV_TYPE_COORD;
+        *p++ = SIM_DEV_STATE_ZB_COORD;
+        *p++ = 0;                             /* no associated devices listed */
+    } else {
+        frame[2] = SIM_RPC_SRSP;
+        frame[3] = 0x00;
+        *p++ = SIM_RPC_ERR_COMMAND_ID;
+        *p++ = cmd0;
+        *p++ = cmd1;
+    }
+
+    len = (u8)(p - &frame[4]);
+    frame[0] = SIM_RPC_SOF;
+    frame[1] = len + 2;
+    frame[4 + len] = sim_xorSum(&frame[1], len + 3);
+    sim_send(frame, len + 2 + SIM_RPC_FRAME_OVERHEAD);
+}
+
+/*********************************************************************
+ * @fn      sim_dispatchFrame
+ *
+ * @brief   Handle one complete frame of the gateway
+ *
+ * @param   frame - the frame, SOF to FCS
+ *
+ * @return  none
+ */
+static void sim_dispatchFrame(u8 *frame)
+{
+    gw_app_cmd_t *pCmd = (gw_app_cmd_t*)&frame[1];
+    u8 hdrLen = offsetof(data_cmd_t, payload);
+
+    sim_v->stats.rxFrames++;
+    if (sim_v->frameCb) {
+        sim_v->frameCb(frame, pCmd->len + SIM_RPC_FRAME_OVERHEAD);
+    }
+
+    if ((pCmd->cmd0 & SIM_RPC_CMD_TYPE_MASK) == SIM_RPC_SREQ) {
+        sim_sreq(pCmd->cmd0, pCmd->cmd1);
+        return;
+    }
+
+    if ((pCmd->cmd0 & SIM_RPC_SUBSYSTEM_MASK) != SIM_RPC_SYS_APP || pCmd->cmd1 != SIM_MT_APP_MSG) {
+        return;
+    }
+
+    if (pCmd->data.ctrlCmd.clusterID == SIM_CTRL_CLUSTER_ID) {
+        sim_ctrlCmd(&pCmd->data.ctrlCmd);
+    } else if (pCmd->len >= 2 + hdrLen) {
+        sim_dataCmd(&pCmd->data.dataCmd, pCmd->len - 2 - hdrLen);
+    }
+}
+
+/*********************************************************************
+ * @fn      sim_parseFrames
+ *
+ * @brief   Take every complete frame out of the receive buffer
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void sim_parseFrames(void)
+{
+    u8 frame[SIM_MAX_FRAME_LEN];
+    u32 used, frameLen;
+    u8 len;
+    int sof;
+
+    while ((used = ringBuf_used(&sim_v->rxBuf)) > 0) {
+        if (ringBuf_peek(&sim_v->rxBuf, 0) != SIM_RPC_SOF) {
+            sof = ringBuf_find(&sim_v->rxBuf, 1, SIM_RPC_SOF);
+            ringBuf_drop(&sim_v->rxBuf, (sof == RING_BUF_NOT_FOUND) ? used : (u32)sof);
+            sim_v->stats.rxErrors++;
+            continue;
+        }
+        if (used < 2) {
+            break;
+        }
+
+        len = ringBuf_peek(&sim_v->rxBuf, 1);
+        frameLen = len + SIM_RPC_FRAME_OVERHEAD;
+        if (used < frameLen) {
+            break;
+        }
+
+        ringBuf_copy(&sim_v->rxBuf, 0, frame, frameLen);
+        if (len < 2 || sim_xorSum(&frame[1], len + 1) != frame[frameLen - 1]) {
+            ringBuf_drop(&sim_v->rxBuf, 1);
+            sim_v->stats.rxErrors++;
+            continue;
+        }
+
+        ringBuf_drop(&sim_v->rxBuf, frameLen);
+        sim_dispatchFrame(frame);
+    }
+}
+
+/*********************************************************************
+ * @fn      sim_pump
+ *
+ * @brief   Exchange frames with the gateway, waits for the pty for up
+ *          to a given time. The devices' timers run from
+ *          swTimer_process().
+ *
+ * @param   timeoutMs - longest time to wait for the pty, -1 for ever
+ *
+ * @return  none
+ */
+void sim_pump(int timeoutMs)
+{
+    struct pollfd pfd;
+    struct iovec iov[2];
+    int cnt, n;
+
+    pfd.fd = sim_v->master;
+    pfd.events = POLLIN | (ringBuf_used(&sim_v->txBuf) ? POLLOUT : 0);
+
+    if (poll(&pfd, 1, timeoutMs) <= 0) {
+        return;
+    }
+
+    if (pfd.revents & POLLIN) {
+        while (ringBuf_readFd(&sim_v->rxBuf, sim_v->master) > 0) {
+            sim_parseFrames();
+        }
+    }
+
+    if (pfd.revents & POLLOUT) {
+        cnt = ringBuf_usedIov(&sim_v->txBuf, iov);
+        n = writev(sim_v->master, iov, cnt);
+        if (n > 0) {
+            ringBuf_drop(&sim_v->txBuf, n);
+        }
+    }
+}
+
+/*********************************************************************
+ * @fn      sim_init
+ *
+ * @brief   Create the simulated network behind a pty
+ *
+ * @param   cfg - shape of the network
+ * @param   master - master side of the pty the gateway uses
+ *
+ * @return  0 on success, -1 on error
+ */
+int sim_init(const sim_cfg_t *cfg, int master)
+{
+    if (cfg->lightNum + cfg->switchNum == 0 || cfg->lightNum + cfg->switchNum > SIM_MAX_DEVICES ||
+        cfg->lossPct > 100) {
+        return -1;
+    }
+
+    sim_v->cfg = *cfg;
+    sim_v->master = master;
+    ringBuf_init(&sim_v->rxBuf, sim_v->rxStorage, SIM_RX_BUF_SIZE);
+    ringBuf_init(&sim_v->txBuf, sim_v->txStorage, SIM_TX_BUF_SIZE);
+    return sim_initDevs();
+}
+
+/*********************************************************************
+ * @fn      sim_setFrameCb
+ *
+ * @brief   Watch the frames the gateway writes
+ *
+ * @param   cb - the callback, NULL for none
+ *
+ * @return  none
+ */
+void sim_setFrameCb(simFrameCb_t cb)
+{
+    sim_v->frameCb = cb;
+}
+
+/*********************************************************************
+ * @fn      sim_announceDev
+ *
+ * @brief   Let one device announce itself
+ *
+ * @param   idx - the device, lights come first
+ * @param   delayMs - time until it is sent
+ *
+ * @return  none
+ */
+void sim_announceDev(u32 idx, u32 delayMs)
+{
+    if (idx < sim_devNum()) {
+        sim_announce(&sim_v->devs[idx], delayMs);
+    }
+}
+
+/*********************************************************************
+ * @fn      sim_txPending
+ *
+ * @brief   Get the amount of data waiting for room in the pty, for
+ *          callers polling the pty themselves
+ *
+ * @param   none
+ *
+ * @return  bytes waiting for the pty
+ */
+u32 sim_txPending(void)
+{
+    return ringBuf_used(&sim_v->txBuf);
+}
+
+/*********************************************************************
+ * @fn      sim_getStats
+ *
+ * @brief   Get the counters of the simulation
+ *
+ * @param   none
+ *
+ * @return  the counters
+ */
+sim_stats_t* sim_getStats(void)
+{
+    return &sim_v->stats;
+}
@@ -0,0 +1,63 @@
+#ifndef  __SOC_SIM_H__
+#define  __SOC_SIM_H__
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* Devices get consecutive network addresses from here */
+#define SIM_NWK_ADDR_BASE               0x1001
+
+/* 0xFFF8 - 0xFFFF are broadcast network addresses */
+#define SIM_BROADCAST_ADDR_MIN          0xFFF8
+
+#define SIM_MAX_DEVICES                 (SIM_BROADCAST_ADDR_MIN - SIM_NWK_ADDR_BASE)
+
+/*********************************************************************
+ * ENUMS
+ */
+
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+/* Shape of the simulated network, lights get the first addresses */
+typedef struct {
+    u32 lightNum;
+    u32 switchNum;
+    u32 latencyMs;                    //!< Time a device takes to answer
+    u32 jitterMs;                     //!< Random variation of latencyMs, +/-
+    u32 lossPct;                      //!< Commands lost on the air
+    u32 toggleMs;                     //!< Every switch toggles this often, 0 for never
+    u32 announceMs;                   //!< Time between device announces
+} sim_cfg_t;
+
+typedef struct {
+    u32 rxFrames;                     //!< Frames from the gateway
+    u32 rxErrors;                     //!< Frames with a bad FCS or length
+    u32 txFrames;                     //!< Frames to the gateway
+    u32 rsps;                         //!< Responses of the devices
+    u32 lost;                         //!< Commands lost on the air
+    u32 overflows;                    //!< Frames dropped, the gateway did not read
+} sim_stats_t;
+
+/* Sees every valid frame of the gateway, SOF to FCS, before the devices */
+typedef void (*simFrameCb_t)(const u8 *frame, u16 len);
+
+
+/*********************************************************************
+ * Public Functions
+ */
+int  sim_init(const sim_cfg_t *cfg, int master);
+void sim_setFrameCb(simFrameCb_t cb);
+void sim_pump(int timeoutMs);
+void sim_announceAll(void);
+void sim_announceDev(u32 idx, u32 delayMs);
+u32  sim_txPending(void);
+sim_stats_t* sim_getStats(void);
+
+#endif  /* __SOC_SIM_H__ */
@@ -0,0 +1,184 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "types.h"
+#include "socSim.h"
+#include "swTimer.h"
+#include "tool.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* None */
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+typedef struct {
+    int master;
+    int slave;
+    pid_t child;
+    u16 port;
+    volatile sig_atomic_t stop;
+} simMain_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+simMain_ctrl_t simMain_vs;
+simMain_ctrl_t *simMain_v = &simMain_vs;
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static void usage(char *exeName);
+
+
+/*********************************************************************
+ * @fn      simMain_stopSignal
+ *
+ * @brief   SIGINT and SIGTERM handler
+ *
+ * @param   sig - the signal
+ *
+ * @return  none
+ */
+static void simMain_stopSignal(int sig)
+{
+    simMain_v->stop = TRUE;
+}
+
+int main(int argc, char* argv[])
+{
+    struct sigaction sa;
+    sim_cfg_t cfg;
+    sim_stats_t *stats;
+    char *exe = NULL;
+    char *ptyName;
+    int opt;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.lightNum = 4;
+    cfg.latencyMs = 20;
+    cfg.announceMs = 10;
+    simMain_v->port = TOOL_GW_PORT;
+
+    while ((opt = getopt(argc, argv, "l:s:d:j:x:t:a:r:p:g:")) != -1) {
+        switch (opt) {
+        case 'l':
+            cfg.lightNum = atoi(optarg);
+            break;
+        case 's':
+            cfg.switchNum = atoi(optarg);
+            break;
+        case 'd':
+            cfg.latencyMs = atoi(optarg);
+            break;
+        case 'j':
+            cfg.jitterMs = atoi(optarg);
+            break;
+        case 'x':
+            cfg.lossPct = atoi(optarg);
+            break;
+        case 't':
+            cfg.toggleMs = atoi(optarg);
+            break;
+        case 'a':
+            cfg.announceMs = atoi(optarg);
+            break;
+        case 'r':
+            srand(atoi(optarg));
+            break;
+        case 'p':
+            simMain_v->port = atoi(optarg);
+            break;
+        case 'g':
+            exe = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = simMain_stopSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    ptyName = tool_openPty(&simMain_v->master, &simMain_v->slave);
+    if (!ptyName) {
+        return 1;
+    }
+    if (sim_init(&cfg, simMain_v->master) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (exe) {
+        simMain_v->child = tool_spawnGateway(exe, NULL, simMain_v->port, ptyName, NULL);
+    } else {
+        printf("start the gateway with: gateway -p %u %s\n", simMain_v->port, ptyName);
+        fflush(stdout);
+    }
+    if (simMain_v->child < 0 ||
+        tool_waitGateway(simMain_v->port, exe ? TOOL_GW_START_TIMEOUT_MS : -1, sim_pump) != 0) {
+        tool_stopGateway(simMain_v->child, simMain_v->port);
+        return 1;
+    }
+
+    printf("simulating %u lights and %u switches\n", cfg.lightNum, cfg.switchNum);
+    fflush(stdout);
+    sim_announceAll();
+
+    while (!simMain_v->stop) {
+        sim_pump(swTimer_nextTimeout());
+        swTimer_process();
+
+        /* A gateway we started took the pty with it */
+        if (simMain_v->child > 0 && waitpid(simMain_v->child, NULL, WNOHANG) == simMain_v->child) {
+            simMain_v->child = 0;
+            break;
+        }
+    }
+
+    tool_stopGateway(simMain_v->child, simMain_v->port);
+
+    stats = sim_getStats();
+    printf("frames from gateway %u (%u bad), to gateway %u (%u dropped), responses %u, lost %u\n",
+           stats->rxFrames, stats->rxErrors, stats->txFrames, stats->overflows, stats->rsps, stats->lost);
+    return 0;
+}
+
+static void usage(char* exeName)
+{
+    printf("Usage: %s [options]\n", exeName);
+    printf("  -l num      lights, 4 by default\n");
+    printf("  -s num      switches, 0 by default\n");
+    printf("  -d ms       time a device takes to answer, 20 by default\n");
+    printf("  -j ms       random variation of that time, +/-\n");
+    printf("  -x percent  commands lost on the air\n");
+    printf("  -t ms       every switch toggles this often, never by default\n");
+    printf("  -a ms       time between device announces, 10 by default\n");
+    printf("  -r seed     seed of the loss and jitter random numbers\n");
+    printf("  -p port     TCP port of the gateway, %u by default\n", TOOL_GW_PORT);
+    printf("  -g gateway  start this gateway executable on the pty\n");
+    printf("Eample: %s -l 50 -s 5 -t 1000 -g ./gateway\n", exeName);
+}
@@ -0,0 +1,619 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "socTx.h"
+#include "sched.h"
+#include "swTimer.h"
+#include "trans.h"
+#include "socReq.h"
+#include "socLink.h"
+#include "log.h"
+#include "capture.h"
+#include "stats.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* Frames handed to the kernel per writev() */
+#define SOC_TX_MAX_IOV                  16
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+/* Frames added to the pool by socTx_reserve(), never freed */
+typedef struct socTxChunk_tag {
+    struct socTxChunk_tag *next;
+    socTxFrame_t frames[SOC_TX_POOL_SIZE];
+} socTxChunk_t;
+
+/*
+ * Frames wait per priority until the scheduler grants their airtime, then
+ * move to the wire list which is written to the UART in order.
+ */
+typedef struct {
+    int fd;
+    socTxFrame_t pool[SOC_TX_POOL_SIZE];
+    socTxChunk_t *chunks;
+    u32 frameNum;                     //!< Frames in the pool and the chunks
+    u32 freeNum;
+    socTxFrame_t *freeList;
+    socTxFrame_t *waitHead[SOC_TX_PRIO_NUM];
+    socTxFrame_t *waitTail[SOC_TX_PRIO_NUM];
+    socTxFrame_t *head;               //!< Next frame to write
+    socTxFrame_t *tail;
+    u16 headOff;                      //!< Bytes of the head frame already written
+    u32 queued;
+    u8 admit;                         //!< Waiting frames may be admitted
+    swTimer_t paceTimer;              //!< Runs while waiting frames have no tokens
+} socTx_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+socTx_ctrl_t socTx_vs;
+socTx_ctrl_t *socTx_v = &socTx_vs;
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      socTx_release
+ *
+ * @brief   Put a frame back on the free list
+ *
+ * @param   frame - the frame
+ *
+ * @return  none
+ */
+static void socTx_release(socTxFrame_t *frame)
+{
+    frame->next = socTx_v->freeList;
+    socTx_v->freeList = frame;
+    socTx_v->freeNum++;
+}
+
+/*********************************************************************
+ * @fn      socTx_append
+ *
+ * @brief   Append a frame to a list
+ *
+ * @param   head - head of the list
+ * @param   tail - tail of the list
+ * @param   frame - the frame
+ *
+ * @return  none
+ */
+static void socTx_append(socTxFrame_t **head, socTxFrame_t **tail, socTxFrame_t *frame)
+{
+    frame->next = NULL;
+    if (*tail) {
+        (*tail)->next = frame;
+    } else {
+        *head = frame;
+    }
+    *tail = frame;
+}
+
+/*********************************************************************
+ * @fn      socTx_unlink
+ *
+ * @brief   Remove a frame from a list
+ *
+ * @param   head - head of the list
+ * @param   tail - tail of the list
+ * @param   prev - frame before it, NULL if it is the head
+ * @param   frame - the frame
+ *
+ * @return  none
+ */
+static void socTx_unlink(socTxFrame_t **head, socTxFrame_t **tail, socTxFrame_t *prev, socTxFrame_t *frame)
+{
+    if (prev) {
+        prev->next = frame->next;
+    } else {
+        *head = frame->next;
+    }
+    if (*tail == frame) {
+        *tail = prev;
+    }
+}
+
+/*********************************************************************
+ * @fn      socTx_supersede
+ *
+ * @brief   Drop the frame of a list carrying a coalesce key
+ *
+ * @param   head - head of the list
+ * @param   tail - tail of the list
+ * @param   skip - frame not to touch, the one partially written
+ * @param   key - the coalesce key
+ *
+ * @return  TRUE if a frame was dropped
+ */
+static int socTx_supersede(socTxFrame_t **head, socTxFrame_t **tail, socTxFrame_t *skip, u64 key)
+{
+    socTxFrame_t *prev = NULL;
+    socTxFrame_t *p;
+
+    for (p = *head; p; prev = p, p = p->next) {
+        if (p == skip || p->key != key) {
+            continue;
+        }
+
+        socTx_unlink(head, tail, prev, p);
+        if (p->transSeq == SOC_TX_NEW_TRANS) {
+            trans_superseded(p);
+        } else if (p->transSeq != SOC_TX_NO_TRANS) {
+            trans_cancel((u8)p->transSeq);
+        }
+        socTx_release(p);
+        socTx_v->queued--;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*********************************************************************
+ * @fn      socTx_paceTimerCb
+ *
+ * @brief   The scheduler has tokens again for the waiting frames
+ *
+ * @param   arg - unused
+ *
+ * @return  none
+ */
+static void socTx_paceTimerCb(void *arg)
+{
+    socTx_v->admit = TRUE;
+}
+
+/*********************************************************************
+ * @fn      socTx_admit
+ *
+ * @brief   Move the waiting frames the scheduler lets go to the wire
+ *          list, interactive ones first. A frame whose destination is
+ *          busy, or which would open a transaction while
+ *          TRANS_MAX_PENDING are in flight, is passed over; when the
+ *          global budget is spent no frame goes, so groupcasts are not
+ *          starved by unicasts.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void socTx_admit(void)
+{
+    socTxFrame_t *prev, *p, *next;
+    u32 wait, minWait = 0;
+    int prio;
+
+    socTx_v->admit = FALSE;
+    for (prio = 0; prio < SOC_TX_PRIO_NUM; prio++) {
+        prev = NULL;
+        for (p = socTx_v->waitHead[prio]; p; p = next) {
+            next = p->next;
+
+            /* trans_free() wakes the queue when a slot is free again */
+            if (p->transSeq == SOC_TX_NEW_TRANS && trans_pendingNum() >= TRANS_MAX_PENDING) {
+                prev = p;
+                continue;
+            }
+
+            wait = sched_globalWait(p->cost);
+            if (wait) {
+                if (!minWait || wait < minWait) {
+                    minWait = wait;
+                }
+                goto done;
+            }
+
+            wait = sched_take(p->paceDst, p->cost);
+            if (wait) {
+                if (!minWait || wait < minWait) {
+                    minWait = wait;
+                }
+                prev = p;
+                continue;
+            }
+
+            socTx_unlink(&socTx_v->waitHead[prio], &socTx_v->waitTail[prio], prev, p);
+            if (p->transSeq == SOC_TX_NEW_TRANS) {
+                trans_open(p);
+            }
+            socTx_append(&socTx_v->head, &socTx_v->tail, p);
+        }
+    }
+
+done:
+    if (minWait) {
+        swTimer_start(&socTx_v->paceTimer, (minWait + 999) / 1000, socTx_paceTimerCb, NULL);
+    }
+}
+
+
+/*********************************************************************
+ * @fn      socTx_init
+ *
+ * @brief   Reset the transmit queue and bind it to the serial port
+ *
+ * @param   fd - the non-blocking serial port
+ *
+ * @return  none
+ */
+void socTx_init(int fd)
+{
+    socTxChunk_t *chunk;
+    int i;
+
+    socTx_v->fd = fd;
+    for (i = 0; i < SOC_TX_PRIO_NUM; i++) {
+        socTx_v->waitHead[i] = NULL;
+        socTx_v->waitTail[i] = NULL;
+    }
+    socTx_v->head = NULL;
+    socTx_v->tail = NULL;
+    socTx_v->headOff = 0;
+    socTx_v->queued = 0;
+    socTx_v->admit = FALSE;
+    swTimer_stop(&socTx_v->paceTimer);
+
+    socTx_v->freeList = NULL;
+    socTx_v->freeNum = 0;
+    for (chunk = socTx_v->chunks; chunk; chunk = chunk->next) {
+        for (i = SOC_TX_POOL_SIZE - 1; i >= 0; i--) {
+            socTx_release(&chunk->frames[i]);
+        }
+    }
+    for (i = SOC_TX_POOL_SIZE - 1; i >= 0; i--) {
+        socTx_release(&socTx_v->pool[i]);
+    }
+    socTx_v->frameNum = socTx_v->freeNum;
+}
+
+/*********************************************************************
+ * @fn      socTx_dropSreqs
+ *
+ * @brief   Drop the SREQs of a list
+ *
+ * @param   head - head of the list
+ * @param   tail - tail of the list
+ *
+ * @return  none
+ */
+static void socTx_dropSreqs(socTxFrame_t **head, socTxFrame_t **tail)
+{
+    socTxFrame_t *prev = NULL;
+    socTxFrame_t *p, *next;
+
+    for (p = *head; p; p = next) {
+        next = p->next;
+        if (!p->sreq) {
+            prev = p;
+            continue;
+        }
+
+        socTx_unlink(head, tail, prev, p);
+        socTx_release(p);
+        socTx_v->queued--;
+    }
+}
+
+/*********************************************************************
+ * @fn      socTx_relink
+ *
+ * @brief   Bind the queue to a reopened serial port, or to none while
+ *          the link is down. Queued frames are kept for the new port, a
+ *          frame cut short by the old one goes again from its start.
+ *          SREQs are dropped, their requests end with the link.
+ *
+ * @param   fd - the non-blocking serial port, -1 if none
+ *
+ * @return  none
+ */
+void socTx_relink(int fd)
+{
+    int prio;
+
+    socTx_v->fd = fd;
+    socTx_v->headOff = 0;
+    socTx_dropSreqs(&socTx_v->head, &socTx_v->tail);
+    for (prio = 0; prio < SOC_TX_PRIO_NUM; prio++) {
+        socTx_dropSreqs(&socTx_v->waitHead[prio], &socTx_v->waitTail[prio]);
+    }
+}
+
+/*********************************************************************
+ * @fn      socTx_alloc
+ *
+ * @brief   Get a free frame to build a command into
+ *
+ * @param   none
+ *
+ * @return  the frame, NULL if the queue is full
+ */
+socTxFrame_t* socTx_alloc(void)
+{
+    socTxFrame_t *frame = socTx_v->freeList;
+
+    if (!frame) {
+        LOG_WARN(LOG_MOD_SOC, "socTx: queue full, frame dropped");
+        return NULL;
+    }
+
+    socTx_v->freeList = frame->next;
+    socTx_v->freeNum--;
+    frame->next = NULL;
+    frame->len = 0;
+    frame->key = SOC_TX_NO_COALESCE;
+    frame->transSeq = SOC_TX_NO_TRANS;
+    frame->prio = SOC_TX_PRIO_INTERACTIVE;
+    frame->cost = 0;
+    frame->paceDst = SCHED_DST_NONE;
+    frame->sreq = FALSE;
+    return frame;
+}
+
+/*********************************************************************
+ * @fn      socTx_free
+ *
+ * @brief   Give back a frame from socTx_alloc() which will not be sent
+ *
+ * @param   frame - the frame
+ *
+ * @return  none
+ */
+void socTx_free(socTxFrame_t *frame)
+{
+    socTx_release(frame);
+}
+
+/*********************************************************************
+ * @fn      socTx_reserve
+ *
+ * @brief   Make sure a batch of frames can be queued at once, growing
+ *          the pool if needed
+ *
+ * @param   num - number of frames the batch needs
+ *
+ * @return  0 if that many frames are free, -1 otherwise
+ */
+int socTx_reserve(u32 num)
+{
+    socTxChunk_t *chunk;
+    int i;
+
+    while (socTx_v->freeNum < num) {
+        if (socTx_v->frameNum + SOC_TX_POOL_SIZE > SOC_TX_MAX_FRAMES) {
+            return -1;
+        }
+
+        chunk = malloc(sizeof(socTxChunk_t));
+        if (!chunk) {
+            return -1;
+        }
+        chunk->next = socTx_v->chunks;
+        socTx_v->chunks = chunk;
+        for (i = SOC_TX_POOL_SIZE - 1; i >= 0; i--) {
+            socTx_release(&chunk->frames[i]);
+        }
+        socTx_v->frameNum += SOC_TX_POOL_SIZE;
+        LOG_INFO(LOG_MOD_SOC, "socTx: pool grown to %u frames", socTx_v->frameNum);
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      socTx_commit
+ *
+ * @brief   Queue a built frame for the UART. A frame with the same key
+ *          which has not started transmission is superseded: it is
+ *          removed and the new frame goes to the tail, so the order of
+ *          the latest commands is kept. A frame replacing one already
+ *          admitted takes over its airtime, and opens its transaction
+ *          at once.
+ *
+ * @param   frame - frame from socTx_alloc(), len, data and pacing filled in
+ * @param   key - coalesce key, SOC_TX_NO_COALESCE to always append
+ *
+ * @return  none
+ */
+void socTx_commit(socTxFrame_t *frame, u64 key)
+{
+    socTxFrame_t *partial = socTx_v->headOff ? socTx_v->head : NULL;
+    int prio;
+
+    frame->key = key;
+    LOG_HEX(LOG_MOD_SOC, LOG_LEVEL_DEBUG, "tx", frame->data, frame->len);
+    socTx_v->queued++;
+
+    if (key != SOC_TX_NO_COALESCE) {
+        if (socTx_supersede(&socTx_v->head, &socTx_v->tail, partial, key) &&
+            (frame->transSeq != SOC_TX_NEW_TRANS || trans_open(frame) == 0)) {
+            socTx_append(&socTx_v->head, &socTx_v->tail, frame);
+            return;
+        }
+        for (prio = 0; prio < SOC_TX_PRIO_NUM; prio++) {
+            if (socTx_supersede(&socTx_v->waitHead[prio], &socTx_v->waitTail[prio], NULL, key)) {
+                break;
+            }
+        }
+    }
+
+    socTx_append(&socTx_v->waitHead[frame->prio], &socTx_v->waitTail[frame->prio], frame);
+    socTx_v->admit = TRUE;
+}
+
+/*********************************************************************
+ * @fn      socTx_enqueue
+ *
+ * @brief   Copy a complete frame into the transmit queue
+ *
+ * @param   data - the frame, SOF to FCS
+ * @param   len - length of the frame
+ * @param   key - coalesce key, SOC_TX_NO_COALESCE to always append
+ *
+ * @return  0 on success, -1 if the frame could not be queued
+ */
+int socTx_enqueue(const u8 *data, u16 len, u64 key)
+{
+    socTxFrame_t *frame;
+
+    if (len > SOC_TX_MAX_FRAME_LEN) {
+        return -1;
+    }
+
+    frame = socTx_alloc();
+    if (!frame) {
+        return -1;
+    }
+
+    memcpy(frame->data, data, len);
+    frame->len = len;
+    socTx_commit(frame, key);
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      socTx_pending
+ *
+ * @brief   Check whether frames are waiting for the UART or for the
+ *          scheduler to be asked again
+ *
+ * @param   none
+ *
+ * @return  TRUE if socTx_flush() has work to do
+ */
+int socTx_pending(void)
+{
+    return (socTx_v->head != NULL || socTx_v->admit);
+}
+
+/*********************************************************************
+ * @fn      socTx_wake
+ *
+ * @brief   Ask the scheduler again for the waiting frames, at the next
+ *          socTx_flush()
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void socTx_wake(void)
+{
+    socTx_v->admit = TRUE;
+}
+
+/*********************************************************************
+ * @fn      socTx_flush
+ *
+ * @brief   Admit the waiting frames the scheduler lets go, then write
+ *          as many frames as the serial port accepts. Called when the
+ *          port is writable. Never blocks.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void socTx_flush(void)
+{
+    struct iovec iov[SOC_TX_MAX_IOV];
+    socTxFrame_t *p;
+    int cnt, n;
+
+    /* Frames wait for the link to come back */
+    if (socTx_v->fd < 0) {
+        return;
+    }
+
+    if (socTx_v->admit) {
+        socTx_admit();
+    }
+
+    while (socTx_v->head) {
+        cnt = 0;
+        for (p = socTx_v->head; p && cnt < SOC_TX_MAX_IOV; p = p->next) {
+            iov[cnt].iov_base = p->data;
+            iov[cnt].iov_len = p->len;
+            cnt++;
+        }
+        iov[0].iov_base = socTx_v->head->data + socTx_v->headOff;
+        iov[0].iov_len -= socTx_v->headOff;
+
+        n = writev(socTx_v->fd, iov, cnt);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                stats_v->uartWriteErrors++;
+                perror("socTx: write failed");
+                socLink_lost("write failed");
+            }
+            return;
+        }
+
+        /* Release what the kernel took */
+        stats_v->uartTxBytes += n;
+        n += socTx_v->headOff;
+        while (socTx_v->head && n >= socTx_v->head->len) {
+            p = socTx_v->head;
+            n -= p->len;
+            socTx_v->head = p->next;
+            CAPTURE(CAPTURE_SOC_TX, CAPTURE_NO_CONN, p->data, p->len);
+            stats_v->txFrames[p->data[2] & STATS_MT_SYS_MASK]++;
+            if (p->transSeq >= 0) {
+                trans_sent((u8)p->transSeq);
+            }
+            if (p->sreq) {
+                socReq_sent();
+            }
+            socTx_release(p);
+            socTx_v->queued--;
+        }
+        socTx_v->headOff = n;
+
+        if (!socTx_v->head) {
+            socTx_v->tail = NULL;
+            socTx_v->headOff = 0;
+        } else if (socTx_v->headOff || cnt < SOC_TX_MAX_IOV) {
+            /* Short write, wait for the next POLLOUT */
+            return;
+        }
+    }
+}
+
+/*********************************************************************
+ * @fn      socTx_dataKey
+ *
+ * @brief   Build the coalesce key of a ZCL command. Commands to the same
+ *          destination and cluster in the same class set the same state,
+ *          so only the latest one needs to be sent.
+ *
+ * @param   addrMode - address mode of the destination
+ * @param   dstAddr - network address or group ID
+ * @param   endpoint - destination endpoint
+ * @param   clusterID - ZCL cluster
+ * @param   cmdClass - commands sharing a class supersede each other
+ *
+ * @return  the key
+ */
+u64 socTx_dataKey(u8 addrMode, u16 dstAddr, u8 endpoint, u16 clusterID, u8 cmdClass)
+{
+    return ((u64)1 << 63) |
+           ((u64)addrMode << 48) |
+           ((u64)endpoint << 40) |
+           ((u64)dstAddr << 24) |
+           ((u64)clusterID << 8) |
+           cmdClass;
+}
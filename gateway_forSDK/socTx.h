@@ -0,0 +1,76 @@
+#ifndef  __SOC_TX_H__
+#define  __SOC_TX_H__
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* Largest RPC frame: SOF + len + 255 bytes + FCS */
+#define SOC_TX_MAX_FRAME_LEN            258
+
+/* Number of frames that can wait for the UART. socTx_reserve() grows
+ * the pool by as many at a time, up to SOC_TX_MAX_FRAMES. */
+#define SOC_TX_POOL_SIZE                128
+#define SOC_TX_MAX_FRAMES               1024
+
+/* Key of a frame that must never be merged with another one */
+#define SOC_TX_NO_COALESCE              0
+
+/* Frame which does not carry a tracked ZCL transaction */
+#define SOC_TX_NO_TRANS                 -1
+
+/* Frame opening a ZCL transaction when it is admitted, see trans_open() */
+#define SOC_TX_NEW_TRANS                -2
+
+/*********************************************************************
+ * ENUMS
+ */
+
+/*
+ * Order in which paced frames get the airtime
+ */
+enum {
+    SOC_TX_PRIO_CONTROL,              //!< Requests to the coordinator itself
+    SOC_TX_PRIO_INTERACTIVE,          //!< Commands a user waits for
+    SOC_TX_PRIO_BULK,                 //!< Queries and configuration
+    SOC_TX_PRIO_NUM,
+};
+
+
+/*********************************************************************
+ * TYPES
+ */
+typedef struct socTxFrame_tag {
+    struct socTxFrame_tag *next;
+    u64 key;                          //!< Frames with the same key supersede each other
+    u16 len;                          //!< Length of the whole frame, SOF to FCS
+    s16 transSeq;                     //!< Pending ZCL transaction, SOC_TX_NO_TRANS if none
+    u8 retries;                       //!< Of the transaction to open, see trans_queue()
+    u32 origin;                       //!< App the transaction to open reports to
+    u8 prio;
+    u8 cost;                          //!< Airtime in frames, 0 to skip pacing
+    u32 paceDst;                      //!< Destination bucket, SCHED_DST_NONE if none
+    u8 sreq;                          //!< TRUE for the outstanding SREQ, see socReq_sent()
+    u8 data[SOC_TX_MAX_FRAME_LEN];
+} socTxFrame_t;
+
+
+/*********************************************************************
+ * Public Functions
+ */
+void socTx_init(int fd);
+void socTx_relink(int fd);
+socTxFrame_t* socTx_alloc(void);
+void socTx_free(socTxFrame_t *frame);
+int  socTx_reserve(u32 num);
+void socTx_commit(socTxFrame_t *frame, u64 key);
+int  socTx_enqueue(const u8 *data, u16 len, u64 key);
+int  socTx_pending(void);
+void socTx_wake(void);
+void socTx_flush(void);
+
+u64  socTx_dataKey(u8 addrMode, u16 dstAddr, u8 endpoint, u16 clusterID, u8 cmdClass);
+
+#endif  /* __SOC_TX_H__ */
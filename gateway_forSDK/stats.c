@@ -0,0 +1,347 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "stats.h"
+#include "sched.h"
+#include "socReq.h"
+#include "socLink.h"
+#include "server.h"
+#include "nodes.h"
+#include "evLoop.h"
+#include "swTimer.h"
+#include "log.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* Longest path of the stats socket */
+#define STATS_MAX_PATH                  108
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+/* Local socket which answers every connection with stats_print() */
+typedef struct {
+    int fd;
+    u8 atExit;
+    char path[STATS_MAX_PATH];
+} stats_sock_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+stats_t stats_vs;
+stats_t *stats_v = &stats_vs;
+
+stats_sock_t stats_sockVs = { .fd = -1 };
+stats_sock_t *stats_sockV = &stats_sockVs;
+
+static const char *stats_mtSysName[STATS_MT_SYS_NUM] = {
+    "RES0", "SYS", "MAC", "NWK", "AF", "ZDO", "SAPI", "UTIL", "DBG", "APP", "OTA", "ZNP", "SPARE12", "UBL",
+};
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* None */
+
+
+/*********************************************************************
+ * @fn      stats_reset
+ *
+ * @brief   Clear all the counters and histograms
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void stats_reset(void)
+{
+    memset(stats_v, 0, sizeof(stats_t));
+    stats_v->startUs = swTimer_nowUs();
+}
+
+/*********************************************************************
+ * @fn      stats_histIdx
+ *
+ * @brief   Find the bucket of a value
+ *
+ * @param   value - the value
+ *
+ * @return  the bucket
+ */
+static u32 stats_histIdx(u32 value)
+{
+    u32 exp;
+
+    if (value < STATS_HIST_SUB_NUM) {
+        return value;
+    }
+
+    /* Position of the top bit, the next STATS_HIST_SUB_BITS pick the bucket */
+    exp = 31 - __builtin_clz(value);
+    return STATS_HIST_SUB_NUM * (exp - STATS_HIST_SUB_BITS + 1) +
+           ((value >> (exp - STATS_HIST_SUB_BITS)) & (STATS_HIST_SUB_NUM - 1));
+}
+
+/*********************************************************************
+ * @fn      stats_histTop
+ *
+ * @brief   Get the largest value of a bucket
+ *
+ * @param   idx - the bucket
+ *
+ * @return  the value
+ */
+static u32 stats_histTop(u32 idx)
+{
+    u32 shift;
+
+    if (idx < STATS_HIST_SUB_NUM) {
+        return idx;
+    }
+
+    shift = idx / STATS_HIST_SUB_NUM - 1;
+    return (u32)((((u64)STATS_HIST_SUB_NUM + idx % STATS_HIST_SUB_NUM + 1) << shift) - 1);
+}
+
+/*********************************************************************
+ * @fn      stats_histAdd
+ *
+ * @brief   Record a value in a histogram
+ *
+ * @param   hist - the histogram
+ * @param   value - the value
+ *
+ * @return  none
+ */
+void stats_histAdd(stats_hist_t *hist, u32 value)
+{
+    if (hist->count == 0 || value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+    hist->count++;
+    hist->sum += value;
+    hist->buckets[stats_histIdx(value)]++;
+}
+
+/*********************************************************************
+ * @fn      stats_histPct
+ *
+ * @brief   Get a percentile of a histogram, rounded up to the top of
+ *          its bucket
+ *
+ * @param   hist - the histogram
+ * @param   permille - the percentile in 1/1000, 999 for p99.9
+ *
+ * @return  the value, 0 if the histogram is empty
+ */
+u32 stats_histPct(const stats_hist_t *hist, u32 permille)
+{
+    u64 rank = (hist->count * permille + 999) / 1000;
+    u64 seen = 0;
+    u32 i;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    for (i = 0; i < STATS_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            return (stats_histTop(i) < hist->max) ? stats_histTop(i) : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+/*********************************************************************
+ * @fn      stats_printHist
+ *
+ * @brief   Print a line of summary of a histogram
+ *
+ * @param   fp - where to print
+ * @param   name - the histogram
+ * @param   hist - the histogram
+ *
+ * @return  none
+ */
+static void stats_printHist(FILE *fp, const char *name, const stats_hist_t *hist)
+{
+    if (hist->count == 0) {
+        fprintf(fp, "%s: no samples\n", name);
+        return;
+    }
+    fprintf(fp, "%s: %llu samples, min %u, avg %llu, p50 %u, p99 %u, p99.9 %u, max %u us\n", name,
+            (unsigned long long)hist->count, hist->min, (unsigned long long)(hist->sum / hist->count),
+            stats_histPct(hist, 500), stats_histPct(hist, 990), stats_histPct(hist, 999), hist->max);
+}
+
+/*********************************************************************
+ * @fn      stats_print
+ *
+ * @brief   Print all the counters, the connected Apps and the histograms
+ *
+ * @param   fp - where to print
+ *
+ * @return  none
+ */
+void stats_print(FILE *fp)
+{
+    stats_t *st = stats_v;
+    u32 i;
+
+    fprintf(fp, "Stats of the last %llu s\n", (unsigned long long)((swTimer_nowUs() - st->startUs) / 1000000));
+
+    fprintf(fp, "UART: %llu bytes in, %llu bytes out, %u read retries, %u read errors, %u write errors\n",
+            (unsigned long long)st->uartRxBytes, (unsigned long long)st->uartTxBytes,
+            st->uartReadRetries, st->uartReadErrors, st->uartWriteErrors);
+    fprintf(fp, "RPC frames: %u FCS errors, %u bad length, %u resyncs, %u too short, %u unknown, %u unknown ZCL\n",
+            st->fcsErrors, st->badFrames, st->resyncs, st->rxShort, st->rxUnknown, st->zclUnknown);
+    for (i = 0; i < STATS_MT_SYS_NUM; i++) {
+        if (st->rxFrames[i] || st->txFrames[i]) {
+            fprintf(fp, "    %-8s %10u in %10u out\n", stats_mtSysName[i] ? stats_mtSysName[i] : "?",
+                    st->rxFrames[i], st->txFrames[i]);
+        }
+    }
+    sched_print(fp);
+    socReq_print(fp);
+    socLink_print(fp);
+
+    fprintf(fp, "Apps: %u connected, %u accepted, %u refused, %u dropped, %u closed, "
+            "%llu bytes in, %llu bytes out\n",
+            server_connNum(), st->tcpAccepts, st->tcpRejects, st->tcpDrops, st->tcpCloses,
+            (unsigned long long)st->tcpRxBytes, (unsigned long long)st->tcpTxBytes);
+    server_printConns(fp);
+
+    fprintf(fp, "Nodes: %u\n", nodes_curNum());
+    stats_printHist(fp, "Round trip", &st->rtt);
+    stats_printHist(fp, "Loop pass", &st->loop);
+    fprintf(fp, "\n");
+}
+
+/*********************************************************************
+ * @fn      stats_sockEvent
+ *
+ * @brief   Answer the connections to the stats socket. The report is
+ *          built in memory and written without blocking, a reader which
+ *          does not take it gets it cut short.
+ *
+ * @param   fd - the listen socket
+ * @param   events - ready events
+ * @param   arg - unused
+ *
+ * @return  none
+ */
+static void stats_sockEvent(int fd, u32 events, void *arg)
+{
+    char *text;
+    size_t len;
+    FILE *fp;
+    int sock;
+
+    while ((sock = accept(fd, NULL, NULL)) >= 0) {
+        text = NULL;
+        len = 0;
+        fp = open_memstream(&text, &len);
+        if (fp) {
+            stats_print(fp);
+            fclose(fp);
+            if (send(sock, text, len, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)len) {
+                LOG_WARN(LOG_MOD_SERVER, "stats: reader did not take the report");
+            }
+            free(text);
+        }
+        close(sock);
+    }
+}
+
+/*********************************************************************
+ * @fn      stats_open
+ *
+ * @brief   Start answering stats requests on a local socket, anything
+ *          connecting to it reads the output of stats_print()
+ *
+ * @param   path - path of the socket, replaced if it exists
+ *
+ * @return  0 on success, -1 on error
+ */
+int stats_open(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("stats socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0 ||
+        fcntl(fd, F_SETFL, O_NONBLOCK) != 0 || evLoop_add(fd, EPOLLIN, stats_sockEvent, NULL) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    strcpy(stats_sockV->path, path);
+    stats_sockV->fd = fd;
+    if (!stats_sockV->atExit) {
+        atexit(stats_close);
+        stats_sockV->atExit = TRUE;
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      stats_close
+ *
+ * @brief   Stop answering stats requests and remove the socket
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void stats_close(void)
+{
+    if (stats_sockV->fd < 0) {
+        return;
+    }
+
+    evLoop_del(stats_sockV->fd);
+    close(stats_sockV->fd);
+    unlink(stats_sockV->path);
+    stats_sockV->fd = -1;
+}
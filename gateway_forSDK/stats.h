@@ -0,0 +1,89 @@
+#ifndef  __STATS_H__
+#define  __STATS_H__
+
+#include <stdio.h>
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* Subsystem field of RPC cmd0 */
+#define STATS_MT_SYS_MASK               0x1F
+#define STATS_MT_SYS_NUM                (STATS_MT_SYS_MASK + 1)
+
+/* Histogram buckets are exact below 2^STATS_HIST_SUB_BITS. Above, each
+ * power of two is split in 2^STATS_HIST_SUB_BITS buckets, so a value is
+ * known to within 1/16. */
+#define STATS_HIST_SUB_BITS             4
+#define STATS_HIST_SUB_NUM              (1 << STATS_HIST_SUB_BITS)
+#define STATS_HIST_BUCKETS              (STATS_HIST_SUB_NUM * (32 - STATS_HIST_SUB_BITS + 1))
+
+/*********************************************************************
+ * ENUMS
+ */
+
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+/* Log-linear histogram of times in us, fixed size and O(1) to update */
+typedef struct {
+    u64 count;
+    u64 sum;
+    u32 min;
+    u32 max;
+    u32 buckets[STATS_HIST_BUCKETS];
+} stats_hist_t;
+
+/*
+ * Counters of the whole gateway. The modules update them in place, they
+ * are only read by stats_print().
+ */
+typedef struct {
+    u64 startUs;                      //!< Monotonic time of the last reset
+
+    /* UART */
+    u64 uartRxBytes;
+    u64 uartTxBytes;
+    u32 uartReadRetries;              //!< Reads interrupted by a signal
+    u32 uartReadErrors;
+    u32 uartWriteErrors;
+    u32 rxFrames[STATS_MT_SYS_NUM];   //!< Valid frames from the SoC, per subsystem
+    u32 txFrames[STATS_MT_SYS_NUM];   //!< Frames written to the SoC, per subsystem
+    u32 fcsErrors;
+    u32 badFrames;                    //!< Frames with a bad length
+    u32 resyncs;                      //!< Times garbage was skipped to find a SOF
+    u32 rxShort;                      //!< Frames too short for their handler
+    u32 rxUnknown;                    //!< Frames without a handler
+    u32 zclUnknown;                   //!< ZCL commands without a handler
+
+    /* Apps */
+    u64 tcpRxBytes;
+    u64 tcpTxBytes;
+    u32 tcpAccepts;
+    u32 tcpRejects;                   //!< Refused, too many Apps connected
+    u32 tcpDrops;                     //!< Disconnected for being too slow
+    u32 tcpCloses;
+
+    stats_hist_t rtt;                 //!< ZCL command to response
+    stats_hist_t loop;                //!< Work of one event loop pass, without the wait
+} stats_t;
+
+extern stats_t *stats_v;
+
+
+/*********************************************************************
+ * Public Functions
+ */
+void stats_reset(void);
+void stats_histAdd(stats_hist_t *hist, u32 value);
+u32  stats_histPct(const stats_hist_t *hist, u32 permille);
+void stats_print(FILE *fp);
+int  stats_open(const char *path);
+void stats_close(void);
+
+#endif  /* __STATS_H__ */
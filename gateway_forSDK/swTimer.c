@@ -0,0 +1,155 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <time.h>
+
+#include "swTimer.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* None */
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+typedef struct {
+    swTimer_t *head;                  //!< Armed timers, sorted by expiry
+} swTimer_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+swTimer_ctrl_t swTimer_vs;
+swTimer_ctrl_t *swTimer_v = &swTimer_vs;
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+
+/*********************************************************************
+ * @fn      swTimer_nowUs
+ *
+ * @brief   Get the monotonic time
+ *
+ * @param   none
+ *
+ * @return  time in microseconds
+ */
+u64 swTimer_nowUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*********************************************************************
+ * @fn      swTimer_start
+ *
+ * @brief   Arm (or re-arm) a one shot timer
+ *
+ * @param   timer - the timer, owned by the caller
+ * @param   timeoutMs - time until expiry
+ * @param   cb - called from swTimer_process() on expiry
+ * @param   arg - passed to cb
+ *
+ * @return  none
+ */
+void swTimer_start(swTimer_t *timer, u32 timeoutMs, swTimerCb_t cb, void *arg)
+{
+    swTimer_t **pp;
+
+    swTimer_stop(timer);
+
+    timer->expiry = swTimer_nowUs() + (u64)timeoutMs * 1000;
+    timer->cb = cb;
+    timer->arg = arg;
+    timer->active = TRUE;
+
+    for (pp = &swTimer_v->head; *pp && (*pp)->expiry <= timer->expiry; pp = &(*pp)->next) {
+        ;
+    }
+    timer->next = *pp;
+    *pp = timer;
+}
+
+/*********************************************************************
+ * @fn      swTimer_stop
+ *
+ * @brief   Disarm a timer, nothing happens if it is not armed
+ *
+ * @param   timer - the timer
+ *
+ * @return  none
+ */
+void swTimer_stop(swTimer_t *timer)
+{
+    swTimer_t **pp;
+
+    if (!timer->active) {
+        return;
+    }
+
+    for (pp = &swTimer_v->head; *pp; pp = &(*pp)->next) {
+        if (*pp == timer) {
+            *pp = timer->next;
+            break;
+        }
+    }
+    timer->active = FALSE;
+}
+
+/*********************************************************************
+ * @fn      swTimer_nextTimeout
+ *
+ * @brief   Get the poll timeout until the first timer expires
+ *
+ * @param   none
+ *
+ * @return  timeout in ms, SW_TIMER_NONE if no timer is armed
+ */
+int swTimer_nextTimeout(void)
+{
+    u64 now;
+
+    if (!swTimer_v->head) {
+        return SW_TIMER_NONE;
+    }
+
+    now = swTimer_nowUs();
+    if (swTimer_v->head->expiry <= now) {
+        return 0;
+    }
+    /* Round up so we never wake up just before the expiry */
+    return (int)((swTimer_v->head->expiry - now + 999) / 1000);
+}
+
+/*********************************************************************
+ * @fn      swTimer_process
+ *
+ * @brief   Run the callbacks of all expired timers
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void swTimer_process(void)
+{
+    swTimer_t *timer;
+    u64 now = swTimer_nowUs();
+
+    while ((timer = swTimer_v->head) && timer->expiry <= now) {
+        swTimer_v->head = timer->next;
+        timer->active = FALSE;
+        /* The callback may re-arm the timer */
+        timer->cb(timer->arg);
+    }
+}
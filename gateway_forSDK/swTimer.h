@@ -0,0 +1,41 @@
+#ifndef  __SW_TIMER_H__
+#define  __SW_TIMER_H__
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+#define SW_TIMER_NONE                   -1
+
+/*********************************************************************
+ * ENUMS
+ */
+
+
+
+/*********************************************************************
+ * TYPES
+ */
+typedef void (*swTimerCb_t)(void *arg);
+
+typedef struct swTimer_tag {
+    struct swTimer_tag *next;
+    u64 expiry;                       //!< Monotonic time in us
+    swTimerCb_t cb;
+    void *arg;
+    u8 active;
+} swTimer_t;
+
+
+/*********************************************************************
+ * Public Functions
+ */
+u64  swTimer_nowUs(void);
+void swTimer_start(swTimer_t *timer, u32 timeoutMs, swTimerCb_t cb, void *arg);
+void swTimer_stop(swTimer_t *timer);
+int  swTimer_nextTimeout(void);
+void swTimer_process(void);
+
+#endif  /* __SW_TIMER_H__ */
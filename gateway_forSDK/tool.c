@@ -0,0 +1,230 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "tool.h"
+#include "appCmd.h"
+#include "swTimer.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* Pause between attempts to reach the gateway */
+#define TOOL_GW_PROBE_MS                50
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+/* None */
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+
+/* None */
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* None */
+
+
+/*********************************************************************
+ * @fn      tool_openPty
+ *
+ * @brief   Create a pty standing in for the SoC serial port. The slave
+ *          side is held open in raw mode, the pty would hang up
+ *          whenever the gateway does not have it open.
+ *
+ * @param   master - returns the non-blocking master side
+ * @param   slave - returns the slave side
+ *
+ * @return  path of the slave side for the gateway, NULL on error
+ */
+char* tool_openPty(int *master, int *slave)
+{
+    struct termios tio;
+    char *name;
+
+    *master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (*master < 0 || grantpt(*master) != 0 || unlockpt(*master) != 0) {
+        perror("pty");
+        return NULL;
+    }
+    name = ptsname(*master);
+
+    *slave = open(name, O_RDWR | O_NOCTTY);
+    if (*slave < 0) {
+        perror(name);
+        return NULL;
+    }
+    tcgetattr(*slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(*slave, TCSANOW, &tio);
+
+    return name;
+}
+
+/*********************************************************************
+ * @fn      tool_connect
+ *
+ * @brief   Open a TCP connection to the gateway, as an App does
+ *
+ * @param   port - TCP port of the gateway
+ *
+ * @return  the socket, -1 on error
+ */
+int tool_connect(u16 port)
+{
+    struct sockaddr_in addr;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*********************************************************************
+ * @fn      tool_spawnGateway
+ *
+ * @brief   Run the gateway on a pty, with its console input on /dev/null
+ *
+ * @param   exe - the gateway executable
+ * @param   opts - options placed before the port, NULL terminated, NULL
+ *                 for none
+ * @param   port - TCP port it listens on
+ * @param   ptyName - the serial port to give it
+ * @param   outPath - file for its console output, NULL to share ours
+ *
+ * @return  pid of the gateway, -1 on error
+ */
+pid_t tool_spawnGateway(char *exe, char **opts, u16 port, char *ptyName, char *outPath)
+{
+    char *argv[TOOL_GW_MAX_ARGS];
+    char portStr[8];
+    pid_t child;
+    int argc = 0;
+    int fd;
+
+    argv[argc++] = exe;
+    while (opts && *opts && argc < TOOL_GW_MAX_ARGS - 4) {
+        argv[argc++] = *opts++;
+    }
+    snprintf(portStr, sizeof(portStr), "%u", port);
+    argv[argc++] = "-p";
+    argv[argc++] = portStr;
+    argv[argc++] = ptyName;
+    argv[argc] = NULL;
+
+    child = fork();
+    if (child == 0) {
+        fd = open("/dev/null", O_RDWR);
+        dup2(fd, STDIN_FILENO);
+        if (outPath) {
+            fd = open(outPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+        }
+        execv(exe, argv);
+        perror(exe);
+        _exit(1);
+    }
+    if (child < 0) {
+        perror("fork");
+    }
+    return child;
+}
+
+/*********************************************************************
+ * @fn      tool_waitGateway
+ *
+ * @brief   Wait until the gateway takes connections. It listens once
+ *          its serial port is set up, so the pty may be used from then
+ *          on: data written earlier is flushed when the port is opened.
+ *
+ * @param   port - TCP port of the gateway
+ * @param   timeoutMs - longest time to wait, -1 for ever
+ * @param   waitCb - called between attempts, NULL to sleep
+ *
+ * @return  0 once the gateway is up, -1 on timeout
+ */
+int tool_waitGateway(u16 port, int timeoutMs, toolWaitCb_t waitCb)
+{
+    u64 end = swTimer_nowUs() + (u64)timeoutMs * 1000;
+    int fd;
+
+    while ((fd = tool_connect(port)) < 0) {
+        if (timeoutMs >= 0 && swTimer_nowUs() > end) {
+            fprintf(stderr, "gateway did not come up on port %u\n", port);
+            return -1;
+        }
+        if (waitCb) {
+            waitCb(TOOL_GW_PROBE_MS);
+        } else {
+            usleep(TOOL_GW_PROBE_MS * 1000);
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      tool_stopGateway
+ *
+ * @brief   Ask a gateway we started to exit, so it writes out its state
+ *          as it would on a normal close
+ *
+ * @param   child - pid of the gateway, nothing is done if <= 0
+ * @param   port - TCP port of the gateway
+ *
+ * @return  none
+ */
+void tool_stopGateway(pid_t child, u16 port)
+{
+    u8 cmd[APP_CMD_HDR_LEN] = { APP_CMD_SOF, CMD_CLOSE };
+    int fd;
+
+    if (child <= 0) {
+        return;
+    }
+
+    fd = tool_connect(port);
+    if (fd < 0 || send(fd, cmd, sizeof(cmd), MSG_NOSIGNAL) != sizeof(cmd)) {
+        kill(child, SIGTERM);
+    }
+    waitpid(child, NULL, 0);
+    if (fd >= 0) {
+        close(fd);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef  __TOOL_H__
+#define  __TOOL_H__
+
+#include <sys/types.h>
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* TCP port of the gateway, SERVER_LISTEN_PORT of config.h */
+#define TOOL_GW_PORT                    16000
+
+/* Time the gateway gets to come up */
+#define TOOL_GW_START_TIMEOUT_MS        5000
+
+/* Longest command line of the gateway, its options and port included */
+#define TOOL_GW_MAX_ARGS                16
+
+/*********************************************************************
+ * ENUMS
+ */
+
+
+
+/*********************************************************************
+ * TYPES
+ */
+
+/* Called while waiting for the gateway, keeps the pty drained */
+typedef void (*toolWaitCb_t)(int waitMs);
+
+
+/*********************************************************************
+ * Public Functions
+ */
+char* tool_openPty(int *master, int *slave);
+int   tool_connect(u16 port);
+pid_t tool_spawnGateway(char *exe, char **opts, u16 port, char *ptyName, char *outPath);
+int   tool_waitGateway(u16 port, int timeoutMs, toolWaitCb_t waitCb);
+void  tool_stopGateway(pid_t child, u16 port);
+
+#endif  /* __TOOL_H__ */
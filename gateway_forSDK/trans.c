@@ -0,0 +1,522 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trans.h"
+#include "nodes.h"
+#include "swTimer.h"
+#include "log.h"
+#include "stats.h"
+#include "attrCache.h"
+#include "sched.h"
+#include "appCmd.h"
+#include "socCmd.h"
+#include "config.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* None */
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+typedef struct {
+    trans_t tbl[TRANS_TBL_SIZE];
+    u32 pendingNum;
+    u8 nextSeq;                       //!< Seq tried first by trans_open()
+    u32 origin;                       //!< App the commands being built come from
+    swTimer_t sweepTimer;
+    swTimer_t retryTimer;             //!< Runs while sends wait for their backoff
+    trans_stats_t stats;
+} trans_ctrl_t;
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+trans_ctrl_t trans_vs;
+trans_ctrl_t *trans_v = &trans_vs;
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static void trans_sweep(void *arg);
+static void trans_retryCb(void *arg);
+
+
+/*********************************************************************
+ * @fn      trans_free
+ *
+ * @brief   Release a transaction slot
+ *
+ * @param   seq - the transaction sequence number
+ *
+ * @return  none
+ */
+static void trans_free(u8 seq)
+{
+    trans_v->tbl[seq].inUse = FALSE;
+
+    /* Frames held for a free slot may go again */
+    if (trans_v->pendingNum-- == TRANS_MAX_PENDING) {
+        socTx_wake();
+    }
+
+    if (trans_v->pendingNum == 0) {
+        swTimer_stop(&trans_v->sweepTimer);
+        swTimer_stop(&trans_v->retryTimer);
+    }
+}
+
+/*********************************************************************
+ * @fn      trans_finish
+ *
+ * @brief   End a transaction and tell the App it came from
+ *
+ * @param   seq - the transaction sequence number
+ * @param   status - ZCL status of the response or APP_DELIVERY_*
+ *
+ * @return  none
+ */
+static void trans_finish(u8 seq, u8 status)
+{
+    trans_t *t = &trans_v->tbl[seq];
+
+    if (status != 0) {
+        attrCache_invalidate(t->dstAddr, t->endpoint, t->clusterID);
+    }
+    if (t->origin != TRANS_NO_ORIGIN) {
+        app_sendDeliveryRspCmd(t->origin, t->dstAddr, t->endpoint, t->clusterID, t->cmdID, status, t->attempts);
+    }
+    trans_free(seq);
+}
+
+/*********************************************************************
+ * @fn      trans_lost
+ *
+ * @brief   Handle a send which got no response in time: wait for an
+ *          exponential backoff with jitter and send it again, or give
+ *          up when the retries of the command are used
+ *
+ * @param   seq - the transaction sequence number
+ * @param   now - monotonic time in us
+ *
+ * @return  none
+ */
+static void trans_lost(u8 seq, u64 now)
+{
+    trans_t *t = &trans_v->tbl[seq];
+    u32 backoffMs;
+
+    LOG_WARN(LOG_MOD_SOC, "trans: seq 0x%02x to 0x%04x cluster 0x%04x cmd 0x%02x timed out, %u retries left",
+             seq, t->dstAddr, t->clusterID, t->cmdID, t->retries);
+    trans_v->stats.timeouts++;
+    nodes_recordRtt(t->dstAddr, 0, TRUE);
+    sched_onResult(FALSE);
+
+    if (t->retries == 0) {
+        trans_v->stats.lost++;
+        trans_finish(seq, APP_DELIVERY_TIMEOUT);
+        return;
+    }
+
+    /* Half to one and a half times the base, so retries of commands lost
+     * together spread out */
+    backoffMs = TRANS_RETRY_BASE_MS << (t->attempts - 1);
+    backoffMs = backoffMs / 2 + rand() % (backoffMs + 1);
+
+    t->retries--;
+    t->sent = FALSE;
+    t->retryTime = now + (u64)backoffMs * 1000;
+    if (!trans_v->retryTimer.active || trans_v->retryTimer.expiry > t->retryTime) {
+        swTimer_start(&trans_v->retryTimer, backoffMs, trans_retryCb, NULL);
+    }
+}
+
+/*********************************************************************
+ * @fn      trans_resend
+ *
+ * @brief   Queue the frame of a transaction again
+ *
+ * @param   seq - the transaction sequence number
+ * @param   now - monotonic time in us
+ *
+ * @return  none
+ */
+static void trans_resend(u8 seq, u64 now)
+{
+    trans_t *t = &trans_v->tbl[seq];
+    socTxFrame_t *frame = socTx_alloc();
+
+    if (!frame) {
+        /* Queue full, try again after another base interval */
+        t->retryTime = now + (u64)TRANS_RETRY_BASE_MS * 1000;
+        return;
+    }
+
+    memcpy(frame->data, t->frame.data, t->frame.len);
+    frame->len = t->frame.len;
+    frame->prio = t->frame.prio;
+    frame->cost = t->frame.cost;
+    frame->paceDst = t->frame.paceDst;
+    frame->transSeq = seq;
+
+    t->retryTime = 0;
+    t->attempts++;
+    trans_v->stats.retries++;
+    socTx_commit(frame, t->frame.key);
+}
+
+/*********************************************************************
+ * @fn      trans_retryCb
+ *
+ * @brief   Send again the frames whose backoff is over
+ *
+ * @param   arg - unused
+ *
+ * @return  none
+ */
+static void trans_retryCb(void *arg)
+{
+    u64 now = swTimer_nowUs();
+    u64 next = 0;
+    trans_t *t;
+    int i;
+
+    for (i = 0; i < TRANS_TBL_SIZE; i++) {
+        t = &trans_v->tbl[i];
+        if (!t->inUse || !t->retryTime) {
+            continue;
+        }
+        if (t->retryTime <= now) {
+            trans_resend(i, now);
+        }
+        if (t->retryTime && (!next || t->retryTime < next)) {
+            next = t->retryTime;
+        }
+    }
+
+    if (next) {
+        swTimer_start(&trans_v->retryTimer, (u32)((next - now + 999) / 1000), trans_retryCb, NULL);
+    }
+}
+
+/*********************************************************************
+ * @fn      trans_init
+ *
+ * @brief   Reset the pending transaction table
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void trans_init(void)
+{
+    swTimer_stop(&trans_v->sweepTimer);
+    swTimer_stop(&trans_v->retryTimer);
+    memset(trans_v->tbl, 0, sizeof(trans_v->tbl));
+    memset(&trans_v->stats, 0, sizeof(trans_v->stats));
+    trans_v->pendingNum = 0;
+    trans_v->origin = TRANS_NO_ORIGIN;
+}
+
+/*********************************************************************
+ * @fn      trans_setOrigin
+ *
+ * @brief   Set the App the next commands are sent for, the result of
+ *          their delivery is reported to it
+ *
+ * @param   connId - ID of the App connection, TRANS_NO_ORIGIN for
+ *                   commands of the gateway itself
+ *
+ * @return  none
+ */
+void trans_setOrigin(u32 connId)
+{
+    trans_v->origin = connId;
+}
+
+/*********************************************************************
+ * @fn      trans_queue
+ *
+ * @brief   Mark a ZCL command frame which expects a response, its
+ *          transaction is opened when the frame is admitted to the UART.
+ *          A pending command with the same coalesce key is superseded.
+ *
+ * @param   frame - the frame carrying it, key filled in
+ * @param   retries - times to send it again when no response comes
+ *
+ * @return  none
+ */
+void trans_queue(socTxFrame_t *frame, u8 retries)
+{
+    int i;
+
+    frame->transSeq = SOC_TX_NEW_TRANS;
+    frame->retries = retries;
+    frame->origin = trans_v->origin;
+
+    if (frame->key != SOC_TX_NO_COALESCE) {
+        for (i = 0; i < TRANS_TBL_SIZE && trans_v->pendingNum; i++) {
+            if (trans_v->tbl[i].inUse && trans_v->tbl[i].frame.key == frame->key) {
+                trans_v->stats.superseded++;
+                trans_finish(i, APP_DELIVERY_SUPERSEDED);
+            }
+        }
+    }
+}
+
+/*********************************************************************
+ * @fn      trans_open
+ *
+ * @brief   Give a frame from trans_queue() the next free sequence number
+ *          and record its transaction. Called when the frame moves to
+ *          the wire list, so queued batches of any size never wrap the
+ *          sequence number of a pending command.
+ *
+ * @param   frame - the frame, its seq and FCS are rewritten
+ *
+ * @return  0 on success, -1 if TRANS_MAX_PENDING are in flight
+ */
+int trans_open(socTxFrame_t *frame)
+{
+    data_cmd_t *pData = &((gw_app_cmd_t*)&frame->data[1])->data.dataCmd;
+    trans_t *t;
+    u8 seq;
+
+    if (trans_v->pendingNum >= TRANS_MAX_PENDING) {
+        return -1;
+    }
+
+    do {
+        seq = trans_v->nextSeq++;
+    } while (trans_v->tbl[seq].inUse);
+
+    pData->zclTransSeqNo = seq;
+    calcFcs(frame->data, frame->len);
+    frame->transSeq = seq;
+
+    t = &trans_v->tbl[seq];
+    t->inUse = TRUE;
+    t->sent = FALSE;
+    t->addrMode = pData->addrMode;
+    t->dstAddr = pData->dstNwkAddr;
+    t->endpoint = pData->dstEndpoint;
+    t->clusterID = pData->clusterID;
+    t->cmdID = pData->cmdID;
+    t->attempts = 1;
+    t->retries = frame->retries;
+    t->origin = frame->origin;
+    t->sendTime = 0;
+    t->retryTime = 0;
+    memcpy(&t->frame, frame, offsetof(socTxFrame_t, data) + frame->len);
+
+    trans_v->stats.added++;
+    if (trans_v->pendingNum++ == 0) {
+        swTimer_start(&trans_v->sweepTimer, TRANS_SWEEP_INTERVAL_MS, trans_sweep, NULL);
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      trans_superseded
+ *
+ * @brief   Tell the App of a frame from trans_queue() replaced by a newer
+ *          command before it was admitted
+ *
+ * @param   frame - the frame
+ *
+ * @return  none
+ */
+void trans_superseded(const socTxFrame_t *frame)
+{
+    const data_cmd_t *pData = &((const gw_app_cmd_t*)&frame->data[1])->data.dataCmd;
+
+    trans_v->stats.superseded++;
+    if (frame->origin != TRANS_NO_ORIGIN) {
+        app_sendDeliveryRspCmd(frame->origin, pData->dstNwkAddr, pData->dstEndpoint, pData->clusterID,
+                               pData->cmdID, APP_DELIVERY_SUPERSEDED, 0);
+    }
+}
+
+/*********************************************************************
+ * @fn      trans_sent
+ *
+ * @brief   Start the response clock of a transaction, called when its
+ *          frame has been written to the UART
+ *
+ * @param   seq - ZCL transaction sequence number
+ *
+ * @return  none
+ */
+void trans_sent(u8 seq)
+{
+    trans_t *t = &trans_v->tbl[seq];
+
+    if (t->inUse && !t->sent) {
+        t->sent = TRUE;
+        t->sendTime = swTimer_nowUs();
+    }
+}
+
+/*********************************************************************
+ * @fn      trans_cancel
+ *
+ * @brief   Forget a transaction whose frame will never be sent
+ *
+ * @param   seq - ZCL transaction sequence number
+ *
+ * @return  none
+ */
+void trans_cancel(u8 seq)
+{
+    if (trans_v->tbl[seq].inUse) {
+        trans_v->stats.added--;
+        trans_free(seq);
+    }
+}
+
+/*********************************************************************
+ * @fn      trans_match
+ *
+ * @brief   Match a response from a device against the pending table
+ *
+ * @param   seq - ZCL transaction sequence number of the response
+ * @param   srcAddr - network address of the responding device
+ * @param   clusterID - ZCL cluster of the response
+ * @param   status - ZCL status carried by the response
+ *
+ * @return  round trip time in us, TRANS_NO_MATCH if nothing was pending
+ */
+int trans_match(u8 seq, u16 srcAddr, u16 clusterID, u8 status)
+{
+    trans_t *t = &trans_v->tbl[seq];
+    u32 rtt;
+
+    if (!t->inUse || !t->sent || t->clusterID != clusterID || t->dstAddr != srcAddr) {
+        trans_v->stats.unmatched++;
+        return TRANS_NO_MATCH;
+    }
+
+    rtt = (u32)(swTimer_nowUs() - t->sendTime);
+
+    trans_v->stats.matched++;
+    if (status != 0) {
+        trans_v->stats.failed++;
+    }
+    sched_onResult(status == 0);
+    trans_v->stats.rttSumUs += rtt;
+    if (trans_v->stats.matched == 1 || rtt < trans_v->stats.rttMinUs) {
+        trans_v->stats.rttMinUs = rtt;
+    }
+    if (rtt > trans_v->stats.rttMaxUs) {
+        trans_v->stats.rttMaxUs = rtt;
+    }
+    stats_histAdd(&stats_v->rtt, rtt);
+    nodes_recordRtt(srcAddr, rtt, FALSE);
+
+    trans_finish(seq, status);
+    return (int)rtt;
+}
+
+/*********************************************************************
+ * @fn      trans_sweep
+ *
+ * @brief   Expire transactions which did not get a response in time
+ *
+ * @param   arg - unused
+ *
+ * @return  none
+ */
+static void trans_sweep(void *arg)
+{
+    u64 now = swTimer_nowUs();
+    trans_t *t;
+    int i;
+
+    for (i = 0; i < TRANS_TBL_SIZE && trans_v->pendingNum; i++) {
+        t = &trans_v->tbl[i];
+        if (!t->inUse || !t->sent || now - t->sendTime < (u64)TRANS_TIMEOUT_MS * 1000) {
+            continue;
+        }
+
+        trans_lost(i, now);
+    }
+
+    if (trans_v->pendingNum) {
+        swTimer_start(&trans_v->sweepTimer, TRANS_SWEEP_INTERVAL_MS, trans_sweep, NULL);
+    }
+}
+
+/*********************************************************************
+ * @fn      trans_pendingNum
+ *
+ * @brief   Get the number of transactions waiting for a response
+ *
+ * @param   none
+ *
+ * @return  number of pending transactions
+ */
+u32 trans_pendingNum(void)
+{
+    return trans_v->pendingNum;
+}
+
+/*********************************************************************
+ * @fn      trans_getStats
+ *
+ * @brief   Get the transaction counters
+ *
+ * @param   none
+ *
+ * @return  the counters
+ */
+trans_stats_t* trans_getStats(void)
+{
+    return &trans_v->stats;
+}
+
+/*********************************************************************
+ * @fn      trans_printStats
+ *
+ * @brief   Print the transaction counters and the per node latency
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void trans_printStats(void)
+{
+    trans_stats_t *st = &trans_v->stats;
+    nodeInfo_t *entry;
+    u32 i;
+
+    printf("Transactions: %u sent, %u pending, %u matched, %u failed, %u timeouts, %u retries, %u lost, "
+           "%u superseded, %u unmatched\n",
+           st->added, trans_v->pendingNum, st->matched, st->failed, st->timeouts, st->retries, st->lost,
+           st->superseded, st->unmatched);
+    if (st->matched) {
+        printf("Round trip: min %u us, avg %u us, max %u us\n",
+               st->rttMinUs, (u32)(st->rttSumUs / st->matched), st->rttMaxUs);
+    }
+
+    for (i = 0; i < nodes_curNum(); i++) {
+        entry = nodes_get(i);
+        if (!entry->rttSamples && !entry->timeouts) {
+            continue;
+        }
+        printf("    0x%04x: last %u us, avg %u us, %u samples, %u timeouts\n",
+               entry->nwkAddr, entry->rttLastUs, entry->rttAvgUs, entry->rttSamples, entry->timeouts);
+    }
+    printf("\n");
+}
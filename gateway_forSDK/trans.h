@@ -0,0 +1,84 @@
+#ifndef  __TRANS_H__
+#define  __TRANS_H__
+
+#include "types.h"
+#include "socTx.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* One slot per ZCL transaction sequence number */
+#define TRANS_TBL_SIZE                  256
+
+/* Most transactions in flight. Commands beyond wait in the transmit
+ * queue, so a seq is never given to two of them. */
+#define TRANS_MAX_PENDING               (TRANS_TBL_SIZE - 1)
+
+/* A send without response after this time is lost, the command is
+ * sent again while its retries last */
+#define TRANS_TIMEOUT_MS                1500
+
+#define TRANS_SWEEP_INTERVAL_MS         250
+
+#define TRANS_NO_MATCH                  -1
+
+/* Transaction no App waits for */
+#define TRANS_NO_ORIGIN                 0xFFFFFFFF
+
+/*********************************************************************
+ * ENUMS
+ */
+
+
+
+/*********************************************************************
+ * TYPES
+ */
+typedef struct {
+    u8 inUse;
+    u8 sent;                          //!< Frame has left the transmit queue
+    u8 addrMode;
+    u8 endpoint;
+    u16 dstAddr;
+    u16 clusterID;
+    u8 cmdID;
+    u8 attempts;                      //!< Times the frame was queued
+    u8 retries;                       //!< Sends left once this one is lost
+    u32 origin;                       //!< ID of the App connection, TRANS_NO_ORIGIN if none
+    u64 sendTime;                     //!< Monotonic time in us the frame was written
+    u64 retryTime;                    //!< Time to send it again, 0 if not waiting to
+    socTxFrame_t frame;               //!< Copy sent again after a loss
+} trans_t;
+
+typedef struct {
+    u32 added;
+    u32 matched;
+    u32 failed;                       //!< Matched with a non-success status
+    u32 timeouts;                     //!< Sends lost
+    u32 retries;
+    u32 lost;                         //!< Commands given up after all retries
+    u32 superseded;                   //!< Replaced by a newer command before delivery
+    u32 unmatched;                    //!< Responses without a pending transaction
+    u64 rttSumUs;
+    u32 rttMinUs;
+    u32 rttMaxUs;
+} trans_stats_t;
+
+
+/*********************************************************************
+ * Public Functions
+ */
+void trans_init(void);
+void trans_setOrigin(u32 connId);
+void trans_queue(socTxFrame_t *frame, u8 retries);
+int  trans_open(socTxFrame_t *frame);
+void trans_superseded(const socTxFrame_t *frame);
+void trans_sent(u8 seq);
+void trans_cancel(u8 seq);
+int  trans_match(u8 seq, u16 srcAddr, u16 clusterID, u8 status);
+u32  trans_pendingNum(void);
+trans_stats_t* trans_getStats(void);
+void trans_printStats(void);
+
+#endif  /* __TRANS_H__ */
@@ -0,0 +1,250 @@
+
+
+/**********************************************************************
+ * INCLUDES
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "zclEnc.h"
+#include "socCmd.h"
+#include "socTx.h"
+
+/**********************************************************************
+ * LOCAL CONSTANTS
+ */
+
+/* MT data request to the APP subsystem: AREQ | MT_RPC_SYS_APP, MT_APP_MSG */
+#define ZCL_ENC_MT_SOF                  0xFE
+#define ZCL_ENC_MT_CMD0                 0x49
+#define ZCL_ENC_MT_CMD1                 0x00
+
+/* SOF, length, cmd0, cmd1, the data_cmd_t fields and the ZCL header */
+#define ZCL_ENC_HDR_LEN                 15
+
+/* ZCL header bytes counted in data_cmd_t.dataLen */
+#define ZCL_ENC_ZCL_HDR_LEN             3
+
+/* Largest frame: the length byte counts cmd0 to the end of the payload */
+#define ZCL_ENC_MAX_FRAME_LEN           (0xFF + 3)
+
+/*
+ * Every command the gateway sends. A new command is one entry here and
+ * one ID in zclEnc.h.
+ */
+static const zclEnc_desc_t zclEnc_descTbl[ZCL_ENC_CMD_NUM] = {
+    [ZCL_ENC_OFF] = {
+        ZCL_CLUSTER_ID_GEN_ON_OFF, COMMAND_ON_OFF_OFF, ZCL_FRAME_CTRL_CLUSTER, SOC_TX_PRIO_INTERACTIVE,
+        { ZCL_FIELD_END } },
+    [ZCL_ENC_ON] = {
+        ZCL_CLUSTER_ID_GEN_ON_OFF, COMMAND_ON_OFF_ON, ZCL_FRAME_CTRL_CLUSTER, SOC_TX_PRIO_INTERACTIVE,
+        { ZCL_FIELD_END } },
+    [ZCL_ENC_FLASH_RESET] = {
+        ZCL_CLUSTER_ID_GEN_ON_OFF, COMMAND_ON_OFF_FLASH_RESET, ZCL_FRAME_CTRL_CLUSTER, SOC_TX_PRIO_BULK,
+        { ZCL_FIELD_END } },
+    [ZCL_ENC_IDENTIFY] = {
+        ZCL_CLUSTER_ID_GEN_IDENTIFY, COMMAND_IDENTIFY, ZCL_FRAME_CTRL_CLUSTER, SOC_TX_PRIO_INTERACTIVE,
+        { ZCL_FIELD_U16 } },                                        /* identify time */
+    [ZCL_ENC_MOVE_TO_LEVEL_ONOFF] = {
+        ZCL_CLUSTER_ID_GEN_LEVEL_CONTROL, COMMAND_LEVEL_MOVE_TO_LEVEL_WITH_ONOFF, ZCL_FRAME_CTRL_CLUSTER,
+        SOC_TX_PRIO_INTERACTIVE,
+        { ZCL_FIELD_U8, ZCL_FIELD_U16 } },                          /* level, transition time */
+    [ZCL_ENC_MOVE_TO_HUE] = {
+        ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL, COMMAND_LIGHTING_MOVE_TO_HUE, ZCL_FRAME_CTRL_CLUSTER,
+        SOC_TX_PRIO_INTERACTIVE,
+        { ZCL_FIELD_U8, ZCL_FIELD_U8, ZCL_FIELD_U16 } },            /* hue, direction, transition time */
+    [ZCL_ENC_MOVE_TO_SAT] = {
+        ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL, COMMAND_LIGHTING_MOVE_TO_SATURATION, ZCL_FRAME_CTRL_CLUSTER,
+        SOC_TX_PRIO_INTERACTIVE,
+        { ZCL_FIELD_U8, ZCL_FIELD_U16 } },                          /* saturation, transition time */
+    [ZCL_ENC_MOVE_TO_HUE_SAT] = {
+        ZCL_CLUSTER_ID_LIGHTING_COLOR_CONTROL, COMMAND_LIGHTING_MOVE_TO_HUE_AND_SATURATION, ZCL_FRAME_CTRL_CLUSTER,
+        SOC_TX_PRIO_INTERACTIVE,
+        { ZCL_FIELD_U8, ZCL_FIELD_U8, ZCL_FIELD_U16 } },            /* hue, saturation, transition time */
+    [ZCL_ENC_ADD_GROUP] = {
+        ZCL_CLUSTER_ID_GEN_GROUPS, COMMAND_GROUP_ADD, ZCL_FRAME_CTRL_CLUSTER, SOC_TX_PRIO_BULK,
+        { ZCL_FIELD_U16, ZCL_FIELD_STR } },                         /* group ID, group name */
+    [ZCL_ENC_STORE_SCENE] = {
+        ZCL_CLUSTER_ID_GEN_SCENES, COMMAND_SCENE_STORE, ZCL_FRAME_CTRL_CLUSTER, SOC_TX_PRIO_BULK,
+        { ZCL_FIELD_U16, ZCL_FIELD_U8 } },                          /* group ID, scene ID */
+    [ZCL_ENC_RECALL_SCENE] = {
+        ZCL_CLUSTER_ID_GEN_SCENES, COMMAND_SCENE_RECALL, ZCL_FRAME_CTRL_CLUSTER, SOC_TX_PRIO_INTERACTIVE,
+        { ZCL_FIELD_U16, ZCL_FIELD_U8 } },                          /* group ID, scene ID */
+    [ZCL_ENC_READ_ATTR] = {
+        0, ZCL_CMD_READ, 0, SOC_TX_PRIO_BULK,
+        { ZCL_FIELD_CLUSTER, ZCL_FIELD_U16 } },                     /* cluster, attribute ID */
+};
+
+/**********************************************************************
+ * LOCAL TYPES
+ */
+
+/* None */
+
+
+/**********************************************************************
+ * LOCAL VARIABLES
+ */
+
+/* None */
+
+
+/**********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* None */
+
+
+/*********************************************************************
+ * @fn      zclEnc_desc
+ *
+ * @brief   Get the description of a command
+ *
+ * @param   cmd - ZCL_ENC_* command
+ *
+ * @return  the description, NULL for an unknown command
+ */
+const zclEnc_desc_t* zclEnc_desc(u8 cmd)
+{
+    return (cmd < ZCL_ENC_CMD_NUM) ? &zclEnc_descTbl[cmd] : NULL;
+}
+
+/*********************************************************************
+ * @fn      zclEnc_encode
+ *
+ * @brief   Build the complete RPC frame of a ZCL command
+ *
+ * @param   buf - where to build the frame
+ * @param   size - size of buf
+ * @param   cmd - ZCL_ENC_* command
+ * @param   addrMode - address mode of the destination
+ * @param   dstAddr - network address or group ID
+ * @param   endpoint - destination endpoint
+ * @param   seq - ZCL transaction sequence number
+ * @param   ... - one argument per payload field of the command
+ *
+ * @return  length of the frame, SOF to FCS, 0 if it does not fit
+ */
+u16 zclEnc_encode(u8 *buf, u16 size, u8 cmd, u8 addrMode, u16 dstAddr, u8 endpoint, u8 seq, ...)
+{
+    va_list args;
+    u16 len;
+
+    va_start(args, seq);
+    len = zclEnc_vencode(buf, size, cmd, addrMode, dstAddr, endpoint, seq, args);
+    va_end(args);
+    return len;
+}
+
+/*********************************************************************
+ * @fn      zclEnc_vencode
+ *
+ * @brief   zclEnc_encode() taking the payload fields as a va_list
+ *
+ * @param   buf - where to build the frame
+ * @param   size - size of buf
+ * @param   cmd - ZCL_ENC_* command
+ * @param   addrMode - address mode of the destination
+ * @param   dstAddr - network address or group ID
+ * @param   endpoint - destination endpoint
+ * @param   seq - ZCL transaction sequence number
+ * @param   args - one argument per payload field of the command
+ *
+ * @return  length of the frame, SOF to FCS, 0 if it does not fit
+ */
+u16 zclEnc_vencode(u8 *buf, u16 size, u8 cmd, u8 addrMode, u16 dstAddr, u8 endpoint, u8 seq, va_list args)
+{
+    const zclEnc_desc_t *desc = zclEnc_desc(cmd);
+    u16 clusterID;
+    u16 len = ZCL_ENC_HDR_LEN;
+    const char *str;
+    u32 value, strLen;
+    u8 fcs = 0;
+    int i;
+
+    if (!desc) {
+        return 0;
+    }
+    if (size > ZCL_ENC_MAX_FRAME_LEN) {
+        size = ZCL_ENC_MAX_FRAME_LEN;
+    }
+    if (size < ZCL_ENC_HDR_LEN + 1) {
+        return 0;
+    }
+    /* Keep room for the FCS */
+    size--;
+
+    clusterID = desc->clusterID;
+    for (i = 0; i < ZCL_ENC_MAX_FIELDS && desc->field[i] != ZCL_FIELD_END; i++) {
+        switch (desc->field[i]) {
+        case ZCL_FIELD_U8:
+            value = va_arg(args, u32);
+            if (len + 1 > size) {
+                return 0;
+            }
+            buf[len++] = (u8)value;
+            break;
+
+        case ZCL_FIELD_U16:
+            value = va_arg(args, u32);
+            if (len + 2 > size) {
+                return 0;
+            }
+            buf[len++] = value & 0xff;
+            buf[len++] = (value >> 8) & 0xff;
+            break;
+
+        case ZCL_FIELD_U32:
+            value = va_arg(args, u32);
+            if (len + 4 > size) {
+                return 0;
+            }
+            buf[len++] = value & 0xff;
+            buf[len++] = (value >> 8) & 0xff;
+            buf[len++] = (value >> 16) & 0xff;
+            buf[len++] = (value >> 24) & 0xff;
+            break;
+
+        case ZCL_FIELD_STR:
+            str = va_arg(args, const char*);
+            strLen = str ? strlen(str) : 0;
+            if (strLen > 0xFE || len + 1 + strLen > size) {
+                return 0;
+            }
+            buf[len++] = (u8)strLen;
+            memcpy(&buf[len], str, strLen);
+            len += strLen;
+            break;
+
+        case ZCL_FIELD_CLUSTER:
+            clusterID = (u16)va_arg(args, u32);
+            break;
+
+        default:
+            return 0;
+        }
+    }
+
+    buf[0] = ZCL_ENC_MT_SOF;
+    buf[1] = (u8)(len - 2);
+    buf[2] = ZCL_ENC_MT_CMD0;
+    buf[3] = ZCL_ENC_MT_CMD1;
+    buf[4] = SOC_GW_ENDPOINT;
+    buf[5] = dstAddr & 0xff;
+    buf[6] = dstAddr >> 8;
+    buf[7] = endpoint;
+    buf[8] = clusterID & 0xff;
+    buf[9] = clusterID >> 8;
+    buf[10] = (u8)(len - ZCL_ENC_HDR_LEN + ZCL_ENC_ZCL_HDR_LEN);
+    buf[11] = addrMode;
+    buf[12] = desc->frameCtrl;
+    buf[13] = seq;
+    buf[14] = desc->cmdID;
+
+    for (i = 1; i < len; i++) {
+        fcs ^= buf[i];
+    }
+    buf[len++] = fcs;
+    return len;
+}
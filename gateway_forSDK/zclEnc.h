@@ -0,0 +1,71 @@
+#ifndef  __ZCL_ENC_H__
+#define  __ZCL_ENC_H__
+
+#include <stdarg.h>
+
+#include "types.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* Payload fields a command may declare */
+#define ZCL_ENC_MAX_FIELDS              4
+
+/*********************************************************************
+ * ENUMS
+ */
+
+/*
+ * ZCL commands the gateway sends, each one described once in
+ * zclEnc_descTbl
+ */
+enum {
+    ZCL_ENC_OFF,
+    ZCL_ENC_ON,
+    ZCL_ENC_FLASH_RESET,
+    ZCL_ENC_IDENTIFY,
+    ZCL_ENC_MOVE_TO_LEVEL_ONOFF,
+    ZCL_ENC_MOVE_TO_HUE,
+    ZCL_ENC_MOVE_TO_SAT,
+    ZCL_ENC_MOVE_TO_HUE_SAT,
+    ZCL_ENC_ADD_GROUP,
+    ZCL_ENC_STORE_SCENE,
+    ZCL_ENC_RECALL_SCENE,
+    ZCL_ENC_READ_ATTR,
+    ZCL_ENC_CMD_NUM,
+};
+
+/*
+ * Payload field types, each one takes one argument of zclEnc_encode()
+ */
+enum {
+    ZCL_FIELD_END,
+    ZCL_FIELD_U8,
+    ZCL_FIELD_U16,
+    ZCL_FIELD_U32,
+    ZCL_FIELD_STR,                    //!< const char*, NULL for an empty string
+    ZCL_FIELD_CLUSTER,                //!< Cluster of a foundation command, not in the payload
+};
+
+
+/*********************************************************************
+ * TYPES
+ */
+typedef struct {
+    u16 clusterID;                    //!< Ignored for foundation commands
+    u8 cmdID;
+    u8 frameCtrl;
+    u8 prio;                          //!< SOC_TX_PRIO_* of the command
+    u8 field[ZCL_ENC_MAX_FIELDS];     //!< Payload, up to ZCL_FIELD_END
+} zclEnc_desc_t;
+
+
+/*********************************************************************
+ * Public Functions
+ */
+const zclEnc_desc_t* zclEnc_desc(u8 cmd);
+u16  zclEnc_encode(u8 *buf, u16 size, u8 cmd, u8 addrMode, u16 dstAddr, u8 endpoint, u8 seq, ...);
+u16  zclEnc_vencode(u8 *buf, u16 size, u8 cmd, u8 addrMode, u16 dstAddr, u8 endpoint, u8 seq, va_list args);
+
+#endif  /* __ZCL_ENC_H__ */